@@ -0,0 +1,123 @@
+#include <string.h>
+
+#include "allocator.h"
+#include "memory.h"
+
+void init_slab_allocator(SlabAllocator *allocator) {
+  size_t block_size = SLAB_SMALLEST_BLOCK_SIZE;
+  for (size_t i = 0; i < SLAB_SIZE_CLASSES; i++) {
+    SlabSizeClass *size_class = &allocator->size_classes[i];
+    size_class->block_size = block_size;
+    size_class->free_blocks = NULL;
+    size_class->pages_used = 0;
+    size_class->pages_capacity = 0;
+    size_class->pages = NULL;
+    size_class->blocks_in_use = 0;
+    size_class->blocks_free = 0;
+    size_class->requested_bytes = 0;
+    block_size *= 2;
+  }
+  allocator->large_allocations = 0;
+  allocator->large_bytes = 0;
+}
+
+void free_slab_allocator(SlabAllocator *allocator) {
+  for (size_t i = 0; i < SLAB_SIZE_CLASSES; i++) {
+    SlabSizeClass *size_class = &allocator->size_classes[i];
+    for (size_t j = 0; j < size_class->pages_used; j++)
+      reallocate_array(MEMORY_TAG_OBJECTS, size_class->pages[j], SLAB_PAGE_SIZE,
+                       0);
+    FREE_ARRAY(MEMORY_TAG_OBJECTS, void *, size_class->pages,
+               size_class->pages_capacity);
+  }
+  init_slab_allocator(allocator);
+}
+
+static SlabSizeClass *get_size_class(SlabAllocator *allocator, size_t size) {
+  if (size > SLAB_LARGEST_BLOCK_SIZE)
+    return NULL;
+  size_t class_index = 0;
+  while (allocator->size_classes[class_index].block_size < size)
+    class_index++;
+  return &allocator->size_classes[class_index];
+}
+
+static void grow_size_class(SlabSizeClass *size_class) {
+  if (size_class->pages_capacity < size_class->pages_used + 1) {
+    size_t current_capacity = size_class->pages_capacity;
+    size_class->pages_capacity = COMPUTE_ARRAY_CAPACITY(current_capacity);
+    size_class->pages =
+        GROW_ARRAY(MEMORY_TAG_OBJECTS, void *, size_class->pages,
+                   current_capacity, size_class->pages_capacity);
+  }
+  char *page =
+      (char *)reallocate_array(MEMORY_TAG_OBJECTS, NULL, 0, SLAB_PAGE_SIZE);
+  size_class->pages[size_class->pages_used] = page;
+  size_class->pages_used++;
+  size_t blocks_per_page = SLAB_PAGE_SIZE / size_class->block_size;
+  for (size_t i = blocks_per_page; i > 0; i--) {
+    SlabBlock *block = (SlabBlock *)(page + (i - 1) * size_class->block_size);
+    block->next = size_class->free_blocks;
+    size_class->free_blocks = block;
+  }
+  size_class->blocks_free += blocks_per_page;
+}
+
+static void *allocate_block(SlabSizeClass *size_class, size_t size) {
+  if (size_class->free_blocks == NULL)
+    grow_size_class(size_class);
+  SlabBlock *block = size_class->free_blocks;
+  size_class->free_blocks = block->next;
+  size_class->blocks_free--;
+  size_class->blocks_in_use++;
+  size_class->requested_bytes += size;
+  return block;
+}
+
+static void free_block(SlabSizeClass *size_class, void *pointer, size_t size) {
+  SlabBlock *block = (SlabBlock *)pointer;
+  block->next = size_class->free_blocks;
+  size_class->free_blocks = block;
+  size_class->blocks_free++;
+  size_class->blocks_in_use--;
+  size_class->requested_bytes -= size;
+}
+
+void *reallocate_slab_memory(SlabAllocator *allocator, void *pointer,
+                             size_t current_size, size_t new_size) {
+  SlabSizeClass *current_class =
+      pointer == NULL ? NULL : get_size_class(allocator, current_size);
+  SlabSizeClass *new_class =
+      new_size == 0 ? NULL : get_size_class(allocator, new_size);
+  if (pointer != NULL && current_class == NULL && new_size != 0 &&
+      new_class == NULL) {
+    allocator->large_bytes += new_size - current_size;
+    return reallocate_array(MEMORY_TAG_OBJECTS, pointer, current_size,
+                            new_size);
+  }
+  if (current_class != NULL && current_class == new_class) {
+    current_class->requested_bytes += new_size - current_size;
+    return pointer;
+  }
+  void *new_pointer = NULL;
+  if (new_class != NULL) {
+    new_pointer = allocate_block(new_class, new_size);
+  } else if (new_size != 0) {
+    new_pointer = reallocate_array(MEMORY_TAG_OBJECTS, NULL, 0, new_size);
+    allocator->large_allocations++;
+    allocator->large_bytes += new_size;
+  }
+  if (pointer == NULL)
+    return new_pointer;
+  if (new_pointer != NULL)
+    memcpy(new_pointer, pointer,
+           current_size < new_size ? current_size : new_size);
+  if (current_class != NULL) {
+    free_block(current_class, pointer, current_size);
+  } else {
+    reallocate_array(MEMORY_TAG_OBJECTS, pointer, current_size, 0);
+    allocator->large_allocations--;
+    allocator->large_bytes -= current_size;
+  }
+  return new_pointer;
+}
@@ -0,0 +1,83 @@
+#ifndef interpres_allocator_h
+#define interpres_allocator_h
+
+#include <stdlib.h>
+
+/* Here we define the size in bytes of the smallest block handed out by the
+ * slab allocator. Every size class doubles the block size of the previous one,
+ * up to the size of the largest block; requests that do not fit in the largest
+ * block are forwarded to the system allocator. */
+#define SLAB_SMALLEST_BLOCK_SIZE 16
+#define SLAB_LARGEST_BLOCK_SIZE 256
+#define SLAB_SIZE_CLASSES 5
+/* Here we define the size in bytes of the pages that the slab allocator
+ * requests from the system allocator and carves into blocks of the same size
+ * class. */
+#define SLAB_PAGE_SIZE (16 * 1024)
+/* Free blocks are threaded into a singly linked list by storing the pointer to
+ * the next free block in the block itself. */
+typedef struct SlabBlock {
+  struct SlabBlock *next;
+} SlabBlock;
+/* Each size class keeps a list of free blocks of "block_size" bytes and the
+ * dynamic array of pages they were carved from, along with counters that
+ * describe how the memory reserved by the class is being used: the number of
+ * blocks handed out, the number of blocks sitting in the free list and the
+ * number of bytes that were actually requested for the blocks in use. The
+ * difference between the memory reserved by the pages and the requested bytes
+ * is the fragmentation of the class. */
+typedef struct {
+  size_t block_size;
+  SlabBlock *free_blocks;
+  size_t pages_used;
+  size_t pages_capacity;
+  void **pages;
+  size_t blocks_in_use;
+  size_t blocks_free;
+  size_t requested_bytes;
+} SlabSizeClass;
+/* The slab allocator serves small requests from its size classes and keeps
+ * count of the requests it had to forward to the system allocator. Every
+ * virtual machine owns its own allocator, so that the free lists are never
+ * shared between threads and need no locking. */
+typedef struct {
+  SlabSizeClass size_classes[SLAB_SIZE_CLASSES];
+  size_t large_allocations;
+  size_t large_bytes;
+} SlabAllocator;
+/*
+ * @brief Initialize the slab allocator.
+ * Size classes start off with no pages; pages are requested from the system
+ * allocator the first time a class runs out of free blocks.
+ *
+ * @param allocator A pointer to the slab allocator to initialize
+ * @return void
+ */
+void init_slab_allocator(SlabAllocator *allocator);
+/*
+ * @brief Free the slab allocator.
+ * This function will return every page owned by the allocator to the system
+ * allocator, invalidating every block it handed out, and re-initialize it to
+ * an empty state.
+ *
+ * @param allocator A pointer to the slab allocator to free
+ * @return void
+ */
+void free_slab_allocator(SlabAllocator *allocator);
+/*
+ * @brief Reallocate a block of memory to a new size.
+ * This function has the same semantics as reallocate_array: blocks that fit in
+ * a size class are served from that class' free list, while larger blocks are
+ * handed over to the system allocator. Since blocks carry no header, callers
+ * must always pass the exact size they requested for the block.
+ *
+ * @param allocator A pointer to the slab allocator that owns the block
+ * @param pointer A pointer to the block to reallocate
+ * @param current_size The current size of the block in bytes
+ * @param new_size The new size of the block in bytes
+ * @return A pointer to the reallocated block or NULL
+ */
+void *reallocate_slab_memory(SlabAllocator *allocator, void *pointer,
+                             size_t current_size, size_t new_size);
+
+#endif
@@ -1,13 +1,30 @@
+#include <string.h>
+
 #include "chunk.h"
+#include "memory.h"
 
 void init_chunk(Chunk *chunk) {
   init_instructions_array(&chunk->instructions);
   init_constants_array(&chunk->constants);
+  init_inline_caches_array(&chunk->caches);
+  init_exception_handlers_array(&chunk->handlers);
+  init_register_instructions_array(&chunk->registers);
+  chunk->quickening_counters = NULL;
+  chunk->quickening_counters_count = 0;
+  chunk->loop_iterations_count = 0;
+  chunk->original_instructions = NULL;
 }
 
 void free_chunk(Chunk *chunk) {
+  FREE_ARRAY(MEMORY_TAG_DEBUGGER, uint8_t, chunk->original_instructions,
+             chunk->instructions.used);
   free_instructions_array(&chunk->instructions);
   free_constants_array(&chunk->constants);
+  free_inline_caches_array(&chunk->caches);
+  free_exception_handlers_array(&chunk->handlers);
+  free_register_instructions_array(&chunk->registers);
+  FREE_ARRAY(MEMORY_TAG_QUICKENING, QuickeningCounter,
+             chunk->quickening_counters, chunk->quickening_counters_count);
   init_chunk(chunk);
 }
 
@@ -20,3 +37,124 @@ size_t push_constant_to_chunk(Chunk *chunk, Constant constant) {
   write_constants_array(&chunk->constants, constant);
   return chunk->constants.used - 1;
 }
+
+size_t push_inline_cache_to_chunk(Chunk *chunk) {
+  return write_inline_caches_array(&chunk->caches);
+}
+
+void push_exception_handler_to_chunk(Chunk *chunk, ExceptionHandler handler) {
+  write_exception_handlers_array(&chunk->handlers, handler);
+}
+
+int get_instruction_length(uint8_t instruction) {
+  switch (instruction) {
+  case OP_RETURN:
+  case OP_ZERO:
+  case OP_ONE:
+  case OP_NIL:
+  case OP_TRUE:
+  case OP_FALSE:
+  case OP_POP:
+  case OP_EQUAL:
+  case OP_NOT_EQUAL:
+  case OP_GREATER:
+  case OP_GREATER_EQUAL:
+  case OP_LESS:
+  case OP_LESS_EQUAL:
+  case OP_ADD:
+  case OP_SUBTRACT:
+  case OP_MULTIPLY:
+  case OP_DIVIDE:
+  case OP_NOT:
+  case OP_NEGATE:
+  case OP_PRINT:
+  case OP_INHERIT:
+  case OP_THROW:
+  case OP_ADD_INTEGER:
+  case OP_ADD_NUMBER:
+  case OP_ADD_STRING:
+  case OP_SUBTRACT_INTEGER:
+  case OP_SUBTRACT_NUMBER:
+  case OP_MULTIPLY_INTEGER:
+  case OP_MULTIPLY_NUMBER:
+    return 1;
+  case OP_CONSTANT:
+  case OP_SMALL_INTEGER:
+  case OP_DEFINE_GLOBAL:
+  case OP_GET_GLOBAL:
+  case OP_SET_GLOBAL:
+  case OP_GET_LOCAL:
+  case OP_SET_LOCAL:
+  case OP_CALL:
+  case OP_TAIL_CALL:
+  case OP_CLASS:
+  case OP_METHOD:
+    return 2;
+  case OP_SHORT_INTEGER:
+  case OP_JUMP:
+  case OP_JUMP_IF_FALSE:
+  case OP_POP_JUMP_IF_FALSE:
+  case OP_JUMP_IF_EQUAL:
+  case OP_JUMP_IF_NOT_EQUAL:
+  case OP_JUMP_IF_NOT_GREATER:
+  case OP_JUMP_IF_NOT_GREATER_EQUAL:
+  case OP_JUMP_IF_NOT_LESS:
+  case OP_JUMP_IF_NOT_LESS_EQUAL:
+  case OP_LOOP:
+  case OP_JUMP_IF_NOT_GREATER_INTEGER:
+  case OP_JUMP_IF_NOT_GREATER_EQUAL_INTEGER:
+  case OP_JUMP_IF_NOT_LESS_INTEGER:
+  case OP_JUMP_IF_NOT_LESS_EQUAL_INTEGER:
+    return 3;
+  case OP_GET_PROPERTY:
+  case OP_SET_PROPERTY:
+    return 4;
+  case OP_INVOKE:
+  case OP_TAIL_INVOKE:
+    return 5;
+  }
+  return 0;
+}
+
+uint8_t get_generic_instruction(uint8_t instruction) {
+  switch (instruction) {
+  case OP_ADD_INTEGER:
+  case OP_ADD_NUMBER:
+  case OP_ADD_STRING:
+    return OP_ADD;
+  case OP_SUBTRACT_INTEGER:
+  case OP_SUBTRACT_NUMBER:
+    return OP_SUBTRACT;
+  case OP_MULTIPLY_INTEGER:
+  case OP_MULTIPLY_NUMBER:
+    return OP_MULTIPLY;
+  case OP_JUMP_IF_NOT_GREATER_INTEGER:
+    return OP_JUMP_IF_NOT_GREATER;
+  case OP_JUMP_IF_NOT_GREATER_EQUAL_INTEGER:
+    return OP_JUMP_IF_NOT_GREATER_EQUAL;
+  case OP_JUMP_IF_NOT_LESS_INTEGER:
+    return OP_JUMP_IF_NOT_LESS;
+  case OP_JUMP_IF_NOT_LESS_EQUAL_INTEGER:
+    return OP_JUMP_IF_NOT_LESS_EQUAL;
+  }
+  return instruction;
+}
+
+QuickeningCounter *get_quickening_counter(Chunk *chunk, size_t offset) {
+  if (chunk->quickening_counters == NULL) {
+    chunk->quickening_counters_count = chunk->instructions.used;
+    chunk->quickening_counters =
+        GROW_ARRAY(MEMORY_TAG_QUICKENING, QuickeningCounter, NULL, 0,
+                   chunk->quickening_counters_count);
+    memset(chunk->quickening_counters, 0,
+           sizeof(QuickeningCounter) * chunk->quickening_counters_count);
+  }
+  return &chunk->quickening_counters[offset];
+}
+
+uint8_t get_chunk_instruction(Chunk *chunk, size_t offset) {
+  uint8_t instruction = chunk->instructions.values[offset];
+  if (instruction == OP_BREAKPOINT && chunk->original_instructions != NULL)
+    return chunk->original_instructions[offset];
+  return instruction;
+}
@@ -2,26 +2,139 @@
 #define interpres_chunk_h
 
 #include "constant.h"
+#include "exception_handler.h"
+#include "inline_cache.h"
 #include "instruction.h"
+#include "register_instruction.h"
 
 /* Each instruction in bytecode format has a one-byte operation code that
  * represents what kind of operation we're dealing with from arithmetic
- * operations to looking up variables, returning from somewhere, etc... */
+ * operations to looking up variables, returning from somewhere, etc...
+ * Jump instructions are followed by a two-byte, big-endian offset that is
+ * relative to the end of the instruction: forward for the OP_JUMP family and
+ * backward for OP_LOOP. OP_ZERO and OP_ONE push the integers 0 and 1, while
+ * OP_SMALL_INTEGER and OP_SHORT_INTEGER push the integer held by their
+ * one-byte or two-byte, big-endian, signed operand, so that small integer
+ * literals take no room in the constants array. The OP_JUMP_IF_EQUAL and
+ * OP_JUMP_IF_NOT_* instructions fuse a comparison with the conditional jump
+ * that follows it: they pop both operands and jump whenever the condition of an
+ * "if" or a "while" does not hold, without ever pushing the boolean result of
+ * the comparison.
+ * OP_TAIL_CALL behaves like OP_CALL, but it replaces the caller's call frame
+ * with the callee's instead of pushing a new one; it is always followed by an
+ * OP_RETURN, which is only reached when the callee cannot reuse the frame.
+ * OP_GET_PROPERTY and OP_SET_PROPERTY are followed by the index of the
+ * property's name in the constants array and by the two-byte, big-endian index
+ * of their inline cache; OP_INVOKE additionally carries the number of
+ * arguments between the two, and OP_TAIL_INVOKE is to OP_INVOKE what
+ * OP_TAIL_CALL is to OP_CALL. OP_THROW pops the exception and unwinds to the
+ * innermost exception handler covering the instruction that threw it.
+ * The instructions following OP_THROW are the quickened forms of OP_ADD,
+ * OP_SUBTRACT, OP_MULTIPLY and of the fused integer comparisons: they are never
+ * emitted by the compiler, but the virtual machine rewrites a generic
+ * instruction in place into one of them once it has seen the same operand
+ * types a few times in a row. A quickened instruction only checks that its
+ * operands still have the expected types and falls back to its generic form,
+ * which get_generic_instruction maps it to, as soon as they do not.
+ * OP_BREAKPOINT is never emitted by the compiler either: a debugger patches it
+ * over the opcode of the instructions it wants to stop at, and the virtual
+ * machine looks the original opcode up in the chunk's copy of its
+ * instructions before running it. */
 typedef enum {
   OP_RETURN,
   OP_CONSTANT,
+  OP_ZERO,
+  OP_ONE,
+  OP_SMALL_INTEGER,
+  OP_SHORT_INTEGER,
+  OP_NIL,
+  OP_TRUE,
+  OP_FALSE,
+  OP_POP,
+  OP_DEFINE_GLOBAL,
+  OP_GET_GLOBAL,
+  OP_SET_GLOBAL,
+  OP_GET_LOCAL,
+  OP_SET_LOCAL,
+  OP_EQUAL,
+  OP_NOT_EQUAL,
+  OP_GREATER,
+  OP_GREATER_EQUAL,
+  OP_LESS,
+  OP_LESS_EQUAL,
   OP_ADD,
   OP_SUBTRACT,
   OP_MULTIPLY,
   OP_DIVIDE,
+  OP_NOT,
   OP_NEGATE,
+  OP_PRINT,
+  OP_JUMP,
+  OP_JUMP_IF_FALSE,
+  OP_POP_JUMP_IF_FALSE,
+  OP_JUMP_IF_EQUAL,
+  OP_JUMP_IF_NOT_EQUAL,
+  OP_JUMP_IF_NOT_GREATER,
+  OP_JUMP_IF_NOT_GREATER_EQUAL,
+  OP_JUMP_IF_NOT_LESS,
+  OP_JUMP_IF_NOT_LESS_EQUAL,
+  OP_LOOP,
+  OP_CALL,
+  OP_TAIL_CALL,
+  OP_GET_PROPERTY,
+  OP_SET_PROPERTY,
+  OP_INVOKE,
+  OP_TAIL_INVOKE,
+  OP_CLASS,
+  OP_INHERIT,
+  OP_METHOD,
+  OP_THROW,
+  OP_ADD_INTEGER,
+  OP_ADD_NUMBER,
+  OP_ADD_STRING,
+  OP_SUBTRACT_INTEGER,
+  OP_SUBTRACT_NUMBER,
+  OP_MULTIPLY_INTEGER,
+  OP_MULTIPLY_NUMBER,
+  OP_JUMP_IF_NOT_GREATER_INTEGER,
+  OP_JUMP_IF_NOT_GREATER_EQUAL_INTEGER,
+  OP_JUMP_IF_NOT_LESS_INTEGER,
+  OP_JUMP_IF_NOT_LESS_EQUAL_INTEGER,
+  OP_BREAKPOINT,
 } OpCode;
-/* A chunk is nothing more than sequences of bytecode instructions and the
- * constants that make up those instructions; notice that both are implemented
- * as dynamic arrays since they need to grow and shrink in size at runtime. */
+/* The type feedback the virtual machine keeps for every instruction of a chunk
+ * that can be quickened: the number of times in a row its generic form saw the
+ * same operand types and the number of times its quickened form had to fall
+ * back to the generic one. */
+typedef struct {
+  uint8_t executions;
+  uint8_t deoptimizations;
+} QuickeningCounter;
+/* A chunk is nothing more than sequences of bytecode instructions, the
+ * constants that make up those instructions, the inline caches used by its
+ * property accesses and the exception handlers of its "try" blocks; notice
+ * that all of them are implemented as dynamic arrays since they need to grow
+ * and shrink in size at runtime. When the virtual machine runs on registers,
+ * the chunk also holds the register instructions its bytecode was translated
+ * into, which share its constants, inline caches and exception handlers.
+ * Once the chunk runs, "quickening_counters" holds one counter per byte of its
+ * instructions, of which there are "quickening_counters_count"; it stays NULL
+ * until the first instruction of the chunk is considered for quickening. The
+ * "loop_iterations_count" counter holds the number of backward jumps the chunk
+ * took while running on the stack, which is how hot loops are detected.
+ * While a debugger is attached, "original_instructions" holds a copy of the
+ * instructions taken before any OP_BREAKPOINT was patched in; it is NULL
+ * otherwise. */
 typedef struct {
   InstructionsArray instructions;
   ConstantsArray constants;
+  InlineCachesArray caches;
+  ExceptionHandlersArray handlers;
+  RegisterInstructionsArray registers;
+  QuickeningCounter *quickening_counters;
+  size_t quickening_counters_count;
+  size_t loop_iterations_count;
+  uint8_t *original_instructions;
 } Chunk;
 /*
  * @brief Initialize a new chunk.
@@ -36,8 +149,10 @@ void init_chunk(Chunk *chunk);
 /*
  * @brief Free the chunk's set of arrays.
  * This function will free the memory allocated for the chunk's instructions
- * array and constants array and re-initialize the chunk to an empty state by
- * calling init_chunk.
+ * array, constants array, inline caches array, exception handlers array,
+ * register instructions array, quickening counters and copy of the original
+ * instructions and re-initialize the chunk to an empty state by calling
+ * init_chunk.
  *
  * @param chunk A pointer to the chunk to free
  * @return void
@@ -71,5 +186,56 @@ void push_instruction_to_chunk(Chunk *chunk, uint8_t instruction,
  * @return The index of the constants array where the constant was added
  */
 size_t push_constant_to_chunk(Chunk *chunk, Constant constant);
+/*
+ * @brief Append a new, empty inline cache to a chunk's inline caches array.
+ *
+ * @param chunk A pointer to the chunk to append the new inline cache to
+ * @return The index of the inline caches array where the cache was added
+ */
+size_t push_inline_cache_to_chunk(Chunk *chunk);
+/*
+ * @brief Append a new exception handler to a chunk's exception handlers array.
+ *
+ * @param chunk A pointer to the chunk to append the new handler to
+ * @param handler The exception handler to add to the chunk
+ * @return void
+ */
+void push_exception_handler_to_chunk(Chunk *chunk, ExceptionHandler handler);
+/*
+ * @brief Get the length of a bytecode instruction.
+ *
+ * @param instruction The OpCode of the instruction
+ * @return The number of bytes taken by the instruction and its operands, or 0
+ * if the OpCode is unknown
+ */
+int get_instruction_length(uint8_t instruction);
+/*
+ * @brief Get the generic form of a bytecode instruction.
+ *
+ * @param instruction The OpCode of the instruction
+ * @return The OpCode the instruction was quickened from, or the instruction
+ * itself if it is not a quickened one
+ */
+uint8_t get_generic_instruction(uint8_t instruction);
+/*
+ * @brief Get the quickening counter of an instruction of a chunk.
+ * The counters of the chunk are allocated, zeroed, the first time one of them
+ * is needed.
+ *
+ * @param chunk A pointer to the chunk holding the instruction
+ * @param offset The offset of the instruction in the chunk's instructions array
+ * @return A pointer to the instruction's quickening counter
+ */
+QuickeningCounter *get_quickening_counter(Chunk *chunk, size_t offset);
+/*
+ * @brief Get the opcode of an instruction of a chunk.
+ * Instructions over which a debugger patched OP_BREAKPOINT are looked up in
+ * the chunk's copy of its original instructions.
+ *
+ * @param chunk A pointer to the chunk holding the instruction
+ * @param offset The offset of the instruction in the chunk's instructions array
+ * @return The OpCode the instruction was compiled or quickened into
+ */
+uint8_t get_chunk_instruction(Chunk *chunk, size_t offset);
 
 #endif
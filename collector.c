@@ -0,0 +1,371 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "collector.h"
+#include "compiler.h"
+#include "memory.h"
+#include "vm.h"
+
+static uint64_t get_monotonic_microseconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+static bool object_is_white(Object *object) {
+  return object->color == OBJECT_COLOR_WHITE_A ||
+         object->color == OBJECT_COLOR_WHITE_B;
+}
+
+void init_garbage_collector(GarbageCollector *collector) {
+  collector->objects = NULL;
+  collector->gray_used = 0;
+  collector->gray_capacity = 0;
+  collector->gray_stack = NULL;
+  collector->sweep_cursor = NULL;
+  collector->phase = COLLECTOR_PHASE_IDLE;
+  collector->is_paused = false;
+  collector->live_white = OBJECT_COLOR_WHITE_A;
+  collector->bytes_allocated = 0;
+  collector->next_collection = COLLECTOR_INITIAL_THRESHOLD;
+  collector->next_step = 0;
+  collector->growth_factor = COLLECTOR_DEFAULT_GROWTH_FACTOR;
+  collector->pause_budget_microseconds = COLLECTOR_DEFAULT_PAUSE_BUDGET;
+  collector->heap_limit = SIZE_MAX;
+  collector->is_over_heap_limit = false;
+  collector->statistics = (CollectorStatistics){0};
+}
+
+void free_garbage_collector(VirtualMachine *vm) {
+  GarbageCollector *collector = &vm->collector;
+  Object *object = collector->objects;
+  while (object != NULL) {
+    Object *next_object = object->next;
+    free_object(vm, object);
+    object = next_object;
+  }
+  FREE_ARRAY(MEMORY_TAG_COLLECTOR, Object *, collector->gray_stack,
+             collector->gray_capacity);
+  init_garbage_collector(collector);
+}
+
+static bool should_step_garbage_collector(GarbageCollector *collector) {
+  if (collector->is_paused)
+    return false;
+  if (collector->phase == COLLECTOR_PHASE_IDLE)
+    return collector->bytes_allocated > collector->next_collection;
+  return collector->bytes_allocated > collector->next_step;
+}
+
+static void enforce_heap_limit(VirtualMachine *vm) {
+  GarbageCollector *collector = &vm->collector;
+  if (collector->is_paused || collector->is_over_heap_limit ||
+      collector->bytes_allocated <= collector->heap_limit)
+    return;
+  collect_garbage(vm);
+  if (collector->bytes_allocated <= collector->heap_limit)
+    return;
+  collector->is_over_heap_limit = true;
+  vm->interrupted_fuel = vm->fuel;
+  vm->fuel = 0;
+}
+
+void *reallocate_object_memory(VirtualMachine *vm, void *pointer,
+                               size_t current_size, size_t new_size) {
+  GarbageCollector *collector = &vm->collector;
+  collector->bytes_allocated -= current_size;
+  collector->bytes_allocated += new_size;
+  if (new_size > current_size && collector->heap_limit != SIZE_MAX)
+    enforce_heap_limit(vm);
+  if (new_size > current_size && should_step_garbage_collector(collector))
+    step_garbage_collector(vm);
+  return reallocate_slab_memory(&vm->allocator, pointer, current_size,
+                                new_size);
+}
+
+static void push_gray_object(VirtualMachine *vm, Object *object) {
+  GarbageCollector *collector = &vm->collector;
+  object->color = OBJECT_COLOR_GRAY;
+  if (collector->gray_capacity < collector->gray_used + 1) {
+    size_t current_capacity = collector->gray_capacity;
+    collector->gray_capacity = COMPUTE_ARRAY_CAPACITY(current_capacity);
+    collector->gray_stack =
+        GROW_ARRAY(MEMORY_TAG_COLLECTOR, Object *, collector->gray_stack,
+                   current_capacity, collector->gray_capacity);
+  }
+  collector->gray_stack[collector->gray_used] = object;
+  collector->gray_used++;
+}
+
+void mark_object(VirtualMachine *vm, Object *object) {
+  if (object != NULL && object_is_white(object))
+    push_gray_object(vm, object);
+}
+
+void mark_constant(VirtualMachine *vm, Constant constant) {
+  if (IS_OBJECT_CONSTANT(constant))
+    mark_object(vm, AS_OBJECT_CONSTANT(constant));
+}
+
+void collector_write_barrier(VirtualMachine *vm, Object *container,
+                             Constant constant) {
+  if (vm->collector.phase == COLLECTOR_PHASE_MARK &&
+      container->color == OBJECT_COLOR_BLACK)
+    mark_constant(vm, constant);
+}
+
+void collector_stack_barrier(VirtualMachine *vm, Object *coroutine) {
+  if (vm->collector.phase == COLLECTOR_PHASE_MARK &&
+      coroutine->color == OBJECT_COLOR_BLACK)
+    push_gray_object(vm, coroutine);
+}
+
+static void mark_constants_array(VirtualMachine *vm, ConstantsArray *array) {
+  for (size_t i = 0; i < array->used; i++)
+    mark_constant(vm, array->values[i]);
+}
+
+static void mark_table(VirtualMachine *vm, Table *table) {
+  for (size_t i = 0; i < table->capacity; i++) {
+    TableEntry *entry = &table->entries[i];
+    mark_object(vm, (Object *)entry->key);
+    mark_constant(vm, entry->value);
+  }
+}
+
+static void mark_stacks(VirtualMachine *vm, CallFrame *frames,
+                        int frame_count, Constant *stack,
+                        Constant *stack_pointer) {
+  for (Constant *slot = stack; slot < stack_pointer; slot++)
+    mark_constant(vm, *slot);
+  for (int i = 0; i < frame_count; i++)
+    mark_object(vm, (Object *)frames[i].function);
+}
+
+static void mark_event_loop(VirtualMachine *vm, EventLoop *loop) {
+  for (size_t i = 0; i < loop->ready_count; i++) {
+    ReadyTask *task =
+        &loop->ready_tasks[(loop->ready_start + i) % loop->ready_capacity];
+    mark_object(vm, (Object *)task->task);
+    mark_constant(vm, task->value);
+  }
+  for (size_t i = 0; i < loop->operations_used; i++) {
+    EventOperation *operation = &loop->operations[i];
+    mark_object(vm, (Object *)operation->task);
+    mark_object(vm, (Object *)operation->data);
+  }
+  mark_object(vm, (Object *)loop->runner);
+}
+
+static void mark_roots(VirtualMachine *vm) {
+  mark_stacks(vm, vm->frames, vm->frame_count, vm->stack, vm->stack_pointer);
+  if (vm->coroutine != NULL) {
+    mark_stacks(vm, vm->main_frames, vm->main_frame_count, vm->main_stack,
+                vm->main_stack_pointer);
+    mark_object(vm, (Object *)vm->coroutine);
+  }
+  for (Compiler *compiler = vm->compiler; compiler != NULL;
+       compiler = compiler->enclosing)
+    mark_object(vm, (Object *)compiler->function);
+  mark_table(vm, &vm->globals);
+  mark_table(vm, &vm->compiled_inputs);
+  mark_table(vm, &vm->initial_globals);
+  register_profiled_functions(&vm->profiler);
+  for (size_t i = 0; i < vm->profiler.functions_used; i++)
+    mark_object(vm, (Object *)vm->profiler.functions[i]);
+  mark_object(vm, (Object *)vm->debugger.stepped_function);
+  mark_event_loop(vm, &vm->event_loop);
+}
+
+static void remove_white_strings(Table *table) {
+  for (size_t i = 0; i < table->capacity; i++) {
+    TableEntry *entry = &table->entries[i];
+    if (entry->key != NULL && object_is_white((Object *)entry->key))
+      delete_from_table(table, entry->key);
+  }
+}
+
+static void mark_inline_caches_array(VirtualMachine *vm,
+                                     InlineCachesArray *array) {
+  for (size_t i = 0; i < array->used; i++) {
+    InlineCache *cache = &array->values[i];
+    for (int j = 0; j < cache->entries_count; j++) {
+      InlineCacheEntry *entry = &cache->entries[j];
+      mark_object(vm, (Object *)entry->shape);
+      mark_object(vm, (Object *)entry->transition);
+      mark_object(vm, (Object *)entry->method);
+    }
+  }
+}
+
+static void blacken_object(VirtualMachine *vm, Object *object) {
+  switch (object->type) {
+  case OBJECT_BOUND_METHOD: {
+    ObjectBoundMethod *bound_method = (ObjectBoundMethod *)object;
+    mark_constant(vm, bound_method->receiver);
+    mark_object(vm, (Object *)bound_method->method);
+    break;
+  }
+  case OBJECT_CLASS: {
+    ObjectClass *object_class = (ObjectClass *)object;
+    mark_object(vm, (Object *)object_class->name);
+    mark_table(vm, &object_class->methods);
+    mark_object(vm, (Object *)object_class->initializer);
+    mark_object(vm, (Object *)object_class->root_shape);
+    break;
+  }
+  case OBJECT_COROUTINE: {
+    ObjectCoroutine *coroutine = (ObjectCoroutine *)object;
+    mark_object(vm, (Object *)coroutine->function);
+    mark_object(vm, (Object *)coroutine->resumer);
+    if (coroutine != vm->coroutine)
+      mark_stacks(vm, coroutine->frames, coroutine->frame_count,
+                  coroutine->stack, coroutine->stack_pointer);
+    break;
+  }
+  case OBJECT_FUNCTION: {
+    ObjectFunction *function = (ObjectFunction *)object;
+    mark_object(vm, (Object *)function->name);
+    mark_object(vm, (Object *)function->source);
+    mark_constants_array(vm, &function->chunk.constants);
+    mark_inline_caches_array(vm, &function->chunk.caches);
+    break;
+  }
+  case OBJECT_INSTANCE: {
+    ObjectInstance *instance = (ObjectInstance *)object;
+    mark_object(vm, (Object *)instance->shape);
+    for (int i = 0; i < instance->shape->field_count; i++)
+      mark_constant(vm, instance->fields[i]);
+    break;
+  }
+  case OBJECT_NATIVE:
+    mark_object(vm, (Object *)((ObjectNative *)object)->name);
+    break;
+  case OBJECT_SHAPE: {
+    ObjectShape *shape = (ObjectShape *)object;
+    mark_object(vm, (Object *)shape->owner_class);
+    mark_table(vm, &shape->slots);
+    mark_table(vm, &shape->transitions);
+    break;
+  }
+  case OBJECT_STRING:
+    break;
+  }
+  object->color = OBJECT_COLOR_BLACK;
+}
+
+static bool propagate_marks(VirtualMachine *vm, size_t work_limit) {
+  GarbageCollector *collector = &vm->collector;
+  while (collector->gray_used > 0 && work_limit > 0) {
+    collector->gray_used--;
+    blacken_object(vm, collector->gray_stack[collector->gray_used]);
+    work_limit--;
+  }
+  return collector->gray_used > 0;
+}
+
+static void begin_marking(VirtualMachine *vm) {
+  vm->collector.phase = COLLECTOR_PHASE_MARK;
+  mark_roots(vm);
+}
+
+static void finish_marking(VirtualMachine *vm) {
+  GarbageCollector *collector = &vm->collector;
+  /* The roots are not protected by the write barrier, so they are scanned once
+   * more before flipping the live white: this is the only part of a cycle that
+   * is not incremental, and its cost depends on the size of the roots rather
+   * than on the size of the heap. */
+  mark_roots(vm);
+  while (propagate_marks(vm, SIZE_MAX))
+    ;
+  remove_white_strings(&vm->strings);
+  collector->live_white = collector->live_white == OBJECT_COLOR_WHITE_A
+                              ? OBJECT_COLOR_WHITE_B
+                              : OBJECT_COLOR_WHITE_A;
+  collector->sweep_cursor = &collector->objects;
+  collector->phase = COLLECTOR_PHASE_SWEEP;
+}
+
+static bool sweep_objects(VirtualMachine *vm, size_t work_limit) {
+  GarbageCollector *collector = &vm->collector;
+  while (*collector->sweep_cursor != NULL && work_limit > 0) {
+    Object *object = *collector->sweep_cursor;
+    if (object_is_white(object) && object->color != collector->live_white) {
+      *collector->sweep_cursor = object->next;
+      collector->statistics.bytes_freed += free_object(vm, object);
+      collector->statistics.objects_freed++;
+    } else {
+      object->color = collector->live_white;
+      collector->sweep_cursor = &object->next;
+    }
+    work_limit--;
+  }
+  return *collector->sweep_cursor != NULL;
+}
+
+static void finish_sweeping(VirtualMachine *vm) {
+  GarbageCollector *collector = &vm->collector;
+  collector->sweep_cursor = NULL;
+  collector->phase = COLLECTOR_PHASE_IDLE;
+  collector->statistics.collections++;
+  size_t next_collection =
+      (size_t)((double)collector->bytes_allocated * collector->growth_factor);
+  collector->next_collection = next_collection > COLLECTOR_INITIAL_THRESHOLD
+                                   ? next_collection
+                                   : COLLECTOR_INITIAL_THRESHOLD;
+}
+
+static bool advance_garbage_collector(VirtualMachine *vm, size_t work_limit) {
+  switch (vm->collector.phase) {
+  case COLLECTOR_PHASE_IDLE:
+    begin_marking(vm);
+    return true;
+  case COLLECTOR_PHASE_MARK:
+    if (!propagate_marks(vm, work_limit))
+      finish_marking(vm);
+    return true;
+  case COLLECTOR_PHASE_SWEEP:
+    if (sweep_objects(vm, work_limit))
+      return true;
+    finish_sweeping(vm);
+    return false;
+  }
+  return false;
+}
+
+static void record_pause(CollectorStatistics *statistics,
+                         uint64_t pause_microseconds) {
+  size_t bucket = 0;
+  while (bucket < COLLECTOR_PAUSE_HISTOGRAM_BUCKETS - 1 &&
+         pause_microseconds >= ((uint64_t)1 << bucket))
+    bucket++;
+  statistics->pause_histogram[bucket]++;
+  if (pause_microseconds > statistics->longest_pause_microseconds)
+    statistics->longest_pause_microseconds = pause_microseconds;
+}
+
+void step_garbage_collector(VirtualMachine *vm) {
+  GarbageCollector *collector = &vm->collector;
+  uint64_t step_start = get_monotonic_microseconds();
+  while (advance_garbage_collector(vm, COLLECTOR_WORK_PER_SLICE) &&
+         get_monotonic_microseconds() - step_start <
+             collector->pause_budget_microseconds)
+    ;
+  record_pause(&collector->statistics,
+               get_monotonic_microseconds() - step_start);
+  collector->next_step = collector->bytes_allocated + COLLECTOR_STEP_SIZE;
+}
+
+void collect_garbage(VirtualMachine *vm) {
+  GarbageCollector *collector = &vm->collector;
+  uint64_t collection_start = get_monotonic_microseconds();
+  if (collector->phase != COLLECTOR_PHASE_IDLE)
+    while (advance_garbage_collector(vm, SIZE_MAX))
+      ;
+  while (advance_garbage_collector(vm, SIZE_MAX))
+    ;
+  record_pause(&collector->statistics,
+               get_monotonic_microseconds() - collection_start);
+}
@@ -0,0 +1,220 @@
+#ifndef interpres_collector_h
+#define interpres_collector_h
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "object.h"
+
+/* Here we define the number of bytes the heap may grow to before the very
+ * first collection cycle is started. */
+#define COLLECTOR_INITIAL_THRESHOLD (1024 * 1024)
+/* Here we define the default multiplier used to compute the heap size that
+ * triggers the next collection cycle from the number of bytes that survived
+ * the last one. A value of 2 means that a new cycle starts once the heap has
+ * doubled in size. */
+#define COLLECTOR_DEFAULT_GROWTH_FACTOR 2.0
+/* Here we define the default upper bound, in microseconds, of the time spent
+ * in a single incremental step of the collector. */
+#define COLLECTOR_DEFAULT_PAUSE_BUDGET 500
+/* Here we define how many bytes the program may allocate between two
+ * incremental steps while a collection cycle is in progress. */
+#define COLLECTOR_STEP_SIZE (16 * 1024)
+/* Here we define the number of objects the collector processes between two
+ * checks of the elapsed time, so that reading the clock does not dominate the
+ * cost of a step. */
+#define COLLECTOR_WORK_PER_SLICE 64
+/* Here we define the number of buckets of the pause histogram. Bucket 0 counts
+ * pauses shorter than one microsecond, bucket "i" counts pauses in the range
+ * [2^(i - 1), 2^i) microseconds and the last bucket counts everything longer
+ * than that. */
+#define COLLECTOR_PAUSE_HISTOGRAM_BUCKETS 20
+/*
+ * @brief Wrapper around reallocate_object_memory function that pretties up
+ * allocating memory for a number of values of a given type.
+ *
+ * @param vm A pointer to the virtual machine that owns the memory
+ * @param type The type of the values to allocate
+ * @param count The number of values to allocate
+ * @return A pointer to the allocated memory
+ */
+#define ALLOCATE_OBJECT_MEMORY(vm, type, count)                                \
+  (type *)reallocate_object_memory(vm, NULL, 0, sizeof(type) * (count))
+/*
+ * @brief Wrapper around reallocate_object_memory function that pretties up
+ * growing memory that holds a number of values of a given type.
+ *
+ * @param vm A pointer to the virtual machine that owns the memory
+ * @param type The type of the values to grow
+ * @param pointer A pointer to the memory to grow
+ * @param current_count The number of values the memory currently holds
+ * @param new_count The number of values the memory has to hold
+ * @return A pointer to the reallocated memory
+ */
+#define GROW_OBJECT_MEMORY(vm, type, pointer, current_count, new_count)        \
+  (type *)reallocate_object_memory(vm, pointer, sizeof(type) * (current_count), \
+                                   sizeof(type) * (new_count))
+/*
+ * @brief Wrapper around reallocate_object_memory function that pretties up
+ * freeing memory that holds a number of values of a given type.
+ *
+ * @param vm A pointer to the virtual machine that owns the memory
+ * @param type The type of the values to free
+ * @param pointer A pointer to the memory to free
+ * @param count The number of values to free
+ * @return void
+ */
+#define FREE_OBJECT_MEMORY(vm, type, pointer, count)                           \
+  reallocate_object_memory(vm, pointer, sizeof(type) * (count), 0)
+/* The collector is incremental: a collection cycle is split into a marking
+ * phase, during which reachable objects are traced starting from the roots,
+ * and a sweeping phase, during which unreachable objects are freed. Both
+ * phases are interleaved with the execution of the program, which keeps
+ * running while the collector is not idle. */
+typedef enum {
+  COLLECTOR_PHASE_IDLE,
+  COLLECTOR_PHASE_MARK,
+  COLLECTOR_PHASE_SWEEP,
+} CollectorPhase;
+/* These counters are updated by the collector as it runs, and can be read at
+ * any time to monitor how much work it is doing and how long it keeps the
+ * program paused. */
+typedef struct {
+  size_t collections;
+  size_t objects_freed;
+  size_t bytes_freed;
+  uint64_t longest_pause_microseconds;
+  size_t pause_histogram[COLLECTOR_PAUSE_HISTOGRAM_BUCKETS];
+} CollectorStatistics;
+/* The garbage collector keeps track of every object allocated by a virtual
+ * machine in the "objects" linked list, along with the number of bytes they
+ * hold. Objects that have been reached but whose references have not been
+ * traced yet are kept in the "gray_stack" dynamic array, while "sweep_cursor"
+ * points to the link of the next object to look at while sweeping. The
+ * "growth_factor" and "pause_budget_microseconds" fields can be tuned after
+ * initialization to trade memory for throughput and latency. While
+ * "is_paused" is set, no step is ever run, so that the heap can be populated
+ * with objects that are not reachable from the roots yet. Whenever the heap
+ * grows past "heap_limit" bytes, a full collection is run; if the heap is
+ * still too big afterwards, "is_over_heap_limit" is set and the program is
+ * interrupted at its next call or backward jump. */
+typedef struct {
+  Object *objects;
+  size_t gray_used;
+  size_t gray_capacity;
+  Object **gray_stack;
+  Object **sweep_cursor;
+  CollectorPhase phase;
+  bool is_paused;
+  ObjectColor live_white;
+  size_t bytes_allocated;
+  size_t next_collection;
+  size_t next_step;
+  double growth_factor;
+  uint64_t pause_budget_microseconds;
+  size_t heap_limit;
+  bool is_over_heap_limit;
+  CollectorStatistics statistics;
+} GarbageCollector;
+/*
+ * @brief Initialize the garbage collector.
+ * This function will set the collector to an idle state with an empty heap and
+ * default tuning parameters.
+ *
+ * @param collector A pointer to the garbage collector to initialize
+ * @return void
+ */
+void init_garbage_collector(GarbageCollector *collector);
+/*
+ * @brief Free every object owned by the virtual machine.
+ * This function will free every object that is still alive, regardless of it
+ * being reachable or not, along with the collector's own bookkeeping memory.
+ *
+ * @param vm A pointer to the virtual machine whose objects to free
+ * @return void
+ */
+void free_garbage_collector(VirtualMachine *vm);
+/*
+ * @brief Reallocate memory owned by the heap to a new size.
+ * This function behaves like reallocate_array, but it serves the memory from
+ * the virtual machine's slab allocator, keeps track of the number of bytes
+ * held by the heap and gives the collector a chance to run an incremental step
+ * whenever the heap grows past the configured thresholds.
+ *
+ * @param vm A pointer to the virtual machine that owns the memory
+ * @param pointer A pointer to the memory to reallocate
+ * @param current_size The current size of the memory in bytes
+ * @param new_size The new size of the memory in bytes
+ * @return A pointer to the reallocated memory or NULL
+ */
+void *reallocate_object_memory(VirtualMachine *vm, void *pointer,
+                               size_t current_size, size_t new_size);
+/*
+ * @brief Run a single incremental step of the garbage collector.
+ * This function will start a new collection cycle if the collector is idle
+ * and then advance it for at most "pause_budget_microseconds", stopping early
+ * if the cycle completes.
+ *
+ * @param vm A pointer to the virtual machine whose heap to collect
+ * @return void
+ */
+void step_garbage_collector(VirtualMachine *vm);
+/*
+ * @brief Run a full, non-incremental collection.
+ * This function will complete any cycle that is in progress and then run a
+ * whole new cycle without yielding back to the program, freeing every object
+ * that is unreachable at the time of the call.
+ *
+ * @param vm A pointer to the virtual machine whose heap to collect
+ * @return void
+ */
+void collect_garbage(VirtualMachine *vm);
+/*
+ * @brief Mark an object as reachable.
+ * This function will paint a white object gray and schedule it for tracing;
+ * objects that are already gray or black are left untouched.
+ *
+ * @param vm A pointer to the virtual machine that owns the object
+ * @param object A pointer to the object to mark
+ * @return void
+ */
+void mark_object(VirtualMachine *vm, Object *object);
+/*
+ * @brief Mark a constant as reachable.
+ * This function will mark the object held by the constant, if any.
+ *
+ * @param vm A pointer to the virtual machine that owns the constant
+ * @param constant The constant to mark
+ * @return void
+ */
+void mark_constant(VirtualMachine *vm, Constant constant);
+/*
+ * @brief Notify the collector that a reference was stored into an object.
+ * Since the program keeps running while the marking phase is in progress, it
+ * could store a reference to a white object into a black one, which the
+ * collector would never look at again. This function has to be called every
+ * time a constant is stored into an object's field, and it will shade the
+ * stored object gray whenever such a store happens while marking.
+ *
+ * @param vm A pointer to the virtual machine that owns the objects
+ * @param container A pointer to the object the constant is stored into
+ * @param constant The constant being stored
+ * @return void
+ */
+void collector_write_barrier(VirtualMachine *vm, Object *container,
+                             Constant constant);
+/*
+ * @brief Notify the collector that a coroutine stopped running.
+ * The stacks of the running coroutine are roots, which the write barrier does
+ * not protect, so a coroutine that was traced while it ran may hold references
+ * the collector never saw once it is switched out. This function will paint
+ * such a coroutine gray again while marking, so that its stacks are traced
+ * once more.
+ *
+ * @param vm A pointer to the virtual machine that owns the coroutine
+ * @param coroutine A pointer to the coroutine being switched out
+ * @return void
+ */
+void collector_stack_barrier(VirtualMachine *vm, Object *coroutine);
+
+#endif
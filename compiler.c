@@ -1,5 +1,10 @@
 #include <stdbool.h>
+#include <string.h>
 
+#include "collector.h"
+#include "compiler.h"
+#include "expression_graph.h"
+#include "object.h"
 #include "parser.h"
 
 void write_instruction_expression(Parser *parser,
@@ -7,6 +12,22 @@ void write_instruction_expression(Parser *parser,
                                   uint8_t byte_to_write) {
   push_instruction_to_chunk(currently_compiling_chunk, byte_to_write,
                             parser->previous_token.line_number);
+  parser->compiler->has_fusable_instruction = false;
+}
+
+static void mark_fusable_instruction(Parser *parser, size_t instruction_offset) {
+  parser->compiler->has_fusable_instruction = true;
+  parser->compiler->fusable_instruction_offset = instruction_offset;
+}
+
+static bool last_instruction_is_fusable(Parser *parser,
+                                        Chunk *currently_compiling_chunk,
+                                        uint8_t *instruction) {
+  if (!parser->compiler->has_fusable_instruction)
+    return false;
+  *instruction = currently_compiling_chunk->instructions
+                     .values[parser->compiler->fusable_instruction_offset];
+  return true;
 }
 
 void write_instruction_expression_multiple(Parser *parser,
@@ -19,11 +40,185 @@ void write_instruction_expression_multiple(Parser *parser,
                                second_byte_to_write);
 }
 
+void write_comparison_expression(Parser *parser,
+                                 Chunk *currently_compiling_chunk,
+                                 uint8_t comparison_instruction) {
+  write_instruction_expression(parser, currently_compiling_chunk,
+                               comparison_instruction);
+  mark_fusable_instruction(parser,
+                           currently_compiling_chunk->instructions.used - 1);
+}
+
+void write_call_expression(Parser *parser, Chunk *currently_compiling_chunk,
+                           uint8_t arguments_count) {
+  write_instruction_expression_multiple(parser, currently_compiling_chunk,
+                                        OP_CALL, arguments_count);
+  mark_fusable_instruction(parser,
+                           currently_compiling_chunk->instructions.used - 2);
+}
+
+void write_default_return_expression(Parser *parser,
+                                     Chunk *currently_compiling_chunk) {
+  if (parser->compiler->function_type == FUNCTION_TYPE_INITIALIZER)
+    write_instruction_expression_multiple(parser, currently_compiling_chunk,
+                                          OP_GET_LOCAL, 0);
+  else
+    write_instruction_expression(parser, currently_compiling_chunk, OP_NIL);
+  write_instruction_expression(parser, currently_compiling_chunk, OP_RETURN);
+}
+
+void write_return_expression(Parser *parser, Chunk *currently_compiling_chunk) {
+  uint8_t last_instruction;
+  if (parser->compiler->try_depth == 0 &&
+      last_instruction_is_fusable(parser, currently_compiling_chunk,
+                                  &last_instruction) &&
+      (last_instruction == OP_CALL || last_instruction == OP_INVOKE))
+    currently_compiling_chunk->instructions
+        .values[parser->compiler->fusable_instruction_offset] =
+        last_instruction == OP_CALL ? OP_TAIL_CALL : OP_TAIL_INVOKE;
+  write_instruction_expression(parser, currently_compiling_chunk, OP_RETURN);
+}
+
+static void write_inline_cache_index(Parser *parser,
+                                     Chunk *currently_compiling_chunk) {
+  size_t cache_index = push_inline_cache_to_chunk(currently_compiling_chunk);
+  if (cache_index > UINT16_MAX)
+    parser_error_at_previous(parser, "too many property accesses in one chunk.");
+  write_instruction_expression_multiple(parser, currently_compiling_chunk,
+                                        (cache_index >> 8) & 0xff,
+                                        cache_index & 0xff);
+}
+
+void write_property_expression(Parser *parser,
+                               Chunk *currently_compiling_chunk,
+                               uint8_t property_instruction,
+                               uint8_t name_index) {
+  write_instruction_expression_multiple(parser, currently_compiling_chunk,
+                                        property_instruction, name_index);
+  write_inline_cache_index(parser, currently_compiling_chunk);
+}
+
+void write_invoke_expression(Parser *parser, Chunk *currently_compiling_chunk,
+                             uint8_t name_index, uint8_t arguments_count) {
+  write_instruction_expression_multiple(parser, currently_compiling_chunk,
+                                        OP_INVOKE, name_index);
+  write_instruction_expression(parser, currently_compiling_chunk,
+                               arguments_count);
+  write_inline_cache_index(parser, currently_compiling_chunk);
+  mark_fusable_instruction(parser,
+                           currently_compiling_chunk->instructions.used - 5);
+}
+
+size_t write_jump_expression(Parser *parser, Chunk *currently_compiling_chunk,
+                             uint8_t jump_instruction) {
+  write_instruction_expression(parser, currently_compiling_chunk,
+                               jump_instruction);
+  write_instruction_expression_multiple(parser, currently_compiling_chunk, 0xff,
+                                        0xff);
+  return currently_compiling_chunk->instructions.used - 2;
+}
+
+static uint8_t get_fused_jump_instruction(uint8_t last_instruction) {
+  switch (last_instruction) {
+  case OP_EQUAL:
+    return OP_JUMP_IF_NOT_EQUAL;
+  case OP_NOT_EQUAL:
+    return OP_JUMP_IF_EQUAL;
+  case OP_GREATER:
+    return OP_JUMP_IF_NOT_GREATER;
+  case OP_GREATER_EQUAL:
+    return OP_JUMP_IF_NOT_GREATER_EQUAL;
+  case OP_LESS:
+    return OP_JUMP_IF_NOT_LESS;
+  case OP_LESS_EQUAL:
+    return OP_JUMP_IF_NOT_LESS_EQUAL;
+  default:
+    return OP_POP_JUMP_IF_FALSE;
+  }
+}
+
+size_t write_condition_jump_expression(Parser *parser,
+                                       Chunk *currently_compiling_chunk) {
+  uint8_t last_instruction;
+  if (!last_instruction_is_fusable(parser, currently_compiling_chunk,
+                                   &last_instruction) ||
+      get_fused_jump_instruction(last_instruction) == OP_POP_JUMP_IF_FALSE)
+    return write_jump_expression(parser, currently_compiling_chunk,
+                                 OP_POP_JUMP_IF_FALSE);
+  InstructionsArray *instructions = &currently_compiling_chunk->instructions;
+  instructions->values[parser->compiler->fusable_instruction_offset] =
+      get_fused_jump_instruction(last_instruction);
+  write_instruction_expression_multiple(parser, currently_compiling_chunk, 0xff,
+                                        0xff);
+  return instructions->used - 2;
+}
+
+void patch_jump_expression(Parser *parser, Chunk *currently_compiling_chunk,
+                           size_t jump_offset) {
+  size_t jump_distance =
+      currently_compiling_chunk->instructions.used - jump_offset - 2;
+  if (jump_distance > UINT16_MAX)
+    parser_error_at_previous(parser, "too much code to jump over.");
+  currently_compiling_chunk->instructions.values[jump_offset] =
+      (jump_distance >> 8) & 0xff;
+  currently_compiling_chunk->instructions.values[jump_offset + 1] =
+      jump_distance & 0xff;
+  parser->compiler->has_fusable_instruction = false;
+}
+
+void write_loop_expression(Parser *parser, Chunk *currently_compiling_chunk,
+                           size_t loop_start) {
+  write_instruction_expression(parser, currently_compiling_chunk, OP_LOOP);
+  size_t loop_distance =
+      currently_compiling_chunk->instructions.used - loop_start + 2;
+  if (loop_distance > UINT16_MAX)
+    parser_error_at_previous(parser, "loop body too large.");
+  write_instruction_expression_multiple(parser, currently_compiling_chunk,
+                                        (loop_distance >> 8) & 0xff,
+                                        loop_distance & 0xff);
+}
+
+void write_exception_handler_expression(Parser *parser,
+                                        Chunk *currently_compiling_chunk,
+                                        size_t try_start, size_t try_end,
+                                        int stack_depth) {
+  ExceptionHandler handler = {
+      .start_offset = try_start,
+      .end_offset = try_end,
+      .handler_offset = currently_compiling_chunk->instructions.used,
+      .stack_depth = stack_depth,
+  };
+  push_exception_handler_to_chunk(currently_compiling_chunk, handler);
+  parser->compiler->has_fusable_instruction = false;
+}
+
+bool optimize_expression(Parser *parser, Chunk *currently_compiling_chunk,
+                         size_t expression_start, bool is_value_used) {
+  Compiler *compiler = parser->compiler;
+  if (!parser->vm->optimizes_expressions || parser->is_error)
+    return false;
+  int stack_depth = compiler->local_count;
+  if (stack_depth > 0 && compiler->locals[stack_depth - 1].depth == -1)
+    stack_depth--;
+  size_t root_offset;
+  if (!optimize_expression_bytecode(currently_compiling_chunk,
+                                    expression_start, stack_depth,
+                                    is_value_used, &root_offset))
+    return false;
+  if (compiler->has_fusable_instruction && root_offset != SIZE_MAX)
+    compiler->fusable_instruction_offset = root_offset;
+  else
+    compiler->has_fusable_instruction = false;
+  return currently_compiling_chunk->instructions.used == expression_start;
+}
+
 static uint8_t make_constant_expression(Parser *parser,
                                         Chunk *currently_compiling_chunk,
                                         Constant constant) {
   size_t constant_index =
       push_constant_to_chunk(currently_compiling_chunk, constant);
+  collector_write_barrier(parser->vm, (Object *)parser->compiler->function,
+                          constant);
   if (constant_index > UINT8_MAX) {
     parser_error_at_previous(parser, "too many constants in one chunk.");
     return 0;
@@ -31,31 +226,191 @@ static uint8_t make_constant_expression(Parser *parser,
   return (uint8_t)constant_index;
 }
 
+static bool write_integer_expression(Parser *parser,
+                                     Chunk *currently_compiling_chunk,
+                                     int64_t integer) {
+  if (integer == 0 || integer == 1) {
+    write_instruction_expression(parser, currently_compiling_chunk,
+                                 integer == 0 ? OP_ZERO : OP_ONE);
+  } else if (integer >= INT8_MIN && integer <= INT8_MAX) {
+    write_instruction_expression_multiple(parser, currently_compiling_chunk,
+                                          OP_SMALL_INTEGER,
+                                          (uint8_t)integer);
+  } else if (integer >= INT16_MIN && integer <= INT16_MAX) {
+    write_instruction_expression(parser, currently_compiling_chunk,
+                                 OP_SHORT_INTEGER);
+    write_instruction_expression_multiple(
+        parser, currently_compiling_chunk, ((uint16_t)integer >> 8) & 0xff,
+        (uint16_t)integer & 0xff);
+  } else {
+    return false;
+  }
+  return true;
+}
+
 void write_constant_expression(Parser *parser, Chunk *currently_compiling_chunk,
                                Constant constant) {
+  if (IS_INTEGER_CONSTANT(constant) &&
+      write_integer_expression(parser, currently_compiling_chunk,
+                               AS_INTEGER_CONSTANT(constant)))
+    return;
   write_instruction_expression_multiple(
       parser, currently_compiling_chunk, OP_CONSTANT,
       make_constant_expression(parser, currently_compiling_chunk, constant));
 }
 
-static void write_return(Parser *parser, Chunk *currently_compiling_chunk) {
-  write_instruction_expression(parser, currently_compiling_chunk, OP_RETURN);
+uint8_t make_identifier_constant(Parser *parser,
+                                 Chunk *currently_compiling_chunk,
+                                 Token *name) {
+  ObjectString *identifier =
+      copy_string(parser->vm, name->lexeme_start, name->lexeme_length);
+  return make_constant_expression(parser, currently_compiling_chunk,
+                                  OBJECT_CONSTANT(identifier));
 }
 
-static void end_compilation(Parser *parser, Chunk *currently_compiling_chunk) {
-  write_return(parser, currently_compiling_chunk);
+void begin_scope(Parser *parser) { parser->compiler->scope_depth++; }
+
+void end_scope(Parser *parser, Chunk *currently_compiling_chunk) {
+  Compiler *compiler = parser->compiler;
+  compiler->scope_depth--;
+  while (compiler->local_count > 0 &&
+         compiler->locals[compiler->local_count - 1].depth >
+             compiler->scope_depth) {
+    write_instruction_expression(parser, currently_compiling_chunk, OP_POP);
+    compiler->local_count--;
+  }
 }
 
-bool compile_input(const char *input, Chunk *compilation_chunk) {
+bool identifiers_are_equal(Token *first_name, Token *second_name) {
+  return first_name->lexeme_length == second_name->lexeme_length &&
+         memcmp(first_name->lexeme_start, second_name->lexeme_start,
+                first_name->lexeme_length) == 0;
+}
+
+void declare_local_variable(Parser *parser) {
+  Compiler *compiler = parser->compiler;
+  Token *name = &parser->previous_token;
+  for (int i = compiler->local_count - 1; i >= 0; i--) {
+    Local *local = &compiler->locals[i];
+    if (local->depth != -1 && local->depth < compiler->scope_depth)
+      break;
+    if (identifiers_are_equal(name, &local->name))
+      parser_error_at_previous(
+          parser, "a variable with this name already exists in this scope.");
+  }
+  if (compiler->local_count == UINT8_COUNT) {
+    parser_error_at_previous(parser, "too many local variables in scope.");
+    return;
+  }
+  Local *local = &compiler->locals[compiler->local_count];
+  local->name = *name;
+  local->depth = -1;
+  compiler->local_count++;
+}
+
+void mark_local_initialized(Parser *parser) {
+  Compiler *compiler = parser->compiler;
+  compiler->locals[compiler->local_count - 1].depth = compiler->scope_depth;
+}
+
+int resolve_local_variable(Parser *parser, Token *name) {
+  Compiler *compiler = parser->compiler;
+  for (int i = compiler->local_count - 1; i >= 0; i--) {
+    Local *local = &compiler->locals[i];
+    if (identifiers_are_equal(name, &local->name)) {
+      if (local->depth == -1)
+        parser_error_at_previous(
+            parser, "can't read local variable in its own initializer.");
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void enter_compiler(Parser *parser, Compiler *compiler,
+                           ObjectFunction *function,
+                           FunctionType function_type) {
+  compiler->enclosing = parser->compiler;
+  compiler->function = function;
+  compiler->function_type = function_type;
+  compiler->local_count = 0;
+  compiler->scope_depth = 0;
+  compiler->has_fusable_instruction = false;
+  compiler->fusable_instruction_offset = 0;
+  compiler->try_depth = 0;
+  parser->compiler = compiler;
+  parser->vm->compiler = compiler;
+  Local *local = &compiler->locals[compiler->local_count];
+  local->depth = 0;
+  if (function_type == FUNCTION_TYPE_METHOD ||
+      function_type == FUNCTION_TYPE_INITIALIZER) {
+    local->name.lexeme_start = "this";
+    local->name.lexeme_length = 4;
+  } else {
+    local->name.lexeme_start = "";
+    local->name.lexeme_length = 0;
+  }
+  compiler->local_count++;
+}
+
+void init_compiler(Parser *parser, Compiler *compiler,
+                   FunctionType function_type) {
+  enter_compiler(parser, compiler, NULL, function_type);
+  compiler->function = new_function(parser->vm);
+  compiler->function->type = function_type;
+  if (function_type != FUNCTION_TYPE_SCRIPT) {
+    compiler->function->name =
+        copy_string(parser->vm, parser->previous_token.lexeme_start,
+                    parser->previous_token.lexeme_length);
+    collector_write_barrier(parser->vm, (Object *)compiler->function,
+                            OBJECT_CONSTANT(compiler->function->name));
+  }
+}
+
+ObjectFunction *end_compiler(Parser *parser) {
+  Compiler *compiler = parser->compiler;
+  Chunk *function_chunk = &compiler->function->chunk;
+  if (compiler->function->source == NULL)
+    write_default_return_expression(parser, function_chunk);
+  parser->compiler = compiler->enclosing;
+  parser->vm->compiler = compiler->enclosing;
+  return compiler->function;
+}
+
+ObjectFunction *compile_input(VirtualMachine *vm, const char *input) {
   Parser parser;
-  init_parser(&parser);
+  init_parser(&parser, vm);
+  parser.source_start = input;
+  Compiler compiler;
+  init_compiler(&parser, &compiler, FUNCTION_TYPE_SCRIPT);
   Scanner scanner;
   init_scanner(&scanner, input);
-  Chunk *currently_compiling_chunk = compilation_chunk;
   advance_parser(&parser, &scanner);
-  parse_expression(&parser, &scanner, currently_compiling_chunk);
-  advance_parser_and_validate_token(&parser, &scanner, TOKEN_EOF,
-                                    "expected end of expression.");
-  end_compilation(&parser, currently_compiling_chunk);
-  return !parser.is_error;
+  while (parser.current_token.type != TOKEN_EOF)
+    parse_declaration(&parser, &scanner, &compiler.function->chunk);
+  ObjectFunction *function = end_compiler(&parser);
+  return parser.is_error ? NULL : function;
+}
+
+bool compile_function_body(VirtualMachine *vm, ObjectFunction *function) {
+  ObjectString *source = function->source;
+  Parser parser;
+  init_parser(&parser, vm);
+  parser.source_start = source->characters;
+  parser.source = source;
+  Compiler compiler;
+  enter_compiler(&parser, &compiler, function, function->type);
+  function->arity = 0;
+  Scanner scanner;
+  init_scanner(&scanner, source->characters + function->source_offset);
+  scanner.line_number = function->source_line_number;
+  advance_parser(&parser, &scanner);
+  parse_function_body(&parser, &scanner);
+  function->source = NULL;
+  end_compiler(&parser);
+  if (!parser.is_error)
+    return true;
+  free_chunk(&function->chunk);
+  function->source = source;
+  return false;
 }
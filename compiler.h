@@ -4,18 +4,87 @@
 #include "parser.h"
 #include "vm.h"
 
+/* Here we define the number of values a one-byte operand can address, which is
+ * also the maximum number of local variables that can be in scope at once. */
+#define UINT8_COUNT (UINT8_MAX + 1)
+/* A local variable is identified by the token holding its name and by the
+ * depth of the scope it was declared in. A depth of -1 marks a variable that
+ * has been declared but whose initializer has not been compiled yet. */
+typedef struct {
+  Token name;
+  int depth;
+} Local;
+/* There is one compiler for each function being compiled, linked to the
+ * compiler of the function it is nested in through "enclosing". Each compiler
+ * keeps track of the local variables that are in scope: since locals live on
+ * the virtual machine's stack, the index of a local in the "locals" array is
+ * also the stack slot, relative to the function's call frame, that holds its
+ * value at runtime. It also remembers whether the last instruction written to
+ * the chunk, found at "fusable_instruction_offset", can still be fused with
+ * the instruction that follows it, which is only the case as long as no jump
+ * has been patched to land right after it, and how many "try" blocks enclose
+ * the code being compiled, since calls inside them cannot be tail calls: the
+ * frame they would replace is the one their exception handler unwinds to. */
+struct Compiler {
+  struct Compiler *enclosing;
+  ObjectFunction *function;
+  FunctionType function_type;
+  Local locals[UINT8_COUNT];
+  int local_count;
+  int scope_depth;
+  bool has_fusable_instruction;
+  size_t fusable_instruction_offset;
+  int try_depth;
+};
+/*
+ * @brief Start compiling a new function.
+ * This function will initialize the compiler, create the function object it
+ * compiles into and make it the parser's current compiler. Functions other
+ * than the top-level script are named after the previously scanned token.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @param compiler A pointer to the compiler to initialize
+ * @param function_type The type of function to compile
+ * @return void
+ */
+void init_compiler(Parser *parser, Compiler *compiler,
+                   FunctionType function_type);
+/*
+ * @brief Finish compiling the current function.
+ * This function will append an implicit "return nil" to the function's chunk,
+ * or an implicit "return this" for initializers, unless the function's body
+ * was skimmed, and restore the enclosing compiler as the parser's current
+ * compiler.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @return The compiled function
+ */
+ObjectFunction *end_compiler(Parser *parser);
 /*
  * @brief Compile a set of instructions into bytecode.
  * This function takes a set of instructions in the form of a string as input
  * and compiles it into bytecode which can later be handled by our virtual
- * machine.
+ * machine. The bytecode is wrapped into a function that represents the
+ * top-level script.
  *
+ * @param vm A pointer to the virtual machine that will own the objects created
+ * while compiling
  * @param input The input set of instructions to compile
- * @param compilation_chunk A pointer to the chunk that will hold the compiled
- * bytecode
- * @return Whether the compilation was successful or not
+ * @return The compiled script, or NULL if the compilation was not successful
+ */
+ObjectFunction *compile_input(VirtualMachine *vm, const char *input);
+/*
+ * @brief Compile the body of a function that was skimmed.
+ * This function will scan the function's source again, starting from the
+ * opening parenthesis of its parameters, and compile its body into the
+ * function's chunk. If the body holds any error, the errors are reported, the
+ * chunk is left empty and the function can be compiled again later on.
+ *
+ * @param vm A pointer to the virtual machine that owns the function
+ * @param function A pointer to the function whose body to compile
+ * @return Whether the body was compiled successfully or not
  */
-bool compile_input(const char *input, Chunk *compilation_chunk);
+bool compile_function_body(VirtualMachine *vm, ObjectFunction *function);
 /*
  * @brief Append a single instruction byte to the chunk.
  * This function will push an instruction byte to the chunk, along with the line
@@ -51,11 +120,184 @@ void write_instruction_expression_multiple(Parser *parser,
                                            Chunk *currently_compiling_chunk,
                                            uint8_t first_byte_to_write,
                                            uint8_t second_byte_to_write);
+/*
+ * @brief Append a comparison instruction to the chunk.
+ * This function will push the comparison's OpCode to the chunk and remember
+ * that it may be fused with a conditional jump written right after it.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @param currently_compiling_chunk A pointer to the chunk that is being
+ * compiled
+ * @param comparison_instruction The comparison OpCode to write
+ * @return void
+ */
+void write_comparison_expression(Parser *parser,
+                                 Chunk *currently_compiling_chunk,
+                                 uint8_t comparison_instruction);
+/*
+ * @brief Append a call instruction to the chunk.
+ * This function will push a call instruction along with its number of
+ * arguments, and remember that it may be turned into a tail call if it turns
+ * out to be the value of a "return" statement.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @param currently_compiling_chunk A pointer to the chunk that is being
+ * compiled
+ * @param arguments_count The number of arguments passed to the call
+ * @return void
+ */
+void write_call_expression(Parser *parser, Chunk *currently_compiling_chunk,
+                           uint8_t arguments_count);
+/*
+ * @brief Append the instructions of a "return" statement with no value.
+ * Functions return nil, while initializers return the instance they were
+ * called on.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @param currently_compiling_chunk A pointer to the chunk that is being
+ * compiled
+ * @return void
+ */
+void write_default_return_expression(Parser *parser,
+                                     Chunk *currently_compiling_chunk);
+/*
+ * @brief Append a return instruction to the chunk.
+ * The value to return must already be on top of the stack. If that value is
+ * the result of a call or of a method invocation written right before, it is
+ * turned into a tail call, so that the callee returns straight to the
+ * caller's caller whenever it can reuse the caller's call frame, unless the
+ * return is inside a "try" block.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @param currently_compiling_chunk A pointer to the chunk that is being
+ * compiled
+ * @return void
+ */
+void write_return_expression(Parser *parser, Chunk *currently_compiling_chunk);
+/*
+ * @brief Append a property access instruction to the chunk.
+ * This function will push the instruction along with the index of the
+ * property's name and the index of a new inline cache that belongs to the
+ * instruction alone.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @param currently_compiling_chunk A pointer to the chunk that is being
+ * compiled
+ * @param property_instruction Either OP_GET_PROPERTY or OP_SET_PROPERTY
+ * @param name_index The index of the property's name in the constants array
+ * @return void
+ */
+void write_property_expression(Parser *parser,
+                               Chunk *currently_compiling_chunk,
+                               uint8_t property_instruction,
+                               uint8_t name_index);
+/*
+ * @brief Append a method invocation instruction to the chunk.
+ * This function will push an OP_INVOKE instruction along with the index of the
+ * method's name, the number of arguments and the index of a new inline cache
+ * that belongs to the instruction alone.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @param currently_compiling_chunk A pointer to the chunk that is being
+ * compiled
+ * @param name_index The index of the method's name in the constants array
+ * @param arguments_count The number of arguments passed to the method
+ * @return void
+ */
+void write_invoke_expression(Parser *parser, Chunk *currently_compiling_chunk,
+                             uint8_t name_index, uint8_t arguments_count);
+/*
+ * @brief Append a jump instruction to the chunk.
+ * This function will push the jump's OpCode to the chunk followed by a
+ * placeholder offset, which has to be filled in with patch_jump once the
+ * target of the jump has been compiled.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @param currently_compiling_chunk A pointer to the chunk that is being
+ * compiled
+ * @param jump_instruction The jump OpCode to write
+ * @return The offset of the placeholder in the chunk's instructions array
+ */
+size_t write_jump_expression(Parser *parser, Chunk *currently_compiling_chunk,
+                             uint8_t jump_instruction);
+/*
+ * @brief Append the conditional jump of an "if" or "while" statement.
+ * This function will write a jump that pops the condition and jumps when it
+ * is falsey. If the condition ends with a comparison, the comparison and the
+ * jump are fused into a single instruction instead.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @param currently_compiling_chunk A pointer to the chunk that is being
+ * compiled
+ * @return The offset of the placeholder in the chunk's instructions array
+ */
+size_t write_condition_jump_expression(Parser *parser,
+                                       Chunk *currently_compiling_chunk);
+/*
+ * @brief Fill in the offset of a jump with the current end of the chunk.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @param currently_compiling_chunk A pointer to the chunk that is being
+ * compiled
+ * @param jump_offset The offset returned when the jump was written
+ * @return void
+ */
+void patch_jump_expression(Parser *parser, Chunk *currently_compiling_chunk,
+                           size_t jump_offset);
+/*
+ * @brief Append a backward jump to the chunk.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @param currently_compiling_chunk A pointer to the chunk that is being
+ * compiled
+ * @param loop_start The offset of the instruction to jump back to
+ * @return void
+ */
+void write_loop_expression(Parser *parser, Chunk *currently_compiling_chunk,
+                           size_t loop_start);
+/*
+ * @brief Record the exception handler of a "try" block in the chunk.
+ * The handler covers the instructions compiled from "try_start" up to
+ * "try_end", and its "catch" block starts at the end of the chunk, with the
+ * exception pushed on top of the local variables that were in scope when the
+ * "try" block was entered.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @param currently_compiling_chunk A pointer to the chunk that is being
+ * compiled
+ * @param try_start The offset of the first instruction of the "try" block
+ * @param try_end The offset right after the last instruction of the block
+ * @param stack_depth The number of local variables in scope at "try_start"
+ * @return void
+ */
+void write_exception_handler_expression(Parser *parser,
+                                        Chunk *currently_compiling_chunk,
+                                        size_t try_start, size_t try_end,
+                                        int stack_depth);
+/*
+ * @brief Optimize the bytecode of the expression that was just compiled.
+ * When expressions are optimized, this function will eliminate the common
+ * subexpressions of the expression compiled from "expression_start" onwards,
+ * keeping track of the instruction the expression ends with in case it can
+ * still be fused with the next one. An expression whose value is not used is
+ * removed altogether if computing it can have no effect.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @param currently_compiling_chunk A pointer to the chunk that is being
+ * compiled
+ * @param expression_start The offset of the expression's first instruction
+ * @param is_value_used Whether the statement uses the value of the expression
+ * @return Whether the expression was removed
+ */
+bool optimize_expression(Parser *parser, Chunk *currently_compiling_chunk,
+                         size_t expression_start, bool is_value_used);
 /*
  * @brief Append a constant byte to the chunk.
  * This function will push a constant byte to the chunk, meaning that it will
  * push the constant to the chunk's constants array and later push the constant
- * OpCode to the chunk together with the constant's index.
+ * OpCode to the chunk together with the constant's index. Integers that fit in
+ * two bytes are pushed by an instruction holding them as an immediate operand
+ * instead, without taking any room in the constants array.
  *
  * @param parser A pointer to the parser that is currently compiling
  * @param currently_compiling_chunk A pointer to the chunk that is being
@@ -66,5 +308,68 @@ void write_instruction_expression_multiple(Parser *parser,
  */
 void write_constant_expression(Parser *parser, Chunk *currently_compiling_chunk,
                                Constant constant);
+/*
+ * @brief Add an identifier's name to the chunk's constants array.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @param currently_compiling_chunk A pointer to the chunk that is being
+ * compiled
+ * @param name A pointer to the token holding the identifier
+ * @return The index of the name in the chunk's constants array
+ */
+uint8_t make_identifier_constant(Parser *parser,
+                                 Chunk *currently_compiling_chunk,
+                                 Token *name);
+/*
+ * @brief Enter a new block scope.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @return void
+ */
+void begin_scope(Parser *parser);
+/*
+ * @brief Leave the innermost block scope.
+ * This function will pop every local variable declared in the scope off the
+ * stack.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @param currently_compiling_chunk A pointer to the chunk that is being
+ * compiled
+ * @return void
+ */
+void end_scope(Parser *parser, Chunk *currently_compiling_chunk);
+/*
+ * @brief Check whether two identifiers have the same name.
+ *
+ * @param first_name A pointer to the token holding the first identifier
+ * @param second_name A pointer to the token holding the second identifier
+ * @return Whether the two identifiers are the same or not
+ */
+bool identifiers_are_equal(Token *first_name, Token *second_name);
+/*
+ * @brief Declare a local variable in the innermost scope.
+ * The variable is named after the previously scanned token, and it cannot be
+ * read until mark_local_initialized is called.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @return void
+ */
+void declare_local_variable(Parser *parser);
+/*
+ * @brief Make the most recently declared local variable readable.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @return void
+ */
+void mark_local_initialized(Parser *parser);
+/*
+ * @brief Resolve a name to a local variable.
+ *
+ * @param parser A pointer to the parser that is currently compiling
+ * @param name A pointer to the token holding the name to resolve
+ * @return The stack slot of the local variable, or -1 if the name does not
+ * refer to a local variable
+ */
+int resolve_local_variable(Parser *parser, Token *name);
 
 #endif
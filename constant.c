@@ -1,5 +1,6 @@
 #include "constant.h"
 #include "memory.h"
+#include "object.h"
 
 void init_constants_array(ConstantsArray *array) {
   array->used = 0;
@@ -8,7 +9,7 @@ void init_constants_array(ConstantsArray *array) {
 }
 
 void free_constants_array(ConstantsArray *array) {
-  FREE_ARRAY(Constant, array->values, array->capacity);
+  FREE_ARRAY(MEMORY_TAG_CONSTANTS, Constant, array->values, array->capacity);
   init_constants_array(array);
 }
 
@@ -16,9 +17,82 @@ void write_constants_array(ConstantsArray *array, Constant constant) {
   if (array->capacity < array->used + 1) {
     size_t current_capacity = array->capacity;
     array->capacity = COMPUTE_ARRAY_CAPACITY(current_capacity);
-    array->values =
-        GROW_ARRAY(Constant, array->values, current_capacity, array->capacity);
+    array->values = GROW_ARRAY(MEMORY_TAG_CONSTANTS, Constant, array->values,
+                               current_capacity, array->capacity);
   }
   array->values[array->used] = constant;
   array->used++;
 }
+
+bool constant_is_falsey(Constant constant) {
+  return IS_NIL_CONSTANT(constant) ||
+         (IS_BOOLEAN_CONSTANT(constant) && !AS_BOOLEAN_CONSTANT(constant));
+}
+
+double compare_integer_to_number(int64_t integer, double number) {
+  if (number != number)
+    return number;
+  if (number >= 0x1p63)
+    return -1;
+  if (number < -0x1p63)
+    return 1;
+  int64_t integral_part = (int64_t)number;
+  if (integer != integral_part)
+    return integer < integral_part ? -1 : 1;
+  double fractional_part = number - (double)integral_part;
+  return fractional_part > 0 ? -1 : fractional_part < 0 ? 1 : 0;
+}
+
+bool constants_are_equal(Constant first_constant, Constant second_constant) {
+  if (first_constant.type != second_constant.type) {
+    if (IS_INTEGER_CONSTANT(first_constant) &&
+        IS_NUMBER_CONSTANT(second_constant))
+      return compare_integer_to_number(AS_INTEGER_CONSTANT(first_constant),
+                                       AS_NUMBER_CONSTANT(second_constant)) ==
+             0;
+    if (IS_NUMBER_CONSTANT(first_constant) &&
+        IS_INTEGER_CONSTANT(second_constant))
+      return compare_integer_to_number(AS_INTEGER_CONSTANT(second_constant),
+                                       AS_NUMBER_CONSTANT(first_constant)) ==
+             0;
+    return false;
+  }
+  switch (first_constant.type) {
+  case CONSTANT_BOOLEAN:
+    return AS_BOOLEAN_CONSTANT(first_constant) ==
+           AS_BOOLEAN_CONSTANT(second_constant);
+  case CONSTANT_INTEGER:
+    return AS_INTEGER_CONSTANT(first_constant) ==
+           AS_INTEGER_CONSTANT(second_constant);
+  case CONSTANT_NIL:
+    return true;
+  case CONSTANT_NUMBER:
+    return AS_NUMBER_CONSTANT(first_constant) ==
+           AS_NUMBER_CONSTANT(second_constant);
+  case CONSTANT_OBJECT:
+    return AS_OBJECT_CONSTANT(first_constant) ==
+           AS_OBJECT_CONSTANT(second_constant);
+  }
+  return false;
+}
+
+void print_constant(OutputBuffer *output, Constant constant) {
+  switch (constant.type) {
+  case CONSTANT_BOOLEAN:
+    write_output_string(output,
+                        AS_BOOLEAN_CONSTANT(constant) ? "true" : "false");
+    break;
+  case CONSTANT_INTEGER:
+    write_output_integer(output, AS_INTEGER_CONSTANT(constant));
+    break;
+  case CONSTANT_NIL:
+    write_output_string(output, "nil");
+    break;
+  case CONSTANT_NUMBER:
+    write_output_number(output, AS_NUMBER_CONSTANT(constant));
+    break;
+  case CONSTANT_OBJECT:
+    print_object(output, constant);
+    break;
+  }
+}
@@ -1,12 +1,93 @@
 #ifndef interpres_constant_h
 #define interpres_constant_h
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
-/* This typedef abstracts how the language constants are actually represented in
- * C, allowing us to change that representation without changing the rest of the
- * existing code that passes around variables of this type. */
-typedef double Constant;
+#include "output.h"
+
+/* Heap-allocated constants (strings and, later on, every other kind of object)
+ * are only referenced through a pointer to their common header, whose layout
+ * is defined in object.h along with the layout of strings, which are also used
+ * as the keys of tables. */
+typedef struct Object Object;
+typedef struct ObjectString ObjectString;
+/* This enum lists every kind of constant the language knows about. Booleans,
+ * nil and numbers are stored inline, while anything that lives on the heap is
+ * represented by an object. Numbers come in two kinds: integers, which are
+ * exact as long as they fit in 64 bits, and doubles. The two kinds are
+ * indistinguishable to programs, which only ever see numbers. */
+typedef enum {
+  CONSTANT_BOOLEAN,
+  CONSTANT_INTEGER,
+  CONSTANT_NIL,
+  CONSTANT_NUMBER,
+  CONSTANT_OBJECT,
+} ConstantType;
+/* This type abstracts how the language constants are actually represented in
+ * C, allowing us to change that representation without changing the rest of
+ * the existing code that passes around variables of this type. Each constant
+ * is a tagged union: the "type" field tells which member of the union holds
+ * the actual value. */
+typedef struct {
+  ConstantType type;
+  union {
+    bool boolean;
+    int64_t integer;
+    double number;
+    Object *object;
+  } as;
+} Constant;
+/* The following macros check the type of a constant, unwrap the C value it
+ * holds and wrap a C value into a constant of the matching type. Unwrapping a
+ * constant without checking its type first is undefined behaviour. */
+#define IS_BOOLEAN_CONSTANT(constant) ((constant).type == CONSTANT_BOOLEAN)
+#define IS_INTEGER_CONSTANT(constant) ((constant).type == CONSTANT_INTEGER)
+#define IS_NIL_CONSTANT(constant) ((constant).type == CONSTANT_NIL)
+#define IS_NUMBER_CONSTANT(constant) ((constant).type == CONSTANT_NUMBER)
+#define IS_OBJECT_CONSTANT(constant) ((constant).type == CONSTANT_OBJECT)
+#define AS_BOOLEAN_CONSTANT(constant) ((constant).as.boolean)
+#define AS_INTEGER_CONSTANT(constant) ((constant).as.integer)
+#define AS_NUMBER_CONSTANT(constant) ((constant).as.number)
+#define AS_OBJECT_CONSTANT(constant) ((constant).as.object)
+#define BOOLEAN_CONSTANT(value)                                                \
+  ((Constant){CONSTANT_BOOLEAN, {.boolean = (value)}})
+#define INTEGER_CONSTANT(value)                                                \
+  ((Constant){CONSTANT_INTEGER, {.integer = (value)}})
+#define NIL_CONSTANT ((Constant){CONSTANT_NIL, {.number = 0}})
+#define NUMBER_CONSTANT(value)                                                 \
+  ((Constant){CONSTANT_NUMBER, {.number = (value)}})
+#define OBJECT_CONSTANT(value)                                                 \
+  ((Constant){CONSTANT_OBJECT, {.object = (Object *)(value)}})
+/* This macro checks whether a constant holds a number of either kind. */
+#define IS_NUMERIC_CONSTANT(constant)                                          \
+  (IS_INTEGER_CONSTANT(constant) || IS_NUMBER_CONSTANT(constant))
+/*
+ * @brief Unwrap a number of either kind as a double.
+ * Integers that do not fit in a double are rounded to the nearest one.
+ *
+ * @param constant The numeric constant to unwrap
+ * @return The number held by the constant
+ */
+static inline double numeric_constant_to_double(Constant constant) {
+  return IS_INTEGER_CONSTANT(constant) ? (double)AS_INTEGER_CONSTANT(constant)
+                                       : AS_NUMBER_CONSTANT(constant);
+}
+/*
+ * @brief Compare an integer with a double exactly.
+ * Neither number is converted to the other's kind, so integers past 2^53 are
+ * not rounded and doubles past the range of integers still order above or
+ * below all of them.
+ *
+ * @param integer The integer to compare
+ * @param number The double to compare the integer with
+ * @return A negative number if the integer is less than the double, a positive
+ * one if it is greater, 0 if they are equal and NaN if the double is NaN, so
+ * that the result can be compared with 0 the way the two numbers would be
+ * compared with each other
+ */
+double compare_integer_to_number(int64_t integer, double number);
 /* A series of constants is defined as a dynamic array which holds two counters:
  * "capacity" and "used", which represent respectively the number of elements in
  * the array and the number of elements that are actually in use. In this case,
@@ -31,6 +112,8 @@ void init_constants_array(ConstantsArray *array);
  * @brief Free the constants array.
  * This function will free the memory allocated for the constants array and
  * re-initialize the array to an empty state by calling init_constants_array.
+ * Objects referenced by the array are not freed: they are owned by the garbage
+ * collector.
  *
  * @param array A pointer to the constants array to free
  * @return void
@@ -48,5 +131,37 @@ void free_constants_array(ConstantsArray *array);
  * @return void
  */
 void write_constants_array(ConstantsArray *array, Constant constant);
+/*
+ * @brief Determine whether a constant is falsey.
+ * Only nil and false are falsey: every other constant, including the number 0
+ * and the empty string, is truthy.
+ *
+ * @param constant The constant to check
+ * @return Whether the constant is falsey or not
+ */
+bool constant_is_falsey(Constant constant);
+/*
+ * @brief Compare two constants for equality.
+ * Constants of different types are never equal, except for integers and
+ * doubles, which are compared exactly. Objects are compared by identity,
+ * which for strings is the same as comparing their characters since every
+ * string is interned.
+ *
+ * @param first_constant The first constant to compare
+ * @param second_constant The second constant to compare
+ * @return Whether the two constants are equal or not
+ */
+bool constants_are_equal(Constant first_constant, Constant second_constant);
+/*
+ * @brief Print a constant to an output buffer.
+ * This function will print the given constant in a human readable format,
+ * dispatching on its type. Numbers are printed with the fewest digits that
+ * read back as the very same number.
+ *
+ * @param output A pointer to the output buffer to print to
+ * @param constant The constant to print
+ * @return void
+ */
+void print_constant(OutputBuffer *output, Constant constant);
 
 #endif
@@ -0,0 +1,259 @@
+#include <string.h>
+
+#include "debugger.h"
+#include "memory.h"
+#include "vm.h"
+
+void init_debugger(Debugger *debugger) {
+  debugger->hook = NULL;
+  debugger->context = NULL;
+  debugger->is_stepping = false;
+  debugger->breakpoint_lines_used = 0;
+  debugger->breakpoint_lines_capacity = 0;
+  debugger->breakpoint_lines = NULL;
+  debugger->stepped_function = NULL;
+  debugger->stepped_offset = 0;
+  debugger->is_trapping = false;
+  debugger->trapped_offsets_count = 0;
+  debugger->runs_on_registers = false;
+  debugger->tier_up_threshold = TIER_UP_THRESHOLD;
+}
+
+static bool is_breakpoint_line(Debugger *debugger, size_t line_number) {
+  for (size_t i = 0; i < debugger->breakpoint_lines_used; i++) {
+    if (debugger->breakpoint_lines[i] == line_number)
+      return true;
+  }
+  return false;
+}
+
+static bool should_patch(Debugger *debugger, ObjectFunction *function,
+                         size_t offset) {
+  if (function == debugger->stepped_function &&
+      offset == debugger->stepped_offset)
+    return false;
+  if (debugger->is_stepping || debugger->is_trapping)
+    return true;
+  if (function == debugger->stepped_function) {
+    for (int i = 0; i < debugger->trapped_offsets_count; i++) {
+      if (debugger->trapped_offsets[i] == offset)
+        return true;
+    }
+  }
+  size_t *line_numbers = function->chunk.instructions.line_numbers;
+  return (offset == 0 || line_numbers[offset] != line_numbers[offset - 1]) &&
+         is_breakpoint_line(debugger, line_numbers[offset]);
+}
+
+static uint8_t refresh_instruction(Debugger *debugger, ObjectFunction *function,
+                                   size_t offset) {
+  Chunk *chunk = &function->chunk;
+  uint8_t instruction = get_chunk_instruction(chunk, offset);
+  if (should_patch(debugger, function, offset)) {
+    chunk->original_instructions[offset] = instruction;
+    chunk->instructions.values[offset] = OP_BREAKPOINT;
+  } else {
+    chunk->instructions.values[offset] = instruction;
+  }
+  return instruction;
+}
+
+static void patch_function(Debugger *debugger, ObjectFunction *function) {
+  Chunk *chunk = &function->chunk;
+  InstructionsArray *instructions = &chunk->instructions;
+  if (chunk->original_instructions == NULL) {
+    chunk->original_instructions = GROW_ARRAY(MEMORY_TAG_DEBUGGER, uint8_t,
+                                              NULL, 0, instructions->used);
+    memcpy(chunk->original_instructions, instructions->values,
+           instructions->used);
+  }
+  for (size_t offset = 0; offset < instructions->used;) {
+    uint8_t instruction = refresh_instruction(debugger, function, offset);
+    offset += (size_t)get_instruction_length(instruction);
+  }
+}
+
+static void restore_function(ObjectFunction *function) {
+  Chunk *chunk = &function->chunk;
+  InstructionsArray *instructions = &chunk->instructions;
+  for (size_t offset = 0; offset < instructions->used;) {
+    uint8_t instruction = get_chunk_instruction(chunk, offset);
+    instructions->values[offset] = instruction;
+    offset += (size_t)get_instruction_length(instruction);
+  }
+  FREE_ARRAY(MEMORY_TAG_DEBUGGER, uint8_t, chunk->original_instructions,
+             instructions->used);
+  chunk->original_instructions = NULL;
+}
+
+static void patch_functions(VirtualMachine *vm) {
+  for (Object *object = vm->collector.objects; object != NULL;
+       object = object->next) {
+    if (object->type == OBJECT_FUNCTION &&
+        ((ObjectFunction *)object)->is_verified)
+      patch_function(&vm->debugger, (ObjectFunction *)object);
+  }
+}
+
+void attach_debugger(VirtualMachine *vm, DebuggerHook hook, void *context,
+                     bool is_stepping) {
+  Debugger *debugger = &vm->debugger;
+  if (debugger->hook == NULL) {
+    debugger->runs_on_registers = vm->runs_on_registers;
+    debugger->tier_up_threshold = vm->tier_up_threshold;
+    vm->runs_on_registers = false;
+    vm->tier_up_threshold = SIZE_MAX;
+  }
+  debugger->hook = hook;
+  debugger->context = context;
+  debugger->is_stepping = is_stepping;
+  patch_functions(vm);
+}
+
+void detach_debugger(VirtualMachine *vm) {
+  Debugger *debugger = &vm->debugger;
+  if (debugger->hook == NULL)
+    return;
+  for (Object *object = vm->collector.objects; object != NULL;
+       object = object->next) {
+    if (object->type == OBJECT_FUNCTION &&
+        ((ObjectFunction *)object)->chunk.original_instructions != NULL)
+      restore_function((ObjectFunction *)object);
+  }
+  vm->runs_on_registers = debugger->runs_on_registers;
+  vm->tier_up_threshold = debugger->tier_up_threshold;
+  FREE_ARRAY(MEMORY_TAG_DEBUGGER, size_t, debugger->breakpoint_lines,
+             debugger->breakpoint_lines_capacity);
+  init_debugger(debugger);
+}
+
+void add_breakpoint(VirtualMachine *vm, size_t line_number) {
+  Debugger *debugger = &vm->debugger;
+  if (is_breakpoint_line(debugger, line_number))
+    return;
+  if (debugger->breakpoint_lines_capacity <
+      debugger->breakpoint_lines_used + 1) {
+    size_t current_capacity = debugger->breakpoint_lines_capacity;
+    debugger->breakpoint_lines_capacity =
+        COMPUTE_ARRAY_CAPACITY(current_capacity);
+    debugger->breakpoint_lines =
+        GROW_ARRAY(MEMORY_TAG_DEBUGGER, size_t, debugger->breakpoint_lines,
+                   current_capacity, debugger->breakpoint_lines_capacity);
+  }
+  debugger->breakpoint_lines[debugger->breakpoint_lines_used++] = line_number;
+  if (debugger->hook != NULL)
+    patch_functions(vm);
+}
+
+void remove_breakpoint(VirtualMachine *vm, size_t line_number) {
+  Debugger *debugger = &vm->debugger;
+  for (size_t i = 0; i < debugger->breakpoint_lines_used; i++) {
+    if (debugger->breakpoint_lines[i] != line_number)
+      continue;
+    debugger->breakpoint_lines[i] =
+        debugger->breakpoint_lines[--debugger->breakpoint_lines_used];
+    if (debugger->hook != NULL)
+      patch_functions(vm);
+    return;
+  }
+}
+
+void debug_function(VirtualMachine *vm, ObjectFunction *function) {
+  if (vm->debugger.hook == NULL)
+    return;
+  patch_function(&vm->debugger, function);
+  ConstantsArray *constants = &function->chunk.constants;
+  for (size_t i = 0; i < constants->used; i++) {
+    if (IS_FUNCTION_CONSTANT(constants->values[i]) &&
+        AS_FUNCTION_CONSTANT(constants->values[i])->is_verified)
+      debug_function(vm, AS_FUNCTION_CONSTANT(constants->values[i]));
+  }
+}
+
+static void trap_offset(Debugger *debugger, size_t offset) {
+  if (offset == debugger->stepped_offset)
+    return;
+  debugger->trapped_offsets[debugger->trapped_offsets_count++] = offset;
+  refresh_instruction(debugger, debugger->stepped_function, offset);
+}
+
+static void trap_successors(VirtualMachine *vm, ObjectFunction *function,
+                            size_t offset) {
+  Debugger *debugger = &vm->debugger;
+  Chunk *chunk = &function->chunk;
+  uint8_t instruction =
+      get_generic_instruction(get_chunk_instruction(chunk, offset));
+  uint8_t *operands = &chunk->instructions.values[offset + 1];
+  size_t instruction_end = offset + (size_t)get_instruction_length(instruction);
+  size_t jump_offset = (size_t)((operands[0] << 8) | operands[1]);
+  switch (instruction) {
+  case OP_CALL:
+  case OP_TAIL_CALL:
+  case OP_INVOKE:
+  case OP_TAIL_INVOKE:
+  case OP_RETURN:
+  case OP_THROW:
+    debugger->is_trapping = true;
+    patch_functions(vm);
+    break;
+  case OP_JUMP:
+    trap_offset(debugger, instruction_end + jump_offset);
+    break;
+  case OP_LOOP:
+    trap_offset(debugger, instruction_end - jump_offset);
+    break;
+  case OP_JUMP_IF_FALSE:
+  case OP_POP_JUMP_IF_FALSE:
+  case OP_JUMP_IF_EQUAL:
+  case OP_JUMP_IF_NOT_EQUAL:
+  case OP_JUMP_IF_NOT_GREATER:
+  case OP_JUMP_IF_NOT_GREATER_EQUAL:
+  case OP_JUMP_IF_NOT_LESS:
+  case OP_JUMP_IF_NOT_LESS_EQUAL:
+    trap_offset(debugger, instruction_end);
+    trap_offset(debugger, instruction_end + jump_offset);
+    break;
+  default:
+    trap_offset(debugger, instruction_end);
+    break;
+  }
+}
+
+void hit_breakpoint(VirtualMachine *vm, ObjectFunction *function,
+                    size_t offset) {
+  Debugger *debugger = &vm->debugger;
+  ObjectFunction *stepped_function = debugger->stepped_function;
+  size_t stepped_offset = debugger->stepped_offset;
+  int trapped_offsets_count = debugger->trapped_offsets_count;
+  debugger->stepped_function = NULL;
+  debugger->trapped_offsets_count = 0;
+  if (debugger->is_trapping) {
+    debugger->is_trapping = false;
+    patch_functions(vm);
+  } else {
+    for (int i = 0; i < trapped_offsets_count; i++)
+      refresh_instruction(debugger, stepped_function,
+                          debugger->trapped_offsets[i]);
+  }
+  if (stepped_function != NULL)
+    refresh_instruction(debugger, stepped_function, stepped_offset);
+  Chunk *chunk = &function->chunk;
+  if (chunk->instructions.values[offset] == OP_BREAKPOINT) {
+    flush_output_buffer(&vm->output);
+    DebuggerAction action =
+        debugger->hook(vm, function, offset, debugger->context);
+    bool is_stepping = action == DEBUGGER_ACTION_STEP;
+    if (debugger->hook != NULL && debugger->is_stepping != is_stepping) {
+      debugger->is_stepping = is_stepping;
+      patch_functions(vm);
+    }
+  }
+  if (debugger->hook == NULL ||
+      chunk->instructions.values[offset] != OP_BREAKPOINT)
+    return;
+  debugger->stepped_function = function;
+  debugger->stepped_offset = offset;
+  refresh_instruction(debugger, function, offset);
+  if (!debugger->is_stepping)
+    trap_successors(vm, function, offset);
+}
@@ -0,0 +1,137 @@
+#ifndef interpres_debugger_h
+#define interpres_debugger_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "object.h"
+
+/* This enum lists what a debugger hook can ask the virtual machine to do once
+ * it returns: run until the next breakpoint, or stop again at the very next
+ * instruction that runs on the stack. */
+typedef enum {
+  DEBUGGER_ACTION_CONTINUE,
+  DEBUGGER_ACTION_STEP,
+} DebuggerAction;
+/* A debugger hook is called right before the virtual machine runs an
+ * instruction it was asked to stop at, with the function the instruction
+ * belongs to, the offset of the instruction in the function's chunk and the
+ * context the debugger was attached with. The top call frame of the virtual
+ * machine and its stack are up to date and can be inspected, but the hook must
+ * not run any code on the virtual machine. */
+typedef DebuggerAction (*DebuggerHook)(VirtualMachine *vm,
+                                       ObjectFunction *function, size_t offset,
+                                       void *context);
+/* Here we define the number of instructions a debugger may have to trap in
+ * the function it is stepping through to regain control after the instruction
+ * it lets run: the next one and the target of a jump. */
+#define DEBUGGER_MAX_TRAPPED_OFFSETS 2
+/* A debugger is attached to a virtual machine by giving it a hook. Nothing is
+ * checked while instructions run: instead, every verified function gets a
+ * copy of its original instructions, and OP_BREAKPOINT is patched over the
+ * first instruction of every line listed in the "breakpoint_lines" dynamic
+ * array or, while "is_stepping", over every instruction. Once the virtual
+ * machine reaches a patched instruction and the hook has returned, the
+ * debugger restores the instruction, "stepped_function" and
+ * "stepped_offset", so that it runs as usual, and traps the instructions that
+ * can run right after it with OP_BREAKPOINT: the ones at "trapped_offsets" in
+ * the same function, or every instruction when "is_trapping" because the
+ * instruction may leave the function. Reaching a trap patches the restored
+ * instruction back and removes the traps. Since the virtual machine only
+ * translates bytecode into register instructions while no debugger is
+ * attached, the settings that make it do so are stashed in
+ * "runs_on_registers" and "tier_up_threshold" and given back on detach;
+ * functions that already run on registers are not observed. */
+typedef struct {
+  DebuggerHook hook;
+  void *context;
+  bool is_stepping;
+  size_t breakpoint_lines_used;
+  size_t breakpoint_lines_capacity;
+  size_t *breakpoint_lines;
+  ObjectFunction *stepped_function;
+  size_t stepped_offset;
+  bool is_trapping;
+  size_t trapped_offsets[DEBUGGER_MAX_TRAPPED_OFFSETS];
+  int trapped_offsets_count;
+  bool runs_on_registers;
+  size_t tier_up_threshold;
+} Debugger;
+/*
+ * @brief Initialize a new, detached debugger with no breakpoints.
+ *
+ * @param debugger A pointer to the debugger to initialize
+ * @return void
+ */
+void init_debugger(Debugger *debugger);
+/*
+ * @brief Attach a debugger to a virtual machine.
+ * This function will patch the instructions of every function verified so far
+ * and make the virtual machine patch the functions it verifies from now on.
+ * The debugger starts off stepping when "is_stepping" is set, so that the
+ * hook is called before every instruction, and only stops at breakpoints
+ * otherwise.
+ *
+ * @param vm A pointer to the virtual machine to debug
+ * @param hook The hook to call whenever the virtual machine stops
+ * @param context A pointer handed over to the hook as is
+ * @param is_stepping Whether to stop before every instruction
+ * @return void
+ */
+void attach_debugger(VirtualMachine *vm, DebuggerHook hook, void *context,
+                     bool is_stepping);
+/*
+ * @brief Detach the debugger of a virtual machine.
+ * Every patched instruction is restored, the copies of the original
+ * instructions and the breakpoints are freed and the virtual machine goes back
+ * to translating functions into register instructions if it did before.
+ *
+ * @param vm A pointer to the virtual machine being debugged
+ * @return void
+ */
+void detach_debugger(VirtualMachine *vm);
+/*
+ * @brief Set a breakpoint on a line.
+ * The virtual machine stops at the first instruction of every run of
+ * instructions compiled from the line, such as the condition of a loop every
+ * time the loop jumps back to it.
+ *
+ * @param vm A pointer to the virtual machine being debugged
+ * @param line_number The line to stop at
+ * @return void
+ */
+void add_breakpoint(VirtualMachine *vm, size_t line_number);
+/*
+ * @brief Remove the breakpoint set on a line.
+ *
+ * @param vm A pointer to the virtual machine being debugged
+ * @param line_number The line to no longer stop at
+ * @return void
+ */
+void remove_breakpoint(VirtualMachine *vm, size_t line_number);
+/*
+ * @brief Patch a function that was just verified, and every function it holds.
+ * Nothing is done when no debugger is attached.
+ *
+ * @param vm A pointer to the virtual machine that owns the function
+ * @param function A pointer to the function to patch
+ * @return void
+ */
+void debug_function(VirtualMachine *vm, ObjectFunction *function);
+/*
+ * @brief Handle an OP_BREAKPOINT reached by the virtual machine.
+ * This function will remove the traps left by the previous stop, call the hook
+ * if the instruction is a breakpoint or the debugger is stepping, switch
+ * between stepping and stopping at breakpoints as the hook asks for and
+ * restore the instruction so that the virtual machine runs it next.
+ *
+ * @param vm A pointer to the virtual machine being debugged
+ * @param function A pointer to the function the virtual machine is running
+ * @param offset The offset of the instruction that was reached
+ * @return void
+ */
+void hit_breakpoint(VirtualMachine *vm, ObjectFunction *function,
+                    size_t offset);
+
+#endif
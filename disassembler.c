@@ -0,0 +1,283 @@
+#include <string.h>
+
+#include "disassembler.h"
+#include "number.h"
+
+static const char *opcode_names[] = {
+    [OP_RETURN] = "OP_RETURN",
+    [OP_CONSTANT] = "OP_CONSTANT",
+    [OP_ZERO] = "OP_ZERO",
+    [OP_ONE] = "OP_ONE",
+    [OP_SMALL_INTEGER] = "OP_SMALL_INTEGER",
+    [OP_SHORT_INTEGER] = "OP_SHORT_INTEGER",
+    [OP_NIL] = "OP_NIL",
+    [OP_TRUE] = "OP_TRUE",
+    [OP_FALSE] = "OP_FALSE",
+    [OP_POP] = "OP_POP",
+    [OP_DEFINE_GLOBAL] = "OP_DEFINE_GLOBAL",
+    [OP_GET_GLOBAL] = "OP_GET_GLOBAL",
+    [OP_SET_GLOBAL] = "OP_SET_GLOBAL",
+    [OP_GET_LOCAL] = "OP_GET_LOCAL",
+    [OP_SET_LOCAL] = "OP_SET_LOCAL",
+    [OP_EQUAL] = "OP_EQUAL",
+    [OP_NOT_EQUAL] = "OP_NOT_EQUAL",
+    [OP_GREATER] = "OP_GREATER",
+    [OP_GREATER_EQUAL] = "OP_GREATER_EQUAL",
+    [OP_LESS] = "OP_LESS",
+    [OP_LESS_EQUAL] = "OP_LESS_EQUAL",
+    [OP_ADD] = "OP_ADD",
+    [OP_SUBTRACT] = "OP_SUBTRACT",
+    [OP_MULTIPLY] = "OP_MULTIPLY",
+    [OP_DIVIDE] = "OP_DIVIDE",
+    [OP_NOT] = "OP_NOT",
+    [OP_NEGATE] = "OP_NEGATE",
+    [OP_PRINT] = "OP_PRINT",
+    [OP_JUMP] = "OP_JUMP",
+    [OP_JUMP_IF_FALSE] = "OP_JUMP_IF_FALSE",
+    [OP_POP_JUMP_IF_FALSE] = "OP_POP_JUMP_IF_FALSE",
+    [OP_JUMP_IF_EQUAL] = "OP_JUMP_IF_EQUAL",
+    [OP_JUMP_IF_NOT_EQUAL] = "OP_JUMP_IF_NOT_EQUAL",
+    [OP_JUMP_IF_NOT_GREATER] = "OP_JUMP_IF_NOT_GREATER",
+    [OP_JUMP_IF_NOT_GREATER_EQUAL] = "OP_JUMP_IF_NOT_GREATER_EQUAL",
+    [OP_JUMP_IF_NOT_LESS] = "OP_JUMP_IF_NOT_LESS",
+    [OP_JUMP_IF_NOT_LESS_EQUAL] = "OP_JUMP_IF_NOT_LESS_EQUAL",
+    [OP_LOOP] = "OP_LOOP",
+    [OP_CALL] = "OP_CALL",
+    [OP_TAIL_CALL] = "OP_TAIL_CALL",
+    [OP_GET_PROPERTY] = "OP_GET_PROPERTY",
+    [OP_SET_PROPERTY] = "OP_SET_PROPERTY",
+    [OP_INVOKE] = "OP_INVOKE",
+    [OP_TAIL_INVOKE] = "OP_TAIL_INVOKE",
+    [OP_CLASS] = "OP_CLASS",
+    [OP_INHERIT] = "OP_INHERIT",
+    [OP_METHOD] = "OP_METHOD",
+    [OP_THROW] = "OP_THROW",
+    [OP_ADD_INTEGER] = "OP_ADD_INTEGER",
+    [OP_ADD_NUMBER] = "OP_ADD_NUMBER",
+    [OP_ADD_STRING] = "OP_ADD_STRING",
+    [OP_SUBTRACT_INTEGER] = "OP_SUBTRACT_INTEGER",
+    [OP_SUBTRACT_NUMBER] = "OP_SUBTRACT_NUMBER",
+    [OP_MULTIPLY_INTEGER] = "OP_MULTIPLY_INTEGER",
+    [OP_MULTIPLY_NUMBER] = "OP_MULTIPLY_NUMBER",
+    [OP_JUMP_IF_NOT_GREATER_INTEGER] = "OP_JUMP_IF_NOT_GREATER_INTEGER",
+    [OP_JUMP_IF_NOT_GREATER_EQUAL_INTEGER] =
+        "OP_JUMP_IF_NOT_GREATER_EQUAL_INTEGER",
+    [OP_JUMP_IF_NOT_LESS_INTEGER] = "OP_JUMP_IF_NOT_LESS_INTEGER",
+    [OP_JUMP_IF_NOT_LESS_EQUAL_INTEGER] = "OP_JUMP_IF_NOT_LESS_EQUAL_INTEGER",
+    [OP_BREAKPOINT] = "OP_BREAKPOINT",
+};
+
+static const char *get_opcode_name(uint8_t instruction) {
+  if (instruction >= sizeof(opcode_names) / sizeof(opcode_names[0]) ||
+      opcode_names[instruction] == NULL)
+    return "OP_UNKNOWN";
+  return opcode_names[instruction];
+}
+
+static const char *get_function_name(ObjectFunction *function) {
+  return function->name == NULL ? "script" : function->name->characters;
+}
+
+void init_bytecode_statistics(BytecodeStatistics *statistics) {
+  statistics->functions_count = 0;
+  statistics->instructions_count = 0;
+  statistics->bytes_count = 0;
+  statistics->constants_count = 0;
+  statistics->duplicate_constants_count = 0;
+  statistics->max_stack_depth = 0;
+  memset(statistics->opcode_counts, 0, sizeof(statistics->opcode_counts));
+}
+
+static void write_constant(FILE *output, Constant constant) {
+  char buffer[NUMBER_FORMAT_MAX_LENGTH];
+  switch (constant.type) {
+  case CONSTANT_BOOLEAN:
+    fputs(AS_BOOLEAN_CONSTANT(constant) ? "true" : "false", output);
+    return;
+  case CONSTANT_INTEGER:
+    format_integer(AS_INTEGER_CONSTANT(constant), buffer);
+    fputs(buffer, output);
+    return;
+  case CONSTANT_NIL:
+    fputs("nil", output);
+    return;
+  case CONSTANT_NUMBER:
+    format_double(AS_NUMBER_CONSTANT(constant), buffer);
+    fputs(buffer, output);
+    return;
+  case CONSTANT_OBJECT:
+    break;
+  }
+  if (IS_STRING_CONSTANT(constant)) {
+    ObjectString *string = AS_STRING_CONSTANT(constant);
+    fputc('"', output);
+    fwrite(string->characters, sizeof(char), string->length, output);
+    fputc('"', output);
+  } else if (IS_FUNCTION_CONSTANT(constant)) {
+    fprintf(output, "<fn %s>",
+            get_function_name(AS_FUNCTION_CONSTANT(constant)));
+  } else {
+    fputs("<object>", output);
+  }
+}
+
+static uint16_t read_operand_short(uint8_t *instruction) {
+  return (uint16_t)((instruction[0] << 8) | instruction[1]);
+}
+
+static void write_constant_operand(FILE *output, Chunk *chunk,
+                                   uint8_t index) {
+  fprintf(output, " %4d ", index);
+  if (index < chunk->constants.used)
+    write_constant(output, chunk->constants.values[index]);
+}
+
+size_t disassemble_instruction(FILE *output, Chunk *chunk, size_t offset) {
+  uint8_t *instruction = &chunk->instructions.values[offset];
+  uint8_t opcode = get_chunk_instruction(chunk, offset);
+  size_t *line_numbers = chunk->instructions.line_numbers;
+  fprintf(output, "%04zu ", offset);
+  if (offset > 0 && line_numbers[offset] == line_numbers[offset - 1])
+    fputs("   | ", output);
+  else
+    fprintf(output, "%4zu ", line_numbers[offset]);
+  int instruction_length = get_instruction_length(opcode);
+  if (instruction_length <= 1 ||
+      offset + (size_t)instruction_length > chunk->instructions.used) {
+    fprintf(output, "%s\n", get_opcode_name(opcode));
+    return offset + 1;
+  }
+  fprintf(output, "%-36s", get_opcode_name(opcode));
+  size_t instruction_end = offset + (size_t)instruction_length;
+  switch (opcode) {
+  case OP_CONSTANT:
+  case OP_DEFINE_GLOBAL:
+  case OP_GET_GLOBAL:
+  case OP_SET_GLOBAL:
+  case OP_CLASS:
+  case OP_METHOD:
+    write_constant_operand(output, chunk, instruction[1]);
+    break;
+  case OP_SMALL_INTEGER:
+    fprintf(output, " %4d", (int8_t)instruction[1]);
+    break;
+  case OP_SHORT_INTEGER:
+    fprintf(output, " %4d", (int16_t)read_operand_short(&instruction[1]));
+    break;
+  case OP_GET_LOCAL:
+  case OP_SET_LOCAL:
+    fprintf(output, " %4d", instruction[1]);
+    break;
+  case OP_CALL:
+  case OP_TAIL_CALL:
+    fprintf(output, " (%d args)", instruction[1]);
+    break;
+  case OP_LOOP:
+    fprintf(output, " %4zu -> %zu", offset,
+            instruction_end - read_operand_short(&instruction[1]));
+    break;
+  case OP_GET_PROPERTY:
+  case OP_SET_PROPERTY:
+    write_constant_operand(output, chunk, instruction[1]);
+    fprintf(output, " cache %d", read_operand_short(&instruction[2]));
+    break;
+  case OP_INVOKE:
+  case OP_TAIL_INVOKE:
+    write_constant_operand(output, chunk, instruction[1]);
+    fprintf(output, " (%d args) cache %d", instruction[2],
+            read_operand_short(&instruction[3]));
+    break;
+  default:
+    if (instruction_length == 3)
+      fprintf(output, " %4zu -> %zu", offset,
+              instruction_end + read_operand_short(&instruction[1]));
+    break;
+  }
+  fputs("\n", output);
+  return instruction_end;
+}
+
+static size_t count_duplicate_constants(ConstantsArray *constants) {
+  size_t duplicates_count = 0;
+  for (size_t i = 1; i < constants->used; i++) {
+    for (size_t j = 0; j < i; j++) {
+      if (constants->values[i].type == constants->values[j].type &&
+          constants_are_equal(constants->values[i], constants->values[j])) {
+        duplicates_count++;
+        break;
+      }
+    }
+  }
+  return duplicates_count;
+}
+
+void disassemble_function(FILE *output, ObjectFunction *function,
+                          BytecodeStatistics *statistics) {
+  Chunk *chunk = &function->chunk;
+  fprintf(output, "== %s ==\n", get_function_name(function));
+  if (function->source != NULL) {
+    fputs("not compiled yet\n\n", output);
+    return;
+  }
+  size_t instructions_count = 0;
+  for (size_t offset = 0; offset < chunk->instructions.used;) {
+    statistics->opcode_counts[get_chunk_instruction(chunk, offset)]++;
+    instructions_count++;
+    offset = disassemble_instruction(output, chunk, offset);
+  }
+  for (size_t i = 0; i < chunk->handlers.used; i++) {
+    ExceptionHandler *handler = &chunk->handlers.values[i];
+    fprintf(output, "handler %04zu..%04zu -> %04zu (stack depth %d)\n",
+            handler->start_offset, handler->end_offset,
+            handler->handler_offset, handler->stack_depth);
+  }
+  size_t duplicates_count = count_duplicate_constants(&chunk->constants);
+  fprintf(output,
+          "%zu instructions, %zu bytes, %zu constants (%zu duplicates), "
+          "max stack depth %d\n\n",
+          instructions_count, chunk->instructions.used, chunk->constants.used,
+          duplicates_count, function->max_stack_depth);
+  statistics->functions_count++;
+  statistics->instructions_count += instructions_count;
+  statistics->bytes_count += chunk->instructions.used;
+  statistics->constants_count += chunk->constants.used;
+  statistics->duplicate_constants_count += duplicates_count;
+  if (function->max_stack_depth > statistics->max_stack_depth)
+    statistics->max_stack_depth = function->max_stack_depth;
+  for (size_t i = 0; i < chunk->constants.used; i++) {
+    if (IS_FUNCTION_CONSTANT(chunk->constants.values[i]))
+      disassemble_function(output,
+                           AS_FUNCTION_CONSTANT(chunk->constants.values[i]),
+                           statistics);
+  }
+}
+
+void write_bytecode_statistics(FILE *output, BytecodeStatistics *statistics) {
+  fprintf(output, "functions: %zu\n", statistics->functions_count);
+  fprintf(output, "instructions: %zu\n", statistics->instructions_count);
+  fprintf(output, "bytes: %zu\n", statistics->bytes_count);
+  fprintf(output, "constants: %zu (%zu duplicates)\n",
+          statistics->constants_count, statistics->duplicate_constants_count);
+  fprintf(output, "max stack depth: %d\n", statistics->max_stack_depth);
+  int opcodes[DISASSEMBLER_OPCODES_COUNT];
+  int opcodes_count = 0;
+  for (int i = 0; i < DISASSEMBLER_OPCODES_COUNT; i++) {
+    if (statistics->opcode_counts[i] == 0)
+      continue;
+    int j = opcodes_count++;
+    while (j > 0 &&
+           statistics->opcode_counts[opcodes[j - 1]] <
+               statistics->opcode_counts[i]) {
+      opcodes[j] = opcodes[j - 1];
+      j--;
+    }
+    opcodes[j] = i;
+  }
+  fputs("opcode histogram:\n", output);
+  for (int i = 0; i < opcodes_count; i++) {
+    size_t count = statistics->opcode_counts[opcodes[i]];
+    fprintf(output, "%-36s %8zu (%.1f%%)\n",
+            get_opcode_name((uint8_t)opcodes[i]), count,
+            100.0 * (double)count / (double)statistics->instructions_count);
+  }
+}
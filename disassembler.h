@@ -0,0 +1,76 @@
+#ifndef interpres_disassembler_h
+#define interpres_disassembler_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "object.h"
+
+/* Here we define the number of entries of the opcode histogram, one for every
+ * value an opcode byte can take. */
+#define DISASSEMBLER_OPCODES_COUNT (UINT8_MAX + 1)
+/* The statistics gathered while disassembling the functions of a program: the
+ * number of functions, instructions and bytes of bytecode, the number of
+ * constants along with how many of them are equal to an earlier constant of
+ * the same chunk, the largest stack depth any function reaches and the number
+ * of times every opcode appears. */
+typedef struct {
+  size_t functions_count;
+  size_t instructions_count;
+  size_t bytes_count;
+  size_t constants_count;
+  size_t duplicate_constants_count;
+  int max_stack_depth;
+  size_t opcode_counts[DISASSEMBLER_OPCODES_COUNT];
+} BytecodeStatistics;
+/*
+ * @brief Initialize a new, empty set of bytecode statistics.
+ *
+ * @param statistics A pointer to the statistics to initialize
+ * @return void
+ */
+void init_bytecode_statistics(BytecodeStatistics *statistics);
+/*
+ * @brief Disassemble a single instruction of a chunk.
+ * The instruction is written on a line of its own, with its offset, its line
+ * number (or '|' when it is the same as the previous instruction's), the name
+ * of its opcode and its operands: constants are followed by their value,
+ * inline caches by their index and jumps by the offset they land on.
+ * Instructions over which a debugger patched OP_BREAKPOINT are shown with
+ * their original opcode.
+ *
+ * @param output The file to write the disassembly to
+ * @param chunk A pointer to the chunk holding the instruction
+ * @param offset The offset of the instruction in the chunk
+ * @return The offset of the next instruction
+ */
+size_t disassemble_instruction(FILE *output, Chunk *chunk, size_t offset);
+/*
+ * @brief Disassemble a function and every function it holds.
+ * This function will write a header naming the function, the disassembly of
+ * its chunk, its exception handlers and a summary of the chunk's size, and
+ * then recurse into the functions found in its constants. Functions that were
+ * only skimmed by the lazy compiler are reported as such. Every chunk is added
+ * to the given statistics; the maximum stack depth is the one recorded by the
+ * bytecode verifier, which must therefore have run first.
+ *
+ * @param output The file to write the disassembly to
+ * @param function A pointer to the function to disassemble
+ * @param statistics A pointer to the statistics to add the chunks to
+ * @return void
+ */
+void disassemble_function(FILE *output, ObjectFunction *function,
+                          BytecodeStatistics *statistics);
+/*
+ * @brief Write a summary of the statistics gathered by the disassembler.
+ * The totals are followed by the opcode histogram, most frequent opcodes
+ * first.
+ *
+ * @param output The file to write the summary to
+ * @param statistics A pointer to the statistics to summarize
+ * @return void
+ */
+void write_bytecode_statistics(FILE *output, BytecodeStatistics *statistics);
+
+#endif
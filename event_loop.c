@@ -0,0 +1,530 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "event_loop.h"
+#include "memory.h"
+#include "vm.h"
+
+void init_event_loop(EventLoop *loop) {
+  loop->backend = EVENT_LOOP_BACKEND_NONE;
+  loop->descriptor = -1;
+  loop->submission_ring = NULL;
+  loop->submission_ring_size = 0;
+  loop->completion_ring = NULL;
+  loop->completion_ring_size = 0;
+  loop->submissions = NULL;
+  loop->submissions_size = 0;
+  loop->operations_used = 0;
+  loop->operations_capacity = 0;
+  loop->operations = NULL;
+  loop->free_operation = -1;
+  loop->operations_count = 0;
+  loop->descriptors_capacity = 0;
+  loop->descriptor_heads = NULL;
+  loop->descriptor_tails = NULL;
+  loop->ready_start = 0;
+  loop->ready_count = 0;
+  loop->ready_capacity = 0;
+  loop->ready_tasks = NULL;
+  loop->runner = NULL;
+  loop->is_running = false;
+}
+
+static void unmap_io_uring(EventLoop *loop) {
+  if (loop->submissions != NULL && loop->submissions != MAP_FAILED)
+    munmap(loop->submissions, loop->submissions_size);
+  if (loop->completion_ring != NULL && loop->completion_ring != MAP_FAILED &&
+      loop->completion_ring != loop->submission_ring)
+    munmap(loop->completion_ring, loop->completion_ring_size);
+  if (loop->submission_ring != NULL && loop->submission_ring != MAP_FAILED)
+    munmap(loop->submission_ring, loop->submission_ring_size);
+  loop->submission_ring = NULL;
+  loop->completion_ring = NULL;
+  loop->submissions = NULL;
+}
+
+static void *map_io_uring(int ring, size_t size, off_t offset) {
+  return mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ring, offset);
+}
+
+static bool set_up_io_uring(EventLoop *loop) {
+  struct io_uring_params parameters;
+  memset(&parameters, 0, sizeof(parameters));
+  int ring = (int)syscall(__NR_io_uring_setup, EVENT_LOOP_RING_ENTRIES,
+                          &parameters);
+  if (ring < 0)
+    return false;
+  unsigned required_features = IORING_FEAT_NODROP | IORING_FEAT_RW_CUR_POS;
+  if ((parameters.features & required_features) != required_features) {
+    close(ring);
+    return false;
+  }
+  loop->submission_ring_size =
+      parameters.sq_off.array + parameters.sq_entries * sizeof(unsigned);
+  loop->completion_ring_size =
+      parameters.cq_off.cqes +
+      parameters.cq_entries * sizeof(struct io_uring_cqe);
+  loop->submissions_size =
+      parameters.sq_entries * sizeof(struct io_uring_sqe);
+  bool is_single_mapping =
+      (parameters.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (is_single_mapping &&
+      loop->completion_ring_size > loop->submission_ring_size)
+    loop->submission_ring_size = loop->completion_ring_size;
+  loop->submission_ring =
+      map_io_uring(ring, loop->submission_ring_size, IORING_OFF_SQ_RING);
+  loop->completion_ring =
+      is_single_mapping
+          ? loop->submission_ring
+          : map_io_uring(ring, loop->completion_ring_size, IORING_OFF_CQ_RING);
+  loop->submissions =
+      map_io_uring(ring, loop->submissions_size, IORING_OFF_SQES);
+  if (loop->submission_ring == MAP_FAILED ||
+      loop->completion_ring == MAP_FAILED || loop->submissions == MAP_FAILED) {
+    unmap_io_uring(loop);
+    close(ring);
+    return false;
+  }
+  char *submission_ring = loop->submission_ring;
+  loop->submission_head =
+      (unsigned *)(submission_ring + parameters.sq_off.head);
+  loop->submission_tail =
+      (unsigned *)(submission_ring + parameters.sq_off.tail);
+  loop->submission_mask =
+      (unsigned *)(submission_ring + parameters.sq_off.ring_mask);
+  loop->submission_array =
+      (unsigned *)(submission_ring + parameters.sq_off.array);
+  loop->submission_entries = parameters.sq_entries;
+  char *completion_ring = loop->completion_ring;
+  loop->completion_head =
+      (unsigned *)(completion_ring + parameters.cq_off.head);
+  loop->completion_tail =
+      (unsigned *)(completion_ring + parameters.cq_off.tail);
+  loop->completion_mask =
+      (unsigned *)(completion_ring + parameters.cq_off.ring_mask);
+  loop->completions =
+      (struct io_uring_cqe *)(completion_ring + parameters.cq_off.cqes);
+  loop->descriptor = ring;
+  loop->backend = EVENT_LOOP_BACKEND_IO_URING;
+  return true;
+}
+
+static void set_up_backend(EventLoop *loop) {
+  if (loop->backend != EVENT_LOOP_BACKEND_NONE || set_up_io_uring(loop))
+    return;
+  loop->descriptor = epoll_create1(EPOLL_CLOEXEC);
+  if (loop->descriptor >= 0)
+    loop->backend = EVENT_LOOP_BACKEND_EPOLL;
+}
+
+void free_event_loop(VirtualMachine *vm) {
+  EventLoop *loop = &vm->event_loop;
+  if (loop->backend == EVENT_LOOP_BACKEND_IO_URING)
+    unmap_io_uring(loop);
+  if (loop->descriptor >= 0)
+    close(loop->descriptor);
+  for (size_t i = 0; i < loop->operations_used; i++) {
+    EventOperation *operation = &loop->operations[i];
+    if (operation->task != NULL && operation->buffer != NULL)
+      FREE_OBJECT_MEMORY(vm, char, operation->buffer, operation->length + 1);
+  }
+  FREE_ARRAY(MEMORY_TAG_EVENT_LOOP, EventOperation, loop->operations,
+             loop->operations_capacity);
+  FREE_ARRAY(MEMORY_TAG_EVENT_LOOP, int, loop->descriptor_heads,
+             loop->descriptors_capacity);
+  FREE_ARRAY(MEMORY_TAG_EVENT_LOOP, int, loop->descriptor_tails,
+             loop->descriptors_capacity);
+  FREE_ARRAY(MEMORY_TAG_EVENT_LOOP, ReadyTask, loop->ready_tasks,
+             loop->ready_capacity);
+  init_event_loop(loop);
+}
+
+void schedule_task(EventLoop *loop, ObjectCoroutine *task, Constant value,
+                   bool is_error) {
+  if (loop->ready_count == loop->ready_capacity) {
+    size_t current_capacity = loop->ready_capacity;
+    loop->ready_capacity = COMPUTE_ARRAY_CAPACITY(current_capacity);
+    loop->ready_tasks =
+        GROW_ARRAY(MEMORY_TAG_EVENT_LOOP, ReadyTask, loop->ready_tasks,
+                   current_capacity, loop->ready_capacity);
+    memcpy(&loop->ready_tasks[current_capacity], loop->ready_tasks,
+           loop->ready_start * sizeof(ReadyTask));
+  }
+  ReadyTask *ready_task =
+      &loop->ready_tasks[(loop->ready_start + loop->ready_count) %
+                         loop->ready_capacity];
+  ready_task->task = task;
+  ready_task->value = value;
+  ready_task->is_error = is_error;
+  loop->ready_count++;
+}
+
+bool pop_ready_task(EventLoop *loop, ReadyTask *task) {
+  if (loop->ready_count == 0)
+    return false;
+  *task = loop->ready_tasks[loop->ready_start];
+  loop->ready_start = (loop->ready_start + 1) % loop->ready_capacity;
+  loop->ready_count--;
+  return true;
+}
+
+static void reserve_descriptor(EventLoop *loop, int descriptor) {
+  size_t current_capacity = loop->descriptors_capacity;
+  if ((size_t)descriptor < current_capacity)
+    return;
+  while (loop->descriptors_capacity <= (size_t)descriptor)
+    loop->descriptors_capacity =
+        COMPUTE_ARRAY_CAPACITY(loop->descriptors_capacity);
+  loop->descriptor_heads =
+      GROW_ARRAY(MEMORY_TAG_EVENT_LOOP, int, loop->descriptor_heads,
+                 current_capacity, loop->descriptors_capacity);
+  loop->descriptor_tails =
+      GROW_ARRAY(MEMORY_TAG_EVENT_LOOP, int, loop->descriptor_tails,
+                 current_capacity, loop->descriptors_capacity);
+  for (size_t i = current_capacity; i < loop->descriptors_capacity; i++)
+    loop->descriptor_heads[i] = loop->descriptor_tails[i] = -1;
+}
+
+static int perform_operation(EventOperation *operation) {
+  ssize_t result;
+  do {
+    result = operation->kind == EVENT_OPERATION_READ
+                 ? read(operation->descriptor, operation->buffer,
+                        operation->length)
+                 : write(operation->descriptor, operation->data->characters,
+                         operation->length);
+  } while (result < 0 && errno == EINTR);
+  return result < 0 ? -errno : (int)result;
+}
+
+static void free_operation_buffer(VirtualMachine *vm,
+                                  EventOperation *operation) {
+  if (operation->buffer != NULL)
+    FREE_OBJECT_MEMORY(vm, char, operation->buffer, operation->length + 1);
+  operation->buffer = NULL;
+}
+
+static Constant get_operation_result(VirtualMachine *vm,
+                                     EventOperation *operation, int result) {
+  if (operation->kind == EVENT_OPERATION_WRITE)
+    return INTEGER_CONSTANT(result);
+  char *characters =
+      GROW_OBJECT_MEMORY(vm, char, operation->buffer, operation->length + 1,
+                         (size_t)result + 1);
+  operation->buffer = NULL;
+  characters[result] = '\0';
+  return OBJECT_CONSTANT(take_string(vm, characters, (size_t)result));
+}
+
+static int complete_operation(VirtualMachine *vm, int index, int result) {
+  EventLoop *loop = &vm->event_loop;
+  EventOperation *operation = &loop->operations[index];
+  Constant value;
+  if (result < 0) {
+    free_operation_buffer(vm, operation);
+    const char *message = strerror(-result);
+    value = OBJECT_CONSTANT(copy_string(vm, message, strlen(message)));
+  } else {
+    value = get_operation_result(vm, operation, result);
+  }
+  schedule_task(loop, operation->task, value, result < 0);
+  int descriptor = operation->descriptor;
+  int next = operation->next;
+  operation->task = NULL;
+  operation->data = NULL;
+  operation->next = loop->free_operation;
+  loop->free_operation = index;
+  loop->operations_count--;
+  loop->descriptor_heads[descriptor] = next;
+  if (next < 0)
+    loop->descriptor_tails[descriptor] = -1;
+  return next;
+}
+
+static bool enter_io_uring(EventLoop *loop, unsigned minimum_completions) {
+  unsigned submissions_count =
+      *loop->submission_tail -
+      __atomic_load_n(loop->submission_head, __ATOMIC_ACQUIRE);
+  unsigned flags = minimum_completions > 0 ? IORING_ENTER_GETEVENTS : 0;
+  return syscall(__NR_io_uring_enter, loop->descriptor, submissions_count,
+                 minimum_completions, flags, NULL, 0) >= 0 ||
+         errno == EINTR;
+}
+
+static bool submit_operation(EventLoop *loop, EventOperation *operation,
+                             int index) {
+  unsigned tail = *loop->submission_tail;
+  if (tail - __atomic_load_n(loop->submission_head, __ATOMIC_ACQUIRE) ==
+          loop->submission_entries &&
+      (!enter_io_uring(loop, 0) ||
+       tail - __atomic_load_n(loop->submission_head, __ATOMIC_ACQUIRE) ==
+           loop->submission_entries))
+    return false;
+  unsigned slot = tail & *loop->submission_mask;
+  struct io_uring_sqe *submission = &loop->submissions[slot];
+  memset(submission, 0, sizeof(*submission));
+  submission->fd = operation->descriptor;
+  submission->off = UINT64_MAX;
+  submission->len = (uint32_t)operation->length;
+  submission->user_data = (uint64_t)index;
+  if (operation->kind == EVENT_OPERATION_READ) {
+    submission->opcode = IORING_OP_READ;
+    submission->addr = (uint64_t)(uintptr_t)operation->buffer;
+  } else {
+    submission->opcode = IORING_OP_WRITE;
+    submission->addr = (uint64_t)(uintptr_t)operation->data->characters;
+  }
+  loop->submission_array[slot] = slot;
+  __atomic_store_n(loop->submission_tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+static bool watch_descriptor(EventLoop *loop, EventOperation *operation) {
+  struct epoll_event event;
+  event.events =
+      (operation->kind == EVENT_OPERATION_READ ? EPOLLIN : EPOLLOUT) |
+      EPOLLONESHOT;
+  event.data.fd = operation->descriptor;
+  if (epoll_ctl(loop->descriptor, EPOLL_CTL_MOD, operation->descriptor,
+                &event) == 0)
+    return true;
+  return errno == ENOENT && epoll_ctl(loop->descriptor, EPOLL_CTL_ADD,
+                                      operation->descriptor, &event) == 0;
+}
+
+static void start_operations(VirtualMachine *vm, int index) {
+  EventLoop *loop = &vm->event_loop;
+  while (index >= 0) {
+    EventOperation *operation = &loop->operations[index];
+    int result;
+    if (loop->backend == EVENT_LOOP_BACKEND_IO_URING) {
+      if (submit_operation(loop, operation, index))
+        return;
+      result = -EBUSY;
+    } else {
+      if (loop->backend == EVENT_LOOP_BACKEND_EPOLL &&
+          watch_descriptor(loop, operation))
+        return;
+      result = perform_operation(operation);
+    }
+    index = complete_operation(vm, index, result);
+  }
+}
+
+static bool wait_for_io_uring(VirtualMachine *vm) {
+  EventLoop *loop = &vm->event_loop;
+  if (!enter_io_uring(loop, 1))
+    return false;
+  unsigned head = *loop->completion_head;
+  unsigned tail = __atomic_load_n(loop->completion_tail, __ATOMIC_ACQUIRE);
+  while (head != tail) {
+    struct io_uring_cqe *completion =
+        &loop->completions[head & *loop->completion_mask];
+    int index = (int)completion->user_data;
+    int result = completion->res;
+    head++;
+    __atomic_store_n(loop->completion_head, head, __ATOMIC_RELEASE);
+    start_operations(vm, complete_operation(vm, index, result));
+  }
+  return true;
+}
+
+static bool wait_for_epoll(VirtualMachine *vm) {
+  EventLoop *loop = &vm->event_loop;
+  struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+  int events_count =
+      epoll_wait(loop->descriptor, events, EVENT_LOOP_MAX_EVENTS, -1);
+  if (events_count < 0)
+    return errno == EINTR;
+  for (int i = 0; i < events_count; i++) {
+    int index = loop->descriptor_heads[events[i].data.fd];
+    EventOperation *operation = &loop->operations[index];
+    if (operation->kind == EVENT_OPERATION_WRITE &&
+        operation->length > PIPE_BUF)
+      operation->length = PIPE_BUF;
+    start_operations(
+        vm, complete_operation(vm, index, perform_operation(operation)));
+  }
+  return true;
+}
+
+bool wait_for_event_operations(VirtualMachine *vm) {
+  switch (vm->event_loop.backend) {
+  case EVENT_LOOP_BACKEND_IO_URING:
+    return wait_for_io_uring(vm);
+  case EVENT_LOOP_BACKEND_EPOLL:
+    return wait_for_epoll(vm);
+  default:
+    return false;
+  }
+}
+
+static bool is_in_task(VirtualMachine *vm) {
+  return vm->coroutine != NULL && vm->coroutine->is_task;
+}
+
+static bool get_descriptor(Constant constant, int *descriptor) {
+  if (!IS_INTEGER_CONSTANT(constant) || AS_INTEGER_CONSTANT(constant) < 0 ||
+      AS_INTEGER_CONSTANT(constant) > INT_MAX)
+    return false;
+  *descriptor = (int)AS_INTEGER_CONSTANT(constant);
+  return true;
+}
+
+static bool perform_operation_now(VirtualMachine *vm, Constant *arguments,
+                                  EventOperation *operation) {
+  int result = perform_operation(operation);
+  if (result < 0) {
+    free_operation_buffer(vm, operation);
+    return throw_from_native(vm, strerror(-result));
+  }
+  return return_from_native(vm, arguments,
+                            get_operation_result(vm, operation, result));
+}
+
+static bool park_on_operation(VirtualMachine *vm, Constant *arguments,
+                              EventOperation *operation) {
+  EventLoop *loop = &vm->event_loop;
+  set_up_backend(loop);
+  reserve_descriptor(loop, operation->descriptor);
+  int index = loop->free_operation;
+  if (index >= 0) {
+    loop->free_operation = loop->operations[index].next;
+  } else {
+    if (loop->operations_used == loop->operations_capacity) {
+      size_t current_capacity = loop->operations_capacity;
+      loop->operations_capacity = COMPUTE_ARRAY_CAPACITY(current_capacity);
+      loop->operations =
+          GROW_ARRAY(MEMORY_TAG_EVENT_LOOP, EventOperation, loop->operations,
+                     current_capacity, loop->operations_capacity);
+    }
+    index = (int)loop->operations_used++;
+  }
+  operation->task = vm->coroutine;
+  operation->next = -1;
+  loop->operations[index] = *operation;
+  loop->operations_count++;
+  vm->stack_pointer = arguments - 1;
+  vm->coroutine->state = COROUTINE_STATE_SUSPENDED;
+  int tail = loop->descriptor_tails[operation->descriptor];
+  loop->descriptor_tails[operation->descriptor] = index;
+  if (tail >= 0) {
+    loop->operations[tail].next = index;
+  } else {
+    loop->descriptor_heads[operation->descriptor] = index;
+    start_operations(vm, index);
+  }
+  return run_next_task(vm);
+}
+
+bool spawn_native(VirtualMachine *vm, Constant *arguments) {
+  if (!IS_FUNCTION_CONSTANT(arguments[0]) ||
+      AS_FUNCTION_CONSTANT(arguments[0])->arity > 1)
+    return throw_from_native(vm,
+                             "tasks run functions of at most one parameter.");
+  ObjectCoroutine *task = new_coroutine(vm, AS_FUNCTION_CONSTANT(arguments[0]));
+  task->is_task = true;
+  schedule_task(&vm->event_loop, task, NIL_CONSTANT, false);
+  return return_from_native(vm, arguments, OBJECT_CONSTANT(task));
+}
+
+bool run_tasks_native(VirtualMachine *vm, Constant *arguments) {
+  EventLoop *loop = &vm->event_loop;
+  if (loop->is_running)
+    return throw_from_native(vm, "tasks are already running.");
+  vm->stack_pointer = arguments - 1;
+  if (vm->coroutine != NULL)
+    vm->coroutine->state = COROUTINE_STATE_NORMAL;
+  loop->runner = vm->coroutine;
+  loop->is_running = true;
+  return run_next_task(vm);
+}
+
+bool open_native(VirtualMachine *vm, Constant *arguments) {
+  if (!IS_STRING_CONSTANT(arguments[0]) || !IS_STRING_CONSTANT(arguments[1]))
+    return throw_from_native(vm, "can only open a path in a mode.");
+  const char *mode = AS_STRING_CONSTANT(arguments[1])->characters;
+  int flags;
+  if (strcmp(mode, "r") == 0)
+    flags = O_RDONLY;
+  else if (strcmp(mode, "w") == 0)
+    flags = O_WRONLY | O_CREAT | O_TRUNC;
+  else if (strcmp(mode, "a") == 0)
+    flags = O_WRONLY | O_CREAT | O_APPEND;
+  else
+    return throw_from_native(vm, "files open in mode \"r\", \"w\" or \"a\".");
+  int descriptor =
+      open(AS_STRING_CONSTANT(arguments[0])->characters, flags | O_CLOEXEC,
+           0666);
+  if (descriptor < 0)
+    return throw_from_native(vm, strerror(errno));
+  return return_from_native(vm, arguments, INTEGER_CONSTANT(descriptor));
+}
+
+bool read_native(VirtualMachine *vm, Constant *arguments) {
+  int descriptor;
+  if (!get_descriptor(arguments[0], &descriptor) ||
+      !IS_INTEGER_CONSTANT(arguments[1]) ||
+      AS_INTEGER_CONSTANT(arguments[1]) <= 0 ||
+      AS_INTEGER_CONSTANT(arguments[1]) > EVENT_LOOP_MAX_READ_SIZE)
+    return throw_from_native(
+        vm, "can only read a positive number of bytes from a descriptor.");
+  size_t length = (size_t)AS_INTEGER_CONSTANT(arguments[1]);
+  EventOperation operation;
+  operation.kind = EVENT_OPERATION_READ;
+  operation.descriptor = descriptor;
+  operation.data = NULL;
+  operation.buffer = ALLOCATE_OBJECT_MEMORY(vm, char, length + 1);
+  operation.length = length;
+  if (!is_in_task(vm))
+    return perform_operation_now(vm, arguments, &operation);
+  return park_on_operation(vm, arguments, &operation);
+}
+
+bool write_native(VirtualMachine *vm, Constant *arguments) {
+  int descriptor;
+  if (!get_descriptor(arguments[0], &descriptor) ||
+      !IS_STRING_CONSTANT(arguments[1]))
+    return throw_from_native(vm, "can only write a string to a descriptor.");
+  if (descriptor == vm->output.file_descriptor)
+    flush_output_buffer(&vm->output);
+  ObjectString *data = AS_STRING_CONSTANT(arguments[1]);
+  EventOperation operation;
+  operation.kind = EVENT_OPERATION_WRITE;
+  operation.descriptor = descriptor;
+  operation.data = data;
+  operation.buffer = NULL;
+  operation.length = data->length > INT_MAX ? INT_MAX : data->length;
+  if (!is_in_task(vm))
+    return perform_operation_now(vm, arguments, &operation);
+  return park_on_operation(vm, arguments, &operation);
+}
+
+bool close_native(VirtualMachine *vm, Constant *arguments) {
+  EventLoop *loop = &vm->event_loop;
+  int descriptor;
+  if (!get_descriptor(arguments[0], &descriptor))
+    return throw_from_native(vm, "can only close a descriptor.");
+  if ((size_t)descriptor < loop->descriptors_capacity &&
+      loop->descriptor_heads[descriptor] >= 0)
+    return throw_from_native(vm,
+                             "can't close a descriptor a task waits on.");
+  if (descriptor == loop->descriptor ||
+      descriptor == vm->output.file_descriptor)
+    return throw_from_native(
+        vm, "can't close a descriptor the virtual machine uses.");
+  if (loop->backend == EVENT_LOOP_BACKEND_EPOLL)
+    epoll_ctl(loop->descriptor, EPOLL_CTL_DEL, descriptor, NULL);
+  if (close(descriptor) != 0)
+    return throw_from_native(vm, strerror(errno));
+  return return_from_native(vm, arguments, NIL_CONSTANT);
+}
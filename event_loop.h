@@ -0,0 +1,210 @@
+#ifndef interpres_event_loop_h
+#define interpres_event_loop_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "object.h"
+
+/* Here we define the number of submission queue entries of the io_uring ring.
+ * The kernel sizes the completion queue twice as large and keeps the
+ * completions that do not fit, so this only bounds how many operations are
+ * handed over to the kernel by a single system call. */
+#define EVENT_LOOP_RING_ENTRIES 256
+/* Here we define the number of readiness events the epoll backend collects by
+ * a single system call. */
+#define EVENT_LOOP_MAX_EVENTS 64
+/* Here we define the largest number of bytes a single call to "read" can ask
+ * for. */
+#define EVENT_LOOP_MAX_READ_SIZE (1024 * 1024)
+/* This enum lists the ways the event loop can wait for operations: through an
+ * io_uring ring, which reads and writes on behalf of the loop, through epoll,
+ * which only tells the loop when a descriptor is ready so that it reads or
+ * writes itself, or not at all when neither could be set up, in which case
+ * every operation is carried out as soon as it is submitted. */
+typedef enum {
+  EVENT_LOOP_BACKEND_NONE,
+  EVENT_LOOP_BACKEND_IO_URING,
+  EVENT_LOOP_BACKEND_EPOLL,
+} EventLoopBackend;
+/* This enum lists the operations a task can wait for. */
+typedef enum {
+  EVENT_OPERATION_READ,
+  EVENT_OPERATION_WRITE,
+} EventOperationKind;
+/* An operation reads up to "length" bytes from "descriptor" into "buffer",
+ * which becomes the characters of the resulting string, or writes the
+ * characters of the "data" string, on behalf of the parked "task". Free
+ * operations have no task and link to the next free one through "next", while
+ * the operations waiting on the same descriptor are queued through it. */
+typedef struct {
+  EventOperationKind kind;
+  int descriptor;
+  ObjectCoroutine *task;
+  ObjectString *data;
+  char *buffer;
+  size_t length;
+  int next;
+} EventOperation;
+/* A ready task runs next with "value" as the result of the call it was parked
+ * at, which is thrown as an exception instead when "is_error" is set. */
+typedef struct {
+  ObjectCoroutine *task;
+  Constant value;
+  bool is_error;
+} ReadyTask;
+/* The event loop schedules tasks, coroutines that take turns running whenever
+ * another one waits for I/O. Ready tasks are kept in order in the "ready_tasks"
+ * circular buffer, "ready_count" of them from "ready_start" on. Operations are
+ * kept in the "operations" dynamic array so that their index identifies them
+ * to the kernel; "operations_count" of them are in flight and the free ones
+ * are chained from "free_operation". Operations on a descriptor run one after
+ * the other, in the order they were submitted: only the operation at the head
+ * of each queue, whose ends are kept in "descriptor_heads" and
+ * "descriptor_tails" by descriptor, is handed over to the backend. The backend
+ * is set up on the first operation, through the ring or epoll instance
+ * "descriptor"; the io_uring queues are shared with the kernel through the
+ * "submission_ring", "completion_ring" and "submissions" mappings, whose
+ * heads, tails and masks point into them. Submissions accumulate in the ring
+ * and are only handed over once no task is ready, by the same system call that
+ * waits for completions, and every completion available by then is reaped at
+ * once. Tasks run on behalf of "runner", the coroutine that called "run_tasks"
+ * or NULL for the top-level script, while "is_running". */
+typedef struct {
+  EventLoopBackend backend;
+  int descriptor;
+  void *submission_ring;
+  size_t submission_ring_size;
+  void *completion_ring;
+  size_t completion_ring_size;
+  struct io_uring_sqe *submissions;
+  size_t submissions_size;
+  unsigned *submission_head;
+  unsigned *submission_tail;
+  unsigned *submission_mask;
+  unsigned *submission_array;
+  unsigned submission_entries;
+  unsigned *completion_head;
+  unsigned *completion_tail;
+  unsigned *completion_mask;
+  struct io_uring_cqe *completions;
+  size_t operations_used;
+  size_t operations_capacity;
+  EventOperation *operations;
+  int free_operation;
+  size_t operations_count;
+  size_t descriptors_capacity;
+  int *descriptor_heads;
+  int *descriptor_tails;
+  size_t ready_start;
+  size_t ready_count;
+  size_t ready_capacity;
+  ReadyTask *ready_tasks;
+  ObjectCoroutine *runner;
+  bool is_running;
+} EventLoop;
+/*
+ * @brief Initialize a new event loop with no tasks and no backend.
+ *
+ * @param loop A pointer to the event loop to initialize
+ * @return void
+ */
+void init_event_loop(EventLoop *loop);
+/*
+ * @brief Free an event loop.
+ * This function will tear down the backend, dropping the operations still in
+ * flight, and release every queue.
+ *
+ * @param vm A pointer to the virtual machine that owns the event loop
+ * @return void
+ */
+void free_event_loop(VirtualMachine *vm);
+/*
+ * @brief Make a task ready to run.
+ *
+ * @param loop A pointer to the event loop to schedule the task on
+ * @param task A pointer to the task to schedule
+ * @param value The result of the call the task is parked at
+ * @param is_error Whether the value is thrown rather than returned
+ * @return void
+ */
+void schedule_task(EventLoop *loop, ObjectCoroutine *task, Constant value,
+                   bool is_error);
+/*
+ * @brief Take the next ready task off the event loop.
+ *
+ * @param loop A pointer to the event loop to take the task from
+ * @param task A pointer to where the ready task is stored
+ * @return Whether a task was ready or not
+ */
+bool pop_ready_task(EventLoop *loop, ReadyTask *task);
+/*
+ * @brief Wait until at least one operation in flight completes.
+ * This function will hand over the pending submissions, block until the
+ * backend reports completions, and make the task of every completed operation
+ * ready with the string read, the number of bytes written or the error
+ * message.
+ *
+ * @param vm A pointer to the virtual machine that owns the event loop
+ * @return Whether the backend could be waited on or not
+ */
+bool wait_for_event_operations(VirtualMachine *vm);
+/*
+ * @brief Create a task running a function of at most one parameter, which
+ * gets nil, and make it ready.
+ *
+ * @param vm A pointer to the virtual machine running the native
+ * @param arguments A pointer to the function to run
+ * @return Whether no runtime error was reported
+ */
+bool spawn_native(VirtualMachine *vm, Constant *arguments);
+/*
+ * @brief Run the ready tasks, and the ones they spawn, until none is left and
+ * no operation is in flight, or until one of them lets an exception through.
+ *
+ * @param vm A pointer to the virtual machine running the native
+ * @param arguments Unused, since the native takes no arguments
+ * @return Whether no runtime error was reported
+ */
+bool run_tasks_native(VirtualMachine *vm, Constant *arguments);
+/*
+ * @brief Open a file for reading ("r"), writing ("w") or appending ("a") and
+ * return its descriptor. Opening never parks the running task.
+ *
+ * @param vm A pointer to the virtual machine running the native
+ * @param arguments A pointer to the path and the mode
+ * @return Whether no runtime error was reported
+ */
+bool open_native(VirtualMachine *vm, Constant *arguments);
+/*
+ * @brief Read up to a number of bytes from a descriptor and return them as a
+ * string, which is empty at the end of the file. A task is parked until the
+ * bytes arrive, while the rest of the program blocks.
+ *
+ * @param vm A pointer to the virtual machine running the native
+ * @param arguments A pointer to the descriptor and the number of bytes
+ * @return Whether no runtime error was reported
+ */
+bool read_native(VirtualMachine *vm, Constant *arguments);
+/*
+ * @brief Write a string to a descriptor and return the number of bytes
+ * written, which can be less than the length of the string. A task is parked
+ * until the bytes are written, while the rest of the program blocks.
+ *
+ * @param vm A pointer to the virtual machine running the native
+ * @param arguments A pointer to the descriptor and the string
+ * @return Whether no runtime error was reported
+ */
+bool write_native(VirtualMachine *vm, Constant *arguments);
+/*
+ * @brief Close a descriptor no operation is waiting on and that the virtual
+ * machine does not use itself, for its output or its event loop.
+ *
+ * @param vm A pointer to the virtual machine running the native
+ * @param arguments A pointer to the descriptor
+ * @return Whether no runtime error was reported
+ */
+bool close_native(VirtualMachine *vm, Constant *arguments);
+
+#endif
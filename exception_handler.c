@@ -0,0 +1,37 @@
+#include "exception_handler.h"
+#include "memory.h"
+
+void init_exception_handlers_array(ExceptionHandlersArray *array) {
+  array->used = 0;
+  array->capacity = 0;
+  array->values = NULL;
+}
+
+void free_exception_handlers_array(ExceptionHandlersArray *array) {
+  FREE_ARRAY(MEMORY_TAG_EXCEPTION_HANDLERS, ExceptionHandler, array->values,
+             array->capacity);
+  init_exception_handlers_array(array);
+}
+
+void write_exception_handlers_array(ExceptionHandlersArray *array,
+                                    ExceptionHandler handler) {
+  if (array->capacity < array->used + 1) {
+    size_t current_capacity = array->capacity;
+    array->capacity = COMPUTE_ARRAY_CAPACITY(current_capacity);
+    array->values =
+        GROW_ARRAY(MEMORY_TAG_EXCEPTION_HANDLERS, ExceptionHandler,
+                   array->values, current_capacity, array->capacity);
+  }
+  array->values[array->used] = handler;
+  array->used++;
+}
+
+ExceptionHandler *find_exception_handler(ExceptionHandlersArray *array,
+                                         size_t offset) {
+  for (size_t i = 0; i < array->used; i++) {
+    ExceptionHandler *handler = &array->values[i];
+    if (handler->start_offset <= offset && offset < handler->end_offset)
+      return handler;
+  }
+  return NULL;
+}
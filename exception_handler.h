@@ -0,0 +1,69 @@
+#ifndef interpres_exception_handler_h
+#define interpres_exception_handler_h
+
+#include <stdlib.h>
+
+/* An exception handler covers the instructions of a "try" block, from
+ * "start_offset" up to (but excluding) "end_offset", and holds the offset of
+ * the first instruction of its "catch" block along with the depth of the stack
+ * the "catch" block starts with, measured from the first slot of the call
+ * frame and not counting the exception itself. Nothing is executed when
+ * entering or leaving a "try" block: handlers are only looked up once an
+ * exception is thrown. */
+typedef struct {
+  size_t start_offset;
+  size_t end_offset;
+  size_t handler_offset;
+  int stack_depth;
+} ExceptionHandler;
+/* A series of exception handlers is defined as a dynamic array which holds two
+ * counters: "capacity" and "used", which represent respectively the number of
+ * elements in the array and the number of elements that are actually in use.
+ * Handlers of nested "try" blocks always come before the handlers of the
+ * blocks enclosing them, so that the first handler covering an offset is the
+ * innermost one. */
+typedef struct {
+  size_t used;
+  size_t capacity;
+  ExceptionHandler *values;
+} ExceptionHandlersArray;
+/*
+ * @brief Initialize a new array of exception handlers.
+ * We set a starting value of 0 for "used" and "capacity", while the handlers
+ * array starts completely empty; we do not even allocate space for a raw array
+ * of handlers during initialization.
+ *
+ * @param array A pointer to the exception handlers array to initialize
+ * @return void
+ */
+void init_exception_handlers_array(ExceptionHandlersArray *array);
+/*
+ * @brief Free the exception handlers array.
+ * This function will free the memory allocated for the handlers array and
+ * re-initialize it to an empty state by calling
+ * init_exception_handlers_array.
+ *
+ * @param array A pointer to the exception handlers array to free
+ * @return void
+ */
+void free_exception_handlers_array(ExceptionHandlersArray *array);
+/*
+ * @brief Append a new exception handler to the exception handlers array.
+ *
+ * @param array A pointer to the exception handlers array to append to
+ * @param handler The exception handler to append
+ * @return void
+ */
+void write_exception_handlers_array(ExceptionHandlersArray *array,
+                                    ExceptionHandler handler);
+/*
+ * @brief Find the innermost exception handler covering an instruction.
+ *
+ * @param array A pointer to the exception handlers array to search
+ * @param offset The offset of the instruction that threw the exception
+ * @return A pointer to the matching handler or NULL
+ */
+ExceptionHandler *find_exception_handler(ExceptionHandlersArray *array,
+                                         size_t offset);
+
+#endif
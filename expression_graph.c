@@ -0,0 +1,438 @@
+#include "expression_graph.h"
+#include "memory.h"
+#include "verifier.h"
+
+static void init_expression_graph(ExpressionGraph *graph, int stack_depth) {
+  graph->used = 0;
+  graph->capacity = 0;
+  graph->values = NULL;
+  graph->stack_depth = stack_depth;
+  for (int i = 0; i <= UINT8_MAX; i++)
+    graph->local_values[i] = -1;
+  graph->epoch = 0;
+  for (int i = 0; i < EXPRESSION_GRAPH_BUCKETS_COUNT; i++)
+    graph->buckets[i] = -1;
+  graph->temporaries_count = 0;
+}
+
+static void free_expression_graph(ExpressionGraph *graph) {
+  FREE_ARRAY(MEMORY_TAG_OPTIMIZER, ExpressionNode, graph->values,
+             graph->capacity);
+  init_expression_graph(graph, graph->stack_depth);
+}
+
+static int push_expression_node(ExpressionGraph *graph, size_t offset,
+                                uint8_t opcode) {
+  if (graph->capacity < graph->used + 1) {
+    size_t current_capacity = graph->capacity;
+    graph->capacity = COMPUTE_ARRAY_CAPACITY(current_capacity);
+    graph->values = GROW_ARRAY(MEMORY_TAG_OPTIMIZER, ExpressionNode,
+                               graph->values, current_capacity,
+                               graph->capacity);
+  }
+  int index = (int)graph->used;
+  graph->values[index] = (ExpressionNode){
+      .offset = offset,
+      .length = get_instruction_length(opcode),
+      .opcode = opcode,
+      .key_opcode = opcode,
+      .immediate = 0,
+      .first_value = -1,
+      .second_value = -1,
+      .epoch = 0,
+      .next_in_bucket = -1,
+      .value_number = index,
+      .subtree_start = index,
+      .is_pure = false,
+      .is_infallible = false,
+      .is_numeric = false,
+      .holder_slot = -1,
+      .temporary = -1,
+      .is_replaced = false,
+      .is_removed = false,
+  };
+  graph->used++;
+  return index;
+}
+
+static int get_popped_operands_count(Chunk *chunk, size_t offset) {
+  uint8_t *instructions = chunk->instructions.values;
+  switch (instructions[offset]) {
+  case OP_CONSTANT:
+  case OP_ZERO:
+  case OP_ONE:
+  case OP_SMALL_INTEGER:
+  case OP_SHORT_INTEGER:
+  case OP_NIL:
+  case OP_TRUE:
+  case OP_FALSE:
+  case OP_GET_LOCAL:
+  case OP_GET_GLOBAL:
+    return 0;
+  case OP_SET_LOCAL:
+  case OP_SET_GLOBAL:
+  case OP_GET_PROPERTY:
+  case OP_NOT:
+  case OP_NEGATE:
+    return 1;
+  case OP_SET_PROPERTY:
+  case OP_EQUAL:
+  case OP_NOT_EQUAL:
+  case OP_GREATER:
+  case OP_GREATER_EQUAL:
+  case OP_LESS:
+  case OP_LESS_EQUAL:
+  case OP_ADD:
+  case OP_SUBTRACT:
+  case OP_MULTIPLY:
+  case OP_DIVIDE:
+    return 2;
+  case OP_CALL:
+    return instructions[offset + 1] + 1;
+  case OP_INVOKE:
+    return instructions[offset + 2] + 1;
+  default:
+    return -1;
+  }
+}
+
+static bool keys_are_equal(ExpressionNode *first_node,
+                           ExpressionNode *second_node) {
+  return first_node->key_opcode == second_node->key_opcode &&
+         first_node->immediate == second_node->immediate &&
+         first_node->first_value == second_node->first_value &&
+         first_node->second_value == second_node->second_value &&
+         first_node->epoch == second_node->epoch;
+}
+
+static int hash_key(ExpressionNode *node) {
+  uint32_t hash = 2166136261u;
+  int key[] = {node->key_opcode, node->immediate, node->first_value,
+               node->second_value, node->epoch};
+  for (size_t i = 0; i < sizeof(key) / sizeof(key[0]); i++) {
+    hash ^= (uint32_t)key[i];
+    hash *= 16777619;
+  }
+  return (int)(hash % EXPRESSION_GRAPH_BUCKETS_COUNT);
+}
+
+static void insert_keyed_node(ExpressionGraph *graph, int index) {
+  ExpressionNode *node = &graph->values[index];
+  int bucket = hash_key(node);
+  node->next_in_bucket = graph->buckets[bucket];
+  graph->buckets[bucket] = index;
+}
+
+static void number_keyed_node(ExpressionGraph *graph, int index) {
+  ExpressionNode *node = &graph->values[index];
+  for (int other = graph->buckets[hash_key(node)]; other != -1;
+       other = graph->values[other].next_in_bucket) {
+    if (keys_are_equal(&graph->values[other], node)) {
+      node->value_number = graph->values[other].value_number;
+      return;
+    }
+  }
+  insert_keyed_node(graph, index);
+}
+
+static void set_key_operands(ExpressionNode *node, int first_value,
+                             int second_value, bool is_commutative) {
+  if (is_commutative && second_value < first_value) {
+    int swapped_value = first_value;
+    first_value = second_value;
+    second_value = swapped_value;
+  }
+  node->first_value = first_value;
+  node->second_value = second_value;
+}
+
+static void find_holder_slot(ExpressionGraph *graph, int index) {
+  ExpressionNode *node = &graph->values[index];
+  if (node->value_number == index)
+    return;
+  for (int slot = 0; slot < graph->stack_depth; slot++) {
+    if (graph->local_values[slot] == node->value_number) {
+      node->holder_slot = slot;
+      return;
+    }
+  }
+}
+
+static void number_expression_node(ExpressionGraph *graph, Chunk *chunk,
+                                   int index, int *operands,
+                                   int operands_count) {
+  ExpressionNode *nodes = graph->values;
+  ExpressionNode *node = &nodes[index];
+  uint8_t operand =
+      node->length > 1 ? chunk->instructions.values[node->offset + 1] : 0;
+  int first_value = operands_count > 0 ? nodes[operands[0]].value_number : -1;
+  int second_value = operands_count > 1 ? nodes[operands[1]].value_number : -1;
+  bool operands_are_numeric = true;
+  for (int i = 0; i < operands_count; i++)
+    operands_are_numeric =
+        operands_are_numeric && nodes[operands[i]].is_numeric;
+  switch (node->opcode) {
+  case OP_CONSTANT:
+    node->immediate = operand;
+    node->is_pure = true;
+    node->is_infallible = true;
+    node->is_numeric =
+        IS_NUMERIC_CONSTANT(chunk->constants.values[operand]);
+    number_keyed_node(graph, index);
+    break;
+  case OP_ZERO:
+  case OP_ONE:
+  case OP_SMALL_INTEGER:
+  case OP_SHORT_INTEGER:
+    if (node->opcode == OP_SMALL_INTEGER)
+      node->immediate = (int8_t)operand;
+    else if (node->opcode == OP_SHORT_INTEGER)
+      node->immediate = (int16_t)((operand << 8) |
+                                  chunk->instructions.values[node->offset + 2]);
+    node->is_pure = true;
+    node->is_infallible = true;
+    node->is_numeric = true;
+    number_keyed_node(graph, index);
+    break;
+  case OP_NIL:
+  case OP_TRUE:
+  case OP_FALSE:
+  case OP_NOT:
+    set_key_operands(node, first_value, second_value, false);
+    node->is_pure = true;
+    node->is_infallible = true;
+    number_keyed_node(graph, index);
+    break;
+  case OP_GET_LOCAL:
+    if (graph->local_values[operand] == -1)
+      graph->local_values[operand] = index;
+    node->value_number = graph->local_values[operand];
+    node->is_pure = true;
+    node->is_infallible = true;
+    node->is_numeric = nodes[node->value_number].is_numeric;
+    break;
+  case OP_SET_LOCAL:
+    graph->local_values[operand] = first_value;
+    node->value_number = first_value;
+    node->is_infallible = true;
+    node->is_numeric = operands_are_numeric;
+    break;
+  case OP_GET_GLOBAL:
+    node->immediate = operand;
+    node->epoch = graph->epoch;
+    node->is_pure = true;
+    number_keyed_node(graph, index);
+    break;
+  case OP_SET_GLOBAL:
+    graph->epoch++;
+    node->key_opcode = OP_GET_GLOBAL;
+    node->immediate = operand;
+    node->epoch = graph->epoch;
+    node->value_number = first_value;
+    node->is_numeric = operands_are_numeric;
+    insert_keyed_node(graph, index);
+    break;
+  case OP_EQUAL:
+  case OP_NOT_EQUAL:
+    set_key_operands(node, first_value, second_value, true);
+    node->is_pure = true;
+    node->is_infallible = true;
+    number_keyed_node(graph, index);
+    break;
+  case OP_GREATER:
+  case OP_GREATER_EQUAL:
+  case OP_LESS:
+  case OP_LESS_EQUAL:
+    set_key_operands(node, first_value, second_value, false);
+    node->is_pure = true;
+    node->is_infallible = operands_are_numeric;
+    number_keyed_node(graph, index);
+    break;
+  case OP_ADD:
+  case OP_SUBTRACT:
+  case OP_MULTIPLY:
+  case OP_DIVIDE:
+  case OP_NEGATE:
+    set_key_operands(node, first_value, second_value,
+                     node->opcode == OP_MULTIPLY);
+    node->is_pure = true;
+    node->is_infallible = operands_are_numeric;
+    node->is_numeric = operands_are_numeric;
+    number_keyed_node(graph, index);
+    break;
+  case OP_CALL:
+  case OP_INVOKE:
+    graph->epoch++;
+    break;
+  default:
+    break;
+  }
+  for (int i = 0; i < operands_count; i++) {
+    node->is_pure = node->is_pure && nodes[operands[i]].is_pure;
+    node->is_infallible =
+        node->is_infallible && nodes[operands[i]].is_infallible;
+  }
+  if (node->is_pure)
+    find_holder_slot(graph, index);
+}
+
+static bool lift_expression(ExpressionGraph *graph, Chunk *chunk,
+                            size_t expression_start) {
+  int stack[VERIFIER_MAX_STACK_DEPTH];
+  int depth = 0;
+  InstructionsArray *instructions = &chunk->instructions;
+  size_t offset = expression_start;
+  while (offset < instructions->used) {
+    uint8_t opcode = instructions->values[offset];
+    int operands_count = get_popped_operands_count(chunk, offset);
+    if (operands_count < 0 || operands_count > depth ||
+        offset + (size_t)get_instruction_length(opcode) > instructions->used)
+      return false;
+    int index = push_expression_node(graph, offset, opcode);
+    depth -= operands_count;
+    if (operands_count > 0)
+      graph->values[index].subtree_start =
+          graph->values[stack[depth]].subtree_start;
+    number_expression_node(graph, chunk, index, &stack[depth],
+                           operands_count);
+    if (depth == VERIFIER_MAX_STACK_DEPTH)
+      return false;
+    stack[depth++] = index;
+    offset += (size_t)get_instruction_length(opcode);
+  }
+  return depth == 1;
+}
+
+static bool subtree_keeps_temporary(ExpressionGraph *graph, int index) {
+  for (int i = graph->values[index].subtree_start; i < index; i++)
+    if (graph->values[i].temporary >= 0)
+      return true;
+  return false;
+}
+
+static int select_replacements(ExpressionGraph *graph, bool uses_temporaries,
+                               int *saved_instructions) {
+  ExpressionNode *nodes = graph->values;
+  int replacements_count = 0;
+  int removed_start = (int)graph->used;
+  graph->temporaries_count = 0;
+  *saved_instructions = 0;
+  for (int i = 0; i < (int)graph->used; i++) {
+    nodes[i].temporary = -1;
+    nodes[i].is_replaced = false;
+    nodes[i].is_removed = false;
+  }
+  for (int i = (int)graph->used - 1; i >= 0; i--) {
+    ExpressionNode *node = &nodes[i];
+    if (i >= removed_start) {
+      node->is_removed = true;
+      continue;
+    }
+    if (!node->is_pure || node->subtree_start == i ||
+        node->value_number >= node->subtree_start ||
+        subtree_keeps_temporary(graph, i))
+      continue;
+    if (node->holder_slot < 0) {
+      ExpressionNode *definition = &nodes[node->value_number];
+      if (!uses_temporaries)
+        continue;
+      if (definition->temporary < 0) {
+        if (graph->temporaries_count == EXPRESSION_GRAPH_MAX_TEMPORARIES ||
+            graph->stack_depth + graph->temporaries_count >= UINT8_MAX)
+          continue;
+        definition->temporary = graph->temporaries_count++;
+      }
+      *saved_instructions += i - node->subtree_start;
+    }
+    node->is_replaced = true;
+    removed_start = node->subtree_start;
+    replacements_count++;
+  }
+  return replacements_count;
+}
+
+static void write_lowered_instruction(InstructionsArray *lowered,
+                                      uint8_t instruction, uint8_t operand,
+                                      size_t line_number) {
+  write_instructions_array(lowered, instruction, line_number);
+  write_instructions_array(lowered, operand, line_number);
+}
+
+static void lower_expression(ExpressionGraph *graph, Chunk *chunk,
+                             size_t expression_start, size_t *root_offset) {
+  InstructionsArray *instructions = &chunk->instructions;
+  InstructionsArray lowered;
+  init_instructions_array(&lowered);
+  for (int i = 0; i < graph->temporaries_count; i++)
+    write_instructions_array(&lowered, OP_NIL,
+                             instructions->line_numbers[expression_start]);
+  *root_offset = SIZE_MAX;
+  for (size_t i = 0; i < graph->used; i++) {
+    ExpressionNode *node = &graph->values[i];
+    size_t line_number = instructions->line_numbers[node->offset];
+    if (node->is_removed)
+      continue;
+    if (node->is_replaced) {
+      int slot = node->holder_slot >= 0
+                     ? node->holder_slot
+                     : graph->stack_depth +
+                           graph->values[node->value_number].temporary;
+      write_lowered_instruction(&lowered, OP_GET_LOCAL, (uint8_t)slot,
+                                line_number);
+    } else {
+      if (i == graph->used - 1)
+        *root_offset = expression_start + lowered.used;
+      for (int j = 0; j < node->length; j++)
+        write_instructions_array(&lowered,
+                                 instructions->values[node->offset + j],
+                                 instructions->line_numbers[node->offset + j]);
+    }
+    if (node->temporary >= 0)
+      write_lowered_instruction(
+          &lowered, OP_SET_LOCAL,
+          (uint8_t)(graph->stack_depth + node->temporary), line_number);
+  }
+  if (graph->temporaries_count > 0) {
+    size_t line_number = lowered.line_numbers[lowered.used - 1];
+    write_lowered_instruction(&lowered, OP_SET_LOCAL,
+                              (uint8_t)graph->stack_depth, line_number);
+    for (int i = 0; i < graph->temporaries_count; i++)
+      write_instructions_array(&lowered, OP_POP, line_number);
+    *root_offset = SIZE_MAX;
+  }
+  instructions->used = expression_start;
+  for (size_t i = 0; i < lowered.used; i++)
+    write_instructions_array(instructions, lowered.values[i],
+                             lowered.line_numbers[i]);
+  free_instructions_array(&lowered);
+}
+
+bool optimize_expression_bytecode(Chunk *chunk, size_t expression_start,
+                                  int stack_depth, bool is_value_used,
+                                  size_t *root_offset) {
+  ExpressionGraph graph;
+  init_expression_graph(&graph, stack_depth);
+  bool is_changed = false;
+  *root_offset = SIZE_MAX;
+  if (lift_expression(&graph, chunk, expression_start)) {
+    ExpressionNode *root = &graph.values[graph.used - 1];
+    int saved_instructions;
+    if (!is_value_used && root->is_pure && root->is_infallible) {
+      chunk->instructions.used = expression_start;
+      is_changed = true;
+    } else {
+      int replacements_count =
+          select_replacements(&graph, true, &saved_instructions);
+      if (graph.temporaries_count > 0 &&
+          saved_instructions <= 3 * graph.temporaries_count + 1)
+        replacements_count =
+            select_replacements(&graph, false, &saved_instructions);
+      if (replacements_count > 0) {
+        lower_expression(&graph, chunk, expression_start, root_offset);
+        is_changed = true;
+      }
+    }
+  }
+  free_expression_graph(&graph);
+  return is_changed;
+}
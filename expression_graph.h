@@ -0,0 +1,91 @@
+#ifndef interpres_expression_graph_h
+#define interpres_expression_graph_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "chunk.h"
+
+/* Here we define the number of values an expression can keep aside in
+ * temporary stack slots so that they are reused instead of computed again. */
+#define EXPRESSION_GRAPH_MAX_TEMPORARIES 16
+/* Here we define the number of buckets the nodes of an expression graph are
+ * hashed into when looking for a node that computes the same value. */
+#define EXPRESSION_GRAPH_BUCKETS_COUNT 256
+/* Every instruction of an expression becomes a node of its graph. Since the
+ * operands a node pops were pushed by the nodes right before it, the nodes that
+ * compute a value, its subtree, always form a contiguous run that starts at
+ * "subtree_start" and ends with the node itself. Every node is given a value
+ * number, which is the index of the first node known to compute the same value:
+ * value numbers are therefore the SSA names of the values of the expression,
+ * and local variables map to the value number they were last assigned. Two
+ * keyed nodes get the same value number whenever they apply the same operation
+ * ("key_opcode" and "immediate") to the same value numbers; reads of global
+ * variables are also keyed by the epoch they happen in, which every call and
+ * global assignment starts anew; the keyed nodes of a bucket are chained
+ * through "next_in_bucket". A node is pure when neither it nor its subtree has
+ * side effects, infallible when none of them can raise a runtime error, and
+ * numeric when its value is known to be a number. A pure node that
+ * recomputes a value which is already held by a local variable or kept aside
+ * in a temporary slot is replaced by a read of "holder_slot", and the rest of
+ * its subtree is removed. */
+typedef struct {
+  size_t offset;
+  int length;
+  uint8_t opcode;
+  uint8_t key_opcode;
+  int immediate;
+  int first_value;
+  int second_value;
+  int epoch;
+  int next_in_bucket;
+  int value_number;
+  int subtree_start;
+  bool is_pure;
+  bool is_infallible;
+  bool is_numeric;
+  int holder_slot;
+  int temporary;
+  bool is_replaced;
+  bool is_removed;
+} ExpressionNode;
+/* An expression graph is a dynamic array of nodes, along with the depth of the
+ * stack right before the expression, which is where its temporary slots start,
+ * the value number every local variable slot holds (-1 until it is first read
+ * or assigned), the current epoch, the first keyed node of every bucket and
+ * the number of temporary slots in use. */
+typedef struct {
+  size_t used;
+  size_t capacity;
+  ExpressionNode *values;
+  int stack_depth;
+  int local_values[UINT8_MAX + 1];
+  int epoch;
+  int buckets[EXPRESSION_GRAPH_BUCKETS_COUNT];
+  int temporaries_count;
+} ExpressionGraph;
+/*
+ * @brief Optimize the bytecode of an expression.
+ * This function will lift the instructions from "expression_start" to the end
+ * of the chunk into an expression graph, number its values, replace the
+ * subtrees that recompute a value which is still available by a read of the
+ * slot holding it and lower the graph back to bytecode in place. Expressions
+ * whose bytecode contains jumps are left untouched. When the value of the
+ * expression is not used and computing it can neither have side effects nor
+ * fail, the expression is removed from the chunk altogether.
+ *
+ * @param chunk A pointer to the chunk the expression was compiled into
+ * @param expression_start The offset of the expression's first instruction
+ * @param stack_depth The depth of the stack right before the expression
+ * @param is_value_used Whether the value of the expression is used
+ * @param root_offset A pointer to where to store the offset the expression's
+ * last instruction was moved to, or SIZE_MAX if the expression no longer ends
+ * with it
+ * @return Whether the bytecode of the expression was changed
+ */
+bool optimize_expression_bytecode(Chunk *chunk, size_t expression_start,
+                                  int stack_depth, bool is_value_used,
+                                  size_t *root_offset);
+
+#endif
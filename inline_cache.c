@@ -0,0 +1,40 @@
+#include "inline_cache.h"
+#include "memory.h"
+
+void init_inline_caches_array(InlineCachesArray *array) {
+  array->used = 0;
+  array->capacity = 0;
+  array->values = NULL;
+}
+
+void free_inline_caches_array(InlineCachesArray *array) {
+  FREE_ARRAY(MEMORY_TAG_INLINE_CACHES, InlineCache, array->values,
+             array->capacity);
+  init_inline_caches_array(array);
+}
+
+size_t write_inline_caches_array(InlineCachesArray *array) {
+  if (array->capacity < array->used + 1) {
+    size_t current_capacity = array->capacity;
+    array->capacity = COMPUTE_ARRAY_CAPACITY(current_capacity);
+    array->values =
+        GROW_ARRAY(MEMORY_TAG_INLINE_CACHES, InlineCache, array->values,
+                   current_capacity, array->capacity);
+  }
+  array->values[array->used] = (InlineCache){0};
+  array->used++;
+  return array->used - 1;
+}
+
+bool record_inline_cache_entry(InlineCache *cache, InlineCacheEntry entry) {
+  if (cache->is_megamorphic)
+    return false;
+  if (cache->entries_count == INLINE_CACHE_ENTRIES) {
+    cache->is_megamorphic = true;
+    cache->entries_count = 0;
+    return false;
+  }
+  cache->entries[cache->entries_count] = entry;
+  cache->entries_count++;
+  return true;
+}
@@ -0,0 +1,100 @@
+#ifndef interpres_inline_cache_h
+#define interpres_inline_cache_h
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+/* Here we define the number of shapes a single inline cache can remember. A
+ * cache that has seen a single shape is monomorphic, one that has seen up to
+ * this many shapes is polymorphic, while a cache that has seen more than that
+ * gives up and becomes megamorphic, falling back to a full lookup every time it
+ * is executed. */
+#define INLINE_CACHE_ENTRIES 4
+/* Shapes and functions are objects, whose layout is defined in object.h. */
+typedef struct ObjectShape ObjectShape;
+typedef struct ObjectFunction ObjectFunction;
+/* Each entry of an inline cache records how a property was resolved the last
+ * time an instance with the given shape went through the cache: either as the
+ * field stored at index "slot" of the instance, or as the method "method" of
+ * the instance's class. Entries that belong to a property assignment which
+ * added a new field also record the shape the instance transitions to. */
+typedef struct {
+  ObjectShape *shape;
+  ObjectShape *transition;
+  ObjectFunction *method;
+  int slot;
+} InlineCacheEntry;
+/* An inline cache belongs to a single property access or method invocation
+ * instruction and remembers the shapes of the instances it has seen so far. */
+typedef struct {
+  int entries_count;
+  bool is_megamorphic;
+  InlineCacheEntry entries[INLINE_CACHE_ENTRIES];
+} InlineCache;
+/* A series of inline caches is defined as a dynamic array which holds two
+ * counters: "capacity" and "used", which represent respectively the number of
+ * elements in the array and the number of elements that are actually in use.
+ * Instructions refer to their cache through its index in the array. */
+typedef struct {
+  size_t used;
+  size_t capacity;
+  InlineCache *values;
+} InlineCachesArray;
+/*
+ * @brief Initialize a new array of inline caches.
+ * We set a starting value of 0 for "used" and "capacity", while the caches
+ * array starts completely empty; we do not even allocate space for a raw array
+ * of caches during initialization.
+ *
+ * @param array A pointer to the inline caches array to initialize
+ * @return void
+ */
+void init_inline_caches_array(InlineCachesArray *array);
+/*
+ * @brief Free the inline caches array.
+ * This function will free the memory allocated for the caches array and
+ * re-initialize it to an empty state by calling init_inline_caches_array.
+ * Shapes and methods referenced by the caches are not freed: they are owned by
+ * the garbage collector.
+ *
+ * @param array A pointer to the inline caches array to free
+ * @return void
+ */
+void free_inline_caches_array(InlineCachesArray *array);
+/*
+ * @brief Append a new, empty inline cache to the inline caches array.
+ *
+ * @param array A pointer to the inline caches array to append the cache to
+ * @return The index of the caches array where the cache was added
+ */
+size_t write_inline_caches_array(InlineCachesArray *array);
+/*
+ * @brief Find the entry of an inline cache that matches a shape.
+ * The first entry is checked before entering the loop, so that a monomorphic
+ * cache hit costs a single comparison.
+ *
+ * @param cache A pointer to the inline cache to search
+ * @param shape A pointer to the shape to look for
+ * @return A pointer to the matching entry or NULL
+ */
+static inline InlineCacheEntry *find_inline_cache_entry(InlineCache *cache,
+                                                        ObjectShape *shape) {
+  if (cache->entries_count > 0 && cache->entries[0].shape == shape)
+    return &cache->entries[0];
+  for (int i = 1; i < cache->entries_count; i++)
+    if (cache->entries[i].shape == shape)
+      return &cache->entries[i];
+  return NULL;
+}
+/*
+ * @brief Record a new entry into an inline cache.
+ * If the cache is already full, it is turned megamorphic and the entry is
+ * dropped; megamorphic caches never record any entry again.
+ *
+ * @param cache A pointer to the inline cache to record the entry into
+ * @param entry The entry to record
+ * @return Whether the entry was recorded or not
+ */
+bool record_inline_cache_entry(InlineCache *cache, InlineCacheEntry entry);
+
+#endif
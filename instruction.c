@@ -9,8 +9,9 @@ void init_instructions_array(InstructionsArray *array) {
 }
 
 void free_instructions_array(InstructionsArray *array) {
-  FREE_ARRAY(uint8_t, array->values, array->capacity);
-  FREE_ARRAY(size_t, array->line_numbers, array->capacity);
+  FREE_ARRAY(MEMORY_TAG_INSTRUCTIONS, uint8_t, array->values, array->capacity);
+  FREE_ARRAY(MEMORY_TAG_LINE_NUMBERS, size_t, array->line_numbers,
+             array->capacity);
   init_instructions_array(array);
 }
 
@@ -19,10 +20,11 @@ void write_instructions_array(InstructionsArray *array, uint8_t value,
   if (array->capacity < array->used + 1) {
     size_t current_capacity = array->capacity;
     array->capacity = COMPUTE_ARRAY_CAPACITY(current_capacity);
-    array->values =
-        GROW_ARRAY(uint8_t, array->values, current_capacity, array->capacity);
-    array->line_numbers = GROW_ARRAY(size_t, array->line_numbers,
-                                     current_capacity, array->capacity);
+    array->values = GROW_ARRAY(MEMORY_TAG_INSTRUCTIONS, uint8_t, array->values,
+                               current_capacity, array->capacity);
+    array->line_numbers =
+        GROW_ARRAY(MEMORY_TAG_LINE_NUMBERS, size_t, array->line_numbers,
+                   current_capacity, array->capacity);
   }
   array->values[array->used] = value;
   array->line_numbers[array->used] = line_number;
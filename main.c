@@ -1,8 +1,51 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
+#include "compiler.h"
+#include "disassembler.h"
+#include "memory.h"
+#include "server.h"
+#include "snapshot.h"
+#include "verifier.h"
 #include "vm.h"
 
 #define MAX_INPUT_LENGTH 1024
+#define MAX_BREAKPOINTS 64
+#define PROFILE_FILE_EXTENSION ".folded"
+
+static OutputBuffer debugger_output;
+
+static DebuggerAction debug_instruction(VirtualMachine *vm,
+                                        ObjectFunction *function,
+                                        size_t offset, void *context) {
+  (void)context;
+  const char *name =
+      function->name == NULL ? "script" : function->name->characters;
+  if (vm->debugger.is_stepping) {
+    fprintf(stderr, "%-16s ", name);
+    disassemble_instruction(stderr, &function->chunk, offset);
+    return DEBUGGER_ACTION_STEP;
+  }
+  CallFrame *frame = &vm->frames[vm->frame_count - 1];
+  write_output_string(&debugger_output, "[line:");
+  write_output_integer(
+      &debugger_output,
+      (int64_t)function->chunk.instructions.line_numbers[offset]);
+  write_output_string(&debugger_output, "] breakpoint in ");
+  write_output_string(&debugger_output, name);
+  write_output_string(&debugger_output, "():");
+  for (Constant *slot = frame->slots; slot < vm->stack_pointer; slot++) {
+    write_output_string(&debugger_output, " [");
+    print_constant(&debugger_output, *slot);
+    write_output_string(&debugger_output, "]");
+  }
+  write_output_string(&debugger_output, "\n");
+  flush_output_buffer(&debugger_output);
+  return DEBUGGER_ACTION_CONTINUE;
+}
 
 static void repl(VirtualMachine *vm) {
   char input[MAX_INPUT_LENGTH];
@@ -41,16 +84,162 @@ static void run_input(VirtualMachine *vm, const char *input_path) {
     exit(EXIT_FAILURE);
 }
 
+static void profile_input(VirtualMachine *vm, const char *input_path) {
+  char *input = read_input(input_path);
+  if (!start_profiler(vm))
+    exit(EXIT_FAILURE);
+  InterpretationResult interpretation_result = interpret_input(vm, input);
+  stop_profiler(vm);
+  free(input);
+  size_t input_path_length = strlen(input_path);
+  char *profile_path =
+      (char *)malloc(input_path_length + sizeof(PROFILE_FILE_EXTENSION));
+  if (profile_path == NULL)
+    exit(EXIT_FAILURE);
+  memcpy(profile_path, input_path, input_path_length);
+  memcpy(profile_path + input_path_length, PROFILE_FILE_EXTENSION,
+         sizeof(PROFILE_FILE_EXTENSION));
+  FILE *folded_stacks = fopen(profile_path, "w");
+  free(profile_path);
+  if (folded_stacks == NULL)
+    exit(EXIT_FAILURE);
+  write_profiler_report(&vm->profiler, stderr, folded_stacks);
+  fclose(folded_stacks);
+  if (interpretation_result == INTERPRETATION_COMPILE_ERROR ||
+      interpretation_result == INTERPRETATION_RUNTIME_ERROR)
+    exit(EXIT_FAILURE);
+}
+
+static void dump_input(VirtualMachine *vm, const char *input_path) {
+  char *input = read_input(input_path);
+  ObjectFunction *function = compile_input(vm, input);
+  free(input);
+  if (function == NULL || !verify_function(function))
+    exit(EXIT_FAILURE);
+  BytecodeStatistics statistics;
+  init_bytecode_statistics(&statistics);
+  disassemble_function(stdout, function, &statistics);
+  write_bytecode_statistics(stdout, &statistics);
+}
+
+static size_t parse_size(const char *argument) {
+  char *argument_end;
+  errno = 0;
+  unsigned long long size = strtoull(argument, &argument_end, 10);
+  if (errno != 0 || argument_end == argument || *argument_end != '\0' ||
+      argument[0] == '-' || size > SIZE_MAX)
+    exit(EXIT_FAILURE);
+  return (size_t)size;
+}
+
+static void report_memory(void) { write_memory_report(stderr); }
+
 int main(int argc, char *argv[]) {
+  bool is_profiling = false;
+  bool dumps_bytecode = false;
+  bool is_lazy = false;
+  bool is_optimized = false;
+  bool runs_on_registers = false;
+  size_t tier_up_threshold = TIER_UP_THRESHOLD;
+  bool traces_tiering = false;
+  bool traces_execution = false;
+  bool allows_io = false;
+  size_t breakpoint_lines[MAX_BREAKPOINTS];
+  int breakpoints_count = 0;
+  const char *load_snapshot_path = NULL;
+  const char *save_snapshot_path = NULL;
+  size_t fuel = SIZE_MAX;
+  size_t heap_limit = SIZE_MAX;
+  const char *serve_path = NULL;
+  size_t workers_count = SERVER_DEFAULT_WORKERS;
+  int argument_index = 1;
+  for (; argument_index < argc && strncmp(argv[argument_index], "--", 2) == 0;
+       argument_index++) {
+    if (strcmp(argv[argument_index], "--profile") == 0)
+      is_profiling = true;
+    else if (strcmp(argv[argument_index], "--dump-bytecode") == 0)
+      dumps_bytecode = true;
+    else if (strcmp(argv[argument_index], "--lazy") == 0)
+      is_lazy = true;
+    else if (strcmp(argv[argument_index], "--optimize") == 0)
+      is_optimized = true;
+    else if (strcmp(argv[argument_index], "--registers") == 0)
+      runs_on_registers = true;
+    else if (strcmp(argv[argument_index], "--tier-up-threshold") == 0 &&
+             argument_index + 1 < argc)
+      tier_up_threshold = parse_size(argv[++argument_index]);
+    else if (strcmp(argv[argument_index], "--trace-tiering") == 0)
+      traces_tiering = true;
+    else if (strcmp(argv[argument_index], "--trace-execution") == 0)
+      traces_execution = true;
+    else if (strcmp(argv[argument_index], "--allow-io") == 0)
+      allows_io = true;
+    else if (strcmp(argv[argument_index], "--breakpoint") == 0 &&
+             argument_index + 1 < argc && breakpoints_count < MAX_BREAKPOINTS)
+      breakpoint_lines[breakpoints_count++] =
+          parse_size(argv[++argument_index]);
+    else if (strcmp(argv[argument_index], "--memory-report") == 0)
+      atexit(report_memory);
+    else if (strcmp(argv[argument_index], "--load-snapshot") == 0 &&
+             argument_index + 1 < argc)
+      load_snapshot_path = argv[++argument_index];
+    else if (strcmp(argv[argument_index], "--save-snapshot") == 0 &&
+             argument_index + 1 < argc)
+      save_snapshot_path = argv[++argument_index];
+    else if (strcmp(argv[argument_index], "--fuel") == 0 &&
+             argument_index + 1 < argc)
+      fuel = parse_size(argv[++argument_index]);
+    else if (strcmp(argv[argument_index], "--heap-limit") == 0 &&
+             argument_index + 1 < argc)
+      heap_limit = parse_size(argv[++argument_index]);
+    else if (strcmp(argv[argument_index], "--serve") == 0 &&
+             argument_index + 1 < argc)
+      serve_path = argv[++argument_index];
+    else if (strcmp(argv[argument_index], "--workers") == 0 &&
+             argument_index + 1 < argc)
+      workers_count = parse_size(argv[++argument_index]);
+    else
+      exit(EXIT_FAILURE);
+  }
+  if (argc - argument_index > 1 ||
+      ((is_profiling || dumps_bytecode || save_snapshot_path != NULL) &&
+       argument_index == argc) ||
+      (serve_path != NULL && (is_profiling || dumps_bytecode || allows_io)))
+    exit(EXIT_FAILURE);
   VirtualMachine vm;
   init_vm(&vm);
-  if (argc == 1) {
-    repl(&vm);
-  } else if (argc == 2) {
-    run_input(&vm, argv[1]);
-  } else {
+  vm.compiles_lazily = is_lazy;
+  vm.optimizes_expressions = is_optimized;
+  vm.runs_on_registers = runs_on_registers;
+  vm.tier_up_threshold = tier_up_threshold == 0 ? SIZE_MAX : tier_up_threshold;
+  vm.traces_tiering = traces_tiering;
+  vm.fuel = fuel;
+  vm.collector.heap_limit = heap_limit;
+  if (allows_io)
+    allow_io(&vm);
+  if (load_snapshot_path != NULL && !read_snapshot(&vm, load_snapshot_path))
     exit(EXIT_FAILURE);
+  if (traces_execution || breakpoints_count > 0) {
+    init_output_buffer(&debugger_output, OUTPUT_STANDARD_ERROR);
+    attach_debugger(&vm, debug_instruction, NULL, traces_execution);
+    for (int i = 0; i < breakpoints_count; i++)
+      add_breakpoint(&vm, breakpoint_lines[i]);
   }
+  if (serve_path != NULL) {
+    if (argument_index < argc)
+      run_input(&vm, argv[argument_index]);
+    if (!serve_requests(&vm, serve_path, workers_count, fuel))
+      exit(EXIT_FAILURE);
+  } else if (argument_index == argc)
+    repl(&vm);
+  else if (dumps_bytecode)
+    dump_input(&vm, argv[argument_index]);
+  else if (is_profiling)
+    profile_input(&vm, argv[argument_index]);
+  else
+    run_input(&vm, argv[argument_index]);
+  if (save_snapshot_path != NULL && !write_snapshot(&vm, save_snapshot_path))
+    exit(EXIT_FAILURE);
   free_vm(&vm);
   return EXIT_SUCCESS;
 }
@@ -1,7 +1,76 @@
+#include <string.h>
+
 #include "memory.h"
 
-void *reallocate_array(void *current_array, size_t current_capacity,
-                       size_t new_capacity) {
+static MemoryStatistics memory_statistics = {
+    .next_growth_threshold = MEMORY_GROWTH_LOG_THRESHOLD};
+
+static const char *memory_tag_names[MEMORY_TAG_COUNT] = {
+    [MEMORY_TAG_INSTRUCTIONS] = "instructions",
+    [MEMORY_TAG_LINE_NUMBERS] = "line numbers",
+    [MEMORY_TAG_CONSTANTS] = "constants",
+    [MEMORY_TAG_INLINE_CACHES] = "inline caches",
+    [MEMORY_TAG_EXCEPTION_HANDLERS] = "exception handlers",
+    [MEMORY_TAG_REGISTER_INSTRUCTIONS] = "register instructions",
+    [MEMORY_TAG_QUICKENING] = "quickening",
+    [MEMORY_TAG_TABLES] = "tables",
+    [MEMORY_TAG_OBJECTS] = "objects",
+    [MEMORY_TAG_COLLECTOR] = "collector",
+    [MEMORY_TAG_VERIFIER] = "verifier",
+    [MEMORY_TAG_TRANSLATOR] = "translator",
+    [MEMORY_TAG_OPTIMIZER] = "optimizer",
+    [MEMORY_TAG_PROFILER] = "profiler",
+    [MEMORY_TAG_DEBUGGER] = "debugger",
+    [MEMORY_TAG_SNAPSHOT] = "snapshot",
+    [MEMORY_TAG_SERVER] = "server",
+    [MEMORY_TAG_EVENT_LOOP] = "event loop",
+};
+
+static void log_memory_growth(MemoryTag tag, size_t allocation_size) {
+  MemoryStatistics *statistics = &memory_statistics;
+  if (statistics->peak_bytes < statistics->next_growth_threshold)
+    return;
+  if (statistics->growth_events_used < MEMORY_GROWTH_LOG_SIZE) {
+    MemoryGrowthEvent *event =
+        &statistics->growth_events[statistics->growth_events_used++];
+    event->tag = tag;
+    event->allocation_size = allocation_size;
+    event->live_bytes = statistics->live_bytes;
+    event->allocations = statistics->allocations;
+  }
+  while (statistics->next_growth_threshold <= statistics->peak_bytes)
+    statistics->next_growth_threshold *= 2;
+}
+
+static void account_reallocation(MemoryTag tag, void *current_array,
+                                 size_t current_capacity,
+                                 size_t new_capacity) {
+  MemoryStatistics *statistics = &memory_statistics;
+  MemoryTagStatistics *tag_statistics = &statistics->tags[tag];
+  if (current_array == NULL) {
+    current_capacity = 0;
+    if (new_capacity == 0)
+      return;
+    tag_statistics->allocations++;
+    statistics->allocations++;
+  } else if (new_capacity == 0) {
+    tag_statistics->frees++;
+  } else {
+    tag_statistics->reallocations++;
+  }
+  tag_statistics->live_bytes += new_capacity - current_capacity;
+  statistics->live_bytes += new_capacity - current_capacity;
+  if (tag_statistics->live_bytes > tag_statistics->peak_bytes)
+    tag_statistics->peak_bytes = tag_statistics->live_bytes;
+  if (statistics->live_bytes > statistics->peak_bytes) {
+    statistics->peak_bytes = statistics->live_bytes;
+    log_memory_growth(tag, new_capacity);
+  }
+}
+
+void *reallocate_array(MemoryTag tag, void *current_array,
+                       size_t current_capacity, size_t new_capacity) {
+  account_reallocation(tag, current_array, current_capacity, new_capacity);
   if (new_capacity == 0) {
     free(current_array);
     return NULL;
@@ -11,3 +80,37 @@ void *reallocate_array(void *current_array, size_t current_capacity,
     exit(EXIT_FAILURE);
   return new_array;
 }
+
+const MemoryStatistics *get_memory_statistics(void) {
+  return &memory_statistics;
+}
+
+void write_memory_report(FILE *report) {
+  MemoryStatistics *statistics = &memory_statistics;
+  int name_width = (int)strlen("memory");
+  for (int i = 0; i < MEMORY_TAG_COUNT; i++) {
+    int name_length = (int)strlen(memory_tag_names[i]);
+    if (name_length > name_width)
+      name_width = name_length;
+  }
+  fprintf(report, "%-*s %12s %12s %12s %12s %12s\n", name_width, "memory",
+          "live", "peak", "allocations", "resizes", "frees");
+  for (int i = 0; i < MEMORY_TAG_COUNT; i++) {
+    MemoryTagStatistics *tag_statistics = &statistics->tags[i];
+    fprintf(report, "%-*s %12zu %12zu %12zu %12zu %12zu\n", name_width,
+            memory_tag_names[i], tag_statistics->live_bytes,
+            tag_statistics->peak_bytes, tag_statistics->allocations,
+            tag_statistics->reallocations, tag_statistics->frees);
+  }
+  fprintf(report, "%-*s %12zu %12zu %12zu\n", name_width, "total",
+          statistics->live_bytes, statistics->peak_bytes,
+          statistics->allocations);
+  for (size_t i = 0; i < statistics->growth_events_used; i++) {
+    MemoryGrowthEvent *event = &statistics->growth_events[i];
+    fprintf(report,
+            "growth: %zu live bytes after %zu allocations, while "
+            "allocating %zu bytes of %s\n",
+            event->live_bytes, event->allocations, event->allocation_size,
+            memory_tag_names[event->tag]);
+  }
+}
@@ -1,6 +1,7 @@
 #ifndef interpres_memory_h
 #define interpres_memory_h
 
+#include <stdio.h>
 #include <stdlib.h>
 
 /* Here we define a heuristic value for the growth operation of a dynamic array.
@@ -11,6 +12,68 @@
  * array when we need to grow it. A value of 2 means that we will double the
  * size of the array every time we need to grow it. */
 #define GROWTH_FACTOR 2
+/* Here we define the number of growth events the memory accounting keeps. A
+ * growth event is logged every time the peak number of live bytes doubles,
+ * starting from MEMORY_GROWTH_LOG_THRESHOLD bytes; once the log is full, the
+ * latest events are dropped. */
+#define MEMORY_GROWTH_LOG_SIZE 64
+#define MEMORY_GROWTH_LOG_THRESHOLD (64 * 1024)
+/* Every allocation is tagged with the subsystem it belongs to, so that the
+ * memory accounting can tell how much memory each of them holds. */
+typedef enum {
+  MEMORY_TAG_INSTRUCTIONS,
+  MEMORY_TAG_LINE_NUMBERS,
+  MEMORY_TAG_CONSTANTS,
+  MEMORY_TAG_INLINE_CACHES,
+  MEMORY_TAG_EXCEPTION_HANDLERS,
+  MEMORY_TAG_REGISTER_INSTRUCTIONS,
+  MEMORY_TAG_QUICKENING,
+  MEMORY_TAG_TABLES,
+  MEMORY_TAG_OBJECTS,
+  MEMORY_TAG_COLLECTOR,
+  MEMORY_TAG_VERIFIER,
+  MEMORY_TAG_TRANSLATOR,
+  MEMORY_TAG_OPTIMIZER,
+  MEMORY_TAG_PROFILER,
+  MEMORY_TAG_DEBUGGER,
+  MEMORY_TAG_SNAPSHOT,
+  MEMORY_TAG_SERVER,
+  MEMORY_TAG_EVENT_LOOP,
+  MEMORY_TAG_COUNT,
+} MemoryTag;
+/* These counters describe the memory held by a single tag: the number of bytes
+ * currently allocated, the highest that number has ever been, and how many
+ * blocks were allocated, resized and freed. */
+typedef struct {
+  size_t live_bytes;
+  size_t peak_bytes;
+  size_t allocations;
+  size_t reallocations;
+  size_t frees;
+} MemoryTagStatistics;
+/* A growth event records the moment the peak number of live bytes crossed a
+ * new threshold: the tag and the size of the allocation that crossed it, and
+ * the number of live bytes and allocations up to that moment. */
+typedef struct {
+  MemoryTag tag;
+  size_t allocation_size;
+  size_t live_bytes;
+  size_t allocations;
+} MemoryGrowthEvent;
+/* The memory accounting keeps track of every block allocated through
+ * reallocate_array, for each tag and across all of them, along with the log of
+ * growth events, of which "growth_events_used" are in use, and the peak that
+ * has to be reached to log the next one. An allocation that doubles the peak
+ * more than once is logged once. */
+typedef struct {
+  MemoryTagStatistics tags[MEMORY_TAG_COUNT];
+  size_t live_bytes;
+  size_t peak_bytes;
+  size_t allocations;
+  size_t next_growth_threshold;
+  size_t growth_events_used;
+  MemoryGrowthEvent growth_events[MEMORY_GROWTH_LOG_SIZE];
+} MemoryStatistics;
 /*
  * @brief Compute the new capacity of a dynamic array before growing it.
  * This macro will return the capacity of the dynamic array that has to be
@@ -27,38 +90,61 @@
  * size of the dynamic array's type and casting the resulting void* back to
  * the pointer of the correct type.
  *
+ * @param tag The memory tag the dynamic array is accounted under
  * @param array_type The type of the dynamic array's values
  * @param array The dynamic array to reallocate
  * @param current_capacity The current capacity of the dynamic array
  * @param new_capacity The new capacity of the dynamic array
  * @return The reallocated dynamic array
  */
-#define GROW_ARRAY(array_type, array, current_capacity, new_capacity)          \
-  (array_type *)reallocate_array(array, sizeof(array_type) * current_capacity, \
-                                 sizeof(array_type) * new_capacity)
+#define GROW_ARRAY(tag, array_type, array, current_capacity, new_capacity)     \
+  (array_type *)reallocate_array(tag, array,                                   \
+                                 sizeof(array_type) * (current_capacity),      \
+                                 sizeof(array_type) * (new_capacity))
 /*
  * @brief Wrapper around reallocate_array function that pretties up freeing the
  * dynamic array and re-initializing it to an empty state.
  *
+ * @param tag The memory tag the dynamic array is accounted under
  * @param array_type The type of the dynamic array's values
  * @param array The dynamic array to free
  * @param current_capacity The current capacity of the dynamic array
  * @return void
  */
-#define FREE_ARRAY(array_type, array, current_capacity)                        \
-  reallocate_array(array, sizeof(array_type) * current_capacity, 0)
+#define FREE_ARRAY(tag, array_type, array, current_capacity)                   \
+  reallocate_array(tag, array, sizeof(array_type) * (current_capacity), 0)
 /*
  * @brief Reallocate a dynamic array to a new size.
  * This function will allocate a new dynamic array of the given size and copy
  * the old array to the new one. If the new size is 0, it will free the old
- * array and return NULL.
+ * array and return NULL. Every call is accounted under the given tag, which is
+ * why the current capacity must always be the exact size the array was last
+ * allocated with.
  *
+ * @param tag The memory tag the dynamic array is accounted under
  * @param array The dynamic array to reallocate
  * @param current_capacity The current capacity of the dynamic array
  * @param new_capacity The new capacity of the dynamic array
  * @return The reallocated dynamic array or NULL
  */
-void *reallocate_array(void *current_array, size_t current_capacity,
-                       size_t new_capacity);
+void *reallocate_array(MemoryTag tag, void *current_array,
+                       size_t current_capacity, size_t new_capacity);
+/*
+ * @brief Get the statistics of the memory accounting.
+ * The statistics cover every block allocated through reallocate_array since
+ * the process started.
+ *
+ * @return A pointer to the memory statistics, which must not be modified
+ */
+const MemoryStatistics *get_memory_statistics(void);
+/*
+ * @brief Write a human readable report of the memory statistics.
+ * The report lists the counters of every tag, the totals and the growth
+ * events that were logged.
+ *
+ * @param report The file to write the report to
+ * @return void
+ */
+void write_memory_report(FILE *report);
 
 #endif
@@ -0,0 +1,137 @@
+#ifndef interpres_number_h
+#define interpres_number_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Here we define the number of significant decimal digits that always fit in
+ * a 64-bit mantissa. Digits past this limit are not accumulated into the
+ * mantissa: the number is then marked as truncated if any of them is not 0. */
+#define DECIMAL_MAX_MANTISSA_DIGITS 19
+/* Here we define the range of decimal exponents covered by the table of
+ * powers of five. Numbers whose exponent falls below the range round to 0,
+ * while numbers whose exponent falls above it round to infinity. */
+#define DECIMAL_MIN_EXPONENT (-342)
+#define DECIMAL_MAX_EXPONENT 308
+/* Here we define the number of significant decimal digits the slow path keeps
+ * when a truncated number has to be compared against a halfway point between
+ * two doubles. No halfway point has more than 767 significant digits, so any
+ * digit past this limit only matters for being 0 or not. */
+#define DECIMAL_MAX_EXACT_DIGITS 800
+/* Here we define the number of 32-bit limbs of the big integers used by the
+ * slow path, which must be large enough to hold the biggest operand of the
+ * halfway comparison: 800 decimal digits scaled by 2^1075, or 2^54 scaled by
+ * 10^1124. */
+#define BIGNUM_LIMBS 160
+/* Here we define the size of a buffer that can hold any formatted double,
+ * including its sign, its exponent and the terminating '\0', and the number of
+ * significant digits the shortest representation of a double can have. */
+#define NUMBER_FORMAT_MAX_LENGTH 32
+#define NUMBER_FORMAT_MAX_DIGITS 17
+/* Here we define when a formatted double switches to scientific notation:
+ * numbers are written out positionally as long as they have no more than 21
+ * digits before the decimal point and no more than 6 zeros right after it. */
+#define NUMBER_FORMAT_MAX_POSITIONAL_DIGITS 21
+#define NUMBER_FORMAT_MAX_LEADING_ZEROS 6
+/* A decimal number is represented as its first significant digits, read as an
+ * unsigned integer "mantissa", scaled by a power of ten "exponent". The scanner
+ * builds it digit by digit while it scans a numeric literal, so that the
+ * parser does not need to go through the digits once more. */
+typedef struct {
+  uint64_t mantissa;
+  int64_t exponent;
+  int mantissa_digits;
+  bool is_truncated;
+} DecimalNumber;
+/* A big integer is an array of 32-bit limbs, least significant first, of
+ * which only the first "used" ones are meaningful. */
+typedef struct {
+  int used;
+  uint32_t limbs[BIGNUM_LIMBS];
+} Bignum;
+/*
+ * @brief Initialize a new decimal number to 0.
+ *
+ * @param number A pointer to the decimal number to initialize
+ * @return void
+ */
+void init_decimal_number(DecimalNumber *number);
+/*
+ * @brief Append a decimal digit to a decimal number.
+ * Leading zeros are skipped, digits are accumulated into the mantissa as long
+ * as it has room for them and the exponent is adjusted to account for digits
+ * that follow the decimal point or that did not fit in the mantissa.
+ *
+ * @param number A pointer to the decimal number to append the digit to
+ * @param digit The value of the digit, from 0 to 9
+ * @param is_fractional Whether the digit follows the decimal point or not
+ * @return void
+ */
+static inline void push_decimal_digit(DecimalNumber *number, int digit,
+                                      bool is_fractional) {
+  if (number->mantissa_digits == 0 && digit == 0) {
+    number->exponent -= is_fractional;
+    return;
+  }
+  if (number->mantissa_digits < DECIMAL_MAX_MANTISSA_DIGITS) {
+    number->mantissa = number->mantissa * 10 + (uint64_t)digit;
+    number->mantissa_digits++;
+    number->exponent -= is_fractional;
+    return;
+  }
+  number->is_truncated |= digit != 0;
+  number->exponent += !is_fractional;
+}
+/*
+ * @brief Convert a decimal number to the nearest double.
+ * The conversion is correctly rounded (ties go to even) and does not depend on
+ * the current locale. Exact integers and small numbers are converted with a
+ * single floating-point operation, every other number goes through the
+ * Eisel-Lemire algorithm and the rare truncated numbers that lie too close to
+ * a halfway point between two doubles are settled by comparing big integers
+ * built from the literal's characters.
+ *
+ * @param number A pointer to the decimal number to convert
+ * @param characters The characters of the numeric literal the number was read
+ * from, made of decimal digits and at most one decimal point
+ * @param length The number of characters of the numeric literal
+ * @return The double that is nearest to the decimal number
+ */
+double decimal_number_to_double(const DecimalNumber *number,
+                                const char *characters, size_t length);
+/*
+ * @brief Convert a decimal number to an integer, if it is one.
+ * Only numbers that were read without a fractional part and that fit in a
+ * signed 64-bit integer are converted.
+ *
+ * @param number A pointer to the decimal number to convert
+ * @param integer A pointer to where the converted integer is stored
+ * @return Whether the decimal number could be converted or not
+ */
+bool decimal_number_to_integer(const DecimalNumber *number, int64_t *integer);
+/*
+ * @brief Format a double as the shortest string that reads back to it.
+ * This function implements the Ryu algorithm: it picks the decimal number
+ * with the fewest significant digits that still rounds to the given double,
+ * and the one that is nearest to it among those. The result does not depend on
+ * the current locale. Infinities and NaNs are written as "inf", "-inf" and
+ * "nan", like printf's "%g" does.
+ *
+ * @param value The double to format
+ * @param buffer A pointer to a buffer of at least NUMBER_FORMAT_MAX_LENGTH
+ * characters to write the '\0' terminated string to
+ * @return The number of characters written, without the terminating '\0'
+ */
+size_t format_double(double value, char *buffer);
+/*
+ * @brief Format a signed 64-bit integer in base 10.
+ *
+ * @param value The integer to format
+ * @param buffer A pointer to a buffer of at least NUMBER_FORMAT_MAX_LENGTH
+ * characters to write the '\0' terminated string to
+ * @return The number of characters written, without the terminating '\0'
+ */
+size_t format_integer(int64_t value, char *buffer);
+
+#endif
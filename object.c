@@ -0,0 +1,308 @@
+#include <string.h>
+
+#include "collector.h"
+#include "memory.h"
+#include "object.h"
+#include "table.h"
+#include "vm.h"
+
+Object *allocate_object(VirtualMachine *vm, size_t object_size,
+                        ObjectType object_type) {
+  Object *object = (Object *)reallocate_object_memory(vm, NULL, 0, object_size);
+  object->type = object_type;
+  object->color = vm->collector.live_white;
+  object->next = vm->collector.objects;
+  vm->collector.objects = object;
+  return object;
+}
+
+ObjectFunction *new_function(VirtualMachine *vm) {
+  ObjectFunction *function = (ObjectFunction *)allocate_object(
+      vm, sizeof(ObjectFunction), OBJECT_FUNCTION);
+  function->type = FUNCTION_TYPE_FUNCTION;
+  function->arity = 0;
+  function->is_verified = false;
+  function->max_stack_depth = 0;
+  function->name = NULL;
+  function->source = NULL;
+  function->source_offset = 0;
+  function->source_line_number = 0;
+  init_chunk(&function->chunk);
+  return function;
+}
+
+static ObjectShape *new_shape(VirtualMachine *vm, ObjectClass *owner_class,
+                              int field_count) {
+  ObjectShape *shape =
+      (ObjectShape *)allocate_object(vm, sizeof(ObjectShape), OBJECT_SHAPE);
+  shape->owner_class = owner_class;
+  shape->field_count = field_count;
+  init_table(&shape->slots);
+  init_table(&shape->transitions);
+  return shape;
+}
+
+ObjectClass *new_class(VirtualMachine *vm, ObjectString *name) {
+  ObjectClass *object_class =
+      (ObjectClass *)allocate_object(vm, sizeof(ObjectClass), OBJECT_CLASS);
+  object_class->name = name;
+  init_table(&object_class->methods);
+  object_class->initializer = NULL;
+  object_class->root_shape = NULL;
+  push_onto_stack(vm, OBJECT_CONSTANT(object_class));
+  object_class->root_shape = new_shape(vm, object_class, 0);
+  pop_from_stack(vm);
+  return object_class;
+}
+
+ObjectInstance *new_instance(VirtualMachine *vm, ObjectClass *instance_class) {
+  ObjectInstance *instance = (ObjectInstance *)allocate_object(
+      vm, sizeof(ObjectInstance), OBJECT_INSTANCE);
+  instance->shape = instance_class->root_shape;
+  instance->fields_capacity = 0;
+  instance->fields = NULL;
+  return instance;
+}
+
+ObjectBoundMethod *new_bound_method(VirtualMachine *vm, Constant receiver,
+                                    ObjectFunction *method) {
+  ObjectBoundMethod *bound_method = (ObjectBoundMethod *)allocate_object(
+      vm, sizeof(ObjectBoundMethod), OBJECT_BOUND_METHOD);
+  bound_method->receiver = receiver;
+  bound_method->method = method;
+  return bound_method;
+}
+
+ObjectNative *new_native(VirtualMachine *vm, NativeFunction function,
+                         ObjectString *name, int arity) {
+  ObjectNative *native =
+      (ObjectNative *)allocate_object(vm, sizeof(ObjectNative), OBJECT_NATIVE);
+  native->function = function;
+  native->name = name;
+  native->arity = arity;
+  return native;
+}
+
+ObjectCoroutine *new_coroutine(VirtualMachine *vm, ObjectFunction *function) {
+  CallFrame *frames =
+      ALLOCATE_OBJECT_MEMORY(vm, CallFrame, COROUTINE_INITIAL_FRAMES);
+  Constant *stack =
+      ALLOCATE_OBJECT_MEMORY(vm, Constant, COROUTINE_INITIAL_STACK_SIZE);
+  ObjectCoroutine *coroutine = (ObjectCoroutine *)allocate_object(
+      vm, sizeof(ObjectCoroutine), OBJECT_COROUTINE);
+  coroutine->state = COROUTINE_STATE_SUSPENDED;
+  coroutine->is_task = false;
+  coroutine->function = function;
+  coroutine->resumer = NULL;
+  coroutine->frame_count = 0;
+  coroutine->frames_capacity = COROUTINE_INITIAL_FRAMES;
+  coroutine->frames = frames;
+  coroutine->stack_capacity = COROUTINE_INITIAL_STACK_SIZE;
+  coroutine->stack = stack;
+  coroutine->stack_pointer = stack;
+  return coroutine;
+}
+
+void free_coroutine_stacks(VirtualMachine *vm, ObjectCoroutine *coroutine) {
+  FREE_OBJECT_MEMORY(vm, CallFrame, coroutine->frames,
+                     coroutine->frames_capacity);
+  FREE_OBJECT_MEMORY(vm, Constant, coroutine->stack,
+                     coroutine->stack_capacity);
+  coroutine->frame_count = 0;
+  coroutine->frames_capacity = 0;
+  coroutine->frames = NULL;
+  coroutine->stack_capacity = 0;
+  coroutine->stack = NULL;
+  coroutine->stack_pointer = NULL;
+}
+
+ObjectShape *get_shape_transition(VirtualMachine *vm, ObjectShape *shape,
+                                  ObjectString *name) {
+  Constant transition;
+  if (get_from_table(&shape->transitions, name, &transition))
+    return (ObjectShape *)AS_OBJECT_CONSTANT(transition);
+  ObjectShape *child_shape =
+      new_shape(vm, shape->owner_class, shape->field_count + 1);
+  copy_table(&shape->slots, &child_shape->slots);
+  set_in_table(&child_shape->slots, name,
+               INTEGER_CONSTANT(shape->field_count));
+  set_in_table(&shape->transitions, name, OBJECT_CONSTANT(child_shape));
+  collector_write_barrier(vm, (Object *)shape, OBJECT_CONSTANT(child_shape));
+  return child_shape;
+}
+
+int find_shape_slot(ObjectShape *shape, ObjectString *name) {
+  Constant slot;
+  if (!get_from_table(&shape->slots, name, &slot))
+    return -1;
+  return (int)AS_INTEGER_CONSTANT(slot);
+}
+
+void reserve_instance_fields(VirtualMachine *vm, ObjectInstance *instance,
+                             int field_count) {
+  if (instance->fields_capacity >= field_count)
+    return;
+  int current_capacity = instance->fields_capacity;
+  int new_capacity = (int)COMPUTE_ARRAY_CAPACITY((size_t)current_capacity);
+  if (new_capacity < field_count)
+    new_capacity = field_count;
+  instance->fields = GROW_OBJECT_MEMORY(vm, Constant, instance->fields,
+                                        current_capacity, new_capacity);
+  instance->fields_capacity = new_capacity;
+}
+
+static uint32_t hash_string(const char *characters, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (uint8_t)characters[i];
+    hash *= 16777619;
+  }
+  return hash;
+}
+
+static ObjectString *allocate_string(VirtualMachine *vm, char *characters,
+                                     size_t length, uint32_t hash) {
+  ObjectString *string = (ObjectString *)allocate_object(
+      vm, sizeof(ObjectString), OBJECT_STRING);
+  string->length = length;
+  string->hash = hash;
+  string->characters = characters;
+  set_in_table(&vm->strings, string, NIL_CONSTANT);
+  return string;
+}
+
+ObjectString *take_string(VirtualMachine *vm, char *characters, size_t length) {
+  uint32_t hash = hash_string(characters, length);
+  ObjectString *interned_string =
+      find_string_in_table(&vm->strings, characters, length, hash);
+  if (interned_string != NULL) {
+    FREE_OBJECT_MEMORY(vm, char, characters, length + 1);
+    return interned_string;
+  }
+  return allocate_string(vm, characters, length, hash);
+}
+
+ObjectString *copy_string(VirtualMachine *vm, const char *characters,
+                          size_t length) {
+  uint32_t hash = hash_string(characters, length);
+  ObjectString *interned_string =
+      find_string_in_table(&vm->strings, characters, length, hash);
+  if (interned_string != NULL)
+    return interned_string;
+  char *string_characters = ALLOCATE_OBJECT_MEMORY(vm, char, length + 1);
+  memcpy(string_characters, characters, length);
+  string_characters[length] = '\0';
+  return allocate_string(vm, string_characters, length, hash);
+}
+
+size_t free_object(VirtualMachine *vm, Object *object) {
+  switch (object->type) {
+  case OBJECT_BOUND_METHOD:
+    FREE_OBJECT_MEMORY(vm, ObjectBoundMethod, object, 1);
+    return sizeof(ObjectBoundMethod);
+  case OBJECT_CLASS: {
+    ObjectClass *object_class = (ObjectClass *)object;
+    free_table(&object_class->methods);
+    FREE_OBJECT_MEMORY(vm, ObjectClass, object_class, 1);
+    return sizeof(ObjectClass);
+  }
+  case OBJECT_COROUTINE: {
+    ObjectCoroutine *coroutine = (ObjectCoroutine *)object;
+    size_t coroutine_size =
+        sizeof(ObjectCoroutine) +
+        sizeof(CallFrame) * (size_t)coroutine->frames_capacity +
+        sizeof(Constant) * coroutine->stack_capacity;
+    free_coroutine_stacks(vm, coroutine);
+    FREE_OBJECT_MEMORY(vm, ObjectCoroutine, coroutine, 1);
+    return coroutine_size;
+  }
+  case OBJECT_FUNCTION: {
+    ObjectFunction *function = (ObjectFunction *)object;
+    free_chunk(&function->chunk);
+    FREE_OBJECT_MEMORY(vm, ObjectFunction, function, 1);
+    return sizeof(ObjectFunction);
+  }
+  case OBJECT_INSTANCE: {
+    ObjectInstance *instance = (ObjectInstance *)object;
+    size_t instance_size =
+        sizeof(ObjectInstance) +
+        sizeof(Constant) * (size_t)instance->fields_capacity;
+    FREE_OBJECT_MEMORY(vm, Constant, instance->fields,
+                       instance->fields_capacity);
+    FREE_OBJECT_MEMORY(vm, ObjectInstance, instance, 1);
+    return instance_size;
+  }
+  case OBJECT_NATIVE:
+    FREE_OBJECT_MEMORY(vm, ObjectNative, object, 1);
+    return sizeof(ObjectNative);
+  case OBJECT_SHAPE: {
+    ObjectShape *shape = (ObjectShape *)object;
+    free_table(&shape->slots);
+    free_table(&shape->transitions);
+    FREE_OBJECT_MEMORY(vm, ObjectShape, shape, 1);
+    return sizeof(ObjectShape);
+  }
+  case OBJECT_STRING: {
+    ObjectString *string = (ObjectString *)object;
+    size_t string_size = sizeof(ObjectString) + string->length + 1;
+    FREE_OBJECT_MEMORY(vm, char, string->characters, string->length + 1);
+    FREE_OBJECT_MEMORY(vm, ObjectString, string, 1);
+    return string_size;
+  }
+  }
+  return 0;
+}
+
+static void print_function(OutputBuffer *output, ObjectFunction *function) {
+  if (function->name == NULL) {
+    write_output_string(output, "<script>");
+    return;
+  }
+  write_output_string(output, "<fn ");
+  write_output_characters(output, function->name->characters,
+                          function->name->length);
+  write_output_string(output, ">");
+}
+
+void print_object(OutputBuffer *output, Constant constant) {
+  switch (OBJECT_TYPE(constant)) {
+  case OBJECT_BOUND_METHOD:
+    print_function(output, AS_BOUND_METHOD_CONSTANT(constant)->method);
+    break;
+  case OBJECT_CLASS: {
+    ObjectString *name = AS_CLASS_CONSTANT(constant)->name;
+    write_output_characters(output, name->characters, name->length);
+    break;
+  }
+  case OBJECT_COROUTINE:
+    write_output_string(output, "<coroutine ");
+    print_function(output, AS_COROUTINE_CONSTANT(constant)->function);
+    write_output_string(output, ">");
+    break;
+  case OBJECT_FUNCTION:
+    print_function(output, AS_FUNCTION_CONSTANT(constant));
+    break;
+  case OBJECT_INSTANCE: {
+    ObjectString *name =
+        AS_INSTANCE_CONSTANT(constant)->shape->owner_class->name;
+    write_output_characters(output, name->characters, name->length);
+    write_output_string(output, " instance");
+    break;
+  }
+  case OBJECT_NATIVE: {
+    ObjectString *name = AS_NATIVE_CONSTANT(constant)->name;
+    write_output_string(output, "<native ");
+    write_output_characters(output, name->characters, name->length);
+    write_output_string(output, ">");
+    break;
+  }
+  case OBJECT_SHAPE:
+    write_output_string(output, "<shape>");
+    break;
+  case OBJECT_STRING: {
+    ObjectString *string = AS_STRING_CONSTANT(constant);
+    write_output_characters(output, string->characters, string->length);
+    break;
+  }
+  }
+}
@@ -0,0 +1,399 @@
+#ifndef interpres_object_h
+#define interpres_object_h
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "chunk.h"
+#include "constant.h"
+#include "table.h"
+
+/* Objects are always allocated on behalf of a virtual machine, which owns them
+ * and is responsible for collecting them once they are no longer reachable. */
+typedef struct VirtualMachine VirtualMachine;
+/* Call frames are defined in vm.h; coroutines only need to know about them to
+ * keep the frames they were suspended with. */
+typedef struct CallFrame CallFrame;
+/* This enum lists every kind of object that can live on the heap. */
+typedef enum {
+  OBJECT_BOUND_METHOD,
+  OBJECT_CLASS,
+  OBJECT_COROUTINE,
+  OBJECT_FUNCTION,
+  OBJECT_INSTANCE,
+  OBJECT_NATIVE,
+  OBJECT_SHAPE,
+  OBJECT_STRING,
+} ObjectType;
+/* Every object is painted with one of these colors by the garbage collector.
+ * There are two shades of white so that the collector can tell apart objects
+ * that were left unmarked by the last marking phase (and are therefore
+ * garbage) from objects that were allocated after it ended. Which of the two
+ * is the "live" white flips at the end of every marking phase. */
+typedef enum {
+  OBJECT_COLOR_WHITE_A,
+  OBJECT_COLOR_WHITE_B,
+  OBJECT_COLOR_GRAY,
+  OBJECT_COLOR_BLACK,
+} ObjectColor;
+/* This is the header shared by every heap-allocated object: its type, the
+ * color the garbage collector painted it with and a pointer to the next object
+ * allocated by the same virtual machine, so that the collector can walk every
+ * object during the sweeping phase. */
+struct Object {
+  ObjectType type;
+  ObjectColor color;
+  struct Object *next;
+};
+/* A string object holds an immutable sequence of characters along with its
+ * length and its hash; the characters are always terminated by '\0' so that
+ * they can be handed over to C functions directly. Strings are interned: there
+ * is never more than one string object with the same characters. */
+struct ObjectString {
+  Object object;
+  size_t length;
+  uint32_t hash;
+  char *characters;
+};
+/* Functions declared by the user and the top-level script are compiled the
+ * same way, except that "return" statements are only allowed in the former.
+ * Methods reserve their first local slot for "this", and initializers always
+ * return it instead of a value of their own. */
+typedef enum {
+  FUNCTION_TYPE_FUNCTION,
+  FUNCTION_TYPE_INITIALIZER,
+  FUNCTION_TYPE_METHOD,
+  FUNCTION_TYPE_SCRIPT,
+} FunctionType;
+/* A function object holds the chunk its body was compiled into, along with
+ * the number of parameters it expects and its name. The top-level script is
+ * compiled into a function too, whose name is NULL. Functions are only run
+ * once the bytecode verifier has checked their chunk, which "is_verified"
+ * keeps track of. When functions are compiled lazily, the body of a function is
+ * only skimmed at first: "source" then holds the input the function was
+ * declared in, and "source_offset" and "source_line_number" locate the opening
+ * parenthesis of its parameters, from which the body is compiled on the first
+ * call. Once compiled, "source" is set back to NULL. The verifier records the
+ * largest depth the stack reaches within a call in "max_stack_depth". */
+struct ObjectFunction {
+  Object object;
+  FunctionType type;
+  int arity;
+  bool is_verified;
+  int max_stack_depth;
+  Chunk chunk;
+  ObjectString *name;
+  ObjectString *source;
+  size_t source_offset;
+  size_t source_line_number;
+};
+/* Shapes and classes refer to each other, so the class type is declared
+ * before both of them are defined. */
+typedef struct ObjectClass ObjectClass;
+/* A shape (also known as a hidden class) describes the layout of the fields of
+ * an instance: the "slots" table maps the name of every field to its index in
+ * the instance's array of fields. Shapes form a tree rooted in the empty shape
+ * of a class: adding a new field to an instance moves it to the child shape
+ * stored in the "transitions" table under the field's name, so that instances
+ * of the same class that were given the same fields in the same order share
+ * the very same shape. Shapes are immutable once created, which is what allows
+ * inline caches to remember the outcome of a lookup by shape alone. */
+struct ObjectShape {
+  Object object;
+  ObjectClass *owner_class;
+  int field_count;
+  Table slots;
+  Table transitions;
+};
+/* A class holds its name, the table of its methods and the empty shape every
+ * new instance of the class starts off with. The initializer, if any, is also
+ * kept aside so that instantiating a class does not need to look it up. The
+ * methods of a class are only ever defined by the class declaration itself,
+ * before any instance can exist. */
+struct ObjectClass {
+  Object object;
+  ObjectString *name;
+  Table methods;
+  ObjectFunction *initializer;
+  ObjectShape *root_shape;
+};
+/* An instance stores its fields in a compact array whose layout is described
+ * by its shape; the class of an instance is the owner of its shape. The
+ * "fields_capacity" counter keeps track of the number of fields the array can
+ * hold before it has to grow. */
+typedef struct {
+  Object object;
+  ObjectShape *shape;
+  int fields_capacity;
+  Constant *fields;
+} ObjectInstance;
+/* A bound method is a method that was read off an instance as a property: it
+ * remembers the instance it was read from so that, once called, the method can
+ * access it as "this". */
+typedef struct {
+  Object object;
+  Constant receiver;
+  ObjectFunction *method;
+} ObjectBoundMethod;
+/* A native function is implemented in C and called with a pointer to its
+ * first argument, which follows the slot holding the native itself; the
+ * virtual machine has already checked the number of arguments. The native must
+ * either replace itself and its arguments with its result, which
+ * return_from_native does, throw an exception through throw_from_native, or
+ * switch to another coroutine after taking itself and its arguments off the
+ * stack. It returns false once a runtime error has been reported. */
+typedef bool (*NativeFunction)(VirtualMachine *vm, Constant *arguments);
+/* A native object wraps a native function so that it can be stored in a
+ * variable and called like any other function. */
+typedef struct {
+  Object object;
+  NativeFunction function;
+  ObjectString *name;
+  int arity;
+} ObjectNative;
+/* This enum lists the states a coroutine goes through: it is suspended until
+ * it is first resumed and whenever it yields, running while its own code runs,
+ * normal while it waits for a coroutine it resumed to yield and dead once its
+ * function has returned or let an exception through. */
+typedef enum {
+  COROUTINE_STATE_SUSPENDED,
+  COROUTINE_STATE_RUNNING,
+  COROUTINE_STATE_NORMAL,
+  COROUTINE_STATE_DEAD,
+} CoroutineState;
+/* A coroutine runs "function" on a stack of call frames and a stack of
+ * constants of its own, so that switching to and from it only swaps the
+ * pointers the virtual machine runs on. Both stacks start small and grow as
+ * deeper calls need it: the "frames" array holds "frames_capacity" frames, of
+ * which "frame_count" are active, and the "stack" array holds
+ * "stack_capacity" constants up to "stack_pointer". While the coroutine runs,
+ * the virtual machine keeps the frame count and the stack pointer itself, and
+ * "resumer" points to the coroutine that resumed it, or is NULL when the
+ * top-level script did. A coroutine that has not been resumed yet has no
+ * frames, and a dead coroutine gives its stacks back. Coroutines that are
+ * "is_task" are never resumed explicitly: the event loop runs them whenever
+ * the I/O they wait for completes. */
+typedef struct ObjectCoroutine {
+  Object object;
+  CoroutineState state;
+  bool is_task;
+  ObjectFunction *function;
+  struct ObjectCoroutine *resumer;
+  int frame_count;
+  int frames_capacity;
+  CallFrame *frames;
+  size_t stack_capacity;
+  Constant *stack;
+  Constant *stack_pointer;
+} ObjectCoroutine;
+/* Here we define the number of call frames and of constants the stacks of a
+ * new coroutine can hold before they have to grow. */
+#define COROUTINE_INITIAL_FRAMES 4
+#define COROUTINE_INITIAL_STACK_SIZE 32
+/* The following macros check whether a constant holds an object of a given
+ * type and unwrap it to a pointer to that object's C representation. */
+#define OBJECT_TYPE(constant) (AS_OBJECT_CONSTANT(constant)->type)
+#define IS_BOUND_METHOD_CONSTANT(constant)                                     \
+  constant_is_object_type(constant, OBJECT_BOUND_METHOD)
+#define IS_CLASS_CONSTANT(constant)                                            \
+  constant_is_object_type(constant, OBJECT_CLASS)
+#define IS_COROUTINE_CONSTANT(constant)                                        \
+  constant_is_object_type(constant, OBJECT_COROUTINE)
+#define IS_FUNCTION_CONSTANT(constant)                                         \
+  constant_is_object_type(constant, OBJECT_FUNCTION)
+#define IS_INSTANCE_CONSTANT(constant)                                         \
+  constant_is_object_type(constant, OBJECT_INSTANCE)
+#define IS_NATIVE_CONSTANT(constant)                                           \
+  constant_is_object_type(constant, OBJECT_NATIVE)
+#define IS_STRING_CONSTANT(constant)                                           \
+  constant_is_object_type(constant, OBJECT_STRING)
+#define AS_BOUND_METHOD_CONSTANT(constant)                                     \
+  ((ObjectBoundMethod *)AS_OBJECT_CONSTANT(constant))
+#define AS_CLASS_CONSTANT(constant)                                            \
+  ((ObjectClass *)AS_OBJECT_CONSTANT(constant))
+#define AS_COROUTINE_CONSTANT(constant)                                        \
+  ((ObjectCoroutine *)AS_OBJECT_CONSTANT(constant))
+#define AS_FUNCTION_CONSTANT(constant)                                         \
+  ((ObjectFunction *)AS_OBJECT_CONSTANT(constant))
+#define AS_INSTANCE_CONSTANT(constant)                                         \
+  ((ObjectInstance *)AS_OBJECT_CONSTANT(constant))
+#define AS_NATIVE_CONSTANT(constant)                                           \
+  ((ObjectNative *)AS_OBJECT_CONSTANT(constant))
+#define AS_STRING_CONSTANT(constant)                                           \
+  ((ObjectString *)AS_OBJECT_CONSTANT(constant))
+/*
+ * @brief Check whether a constant holds an object of the given type.
+ *
+ * @param constant The constant to check
+ * @param object_type The expected object type
+ * @return Whether the constant is an object of the given type or not
+ */
+static inline bool constant_is_object_type(Constant constant,
+                                           ObjectType object_type) {
+  return IS_OBJECT_CONSTANT(constant) &&
+         AS_OBJECT_CONSTANT(constant)->type == object_type;
+}
+/*
+ * @brief Allocate a new object on the heap.
+ * This function will only fill in the object's header and link it to the list
+ * of objects owned by the virtual machine; the caller is responsible for
+ * initializing the rest of the object before the collector can trace it.
+ *
+ * @param vm A pointer to the virtual machine that will own the object
+ * @param object_size The size in bytes of the object to allocate
+ * @param object_type The type of the object to allocate
+ * @return A pointer to the new object
+ */
+Object *allocate_object(VirtualMachine *vm, size_t object_size,
+                        ObjectType object_type);
+/*
+ * @brief Create a new function object.
+ * The function starts off with no parameters, no name and an empty chunk,
+ * which are filled in by the compiler as it goes through the function's
+ * declaration.
+ *
+ * @param vm A pointer to the virtual machine that will own the function
+ * @return A pointer to the new function object
+ */
+ObjectFunction *new_function(VirtualMachine *vm);
+/*
+ * @brief Create a new class object.
+ * The class starts off with no methods, no initializer and an empty root shape
+ * that is owned by the class.
+ *
+ * @param vm A pointer to the virtual machine that will own the class
+ * @param name A pointer to the string object holding the class' name
+ * @return A pointer to the new class object
+ */
+ObjectClass *new_class(VirtualMachine *vm, ObjectString *name);
+/*
+ * @brief Create a new instance object.
+ * The instance starts off with the root shape of its class and no fields.
+ *
+ * @param vm A pointer to the virtual machine that will own the instance
+ * @param instance_class A pointer to the class to instantiate
+ * @return A pointer to the new instance object
+ */
+ObjectInstance *new_instance(VirtualMachine *vm, ObjectClass *instance_class);
+/*
+ * @brief Create a new bound method object.
+ *
+ * @param vm A pointer to the virtual machine that will own the bound method
+ * @param receiver The instance the method is bound to
+ * @param method A pointer to the function implementing the method
+ * @return A pointer to the new bound method object
+ */
+ObjectBoundMethod *new_bound_method(VirtualMachine *vm, Constant receiver,
+                                    ObjectFunction *method);
+/*
+ * @brief Create a new native object.
+ *
+ * @param vm A pointer to the virtual machine that will own the native
+ * @param function The C function implementing the native
+ * @param name A pointer to the string object holding the native's name
+ * @param arity The number of arguments the native expects
+ * @return A pointer to the new native object
+ */
+ObjectNative *new_native(VirtualMachine *vm, NativeFunction function,
+                         ObjectString *name, int arity);
+/*
+ * @brief Create a new coroutine object.
+ * The coroutine starts off suspended, with empty stacks of
+ * COROUTINE_INITIAL_FRAMES call frames and COROUTINE_INITIAL_STACK_SIZE
+ * constants, and calls its function once it is first resumed.
+ *
+ * @param vm A pointer to the virtual machine that will own the coroutine
+ * @param function A pointer to the function the coroutine runs
+ * @return A pointer to the new coroutine object
+ */
+ObjectCoroutine *new_coroutine(VirtualMachine *vm, ObjectFunction *function);
+/*
+ * @brief Free the stacks of a coroutine.
+ * This function is called once a coroutine is dead, so that the memory of its
+ * stacks is given back without waiting for the coroutine to be collected.
+ *
+ * @param vm A pointer to the virtual machine that owns the coroutine
+ * @param coroutine A pointer to the coroutine whose stacks to free
+ * @return void
+ */
+void free_coroutine_stacks(VirtualMachine *vm, ObjectCoroutine *coroutine);
+/*
+ * @brief Get the shape an instance moves to when a new field is added to it.
+ * If the shape has already been extended with a field of the same name, the
+ * existing child shape is returned; otherwise a new shape that stores the field
+ * in the slot following the existing ones is created and remembered as a
+ * transition of the given shape.
+ *
+ * @param vm A pointer to the virtual machine that owns the shapes
+ * @param shape A pointer to the shape to extend
+ * @param name A pointer to the string object holding the field's name
+ * @return A pointer to the extended shape
+ */
+ObjectShape *get_shape_transition(VirtualMachine *vm, ObjectShape *shape,
+                                  ObjectString *name);
+/*
+ * @brief Find the slot of a field in a shape.
+ *
+ * @param shape A pointer to the shape to search
+ * @param name A pointer to the string object holding the field's name
+ * @return The index of the field's slot or -1 if the shape has no such field
+ */
+int find_shape_slot(ObjectShape *shape, ObjectString *name);
+/*
+ * @brief Grow an instance's array of fields so that it fits its shape.
+ *
+ * @param vm A pointer to the virtual machine that owns the instance
+ * @param instance A pointer to the instance whose fields to grow
+ * @param field_count The number of fields the array has to fit
+ * @return void
+ */
+void reserve_instance_fields(VirtualMachine *vm, ObjectInstance *instance,
+                             int field_count);
+/*
+ * @brief Create a string object by copying a set of characters.
+ * This function will allocate a new buffer for the characters, copy them over
+ * and wrap the buffer into a new string object, leaving the original
+ * characters untouched. If a string with the same characters already exists,
+ * that string is returned instead.
+ *
+ * @param vm A pointer to the virtual machine that will own the string
+ * @param characters The characters to copy
+ * @param length The number of characters to copy
+ * @return A pointer to the new string object
+ */
+ObjectString *copy_string(VirtualMachine *vm, const char *characters,
+                          size_t length);
+/*
+ * @brief Create a string object by taking ownership of a set of characters.
+ * This function will wrap an already allocated, '\0' terminated buffer of
+ * characters into a new string object without copying it. The buffer must have
+ * been allocated through the garbage collector with a size of "length" + 1. If
+ * a string with the same characters already exists, the buffer is freed and
+ * that string is returned instead.
+ *
+ * @param vm A pointer to the virtual machine that will own the string
+ * @param characters The characters to take ownership of
+ * @param length The number of characters in the buffer
+ * @return A pointer to the new string object
+ */
+ObjectString *take_string(VirtualMachine *vm, char *characters, size_t length);
+/*
+ * @brief Free an object.
+ * This function will release the memory held by an object, including any
+ * buffer it owns, and return the number of bytes that were released.
+ *
+ * @param vm A pointer to the virtual machine that owns the object
+ * @param object A pointer to the object to free
+ * @return The number of bytes released
+ */
+size_t free_object(VirtualMachine *vm, Object *object);
+/*
+ * @brief Print an object to an output buffer.
+ *
+ * @param output A pointer to the output buffer to print to
+ * @param constant The constant holding the object to print
+ * @return void
+ */
+void print_object(OutputBuffer *output, Constant constant);
+
+#endif
@@ -0,0 +1,102 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "number.h"
+#include "output.h"
+
+void init_output_buffer(OutputBuffer *output, int file_descriptor) {
+  output->file_descriptor = file_descriptor;
+  output->frame_kind = 0;
+  output->frame_start = 0;
+  output->used = 0;
+}
+
+static void write_file_descriptor(int file_descriptor, const char *characters,
+                                  size_t length) {
+  while (length > 0) {
+    ssize_t written = write(file_descriptor, characters, length);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    characters += written;
+    length -= (size_t)written;
+  }
+}
+
+static void complete_output_frame(OutputBuffer *output) {
+  if (output->frame_kind == 0)
+    return;
+  size_t length =
+      output->used - output->frame_start - OUTPUT_FRAME_HEADER_LENGTH;
+  if (length == 0) {
+    output->used = output->frame_start;
+    return;
+  }
+  uint8_t *header = (uint8_t *)&output->characters[output->frame_start];
+  header[0] = output->frame_kind;
+  header[1] = (uint8_t)(length >> 24);
+  header[2] = (uint8_t)(length >> 16);
+  header[3] = (uint8_t)(length >> 8);
+  header[4] = (uint8_t)length;
+}
+
+void begin_output_frame(OutputBuffer *output, uint8_t frame_kind) {
+  if (OUTPUT_BUFFER_SIZE - output->used <= OUTPUT_FRAME_HEADER_LENGTH)
+    flush_output_buffer(output);
+  complete_output_frame(output);
+  output->frame_kind = frame_kind;
+  output->frame_start = output->used;
+  output->used += OUTPUT_FRAME_HEADER_LENGTH;
+}
+
+void flush_output_buffer(OutputBuffer *output) {
+  complete_output_frame(output);
+  write_file_descriptor(output->file_descriptor, output->characters,
+                        output->used);
+  output->used = 0;
+  if (output->frame_kind != 0) {
+    output->frame_start = 0;
+    output->used = OUTPUT_FRAME_HEADER_LENGTH;
+  }
+}
+
+void write_output_characters(OutputBuffer *output, const char *characters,
+                             size_t length) {
+  if (OUTPUT_BUFFER_SIZE - output->used < length)
+    flush_output_buffer(output);
+  if (length > OUTPUT_BUFFER_SIZE && output->frame_kind == 0) {
+    write_file_descriptor(output->file_descriptor, characters, length);
+    return;
+  }
+  while (OUTPUT_BUFFER_SIZE - output->used < length) {
+    size_t written = OUTPUT_BUFFER_SIZE - output->used;
+    memcpy(output->characters + output->used, characters, written);
+    output->used += written;
+    flush_output_buffer(output);
+    characters += written;
+    length -= written;
+  }
+  memcpy(output->characters + output->used, characters, length);
+  output->used += length;
+}
+
+void write_output_string(OutputBuffer *output, const char *string) {
+  write_output_characters(output, string, strlen(string));
+}
+
+void write_output_number(OutputBuffer *output, double number) {
+  if (OUTPUT_BUFFER_SIZE - output->used < NUMBER_FORMAT_MAX_LENGTH)
+    flush_output_buffer(output);
+  output->used += format_double(number, output->characters + output->used);
+}
+
+void write_output_integer(OutputBuffer *output, int64_t integer) {
+  if (OUTPUT_BUFFER_SIZE - output->used < NUMBER_FORMAT_MAX_LENGTH)
+    flush_output_buffer(output);
+  output->used += format_integer(integer, output->characters + output->used);
+}
@@ -0,0 +1,100 @@
+#ifndef interpres_output_h
+#define interpres_output_h
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Here we define the size in bytes of the output buffer. Output is only
+ * handed over to the operating system once this many bytes have accumulated,
+ * or when the buffer is explicitly flushed. */
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+/* Here we define the file descriptor of the standard output, which is where
+ * the virtual machine prints to, and of the standard error, which is where
+ * debuggers report to. */
+#define OUTPUT_STANDARD_OUTPUT 1
+#define OUTPUT_STANDARD_ERROR 2
+/* Here we define the length of the header of a frame: a byte holding the kind
+ * of the frame followed by the length of its payload, as a 32-bit big-endian
+ * integer. */
+#define OUTPUT_FRAME_HEADER_LENGTH 5
+/* An output buffer accumulates the characters written by a program and writes
+ * them to the file descriptor "file_descriptor" in large chunks, so that
+ * printing does not cost a system call for every value. When "frame_kind" is
+ * not 0, the characters are split into frames instead, the last of which
+ * starts at "frame_start" and has its header filled in once it is complete, so
+ * that the reader of the file descriptor can tell where the output ends; a
+ * buffer may hold several frames, which are all written at once. */
+typedef struct {
+  int file_descriptor;
+  uint8_t frame_kind;
+  size_t frame_start;
+  size_t used;
+  char characters[OUTPUT_BUFFER_SIZE];
+} OutputBuffer;
+/*
+ * @brief Initialize a new, empty output buffer.
+ *
+ * @param output A pointer to the output buffer to initialize
+ * @param file_descriptor The file descriptor the buffer is flushed to
+ * @return void
+ */
+void init_output_buffer(OutputBuffer *output, int file_descriptor);
+/*
+ * @brief Start a new frame in the output buffer.
+ * The frame that is currently being written, if any, is completed first, and
+ * dropped if nothing was written into it. Every frame written by a flush is
+ * followed by a new frame of the same kind.
+ *
+ * @param output A pointer to the output buffer to write to
+ * @param frame_kind The kind of the new frame, which must not be 0
+ * @return void
+ */
+void begin_output_frame(OutputBuffer *output, uint8_t frame_kind);
+/*
+ * @brief Write every buffered character to the buffer's file descriptor.
+ * Writes that are interrupted or only partially completed are retried, while
+ * characters that cannot be written because of an error are dropped.
+ *
+ * @param output A pointer to the output buffer to flush
+ * @return void
+ */
+void flush_output_buffer(OutputBuffer *output);
+/*
+ * @brief Append a sequence of characters to the output buffer.
+ * The buffer is flushed first whenever the characters do not fit in the space
+ * that is left, and sequences larger than the whole buffer are written out
+ * directly.
+ *
+ * @param output A pointer to the output buffer to write to
+ * @param characters The characters to write
+ * @param length The number of characters to write
+ * @return void
+ */
+void write_output_characters(OutputBuffer *output, const char *characters,
+                             size_t length);
+/*
+ * @brief Append a '\0' terminated string to the output buffer.
+ *
+ * @param output A pointer to the output buffer to write to
+ * @param string The string to write
+ * @return void
+ */
+void write_output_string(OutputBuffer *output, const char *string);
+/*
+ * @brief Append the shortest representation of a number to the output buffer.
+ *
+ * @param output A pointer to the output buffer to write to
+ * @param number The number to write
+ * @return void
+ */
+void write_output_number(OutputBuffer *output, double number);
+/*
+ * @brief Append an integer, in base 10, to the output buffer.
+ *
+ * @param output A pointer to the output buffer to write to
+ * @param integer The integer to write
+ * @return void
+ */
+void write_output_integer(OutputBuffer *output, int64_t integer);
+
+#endif
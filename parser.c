@@ -1,10 +1,17 @@
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
+#include "collector.h"
 #include "compiler.h"
+#include "object.h"
 #include "parser.h"
 
-void init_parser(Parser *parser) {
+void init_parser(Parser *parser, VirtualMachine *vm) {
+  parser->vm = vm;
+  parser->compiler = NULL;
+  parser->source_start = NULL;
+  parser->source = NULL;
   parser->is_error = false;
   parser->is_panic = false;
 }
@@ -52,6 +59,18 @@ void parser_error_at_current(Parser *parser, const char *error_message) {
   parser_error_at(parser, &parser->current_token, error_message);
 }
 
+static bool check_parser_token(Parser *parser, TokenType token_type) {
+  return parser->current_token.type == token_type;
+}
+
+static bool match_parser_token(Parser *parser, Scanner *scanner,
+                               TokenType token_type) {
+  if (!check_parser_token(parser, token_type))
+    return false;
+  advance_parser(parser, scanner);
+  return true;
+}
+
 void parse_expression_precedence(Parser *parser, Scanner *scanner,
                                  Chunk *currently_compiling_chunk,
                                  ParsingPrecedence parsing_precedence) {
@@ -62,14 +81,17 @@ void parse_expression_precedence(Parser *parser, Scanner *scanner,
     parser_error_at_previous(parser, "expected expression.");
     return;
   }
-  prefix_parsing_rule(parser, scanner, currently_compiling_chunk);
+  bool can_assign = parsing_precedence <= PRECEDENCE_ASSIGNMENT;
+  prefix_parsing_rule(parser, scanner, currently_compiling_chunk, can_assign);
   while (parsing_precedence <=
          get_parsing_rule(parser->current_token.type)->parsing_precedence) {
     advance_parser(parser, scanner);
     ParsingFunction infix_parsing_rule =
         get_parsing_rule(parser->previous_token.type)->infix_function;
-    infix_parsing_rule(parser, scanner, currently_compiling_chunk);
+    infix_parsing_rule(parser, scanner, currently_compiling_chunk, can_assign);
   }
+  if (can_assign && match_parser_token(parser, scanner, TOKEN_EQUAL))
+    parser_error_at_previous(parser, "invalid assignment target.");
 }
 
 void parse_expression(Parser *parser, Scanner *scanner,
@@ -79,13 +101,35 @@ void parse_expression(Parser *parser, Scanner *scanner,
 }
 
 static void parse_binary_expression(Parser *parser, Scanner *scanner,
-                                    Chunk *currently_compiling_chunk) {
+                                    Chunk *currently_compiling_chunk,
+                                    bool can_assign) {
   TokenType operator_type = parser->previous_token.type;
   ParsingRule *parsing_rule = get_parsing_rule(operator_type);
   parse_expression_precedence(
       parser, scanner, currently_compiling_chunk,
       (ParsingPrecedence)(parsing_rule->parsing_precedence + 1));
   switch (operator_type) {
+  case TOKEN_BANG_EQUAL:
+    write_comparison_expression(parser, currently_compiling_chunk,
+                                OP_NOT_EQUAL);
+    break;
+  case TOKEN_EQUAL_EQUAL:
+    write_comparison_expression(parser, currently_compiling_chunk, OP_EQUAL);
+    break;
+  case TOKEN_GREATER:
+    write_comparison_expression(parser, currently_compiling_chunk, OP_GREATER);
+    break;
+  case TOKEN_GREATER_EQUAL:
+    write_comparison_expression(parser, currently_compiling_chunk,
+                                OP_GREATER_EQUAL);
+    break;
+  case TOKEN_LESS:
+    write_comparison_expression(parser, currently_compiling_chunk, OP_LESS);
+    break;
+  case TOKEN_LESS_EQUAL:
+    write_comparison_expression(parser, currently_compiling_chunk,
+                                OP_LESS_EQUAL);
+    break;
   case TOKEN_PLUS:
     write_instruction_expression(parser, currently_compiling_chunk, OP_ADD);
     break;
@@ -105,25 +149,187 @@ static void parse_binary_expression(Parser *parser, Scanner *scanner,
   }
 }
 
+static void parse_and_expression(Parser *parser, Scanner *scanner,
+                                 Chunk *currently_compiling_chunk,
+                                 bool can_assign) {
+  size_t end_jump = write_jump_expression(parser, currently_compiling_chunk,
+                                          OP_JUMP_IF_FALSE);
+  write_instruction_expression(parser, currently_compiling_chunk, OP_POP);
+  parse_expression_precedence(parser, scanner, currently_compiling_chunk,
+                              PRECEDENCE_AND);
+  patch_jump_expression(parser, currently_compiling_chunk, end_jump);
+}
+
+static void parse_or_expression(Parser *parser, Scanner *scanner,
+                                Chunk *currently_compiling_chunk,
+                                bool can_assign) {
+  size_t else_jump = write_jump_expression(parser, currently_compiling_chunk,
+                                           OP_JUMP_IF_FALSE);
+  size_t end_jump =
+      write_jump_expression(parser, currently_compiling_chunk, OP_JUMP);
+  patch_jump_expression(parser, currently_compiling_chunk, else_jump);
+  write_instruction_expression(parser, currently_compiling_chunk, OP_POP);
+  parse_expression_precedence(parser, scanner, currently_compiling_chunk,
+                              PRECEDENCE_OR);
+  patch_jump_expression(parser, currently_compiling_chunk, end_jump);
+}
+
+static uint8_t parse_arguments_list(Parser *parser, Scanner *scanner,
+                                    Chunk *currently_compiling_chunk) {
+  uint8_t arguments_count = 0;
+  if (!check_parser_token(parser, TOKEN_RIGHT_PARENTHESIS)) {
+    do {
+      parse_expression(parser, scanner, currently_compiling_chunk);
+      if (arguments_count == UINT8_MAX) {
+        parser_error_at_previous(parser, "can't have more than 255 arguments.");
+        continue;
+      }
+      arguments_count++;
+    } while (match_parser_token(parser, scanner, TOKEN_COMMA));
+  }
+  advance_parser_and_validate_token(parser, scanner, TOKEN_RIGHT_PARENTHESIS,
+                                    "expected ')' after arguments.");
+  return arguments_count;
+}
+
+static void parse_call_expression(Parser *parser, Scanner *scanner,
+                                  Chunk *currently_compiling_chunk,
+                                  bool can_assign) {
+  uint8_t arguments_count =
+      parse_arguments_list(parser, scanner, currently_compiling_chunk);
+  write_call_expression(parser, currently_compiling_chunk, arguments_count);
+}
+
+static void parse_dot_expression(Parser *parser, Scanner *scanner,
+                                 Chunk *currently_compiling_chunk,
+                                 bool can_assign) {
+  advance_parser_and_validate_token(parser, scanner, TOKEN_IDENTIFIER,
+                                    "expected property name after '.'.");
+  uint8_t name_index = make_identifier_constant(
+      parser, currently_compiling_chunk, &parser->previous_token);
+  if (can_assign && match_parser_token(parser, scanner, TOKEN_EQUAL)) {
+    parse_expression(parser, scanner, currently_compiling_chunk);
+    write_property_expression(parser, currently_compiling_chunk,
+                              OP_SET_PROPERTY, name_index);
+  } else if (match_parser_token(parser, scanner, TOKEN_LEFT_PARENTHESIS)) {
+    uint8_t arguments_count =
+        parse_arguments_list(parser, scanner, currently_compiling_chunk);
+    write_invoke_expression(parser, currently_compiling_chunk, name_index,
+                            arguments_count);
+  } else {
+    write_property_expression(parser, currently_compiling_chunk,
+                              OP_GET_PROPERTY, name_index);
+  }
+}
+
 static void parse_grouping_expression(Parser *parser, Scanner *scanner,
-                                      Chunk *currently_compiling_chunk) {
+                                      Chunk *currently_compiling_chunk,
+                                      bool can_assign) {
   parse_expression(parser, scanner, currently_compiling_chunk);
   advance_parser_and_validate_token(parser, scanner, TOKEN_RIGHT_PARENTHESIS,
                                     "expected ')' after expression.");
 }
 
+static void parse_literal_expression(Parser *parser, Scanner *scanner,
+                                     Chunk *currently_compiling_chunk,
+                                     bool can_assign) {
+  switch (parser->previous_token.type) {
+  case TOKEN_FALSE:
+    write_instruction_expression(parser, currently_compiling_chunk, OP_FALSE);
+    break;
+  case TOKEN_NIL:
+    write_instruction_expression(parser, currently_compiling_chunk, OP_NIL);
+    break;
+  case TOKEN_TRUE:
+    write_instruction_expression(parser, currently_compiling_chunk, OP_TRUE);
+    break;
+  default:
+    return;
+  }
+}
+
 static void parse_numeric_expresion(Parser *parser, Scanner *scanner,
-                                    Chunk *currently_compiling_chunk) {
-  double numeric_value = strtod(parser->previous_token.lexeme_start, NULL);
-  write_constant_expression(parser, currently_compiling_chunk, numeric_value);
+                                    Chunk *currently_compiling_chunk,
+                                    bool can_assign) {
+  Token *token = &parser->previous_token;
+  int64_t integer_value;
+  if (decimal_number_to_integer(&token->number, &integer_value)) {
+    write_constant_expression(parser, currently_compiling_chunk,
+                              INTEGER_CONSTANT(integer_value));
+    return;
+  }
+  double numeric_value = decimal_number_to_double(
+      &token->number, token->lexeme_start, token->lexeme_length);
+  write_constant_expression(parser, currently_compiling_chunk,
+                            NUMBER_CONSTANT(numeric_value));
+}
+
+static void parse_string_expression(Parser *parser, Scanner *scanner,
+                                    Chunk *currently_compiling_chunk,
+                                    bool can_assign) {
+  ObjectString *string =
+      copy_string(parser->vm, parser->previous_token.lexeme_start + 1,
+                  parser->previous_token.lexeme_length - 2);
+  write_constant_expression(parser, currently_compiling_chunk,
+                            OBJECT_CONSTANT(string));
+}
+
+static void parse_named_variable(Parser *parser, Scanner *scanner,
+                                 Chunk *currently_compiling_chunk, Token name,
+                                 bool can_assign) {
+  uint8_t get_instruction, set_instruction;
+  int variable_index = resolve_local_variable(parser, &name);
+  if (variable_index != -1) {
+    get_instruction = OP_GET_LOCAL;
+    set_instruction = OP_SET_LOCAL;
+  } else {
+    variable_index =
+        make_identifier_constant(parser, currently_compiling_chunk, &name);
+    get_instruction = OP_GET_GLOBAL;
+    set_instruction = OP_SET_GLOBAL;
+  }
+  if (can_assign && match_parser_token(parser, scanner, TOKEN_EQUAL)) {
+    parse_expression(parser, scanner, currently_compiling_chunk);
+    write_instruction_expression_multiple(parser, currently_compiling_chunk,
+                                          set_instruction,
+                                          (uint8_t)variable_index);
+  } else {
+    write_instruction_expression_multiple(parser, currently_compiling_chunk,
+                                          get_instruction,
+                                          (uint8_t)variable_index);
+  }
+}
+
+static void parse_variable_expression(Parser *parser, Scanner *scanner,
+                                      Chunk *currently_compiling_chunk,
+                                      bool can_assign) {
+  parse_named_variable(parser, scanner, currently_compiling_chunk,
+                       parser->previous_token, can_assign);
+}
+
+static void parse_this_expression(Parser *parser, Scanner *scanner,
+                                  Chunk *currently_compiling_chunk,
+                                  bool can_assign) {
+  FunctionType function_type = parser->compiler->function_type;
+  if (function_type != FUNCTION_TYPE_METHOD &&
+      function_type != FUNCTION_TYPE_INITIALIZER) {
+    parser_error_at_previous(parser, "can't use 'this' outside of a method.");
+    return;
+  }
+  parse_named_variable(parser, scanner, currently_compiling_chunk,
+                       parser->previous_token, false);
 }
 
 static void parse_unary_expression(Parser *parser, Scanner *scanner,
-                                   Chunk *currently_compiling_chunk) {
+                                   Chunk *currently_compiling_chunk,
+                                   bool can_assign) {
   TokenType operator_type = parser->previous_token.type;
   parse_expression_precedence(parser, scanner, currently_compiling_chunk,
                               PRECEDENCE_UNARY);
   switch (operator_type) {
+  case TOKEN_BANG:
+    write_instruction_expression(parser, currently_compiling_chunk, OP_NOT);
+    break;
   case TOKEN_MINUS:
     write_instruction_expression(parser, currently_compiling_chunk, OP_NEGATE);
     break;
@@ -132,13 +338,375 @@ static void parse_unary_expression(Parser *parser, Scanner *scanner,
   }
 }
 
+static void parse_statement(Parser *parser, Scanner *scanner,
+                            Chunk *currently_compiling_chunk);
+
+static void parse_block_statement(Parser *parser, Scanner *scanner,
+                                  Chunk *currently_compiling_chunk) {
+  while (!check_parser_token(parser, TOKEN_RIGHT_BRACE) &&
+         !check_parser_token(parser, TOKEN_EOF))
+    parse_declaration(parser, scanner, currently_compiling_chunk);
+  advance_parser_and_validate_token(parser, scanner, TOKEN_RIGHT_BRACE,
+                                    "expected '}' after block.");
+}
+
+static void parse_statement_expression(Parser *parser, Scanner *scanner,
+                                       Chunk *currently_compiling_chunk) {
+  size_t expression_start = currently_compiling_chunk->instructions.used;
+  parse_expression(parser, scanner, currently_compiling_chunk);
+  optimize_expression(parser, currently_compiling_chunk, expression_start,
+                      true);
+}
+
+static void parse_expression_statement(Parser *parser, Scanner *scanner,
+                                       Chunk *currently_compiling_chunk) {
+  size_t expression_start = currently_compiling_chunk->instructions.used;
+  parse_expression(parser, scanner, currently_compiling_chunk);
+  advance_parser_and_validate_token(parser, scanner, TOKEN_SEMICOLON,
+                                    "expected ';' after expression.");
+  if (!optimize_expression(parser, currently_compiling_chunk,
+                           expression_start, false))
+    write_instruction_expression(parser, currently_compiling_chunk, OP_POP);
+}
+
+static void parse_if_statement(Parser *parser, Scanner *scanner,
+                               Chunk *currently_compiling_chunk) {
+  advance_parser_and_validate_token(parser, scanner, TOKEN_LEFT_PARENTHESIS,
+                                    "expected '(' after 'if'.");
+  parse_statement_expression(parser, scanner, currently_compiling_chunk);
+  advance_parser_and_validate_token(parser, scanner, TOKEN_RIGHT_PARENTHESIS,
+                                    "expected ')' after condition.");
+  size_t then_jump =
+      write_condition_jump_expression(parser, currently_compiling_chunk);
+  parse_statement(parser, scanner, currently_compiling_chunk);
+  if (match_parser_token(parser, scanner, TOKEN_ELSE)) {
+    size_t else_jump =
+        write_jump_expression(parser, currently_compiling_chunk, OP_JUMP);
+    patch_jump_expression(parser, currently_compiling_chunk, then_jump);
+    parse_statement(parser, scanner, currently_compiling_chunk);
+    patch_jump_expression(parser, currently_compiling_chunk, else_jump);
+  } else {
+    patch_jump_expression(parser, currently_compiling_chunk, then_jump);
+  }
+}
+
+static void parse_print_statement(Parser *parser, Scanner *scanner,
+                                  Chunk *currently_compiling_chunk) {
+  parse_statement_expression(parser, scanner, currently_compiling_chunk);
+  advance_parser_and_validate_token(parser, scanner, TOKEN_SEMICOLON,
+                                    "expected ';' after value.");
+  write_instruction_expression(parser, currently_compiling_chunk, OP_PRINT);
+}
+
+static void parse_return_statement(Parser *parser, Scanner *scanner,
+                                   Chunk *currently_compiling_chunk) {
+  if (parser->compiler->function_type == FUNCTION_TYPE_SCRIPT)
+    parser_error_at_previous(parser, "can't return from top-level code.");
+  if (match_parser_token(parser, scanner, TOKEN_SEMICOLON)) {
+    write_default_return_expression(parser, currently_compiling_chunk);
+    return;
+  }
+  if (parser->compiler->function_type == FUNCTION_TYPE_INITIALIZER)
+    parser_error_at_previous(parser,
+                             "can't return a value from an initializer.");
+  parse_statement_expression(parser, scanner, currently_compiling_chunk);
+  advance_parser_and_validate_token(parser, scanner, TOKEN_SEMICOLON,
+                                    "expected ';' after return value.");
+  write_return_expression(parser, currently_compiling_chunk);
+}
+
+static void parse_while_statement(Parser *parser, Scanner *scanner,
+                                  Chunk *currently_compiling_chunk) {
+  size_t loop_start = currently_compiling_chunk->instructions.used;
+  advance_parser_and_validate_token(parser, scanner, TOKEN_LEFT_PARENTHESIS,
+                                    "expected '(' after 'while'.");
+  parse_statement_expression(parser, scanner, currently_compiling_chunk);
+  advance_parser_and_validate_token(parser, scanner, TOKEN_RIGHT_PARENTHESIS,
+                                    "expected ')' after condition.");
+  size_t exit_jump =
+      write_condition_jump_expression(parser, currently_compiling_chunk);
+  parse_statement(parser, scanner, currently_compiling_chunk);
+  write_loop_expression(parser, currently_compiling_chunk, loop_start);
+  patch_jump_expression(parser, currently_compiling_chunk, exit_jump);
+}
+
+static void parse_throw_statement(Parser *parser, Scanner *scanner,
+                                  Chunk *currently_compiling_chunk) {
+  parse_statement_expression(parser, scanner, currently_compiling_chunk);
+  advance_parser_and_validate_token(parser, scanner, TOKEN_SEMICOLON,
+                                    "expected ';' after exception.");
+  write_instruction_expression(parser, currently_compiling_chunk, OP_THROW);
+}
+
+static void parse_try_statement(Parser *parser, Scanner *scanner,
+                                Chunk *currently_compiling_chunk) {
+  Compiler *compiler = parser->compiler;
+  size_t try_start = currently_compiling_chunk->instructions.used;
+  int stack_depth = compiler->local_count;
+  advance_parser_and_validate_token(parser, scanner, TOKEN_LEFT_BRACE,
+                                    "expected '{' after 'try'.");
+  compiler->try_depth++;
+  begin_scope(parser);
+  parse_block_statement(parser, scanner, currently_compiling_chunk);
+  end_scope(parser, currently_compiling_chunk);
+  compiler->try_depth--;
+  size_t try_end = currently_compiling_chunk->instructions.used;
+  size_t catch_jump =
+      write_jump_expression(parser, currently_compiling_chunk, OP_JUMP);
+  write_exception_handler_expression(parser, currently_compiling_chunk,
+                                     try_start, try_end, stack_depth);
+  advance_parser_and_validate_token(parser, scanner, TOKEN_CATCH,
+                                    "expected 'catch' after 'try' block.");
+  advance_parser_and_validate_token(parser, scanner, TOKEN_LEFT_PARENTHESIS,
+                                    "expected '(' after 'catch'.");
+  advance_parser_and_validate_token(parser, scanner, TOKEN_IDENTIFIER,
+                                    "expected exception variable name.");
+  begin_scope(parser);
+  declare_local_variable(parser);
+  mark_local_initialized(parser);
+  advance_parser_and_validate_token(parser, scanner, TOKEN_RIGHT_PARENTHESIS,
+                                    "expected ')' after exception variable.");
+  advance_parser_and_validate_token(parser, scanner, TOKEN_LEFT_BRACE,
+                                    "expected '{' after 'catch' clause.");
+  parse_block_statement(parser, scanner, currently_compiling_chunk);
+  end_scope(parser, currently_compiling_chunk);
+  patch_jump_expression(parser, currently_compiling_chunk, catch_jump);
+}
+
+static void parse_statement(Parser *parser, Scanner *scanner,
+                            Chunk *currently_compiling_chunk) {
+  if (match_parser_token(parser, scanner, TOKEN_PRINT)) {
+    parse_print_statement(parser, scanner, currently_compiling_chunk);
+  } else if (match_parser_token(parser, scanner, TOKEN_IF)) {
+    parse_if_statement(parser, scanner, currently_compiling_chunk);
+  } else if (match_parser_token(parser, scanner, TOKEN_RETURN)) {
+    parse_return_statement(parser, scanner, currently_compiling_chunk);
+  } else if (match_parser_token(parser, scanner, TOKEN_WHILE)) {
+    parse_while_statement(parser, scanner, currently_compiling_chunk);
+  } else if (match_parser_token(parser, scanner, TOKEN_TRY)) {
+    parse_try_statement(parser, scanner, currently_compiling_chunk);
+  } else if (match_parser_token(parser, scanner, TOKEN_THROW)) {
+    parse_throw_statement(parser, scanner, currently_compiling_chunk);
+  } else if (match_parser_token(parser, scanner, TOKEN_LEFT_BRACE)) {
+    begin_scope(parser);
+    parse_block_statement(parser, scanner, currently_compiling_chunk);
+    end_scope(parser, currently_compiling_chunk);
+  } else {
+    parse_expression_statement(parser, scanner, currently_compiling_chunk);
+  }
+}
+
+static uint8_t parse_variable_name(Parser *parser, Scanner *scanner,
+                                   Chunk *currently_compiling_chunk,
+                                   const char *error_message) {
+  advance_parser_and_validate_token(parser, scanner, TOKEN_IDENTIFIER,
+                                    error_message);
+  if (parser->compiler->scope_depth > 0) {
+    declare_local_variable(parser);
+    return 0;
+  }
+  return make_identifier_constant(parser, currently_compiling_chunk,
+                                  &parser->previous_token);
+}
+
+static void define_variable(Parser *parser, Chunk *currently_compiling_chunk,
+                            uint8_t global_index) {
+  if (parser->compiler->scope_depth > 0) {
+    mark_local_initialized(parser);
+    return;
+  }
+  write_instruction_expression_multiple(parser, currently_compiling_chunk,
+                                        OP_DEFINE_GLOBAL, global_index);
+}
+
+static void parse_function_parameters(Parser *parser, Scanner *scanner) {
+  ObjectFunction *function = parser->compiler->function;
+  Chunk *function_chunk = &function->chunk;
+  begin_scope(parser);
+  advance_parser_and_validate_token(parser, scanner, TOKEN_LEFT_PARENTHESIS,
+                                    "expected '(' after function name.");
+  if (!check_parser_token(parser, TOKEN_RIGHT_PARENTHESIS)) {
+    do {
+      function->arity++;
+      if (function->arity > UINT8_MAX)
+        parser_error_at_current(parser, "can't have more than 255 parameters.");
+      uint8_t parameter_index = parse_variable_name(
+          parser, scanner, function_chunk, "expected parameter name.");
+      define_variable(parser, function_chunk, parameter_index);
+    } while (match_parser_token(parser, scanner, TOKEN_COMMA));
+  }
+  advance_parser_and_validate_token(parser, scanner, TOKEN_RIGHT_PARENTHESIS,
+                                    "expected ')' after parameters.");
+  advance_parser_and_validate_token(parser, scanner, TOKEN_LEFT_BRACE,
+                                    "expected '{' before function body.");
+}
+
+void parse_function_body(Parser *parser, Scanner *scanner) {
+  parse_function_parameters(parser, scanner);
+  parse_block_statement(parser, scanner, &parser->compiler->function->chunk);
+}
+
+static void skip_function_body(Parser *parser, Scanner *scanner,
+                               Token *parameters_token) {
+  ObjectFunction *function = parser->compiler->function;
+  if (parser->source == NULL)
+    parser->source = copy_string(parser->vm, parser->source_start,
+                                 strlen(parser->source_start));
+  function->source = parser->source;
+  collector_write_barrier(parser->vm, (Object *)function,
+                          OBJECT_CONSTANT(parser->source));
+  function->source_offset =
+      (size_t)(parameters_token->lexeme_start - parser->source_start);
+  function->source_line_number = parameters_token->line_number;
+  int brace_depth = 1;
+  while (!check_parser_token(parser, TOKEN_EOF)) {
+    if (check_parser_token(parser, TOKEN_LEFT_BRACE))
+      brace_depth++;
+    else if (check_parser_token(parser, TOKEN_RIGHT_BRACE) &&
+             --brace_depth == 0)
+      break;
+    advance_parser(parser, scanner);
+  }
+  advance_parser_and_validate_token(parser, scanner, TOKEN_RIGHT_BRACE,
+                                    "expected '}' after block.");
+}
+
+static void parse_function(Parser *parser, Scanner *scanner,
+                           Chunk *currently_compiling_chunk,
+                           FunctionType function_type) {
+  Compiler compiler;
+  init_compiler(parser, &compiler, function_type);
+  Token parameters_token = parser->current_token;
+  parse_function_parameters(parser, scanner);
+  if (parser->vm->compiles_lazily)
+    skip_function_body(parser, scanner, &parameters_token);
+  else
+    parse_block_statement(parser, scanner, &compiler.function->chunk);
+  ObjectFunction *function = end_compiler(parser);
+  write_constant_expression(parser, currently_compiling_chunk,
+                            OBJECT_CONSTANT(function));
+}
+
+static void parse_method(Parser *parser, Scanner *scanner,
+                         Chunk *currently_compiling_chunk) {
+  advance_parser_and_validate_token(parser, scanner, TOKEN_IDENTIFIER,
+                                    "expected method name.");
+  Token initializer_name = {.lexeme_start = "init", .lexeme_length = 4};
+  FunctionType function_type =
+      identifiers_are_equal(&parser->previous_token, &initializer_name)
+          ? FUNCTION_TYPE_INITIALIZER
+          : FUNCTION_TYPE_METHOD;
+  uint8_t name_index = make_identifier_constant(
+      parser, currently_compiling_chunk, &parser->previous_token);
+  parse_function(parser, scanner, currently_compiling_chunk, function_type);
+  write_instruction_expression_multiple(parser, currently_compiling_chunk,
+                                        OP_METHOD, name_index);
+}
+
+static void parse_class_declaration(Parser *parser, Scanner *scanner,
+                                    Chunk *currently_compiling_chunk) {
+  advance_parser_and_validate_token(parser, scanner, TOKEN_IDENTIFIER,
+                                    "expected class name.");
+  Token class_name = parser->previous_token;
+  uint8_t name_index =
+      make_identifier_constant(parser, currently_compiling_chunk, &class_name);
+  if (parser->compiler->scope_depth > 0)
+    declare_local_variable(parser);
+  write_instruction_expression_multiple(parser, currently_compiling_chunk,
+                                        OP_CLASS, name_index);
+  define_variable(parser, currently_compiling_chunk, name_index);
+  if (match_parser_token(parser, scanner, TOKEN_LESS)) {
+    advance_parser_and_validate_token(parser, scanner, TOKEN_IDENTIFIER,
+                                      "expected superclass name.");
+    if (identifiers_are_equal(&class_name, &parser->previous_token))
+      parser_error_at_previous(parser, "a class can't inherit from itself.");
+    parse_variable_expression(parser, scanner, currently_compiling_chunk,
+                              false);
+    parse_named_variable(parser, scanner, currently_compiling_chunk,
+                         class_name, false);
+    write_instruction_expression(parser, currently_compiling_chunk,
+                                 OP_INHERIT);
+  }
+  parse_named_variable(parser, scanner, currently_compiling_chunk, class_name,
+                       false);
+  advance_parser_and_validate_token(parser, scanner, TOKEN_LEFT_BRACE,
+                                    "expected '{' before class body.");
+  while (!check_parser_token(parser, TOKEN_RIGHT_BRACE) &&
+         !check_parser_token(parser, TOKEN_EOF))
+    parse_method(parser, scanner, currently_compiling_chunk);
+  advance_parser_and_validate_token(parser, scanner, TOKEN_RIGHT_BRACE,
+                                    "expected '}' after class body.");
+  write_instruction_expression(parser, currently_compiling_chunk, OP_POP);
+}
+
+static void parse_function_declaration(Parser *parser, Scanner *scanner,
+                                       Chunk *currently_compiling_chunk) {
+  uint8_t global_index = parse_variable_name(
+      parser, scanner, currently_compiling_chunk, "expected function name.");
+  if (parser->compiler->scope_depth > 0)
+    mark_local_initialized(parser);
+  parse_function(parser, scanner, currently_compiling_chunk,
+                 FUNCTION_TYPE_FUNCTION);
+  define_variable(parser, currently_compiling_chunk, global_index);
+}
+
+static void parse_variable_declaration(Parser *parser, Scanner *scanner,
+                                       Chunk *currently_compiling_chunk) {
+  uint8_t global_index = parse_variable_name(
+      parser, scanner, currently_compiling_chunk, "expected variable name.");
+  if (match_parser_token(parser, scanner, TOKEN_EQUAL))
+    parse_statement_expression(parser, scanner, currently_compiling_chunk);
+  else
+    write_instruction_expression(parser, currently_compiling_chunk, OP_NIL);
+  advance_parser_and_validate_token(parser, scanner, TOKEN_SEMICOLON,
+                                    "expected ';' after variable declaration.");
+  define_variable(parser, currently_compiling_chunk, global_index);
+}
+
+static void synchronize_parser(Parser *parser, Scanner *scanner) {
+  parser->is_panic = false;
+  while (parser->current_token.type != TOKEN_EOF) {
+    if (parser->previous_token.type == TOKEN_SEMICOLON)
+      return;
+    switch (parser->current_token.type) {
+    case TOKEN_CLASS:
+    case TOKEN_FUNCTION:
+    case TOKEN_VAR:
+    case TOKEN_FOR:
+    case TOKEN_IF:
+    case TOKEN_WHILE:
+    case TOKEN_PRINT:
+    case TOKEN_RETURN:
+    case TOKEN_TRY:
+    case TOKEN_THROW:
+      return;
+    default:
+      advance_parser(parser, scanner);
+    }
+  }
+}
+
+void parse_declaration(Parser *parser, Scanner *scanner,
+                       Chunk *currently_compiling_chunk) {
+  if (match_parser_token(parser, scanner, TOKEN_CLASS))
+    parse_class_declaration(parser, scanner, currently_compiling_chunk);
+  else if (match_parser_token(parser, scanner, TOKEN_FUNCTION))
+    parse_function_declaration(parser, scanner, currently_compiling_chunk);
+  else if (match_parser_token(parser, scanner, TOKEN_VAR))
+    parse_variable_declaration(parser, scanner, currently_compiling_chunk);
+  else
+    parse_statement(parser, scanner, currently_compiling_chunk);
+  if (parser->is_panic)
+    synchronize_parser(parser, scanner);
+}
+
 ParsingRule token_type_to_parsing_rules[] = {
-    [TOKEN_LEFT_PARENTHESIS] = {parse_grouping_expression, NULL,
-                                PRECEDENCE_NONE},
+    [TOKEN_LEFT_PARENTHESIS] = {parse_grouping_expression,
+                                parse_call_expression, PRECEDENCE_CALL},
     [TOKEN_RIGHT_PARENTHESIS] = {NULL, NULL, PRECEDENCE_NONE},
     [TOKEN_LEFT_BRACE] = {NULL, NULL, PRECEDENCE_NONE},
     [TOKEN_RIGHT_BRACE] = {NULL, NULL, PRECEDENCE_NONE},
-    [TOKEN_DOT] = {NULL, NULL, PRECEDENCE_NONE},
+    [TOKEN_DOT] = {NULL, parse_dot_expression, PRECEDENCE_CALL},
     [TOKEN_COMMA] = {NULL, NULL, PRECEDENCE_NONE},
     [TOKEN_SEMICOLON] = {NULL, NULL, PRECEDENCE_NONE},
     [TOKEN_PLUS] = {NULL, parse_binary_expression, PRECEDENCE_TERM},
@@ -146,33 +714,36 @@ ParsingRule token_type_to_parsing_rules[] = {
                      PRECEDENCE_TERM},
     [TOKEN_STAR] = {NULL, parse_binary_expression, PRECEDENCE_FACTOR},
     [TOKEN_SLASH] = {NULL, parse_binary_expression, PRECEDENCE_FACTOR},
-    [TOKEN_BANG] = {NULL, NULL, PRECEDENCE_NONE},
-    [TOKEN_BANG_EQUAL] = {NULL, NULL, PRECEDENCE_NONE},
+    [TOKEN_BANG] = {parse_unary_expression, NULL, PRECEDENCE_NONE},
+    [TOKEN_BANG_EQUAL] = {NULL, parse_binary_expression, PRECEDENCE_EQUALITY},
     [TOKEN_EQUAL] = {NULL, NULL, PRECEDENCE_NONE},
-    [TOKEN_EQUAL_EQUAL] = {NULL, NULL, PRECEDENCE_NONE},
-    [TOKEN_GREATER] = {NULL, NULL, PRECEDENCE_NONE},
-    [TOKEN_GREATER_EQUAL] = {NULL, NULL, PRECEDENCE_NONE},
-    [TOKEN_LESS] = {NULL, NULL, PRECEDENCE_NONE},
-    [TOKEN_LESS_EQUAL] = {NULL, NULL, PRECEDENCE_NONE},
-    [TOKEN_IDENTIFIER] = {NULL, NULL, PRECEDENCE_NONE},
+    [TOKEN_EQUAL_EQUAL] = {NULL, parse_binary_expression, PRECEDENCE_EQUALITY},
+    [TOKEN_GREATER] = {NULL, parse_binary_expression, PRECEDENCE_COMPARISON},
+    [TOKEN_GREATER_EQUAL] = {NULL, parse_binary_expression, PRECEDENCE_COMPARISON},
+    [TOKEN_LESS] = {NULL, parse_binary_expression, PRECEDENCE_COMPARISON},
+    [TOKEN_LESS_EQUAL] = {NULL, parse_binary_expression, PRECEDENCE_COMPARISON},
+    [TOKEN_IDENTIFIER] = {parse_variable_expression, NULL, PRECEDENCE_NONE},
     [TOKEN_VAR] = {NULL, NULL, PRECEDENCE_NONE},
-    [TOKEN_STRING] = {NULL, NULL, PRECEDENCE_NONE},
+    [TOKEN_STRING] = {parse_string_expression, NULL, PRECEDENCE_NONE},
     [TOKEN_NUMBER] = {parse_numeric_expresion, NULL, PRECEDENCE_NONE},
-    [TOKEN_NIL] = {NULL, NULL, PRECEDENCE_NONE},
+    [TOKEN_NIL] = {parse_literal_expression, NULL, PRECEDENCE_NONE},
     [TOKEN_IF] = {NULL, NULL, PRECEDENCE_NONE},
     [TOKEN_ELSE] = {NULL, NULL, PRECEDENCE_NONE},
-    [TOKEN_AND] = {NULL, NULL, PRECEDENCE_NONE},
-    [TOKEN_OR] = {NULL, NULL, PRECEDENCE_NONE},
-    [TOKEN_TRUE] = {NULL, NULL, PRECEDENCE_NONE},
-    [TOKEN_FALSE] = {NULL, NULL, PRECEDENCE_NONE},
+    [TOKEN_AND] = {NULL, parse_and_expression, PRECEDENCE_AND},
+    [TOKEN_OR] = {NULL, parse_or_expression, PRECEDENCE_OR},
+    [TOKEN_TRUE] = {parse_literal_expression, NULL, PRECEDENCE_NONE},
+    [TOKEN_FALSE] = {parse_literal_expression, NULL, PRECEDENCE_NONE},
     [TOKEN_FUNCTION] = {NULL, NULL, PRECEDENCE_NONE},
     [TOKEN_FOR] = {NULL, NULL, PRECEDENCE_NONE},
     [TOKEN_WHILE] = {NULL, NULL, PRECEDENCE_NONE},
     [TOKEN_RETURN] = {NULL, NULL, PRECEDENCE_NONE},
     [TOKEN_CLASS] = {NULL, NULL, PRECEDENCE_NONE},
-    [TOKEN_THIS] = {NULL, NULL, PRECEDENCE_NONE},
+    [TOKEN_THIS] = {parse_this_expression, NULL, PRECEDENCE_NONE},
     [TOKEN_SUPER] = {NULL, NULL, PRECEDENCE_NONE},
     [TOKEN_PRINT] = {NULL, NULL, PRECEDENCE_NONE},
+    [TOKEN_TRY] = {NULL, NULL, PRECEDENCE_NONE},
+    [TOKEN_CATCH] = {NULL, NULL, PRECEDENCE_NONE},
+    [TOKEN_THROW] = {NULL, NULL, PRECEDENCE_NONE},
     [TOKEN_ERROR] = {NULL, NULL, PRECEDENCE_NONE},
     [TOKEN_EOF] = {NULL, NULL, PRECEDENCE_NONE},
 };
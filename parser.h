@@ -4,12 +4,26 @@
 #include "chunk.h"
 #include "scanner.h"
 #include "token.h"
+#include "vm.h"
 
+/* The compiler's state, such as the local variables in scope, is defined in
+ * compiler.h. */
+typedef struct Compiler Compiler;
 /* Our parser keeps asking the scanner for the next token and stores it for
  * later use. Before doing that, it takes the "old" current token and stashes
  * it in the "previous_token" field. This way, we can keep track of the last
- * token we read and the current one. */
+ * token we read and the current one. The parser also keeps a pointer to the
+ * virtual machine it is compiling for, which owns the objects it creates, and
+ * to the compiler that tracks the scopes it is going through. Function bodies
+ * that are skimmed rather than compiled are located by their offset from
+ * "source_start", the start of the input being parsed; "source" is the string
+ * object holding a copy of that input, which is only created once the first
+ * body is skimmed. */
 typedef struct {
+  VirtualMachine *vm;
+  Compiler *compiler;
+  const char *source_start;
+  ObjectString *source;
   Token current_token;
   Token previous_token;
   bool is_error;
@@ -33,11 +47,13 @@ typedef enum {
 } ParsingPrecedence;
 /* This type defines the function signature for a parsing function. Each
  * parsing function takes a pointer to the parser, a pointer to the
- * scanner and a pointer to the chunk that we're currently compiling. The
+ * scanner, a pointer to the chunk that we're currently compiling and whether
+ * the expression being parsed can be the target of an assignment. The
  * function then parses the token and generates the corresponding bytecode
  * instruction. */
 typedef void (*ParsingFunction)(Parser *parser, Scanner *scanner,
-                                Chunk *currently_compiling_chunk);
+                                Chunk *currently_compiling_chunk,
+                                bool can_assign);
 /* A parsing rule is made of two parsing functions: a prefix function and an
  * infix function. The prefix function is used to parse the token when it is
  * the first token in an expression, while the infix function is used to parse
@@ -54,9 +70,10 @@ typedef struct {
  * false, resetting in fact the parser to a non-error state.
  *
  * @param parser A pointer to the parser to initialize
+ * @param vm A pointer to the virtual machine the parser is compiling for
  * @return void
  */
-void init_parser(Parser *parser);
+void init_parser(Parser *parser, VirtualMachine *vm);
 /*
  * @brief Advance the parser to the next token.
  * This function will advance the parser to the next token by calling the
@@ -143,6 +160,20 @@ void parse_expression_precedence(Parser *parser, Scanner *scanner,
  */
 void parse_expression(Parser *parser, Scanner *scanner,
                       Chunk *currently_compiling_chunk);
+/*
+ * @brief Parse a declaration.
+ * This function will parse either a variable declaration or a statement. If
+ * an error was reported while parsing it, the parser is resynchronized at the
+ * start of the next statement so that further errors can be reported.
+ *
+ * @param parser A pointer to the parser to advance
+ * @param scanner A pointer to the scanner that will scan the input
+ * @param currently_compiling_chunk A pointer to the chunk that is being
+ * compiled
+ * @return void
+ */
+void parse_declaration(Parser *parser, Scanner *scanner,
+                       Chunk *currently_compiling_chunk);
 /*
  * @brief Map a token type to its parsing rule.
  * This function will map a given token type to its corresponding set of parsing
@@ -152,5 +183,18 @@ void parse_expression(Parser *parser, Scanner *scanner,
  * @return A pointer to the set of parsing rule for the given token type
  */
 ParsingRule *get_parsing_rule(TokenType token_type);
+/*
+ * @brief Parse the parameters and the body of a function.
+ * This function will parse the parameter list, starting from its opening
+ * parenthesis, and the block that follows it into the chunk of the function
+ * being compiled by the parser's current compiler. Function declarations
+ * nested in the body are skimmed rather than compiled when the virtual machine
+ * compiles lazily.
+ *
+ * @param parser A pointer to the parser to advance
+ * @param scanner A pointer to the scanner that will scan the input
+ * @return void
+ */
+void parse_function_body(Parser *parser, Scanner *scanner);
 
 #endif
@@ -0,0 +1,277 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+#include "memory.h"
+#include "profiler.h"
+#include "vm.h"
+
+static VirtualMachine *profiled_vm = NULL;
+static timer_t profiler_timer;
+
+void init_profiler(Profiler *profiler) {
+  profiler->is_running = false;
+  profiler->frames = NULL;
+  profiler->frames_used = 0;
+  profiler->frames_registered = 0;
+  profiler->samples_taken = 0;
+  profiler->samples_dropped = 0;
+  profiler->functions_used = 0;
+  profiler->functions_capacity = 0;
+  profiler->functions = NULL;
+}
+
+void free_profiler(Profiler *profiler) {
+  if (profiler->frames != NULL)
+    FREE_ARRAY(MEMORY_TAG_PROFILER, ProfilerFrame, profiler->frames,
+               PROFILER_MAX_FRAMES);
+  FREE_ARRAY(MEMORY_TAG_PROFILER, ObjectFunction *, profiler->functions,
+             profiler->functions_capacity);
+  init_profiler(profiler);
+}
+
+static size_t get_sampled_offset(CallFrame *frame) {
+  Chunk *chunk = &frame->function->chunk;
+  if (!frame->runs_on_registers)
+    return (size_t)(frame->instruction_pointer - chunk->instructions.values);
+  size_t index = (size_t)(frame->register_pointer - chunk->registers.values);
+  if (index == 0 || index > chunk->registers.used)
+    return 0;
+  return chunk->registers.offsets[index - 1] + 1;
+}
+
+static void record_sample(int signal_number) {
+  (void)signal_number;
+  VirtualMachine *vm = profiled_vm;
+  Profiler *profiler = &vm->profiler;
+  size_t frame_count = (size_t)vm->frame_count;
+  if (frame_count == 0)
+    return;
+  if (PROFILER_MAX_FRAMES - profiler->frames_used < frame_count + 1) {
+    profiler->samples_dropped++;
+    return;
+  }
+  ProfilerFrame *frames = &profiler->frames[profiler->frames_used];
+  for (size_t i = 0; i < frame_count; i++) {
+    CallFrame *frame = &vm->frames[i];
+    frames[i].function = frame->function;
+    frames[i].offset = get_sampled_offset(frame);
+  }
+  frames[frame_count].function = NULL;
+  frames[frame_count].offset = 0;
+  atomic_signal_fence(memory_order_release);
+  profiler->frames_used += frame_count + 1;
+  profiler->samples_taken++;
+}
+
+bool start_profiler(VirtualMachine *vm) {
+  if (profiled_vm != NULL)
+    return false;
+  Profiler *profiler = &vm->profiler;
+  if (profiler->frames == NULL)
+    profiler->frames = GROW_ARRAY(MEMORY_TAG_PROFILER, ProfilerFrame, NULL, 0,
+                                  PROFILER_MAX_FRAMES);
+  profiled_vm = vm;
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = record_sample;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  struct sigevent timer_event;
+  memset(&timer_event, 0, sizeof(timer_event));
+  timer_event.sigev_notify = SIGEV_SIGNAL;
+  timer_event.sigev_signo = SIGPROF;
+  if (sigaction(SIGPROF, &action, NULL) != 0 ||
+      timer_create(CLOCK_PROCESS_CPUTIME_ID, &timer_event, &profiler_timer) !=
+          0) {
+    profiled_vm = NULL;
+    return false;
+  }
+  struct itimerspec timer_interval;
+  timer_interval.it_interval.tv_sec = 0;
+  timer_interval.it_interval.tv_nsec = PROFILER_SAMPLING_INTERVAL * 1000;
+  timer_interval.it_value = timer_interval.it_interval;
+  if (timer_settime(profiler_timer, 0, &timer_interval, NULL) != 0) {
+    timer_delete(profiler_timer);
+    profiled_vm = NULL;
+    return false;
+  }
+  profiler->is_running = true;
+  return true;
+}
+
+void stop_profiler(VirtualMachine *vm) {
+  if (!vm->profiler.is_running)
+    return;
+  timer_delete(profiler_timer);
+  signal(SIGPROF, SIG_DFL);
+  profiled_vm = NULL;
+  vm->profiler.is_running = false;
+}
+
+static size_t get_registered_frames_count(Profiler *profiler) {
+  sigset_t profiler_signals;
+  sigset_t previous_signals;
+  sigemptyset(&profiler_signals);
+  sigaddset(&profiler_signals, SIGPROF);
+  sigprocmask(SIG_BLOCK, &profiler_signals, &previous_signals);
+  size_t frames_used = profiler->frames_used;
+  sigprocmask(SIG_SETMASK, &previous_signals, NULL);
+  return frames_used;
+}
+
+static void register_profiled_function(Profiler *profiler,
+                                       ObjectFunction *function) {
+  for (size_t i = profiler->functions_used; i > 0; i--) {
+    if (profiler->functions[i - 1] == function)
+      return;
+  }
+  if (profiler->functions_capacity < profiler->functions_used + 1) {
+    size_t current_capacity = profiler->functions_capacity;
+    profiler->functions_capacity = COMPUTE_ARRAY_CAPACITY(current_capacity);
+    profiler->functions =
+        GROW_ARRAY(MEMORY_TAG_PROFILER, ObjectFunction *, profiler->functions,
+                   current_capacity, profiler->functions_capacity);
+  }
+  profiler->functions[profiler->functions_used] = function;
+  profiler->functions_used++;
+}
+
+void register_profiled_functions(Profiler *profiler) {
+  if (profiler->frames == NULL)
+    return;
+  size_t frames_used = get_registered_frames_count(profiler);
+  ObjectFunction *last_function = NULL;
+  for (size_t i = profiler->frames_registered; i < frames_used; i++) {
+    ObjectFunction *function = profiler->frames[i].function;
+    if (function == NULL || function == last_function)
+      continue;
+    register_profiled_function(profiler, function);
+    last_function = function;
+  }
+  profiler->frames_registered = frames_used;
+}
+
+static size_t get_frame_line_number(ProfilerFrame *frame) {
+  InstructionsArray *instructions = &frame->function->chunk.instructions;
+  size_t offset = frame->offset == 0 ? 0 : frame->offset - 1;
+  if (offset >= instructions->used)
+    return 0;
+  return instructions->line_numbers[offset];
+}
+
+static int compare_profiler_lines(const void *first, const void *second) {
+  const ProfilerLine *first_line = (const ProfilerLine *)first;
+  const ProfilerLine *second_line = (const ProfilerLine *)second;
+  if (first_line->samples != second_line->samples)
+    return first_line->samples > second_line->samples ? -1 : 1;
+  if (first_line->line_number != second_line->line_number)
+    return first_line->line_number < second_line->line_number ? -1 : 1;
+  return 0;
+}
+
+static void write_line_report(Profiler *profiler, size_t frames_used,
+                              FILE *line_report) {
+  size_t lines_used = 0;
+  size_t lines_capacity = 0;
+  ProfilerLine *lines = NULL;
+  for (size_t i = 0; i < frames_used; i++) {
+    if (profiler->frames[i].function != NULL ||
+        i == 0 || profiler->frames[i - 1].function == NULL)
+      continue;
+    size_t line_number = get_frame_line_number(&profiler->frames[i - 1]);
+    size_t line_index = 0;
+    while (line_index < lines_used &&
+           lines[line_index].line_number != line_number)
+      line_index++;
+    if (line_index == lines_used) {
+      if (lines_capacity < lines_used + 1) {
+        size_t current_capacity = lines_capacity;
+        lines_capacity = COMPUTE_ARRAY_CAPACITY(current_capacity);
+        lines = GROW_ARRAY(MEMORY_TAG_PROFILER, ProfilerLine, lines,
+                           current_capacity, lines_capacity);
+      }
+      lines[lines_used].line_number = line_number;
+      lines[lines_used].samples = 0;
+      lines_used++;
+    }
+    lines[line_index].samples++;
+  }
+  if (lines_used > 0)
+    qsort(lines, lines_used, sizeof(ProfilerLine), compare_profiler_lines);
+  fprintf(line_report, "profile: %zu samples, %zu dropped\n",
+          profiler->samples_taken, profiler->samples_dropped);
+  for (size_t i = 0; i < lines_used; i++) {
+    fprintf(line_report, "[line:%zu] %zu samples (%.1f%%)\n",
+            lines[i].line_number, lines[i].samples,
+            100.0 * (double)lines[i].samples /
+                (double)profiler->samples_taken);
+  }
+  FREE_ARRAY(MEMORY_TAG_PROFILER, ProfilerLine, lines, lines_capacity);
+}
+
+static size_t format_folded_frame(ProfilerFrame *frame, bool is_outermost,
+                                  char *buffer, size_t buffer_size) {
+  ObjectString *name = frame->function->name;
+  return (size_t)snprintf(buffer, buffer_size, "%s%s:%zu",
+                          is_outermost ? "" : ";",
+                          name == NULL ? "script" : name->characters,
+                          get_frame_line_number(frame));
+}
+
+static char *format_folded_stack(ProfilerFrame *frames, size_t frame_count) {
+  size_t length = 0;
+  for (size_t i = 0; i < frame_count; i++)
+    length += format_folded_frame(&frames[i], i == 0, NULL, 0);
+  char *stack = GROW_ARRAY(MEMORY_TAG_PROFILER, char, NULL, 0, length + 1);
+  size_t used = 0;
+  for (size_t i = 0; i < frame_count; i++)
+    used += format_folded_frame(&frames[i], i == 0, stack + used,
+                                length + 1 - used);
+  stack[length] = '\0';
+  return stack;
+}
+
+static int compare_folded_stacks(const void *first, const void *second) {
+  return strcmp(*(char *const *)first, *(char *const *)second);
+}
+
+static void write_folded_stacks(Profiler *profiler, size_t frames_used,
+                                FILE *folded_stacks) {
+  size_t stacks_count = profiler->samples_taken;
+  char **stacks =
+      GROW_ARRAY(MEMORY_TAG_PROFILER, char *, NULL, 0, stacks_count);
+  size_t stacks_used = 0;
+  size_t sample_start = 0;
+  for (size_t i = 0; i < frames_used && stacks_used < stacks_count; i++) {
+    if (profiler->frames[i].function != NULL)
+      continue;
+    stacks[stacks_used++] =
+        format_folded_stack(&profiler->frames[sample_start], i - sample_start);
+    sample_start = i + 1;
+  }
+  if (stacks_used > 0)
+    qsort(stacks, stacks_used, sizeof(char *), compare_folded_stacks);
+  for (size_t i = 0; i < stacks_used;) {
+    size_t run_end = i + 1;
+    while (run_end < stacks_used && strcmp(stacks[i], stacks[run_end]) == 0)
+      run_end++;
+    fprintf(folded_stacks, "%s %zu\n", stacks[i], run_end - i);
+    i = run_end;
+  }
+  for (size_t i = 0; i < stacks_used; i++)
+    FREE_ARRAY(MEMORY_TAG_PROFILER, char, stacks[i], strlen(stacks[i]) + 1);
+  FREE_ARRAY(MEMORY_TAG_PROFILER, char *, stacks, stacks_count);
+}
+
+void write_profiler_report(Profiler *profiler, FILE *line_report,
+                           FILE *folded_stacks) {
+  if (profiler->frames == NULL)
+    return;
+  size_t frames_used = get_registered_frames_count(profiler);
+  write_line_report(profiler, frames_used, line_report);
+  write_folded_stacks(profiler, frames_used, folded_stacks);
+}
@@ -0,0 +1,112 @@
+#ifndef interpres_profiler_h
+#define interpres_profiler_h
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "object.h"
+
+/* Here we define how often, in microseconds of CPU time, the profiler samples
+ * the call stack of the program being profiled. */
+#define PROFILER_SAMPLING_INTERVAL 1000
+/* Here we define the number of frames the profiler can record before it runs
+ * out of space. The frames are allocated up front, since samples are taken
+ * from a signal handler that cannot allocate memory; samples that do not fit
+ * are dropped and counted. */
+#define PROFILER_MAX_FRAMES (1024 * 1024)
+/* Each sample is recorded as the sequence of the frames that were active when
+ * it was taken, outermost first, followed by a frame whose function is NULL.
+ * Every frame remembers the function being executed and the offset of the
+ * next instruction to execute in its chunk. */
+typedef struct {
+  ObjectFunction *function;
+  size_t offset;
+} ProfilerFrame;
+/* The profiler records samples into the preallocated "frames" array, of which
+ * "frames_used" are taken, along with the number of samples taken and dropped.
+ * Since the recorded functions may become unreachable before the report is
+ * written, the profiler keeps every function it has sampled in the
+ * "functions" dynamic array, which the garbage collector treats as a root;
+ * "frames_registered" counts the frames whose function has already been added
+ * to it. */
+typedef struct {
+  bool is_running;
+  ProfilerFrame *frames;
+  size_t frames_used;
+  size_t frames_registered;
+  size_t samples_taken;
+  size_t samples_dropped;
+  size_t functions_used;
+  size_t functions_capacity;
+  ObjectFunction **functions;
+} Profiler;
+/* The per-line report aggregates samples by the line number of the innermost
+ * frame they were taken in. */
+typedef struct {
+  size_t line_number;
+  size_t samples;
+} ProfilerLine;
+/*
+ * @brief Initialize a new, stopped profiler with no samples.
+ *
+ * @param profiler A pointer to the profiler to initialize
+ * @return void
+ */
+void init_profiler(Profiler *profiler);
+/*
+ * @brief Free the profiler.
+ * This function will release the memory held by the profiler, discarding its
+ * samples, and re-initialize it to an empty state. The profiler must have been
+ * stopped first.
+ *
+ * @param profiler A pointer to the profiler to free
+ * @return void
+ */
+void free_profiler(Profiler *profiler);
+/*
+ * @brief Start sampling the call stack of a virtual machine.
+ * This function will install a SIGPROF handler and arm a timer that delivers
+ * it every PROFILER_SAMPLING_INTERVAL microseconds of CPU time. Only one
+ * virtual machine per process can be profiled at a time.
+ *
+ * @param vm A pointer to the virtual machine to profile
+ * @return Whether sampling could be started or not
+ */
+bool start_profiler(VirtualMachine *vm);
+/*
+ * @brief Stop sampling the call stack of a virtual machine.
+ * The samples taken so far are kept until the profiler is freed.
+ *
+ * @param vm A pointer to the virtual machine being profiled
+ * @return void
+ */
+void stop_profiler(VirtualMachine *vm);
+/*
+ * @brief Add the functions of the latest samples to the profiler's roots.
+ * This function has to be called by the garbage collector whenever it marks
+ * its roots, so that no sampled function is freed before the report is
+ * written.
+ *
+ * @param profiler A pointer to the profiler whose samples to register
+ * @return void
+ */
+void register_profiled_functions(Profiler *profiler);
+/*
+ * @brief Write the report of the samples taken by the profiler.
+ * The number of samples taken by every line is written to "line_report",
+ * hottest lines first. Every distinct call stack is written to
+ * "folded_stacks" on a line of its own, with its frames separated by ';' and
+ * followed by the number of samples taken in it, which is the folded format
+ * read by flame graph tools. Frames are named after their function and the
+ * line they were executing.
+ *
+ * @param profiler A pointer to the profiler whose samples to report
+ * @param line_report The file to write the per-line report to
+ * @param folded_stacks The file to write the folded call stacks to
+ * @return void
+ */
+void write_profiler_report(Profiler *profiler, FILE *line_report,
+                           FILE *folded_stacks);
+
+#endif
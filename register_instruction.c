@@ -0,0 +1,51 @@
+#include "register_instruction.h"
+#include "memory.h"
+
+void init_register_instructions_array(RegisterInstructionsArray *array) {
+  array->used = 0;
+  array->capacity = 0;
+  array->values = NULL;
+  array->offsets = NULL;
+  array->registers_count = 0;
+}
+
+void free_register_instructions_array(RegisterInstructionsArray *array) {
+  FREE_ARRAY(MEMORY_TAG_REGISTER_INSTRUCTIONS, RegisterInstruction,
+             array->values, array->capacity);
+  FREE_ARRAY(MEMORY_TAG_REGISTER_INSTRUCTIONS, size_t, array->offsets,
+             array->capacity);
+  init_register_instructions_array(array);
+}
+
+size_t write_register_instructions_array(RegisterInstructionsArray *array,
+                                         RegisterInstruction instruction,
+                                         size_t offset) {
+  if (array->capacity < array->used + 1) {
+    size_t current_capacity = array->capacity;
+    array->capacity = COMPUTE_ARRAY_CAPACITY(current_capacity);
+    array->values =
+        GROW_ARRAY(MEMORY_TAG_REGISTER_INSTRUCTIONS, RegisterInstruction,
+                   array->values, current_capacity, array->capacity);
+    array->offsets =
+        GROW_ARRAY(MEMORY_TAG_REGISTER_INSTRUCTIONS, size_t, array->offsets,
+                   current_capacity, array->capacity);
+  }
+  array->values[array->used] = instruction;
+  array->offsets[array->used] = offset;
+  array->used++;
+  return array->used - 1;
+}
+
+size_t find_register_instruction(RegisterInstructionsArray *array,
+                                 size_t offset) {
+  size_t low = 0;
+  size_t high = array->used;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (array->offsets[middle] < offset)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low;
+}
@@ -0,0 +1,145 @@
+#ifndef interpres_register_instruction_h
+#define interpres_register_instruction_h
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Register instructions name the registers they read and write instead of
+ * popping and pushing values: a register is a slot of the call frame, so that
+ * local variables are registers too and "a + b" runs as a single OP_ADD that
+ * reads both locals in place. Operands can also refer to a constant of the
+ * chunk, as flagged by these bits of "operand_kinds". */
+#define REGISTER_FIRST_OPERAND_IS_CONSTANT 0x01
+#define REGISTER_SECOND_OPERAND_IS_CONSTANT 0x02
+/* Property accesses and invocations pack the index of the property's name and
+ * the index of their inline cache into their "argument". */
+#define REGISTER_ARGUMENT_SHIFT 16
+#define REGISTER_ARGUMENT_MASK 0xffff
+/* Each register instruction is translated from one or more bytecode
+ * instructions of the same chunk, with the same meaning as the bytecode
+ * instruction it is named after, except that:
+ * - REGISTER_OP_MOVE copies its first operand to its destination register;
+ * - REGISTER_OP_JUMP_IF_FALSE covers both OP_JUMP_IF_FALSE and
+ * OP_POP_JUMP_IF_FALSE, since testing a register never pops it;
+ * - jumps and loops hold the index of the register instruction they jump to in
+ * their "argument", and loops also hold the fuel they consume, which is the
+ * size of the loop's bytecode, in their first operand;
+ * - calls and invocations hold the register of the callee in "destination"
+ * and the number of arguments, which are found in the following registers, in
+ * their first operand;
+ * - global variables, classes and methods hold the index of their name in
+ * "argument". */
+typedef enum {
+  REGISTER_OP_MOVE,
+  REGISTER_OP_NIL,
+  REGISTER_OP_TRUE,
+  REGISTER_OP_FALSE,
+  REGISTER_OP_DEFINE_GLOBAL,
+  REGISTER_OP_GET_GLOBAL,
+  REGISTER_OP_SET_GLOBAL,
+  REGISTER_OP_EQUAL,
+  REGISTER_OP_NOT_EQUAL,
+  REGISTER_OP_GREATER,
+  REGISTER_OP_GREATER_EQUAL,
+  REGISTER_OP_LESS,
+  REGISTER_OP_LESS_EQUAL,
+  REGISTER_OP_ADD,
+  REGISTER_OP_SUBTRACT,
+  REGISTER_OP_MULTIPLY,
+  REGISTER_OP_DIVIDE,
+  REGISTER_OP_NOT,
+  REGISTER_OP_NEGATE,
+  REGISTER_OP_PRINT,
+  REGISTER_OP_JUMP,
+  REGISTER_OP_JUMP_IF_FALSE,
+  REGISTER_OP_JUMP_IF_EQUAL,
+  REGISTER_OP_JUMP_IF_NOT_EQUAL,
+  REGISTER_OP_JUMP_IF_NOT_GREATER,
+  REGISTER_OP_JUMP_IF_NOT_GREATER_EQUAL,
+  REGISTER_OP_JUMP_IF_NOT_LESS,
+  REGISTER_OP_JUMP_IF_NOT_LESS_EQUAL,
+  REGISTER_OP_LOOP,
+  REGISTER_OP_CALL,
+  REGISTER_OP_TAIL_CALL,
+  REGISTER_OP_GET_PROPERTY,
+  REGISTER_OP_SET_PROPERTY,
+  REGISTER_OP_INVOKE,
+  REGISTER_OP_TAIL_INVOKE,
+  REGISTER_OP_CLASS,
+  REGISTER_OP_INHERIT,
+  REGISTER_OP_METHOD,
+  REGISTER_OP_THROW,
+  REGISTER_OP_RETURN,
+} RegisterOpCode;
+/* A register instruction has a fixed size: an opcode, the kinds of its two
+ * operands, the register it writes its result to, its two operands (each of
+ * them either a register or the index of a constant) and an argument whose
+ * meaning depends on the opcode. */
+typedef struct {
+  uint8_t opcode;
+  uint8_t operand_kinds;
+  uint16_t destination;
+  uint16_t first_operand;
+  uint16_t second_operand;
+  uint32_t argument;
+} RegisterInstruction;
+/* A series of register instructions is defined as a dynamic array which holds
+ * two counters: "capacity" and "used", which represent respectively the number
+ * of elements in the array and the number of elements that are actually in
+ * use. The "offsets" array grows in parallel and holds the offset of the
+ * bytecode instruction each register instruction was translated from, which is
+ * what line numbers, exception handlers and profiles are looked up with; since
+ * instructions are translated in order, offsets never decrease. The
+ * "registers_count" counter holds the number of registers a call frame running
+ * the instructions needs. */
+typedef struct {
+  size_t used;
+  size_t capacity;
+  RegisterInstruction *values;
+  size_t *offsets;
+  int registers_count;
+} RegisterInstructionsArray;
+/*
+ * @brief Initialize a new array of register instructions.
+ * We set a starting value of 0 for "used" and "capacity", while the
+ * instructions array starts off completely empty; we do not even allocate space
+ * for a raw array of instructions during initialization.
+ *
+ * @param array A pointer to the register instructions array to initialize
+ * @return void
+ */
+void init_register_instructions_array(RegisterInstructionsArray *array);
+/*
+ * @brief Free the register instructions array.
+ * This function will free the memory allocated for the instructions array and
+ * its offsets and re-initialize it to an empty state by calling
+ * init_register_instructions_array.
+ *
+ * @param array A pointer to the register instructions array to free
+ * @return void
+ */
+void free_register_instructions_array(RegisterInstructionsArray *array);
+/*
+ * @brief Append a new instruction to the register instructions array.
+ *
+ * @param array A pointer to the register instructions array to append to
+ * @param instruction The register instruction to append
+ * @param offset The offset of the bytecode instruction it was translated from
+ * @return The index of the array where the instruction was added
+ */
+size_t write_register_instructions_array(RegisterInstructionsArray *array,
+                                         RegisterInstruction instruction,
+                                         size_t offset);
+/*
+ * @brief Find the first register instruction translated from a bytecode
+ * instruction at or after the given offset.
+ * The search is a binary search over the "offsets" array.
+ *
+ * @param array A pointer to the register instructions array to search
+ * @param offset The offset of the bytecode instruction to look for
+ * @return The index of the register instruction
+ */
+size_t find_register_instruction(RegisterInstructionsArray *array,
+                                 size_t offset);
+
+#endif
@@ -0,0 +1,346 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "compiler.h"
+#include "memory.h"
+#include "object.h"
+#include "server.h"
+
+static Server *running_server = NULL;
+static volatile sig_atomic_t is_stopping = 0;
+
+static uint32_t read_big_endian(const uint8_t *bytes) {
+  return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) |
+         ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+}
+
+static bool read_request(Server *server, int client, size_t length) {
+  if (server->request_start == server->request_used)
+    server->request_start = server->request_used = 0;
+  while (server->request_used - server->request_start < length) {
+    if (server->request_capacity - server->request_start < length) {
+      memmove(server->request, server->request + server->request_start,
+              server->request_used - server->request_start);
+      server->request_used -= server->request_start;
+      server->request_start = 0;
+      size_t current_capacity = server->request_capacity;
+      while (server->request_capacity < length)
+        server->request_capacity =
+            COMPUTE_ARRAY_CAPACITY(server->request_capacity);
+      server->request =
+          GROW_ARRAY(MEMORY_TAG_SERVER, uint8_t, server->request,
+                     current_capacity, server->request_capacity);
+    }
+    ssize_t bytes_read =
+        read(client, server->request + server->request_used,
+             server->request_capacity - server->request_used);
+    if (bytes_read < 0 && errno == EINTR)
+      continue;
+    if (bytes_read <= 0)
+      return false;
+    server->request_used += (size_t)bytes_read;
+  }
+  return true;
+}
+
+static bool read_request_frame(Server *server, int client, uint8_t *kind,
+                               const char **payload, size_t *length) {
+  if (!read_request(server, client, OUTPUT_FRAME_HEADER_LENGTH))
+    return false;
+  size_t payload_length =
+      read_big_endian(&server->request[server->request_start + 1]);
+  size_t frame_length = OUTPUT_FRAME_HEADER_LENGTH + payload_length;
+  if (payload_length > SERVER_MAX_FRAME_LENGTH ||
+      !read_request(server, client, frame_length))
+    return false;
+  uint8_t *frame = &server->request[server->request_start];
+  *kind = frame[0];
+  *payload = (const char *)&frame[OUTPUT_FRAME_HEADER_LENGTH];
+  *length = payload_length;
+  server->request_start += frame_length;
+  return true;
+}
+
+static void bind_input(VirtualMachine *vm, const char *payload, size_t length) {
+  ObjectString *name = copy_string(vm, SERVER_INPUT_GLOBAL,
+                                   sizeof(SERVER_INPUT_GLOBAL) - 1);
+  push_onto_stack(vm, OBJECT_CONSTANT(name));
+  ObjectString *input = copy_string(vm, payload, length);
+  set_in_table(&vm->globals, name, OBJECT_CONSTANT(input));
+  pop_from_stack(vm);
+}
+
+static ObjectFunction *compile_source(VirtualMachine *vm, const char *source,
+                                      size_t length, uint32_t *hash) {
+  ObjectString *key = copy_string(vm, source, length);
+  *hash = key->hash;
+  Constant cached_function;
+  if (get_from_table(&vm->compiled_inputs, key, &cached_function))
+    return AS_FUNCTION_CONSTANT(cached_function);
+  push_onto_stack(vm, OBJECT_CONSTANT(key));
+  ObjectFunction *function = compile_input(vm, key->characters);
+  pop_from_stack(vm);
+  if (function == NULL || !verify_function(function))
+    return NULL;
+  if (vm->compiled_inputs.used >= SERVER_MAX_COMPILED_INPUTS)
+    free_table(&vm->compiled_inputs);
+  set_in_table(&vm->compiled_inputs, key, OBJECT_CONSTANT(function));
+  debug_function(vm, function);
+  return function;
+}
+
+static void remember_hash(Server *server, uint32_t hash) {
+  for (size_t i = 0; i < server->connection_hashes_used; i++) {
+    if (server->connection_hashes[i] == hash)
+      return;
+  }
+  if (server->connection_hashes_capacity < server->connection_hashes_used + 1) {
+    size_t current_capacity = server->connection_hashes_capacity;
+    server->connection_hashes_capacity =
+        COMPUTE_ARRAY_CAPACITY(current_capacity);
+    server->connection_hashes =
+        GROW_ARRAY(MEMORY_TAG_SERVER, uint32_t, server->connection_hashes,
+                   current_capacity, server->connection_hashes_capacity);
+  }
+  server->connection_hashes[server->connection_hashes_used] = hash;
+  server->connection_hashes_used++;
+}
+
+static ObjectFunction *find_compiled_input(Server *server, uint32_t hash) {
+  bool is_known = false;
+  for (size_t i = 0; i < server->connection_hashes_used && !is_known; i++)
+    is_known = server->connection_hashes[i] == hash;
+  if (!is_known)
+    return NULL;
+  VirtualMachine *vm = server->vm;
+  ObjectFunction *function = NULL;
+  for (size_t i = 0; i < vm->compiled_inputs.capacity; i++) {
+    TableEntry *entry = &vm->compiled_inputs.entries[i];
+    if (entry->key == NULL || entry->key->hash != hash)
+      continue;
+    if (function != NULL)
+      return NULL;
+    function = AS_FUNCTION_CONSTANT(entry->value);
+  }
+  return function;
+}
+
+static void forward_errors(VirtualMachine *vm) {
+  off_t errors_length = lseek(STDERR_FILENO, 0, SEEK_CUR);
+  if (errors_length <= 0)
+    return;
+  begin_output_frame(&vm->output, SERVER_FRAME_ERROR);
+  char errors[BUFSIZ];
+  for (off_t offset = 0; offset < errors_length;) {
+    ssize_t bytes_read = pread(STDERR_FILENO, errors, sizeof(errors), offset);
+    if (bytes_read <= 0)
+      break;
+    write_output_characters(&vm->output, errors, (size_t)bytes_read);
+    offset += bytes_read;
+  }
+  if (ftruncate(STDERR_FILENO, 0) == 0)
+    lseek(STDERR_FILENO, 0, SEEK_SET);
+}
+
+static void respond(Server *server, ServerResult result, uint32_t hash) {
+  VirtualMachine *vm = server->vm;
+  forward_errors(vm);
+  char payload[] = {(char)result, (char)(hash >> 24), (char)(hash >> 16),
+                    (char)(hash >> 8), (char)hash};
+  begin_output_frame(&vm->output, SERVER_FRAME_RESULT);
+  write_output_characters(&vm->output, payload, sizeof(payload));
+  flush_output_buffer(&vm->output);
+  begin_output_frame(&vm->output, SERVER_FRAME_OUTPUT);
+  free_table(&vm->globals);
+  copy_table(&vm->initial_globals, &vm->globals);
+  free_event_loop(vm);
+}
+
+static void evaluate_function(Server *server, ObjectFunction *function,
+                              uint32_t hash) {
+  VirtualMachine *vm = server->vm;
+  vm->fuel = server->fuel;
+  vm->collector.is_over_heap_limit = false;
+  respond(server, (ServerResult)interpret_function(vm, function), hash);
+}
+
+static void serve_client(Server *server, int client) {
+  VirtualMachine *vm = server->vm;
+  init_output_buffer(&vm->output, client);
+  begin_output_frame(&vm->output, SERVER_FRAME_OUTPUT);
+  server->request_start = server->request_used = 0;
+  server->connection_hashes_used = 0;
+  uint8_t kind;
+  const char *payload;
+  size_t length;
+  while (read_request_frame(server, client, &kind, &payload, &length)) {
+    uint32_t hash;
+    ObjectFunction *function;
+    if (kind == SERVER_FRAME_INPUT) {
+      bind_input(vm, payload, length);
+    } else if (kind == SERVER_FRAME_SOURCE) {
+      function = compile_source(vm, payload, length, &hash);
+      if (function == NULL) {
+        respond(server, SERVER_RESULT_COMPILE_ERROR, hash);
+      } else {
+        remember_hash(server, hash);
+        evaluate_function(server, function, hash);
+      }
+    } else if (kind == SERVER_FRAME_HASH && length == sizeof(hash)) {
+      hash = read_big_endian((const uint8_t *)payload);
+      function = find_compiled_input(server, hash);
+      if (function == NULL)
+        respond(server, SERVER_RESULT_UNKNOWN_HASH, hash);
+      else
+        evaluate_function(server, function, hash);
+    } else {
+      break;
+    }
+  }
+  free_table(&vm->globals);
+  copy_table(&vm->initial_globals, &vm->globals);
+  init_output_buffer(&vm->output, OUTPUT_STANDARD_OUTPUT);
+}
+
+static void run_worker(Server *server) {
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  signal(SIGPIPE, SIG_IGN);
+  FILE *errors = tmpfile();
+  if (errors == NULL || dup2(fileno(errors), STDERR_FILENO) < 0)
+    _exit(EXIT_FAILURE);
+  fclose(errors);
+  server->request_capacity = SERVER_REQUEST_BUFFER_SIZE;
+  server->request = GROW_ARRAY(MEMORY_TAG_SERVER, uint8_t, NULL, 0,
+                               server->request_capacity);
+  for (;;) {
+    int client = accept(server->listener, NULL, NULL);
+    if (client < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      _exit(EXIT_FAILURE);
+    }
+    serve_client(server, client);
+    close(client);
+  }
+}
+
+static bool start_worker(Server *server, size_t index) {
+  pid_t worker = fork();
+  if (worker < 0)
+    return false;
+  if (worker == 0)
+    run_worker(server);
+  server->workers[index] = worker;
+  return true;
+}
+
+static void stop_server(int signal_number) {
+  (void)signal_number;
+  is_stopping = 1;
+  for (size_t i = 0; i < running_server->workers_count; i++) {
+    if (running_server->workers[i] > 0)
+      kill(running_server->workers[i], SIGTERM);
+  }
+}
+
+static void report_worker_exit(pid_t worker, int status) {
+  if (WIFSIGNALED(status))
+    fprintf(stderr, "worker %d killed by signal %d, restarting it.\n",
+            (int)worker, WTERMSIG(status));
+  else
+    fprintf(stderr, "worker %d exited with status %d, restarting it.\n",
+            (int)worker, WEXITSTATUS(status));
+}
+
+static bool wait_for_workers(Server *server) {
+  while (!is_stopping) {
+    int status;
+    pid_t worker = wait(&status);
+    if (worker < 0 && errno == EINTR)
+      continue;
+    if (worker < 0)
+      return false;
+    for (size_t i = 0; i < server->workers_count; i++) {
+      if (server->workers[i] != worker)
+        continue;
+      server->workers[i] = 0;
+      if (is_stopping)
+        break;
+      report_worker_exit(worker, status);
+      if (!start_worker(server, i))
+        return false;
+    }
+  }
+  return true;
+}
+
+bool serve_requests(VirtualMachine *vm, const char *socket_path,
+                    size_t workers_count, size_t fuel) {
+  struct sockaddr_un address;
+  size_t socket_path_length = strlen(socket_path);
+  if (workers_count == 0 || workers_count > SERVER_MAX_WORKERS ||
+      socket_path_length >= sizeof(address.sun_path))
+    return false;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  memcpy(address.sun_path, socket_path, socket_path_length);
+  Server server;
+  server.vm = vm;
+  server.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  server.fuel = fuel;
+  server.workers_count = workers_count;
+  memset(server.workers, 0, sizeof(server.workers));
+  server.request_start = 0;
+  server.request_used = 0;
+  server.request_capacity = 0;
+  server.request = NULL;
+  server.connection_hashes_used = 0;
+  server.connection_hashes_capacity = 0;
+  server.connection_hashes = NULL;
+  if (server.listener < 0)
+    return false;
+  unlink(socket_path);
+  if (bind(server.listener, (struct sockaddr *)&address, sizeof(address)) !=
+          0 ||
+      listen(server.listener, SERVER_BACKLOG) != 0) {
+    close(server.listener);
+    return false;
+  }
+  flush_output_buffer(&vm->output);
+  free_table(&vm->initial_globals);
+  copy_table(&vm->globals, &vm->initial_globals);
+  running_server = &server;
+  is_stopping = 0;
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = stop_server;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  bool is_served = true;
+  for (size_t i = 0; i < workers_count && is_served; i++)
+    is_served = start_worker(&server, i);
+  if (is_served)
+    is_served = wait_for_workers(&server);
+  for (size_t i = 0; i < workers_count; i++) {
+    if (server.workers[i] <= 0)
+      continue;
+    kill(server.workers[i], SIGTERM);
+    waitpid(server.workers[i], NULL, 0);
+  }
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  running_server = NULL;
+  close(server.listener);
+  unlink(socket_path);
+  return is_served;
+}
@@ -0,0 +1,109 @@
+#ifndef interpres_server_h
+#define interpres_server_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include "vm.h"
+
+/* Here we define the default and the maximum number of worker processes that
+ * evaluate requests, each of them on its own virtual machine. */
+#define SERVER_DEFAULT_WORKERS 4
+#define SERVER_MAX_WORKERS 64
+/* Here we define the number of connections the listening socket can hold while
+ * every worker is busy. */
+#define SERVER_BACKLOG 128
+/* Here we define the initial size in bytes of the buffer requests are read
+ * into, and the largest payload a request frame can carry; a connection that
+ * sends a larger frame is closed. */
+#define SERVER_REQUEST_BUFFER_SIZE (64 * 1024)
+#define SERVER_MAX_FRAME_LENGTH (16 * 1024 * 1024)
+/* Here we define the number of compiled scripts a worker keeps before it
+ * forgets all of them and starts caching again from scratch. */
+#define SERVER_MAX_COMPILED_INPUTS 1024
+/* Here we define the name of the global variable a request's input is bound
+ * to. */
+#define SERVER_INPUT_GLOBAL "input"
+/* Requests and responses are sent as frames, each made of a header of
+ * OUTPUT_FRAME_HEADER_LENGTH bytes, holding one of these kinds and the length
+ * of the payload, followed by the payload. A request is made of an optional
+ * input frame, whose payload is bound to the global variable "input" as a
+ * string, followed by either a source frame, holding the script to run, or a
+ * hash frame, holding the 32-bit big-endian hash of a script sent in a source
+ * frame earlier on the same connection. Hashes are only known to the
+ * connection that sent the script, since every connection is served by
+ * whichever worker accepts it. The response streams the output of the
+ * script in output frames, then the errors it reported, if any, in error
+ * frames, and ends with a result frame, whose payload is the ServerResult of
+ * the request followed by the 32-bit big-endian hash of its script. */
+typedef enum {
+  SERVER_FRAME_INPUT = 'i',
+  SERVER_FRAME_SOURCE = 's',
+  SERVER_FRAME_HASH = 'h',
+  SERVER_FRAME_OUTPUT = 'o',
+  SERVER_FRAME_ERROR = 'e',
+  SERVER_FRAME_RESULT = 'r',
+} ServerFrameKind;
+/* This enum lists the results a request can end with: the first three match
+ * the InterpretationResult of the script, while the last one is sent back for
+ * a hash frame naming a script the connection has not sent or the worker has
+ * forgotten, which the client should then send again as a source frame. */
+typedef enum {
+  SERVER_RESULT_OK,
+  SERVER_RESULT_COMPILE_ERROR,
+  SERVER_RESULT_RUNTIME_ERROR,
+  SERVER_RESULT_UNKNOWN_HASH,
+} ServerResult;
+/* The server listens on the Unix domain socket "listener" and keeps the
+ * process identifiers of its "workers_count" workers in "workers". Every
+ * worker is forked from the virtual machine the server was started with, so
+ * it starts warm with whatever that virtual machine loaded, and accepts
+ * connections on its own, one at a time. Scripts are cached by their source,
+ * compiled, verified and with their instructions quickened as they run, in
+ * the virtual machine's "compiled_inputs" table, while the hashes of the
+ * scripts sent on the current connection are kept in the "connection_hashes"
+ * dynamic array. Every request starts with "fuel" bytes of fuel, with no task
+ * left on the event loop by the request before, whether it was ready or
+ * parked, and with the global variables bound as in "initial_globals"; only
+ * the bindings are restored, so changes a request makes to objects it reaches
+ * from them, such as the fields of an instance the script the server started
+ * with created, persist in the worker for the requests it serves next.
+ * Requests are read into the "request" dynamic array, whose bytes from
+ * "request_start" up to "request_used" have not been handled yet. */
+typedef struct {
+  VirtualMachine *vm;
+  int listener;
+  size_t fuel;
+  size_t workers_count;
+  pid_t workers[SERVER_MAX_WORKERS];
+  size_t request_start;
+  size_t request_used;
+  size_t request_capacity;
+  uint8_t *request;
+  size_t connection_hashes_used;
+  size_t connection_hashes_capacity;
+  uint32_t *connection_hashes;
+} Server;
+/*
+ * @brief Serve requests on a Unix domain socket until a signal stops the
+ * server.
+ * This function will bind the socket, replacing any file at its path, fork the
+ * workers and fork them again whenever one of them exits, reporting how it
+ * exited on the standard error. Once SIGINT or SIGTERM is received, the
+ * workers are terminated and the socket is removed. Errors reported by the
+ * scripts are captured and sent back in error frames, so workers never write
+ * to the standard error themselves.
+ *
+ * @param vm A pointer to the virtual machine every worker starts from
+ * @param socket_path The path to bind the socket to
+ * @param workers_count The number of workers to run
+ * @param fuel The fuel every request starts with, whatever the script the
+ * virtual machine ran before has left
+ * @return Whether the server could be started or not
+ */
+bool serve_requests(VirtualMachine *vm, const char *socket_path,
+                    size_t workers_count, size_t fuel);
+
+#endif
@@ -0,0 +1,661 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "collector.h"
+#include "memory.h"
+#include "object.h"
+#include "snapshot.h"
+
+static int compare_object_addresses(const void *first, const void *second) {
+  uintptr_t first_address = (uintptr_t)*(Object *const *)first;
+  uintptr_t second_address = (uintptr_t)*(Object *const *)second;
+  return (first_address > second_address) - (first_address < second_address);
+}
+
+static void write_snapshot_bytes(SnapshotWriter *writer, const void *bytes,
+                                 size_t size) {
+  if (!writer->is_error && size > 0 &&
+      fwrite(bytes, 1, size, writer->file) != size)
+    writer->is_error = true;
+}
+
+static void write_snapshot_uint8(SnapshotWriter *writer, uint8_t value) {
+  write_snapshot_bytes(writer, &value, sizeof(value));
+}
+
+static void write_snapshot_int32(SnapshotWriter *writer, int32_t value) {
+  write_snapshot_bytes(writer, &value, sizeof(value));
+}
+
+static void write_snapshot_uint64(SnapshotWriter *writer, uint64_t value) {
+  write_snapshot_bytes(writer, &value, sizeof(value));
+}
+
+static void write_snapshot_reference(SnapshotWriter *writer, Object *object) {
+  uint32_t reference = SNAPSHOT_NULL_REFERENCE;
+  if (object != NULL) {
+    Object **entry =
+        bsearch(&object, writer->objects, writer->objects_count,
+                sizeof(Object *), compare_object_addresses);
+    reference = (uint32_t)(entry - writer->objects) + 1;
+  }
+  write_snapshot_bytes(writer, &reference, sizeof(reference));
+}
+
+static void write_snapshot_constant(SnapshotWriter *writer,
+                                    Constant constant) {
+  write_snapshot_uint8(writer, (uint8_t)constant.type);
+  switch (constant.type) {
+  case CONSTANT_BOOLEAN:
+    write_snapshot_uint8(writer, AS_BOOLEAN_CONSTANT(constant));
+    break;
+  case CONSTANT_INTEGER:
+    write_snapshot_bytes(writer, &AS_INTEGER_CONSTANT(constant),
+                         sizeof(int64_t));
+    break;
+  case CONSTANT_NIL:
+    break;
+  case CONSTANT_NUMBER:
+    write_snapshot_bytes(writer, &AS_NUMBER_CONSTANT(constant),
+                         sizeof(double));
+    break;
+  case CONSTANT_OBJECT:
+    write_snapshot_reference(writer, AS_OBJECT_CONSTANT(constant));
+    break;
+  }
+}
+
+static void write_snapshot_table(SnapshotWriter *writer, Table *table) {
+  uint64_t entries_count = 0;
+  for (size_t i = 0; i < table->capacity; i++)
+    if (table->entries[i].key != NULL)
+      entries_count++;
+  write_snapshot_uint64(writer, entries_count);
+  for (size_t i = 0; i < table->capacity; i++) {
+    TableEntry *entry = &table->entries[i];
+    if (entry->key == NULL)
+      continue;
+    write_snapshot_reference(writer, (Object *)entry->key);
+    write_snapshot_constant(writer, entry->value);
+  }
+}
+
+static void write_snapshot_instructions(SnapshotWriter *writer,
+                                        ObjectFunction *function) {
+  InstructionsArray *instructions = &function->chunk.instructions;
+  if (!function->is_verified) {
+    write_snapshot_bytes(writer, instructions->values, instructions->used);
+    return;
+  }
+  for (size_t offset = 0; offset < instructions->used;) {
+    uint8_t instruction = get_generic_instruction(
+        get_chunk_instruction(&function->chunk, offset));
+    size_t instruction_length = (size_t)get_instruction_length(instruction);
+    write_snapshot_uint8(writer, instruction);
+    write_snapshot_bytes(writer, instructions->values + offset + 1,
+                         instruction_length - 1);
+    offset += instruction_length;
+  }
+}
+
+static void write_snapshot_function(SnapshotWriter *writer,
+                                    ObjectFunction *function) {
+  write_snapshot_uint8(writer, (uint8_t)function->type);
+  write_snapshot_int32(writer, function->arity);
+  write_snapshot_reference(writer, (Object *)function->name);
+  write_snapshot_reference(writer, (Object *)function->source);
+  write_snapshot_uint64(writer, function->source_offset);
+  write_snapshot_uint64(writer, function->source_line_number);
+  InstructionsArray *instructions = &function->chunk.instructions;
+  write_snapshot_uint64(writer, instructions->used);
+  write_snapshot_instructions(writer, function);
+  for (size_t i = 0; i < instructions->used; i++)
+    write_snapshot_uint64(writer, instructions->line_numbers[i]);
+  ConstantsArray *constants = &function->chunk.constants;
+  write_snapshot_uint64(writer, constants->used);
+  for (size_t i = 0; i < constants->used; i++)
+    write_snapshot_constant(writer, constants->values[i]);
+  write_snapshot_uint64(writer, function->chunk.caches.used);
+  ExceptionHandlersArray *handlers = &function->chunk.handlers;
+  write_snapshot_uint64(writer, handlers->used);
+  for (size_t i = 0; i < handlers->used; i++) {
+    write_snapshot_uint64(writer, handlers->values[i].start_offset);
+    write_snapshot_uint64(writer, handlers->values[i].end_offset);
+    write_snapshot_uint64(writer, handlers->values[i].handler_offset);
+    write_snapshot_int32(writer, handlers->values[i].stack_depth);
+  }
+}
+
+static void write_snapshot_object(SnapshotWriter *writer, Object *object) {
+  switch (object->type) {
+  case OBJECT_BOUND_METHOD: {
+    ObjectBoundMethod *bound_method = (ObjectBoundMethod *)object;
+    write_snapshot_constant(writer, bound_method->receiver);
+    write_snapshot_reference(writer, (Object *)bound_method->method);
+    break;
+  }
+  case OBJECT_CLASS: {
+    ObjectClass *object_class = (ObjectClass *)object;
+    write_snapshot_reference(writer, (Object *)object_class->name);
+    write_snapshot_reference(writer, (Object *)object_class->initializer);
+    write_snapshot_reference(writer, (Object *)object_class->root_shape);
+    write_snapshot_table(writer, &object_class->methods);
+    break;
+  }
+  case OBJECT_COROUTINE: {
+    ObjectCoroutine *coroutine = (ObjectCoroutine *)object;
+    if (coroutine->state != COROUTINE_STATE_DEAD &&
+        (coroutine->frame_count > 0 || coroutine->is_task))
+      writer->is_error = true;
+    write_snapshot_uint8(writer, (uint8_t)coroutine->state);
+    write_snapshot_reference(writer, (Object *)coroutine->function);
+    break;
+  }
+  case OBJECT_FUNCTION:
+    write_snapshot_function(writer, (ObjectFunction *)object);
+    break;
+  case OBJECT_INSTANCE: {
+    ObjectInstance *instance = (ObjectInstance *)object;
+    write_snapshot_reference(writer, (Object *)instance->shape);
+    write_snapshot_int32(writer, instance->shape->field_count);
+    for (int i = 0; i < instance->shape->field_count; i++)
+      write_snapshot_constant(writer, instance->fields[i]);
+    break;
+  }
+  case OBJECT_NATIVE:
+    write_snapshot_reference(writer, (Object *)((ObjectNative *)object)->name);
+    break;
+  case OBJECT_SHAPE: {
+    ObjectShape *shape = (ObjectShape *)object;
+    write_snapshot_reference(writer, (Object *)shape->owner_class);
+    write_snapshot_int32(writer, shape->field_count);
+    write_snapshot_table(writer, &shape->slots);
+    write_snapshot_table(writer, &shape->transitions);
+    break;
+  }
+  case OBJECT_STRING:
+    break;
+  }
+}
+
+static void write_snapshot_contents(SnapshotWriter *writer,
+                                    VirtualMachine *vm) {
+  SnapshotHeader header;
+  memcpy(header.magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LENGTH);
+  header.version = SNAPSHOT_VERSION;
+  header.byte_order_mark = SNAPSHOT_BYTE_ORDER_MARK;
+  header.objects_count = writer->objects_count;
+  write_snapshot_bytes(writer, &header, sizeof(header));
+  for (size_t i = 0; i < writer->objects_count; i++) {
+    Object *object = writer->objects[i];
+    write_snapshot_uint8(writer, (uint8_t)object->type);
+    if (object->type == OBJECT_STRING) {
+      ObjectString *string = (ObjectString *)object;
+      write_snapshot_uint64(writer, string->length);
+      write_snapshot_bytes(writer, string->characters, string->length);
+    }
+  }
+  for (size_t i = 0; i < writer->objects_count; i++)
+    write_snapshot_object(writer, writer->objects[i]);
+  write_snapshot_table(writer, &vm->globals);
+}
+
+bool write_snapshot(VirtualMachine *vm, const char *snapshot_path) {
+  collect_garbage(vm);
+  SnapshotWriter writer;
+  writer.objects_count = 0;
+  for (Object *object = vm->collector.objects; object != NULL;
+       object = object->next)
+    writer.objects_count++;
+  if (writer.objects_count >= UINT32_MAX)
+    return false;
+  writer.file = fopen(snapshot_path, "wb");
+  if (writer.file == NULL)
+    return false;
+  writer.is_error = false;
+  writer.objects = GROW_ARRAY(MEMORY_TAG_SNAPSHOT, Object *, NULL, 0,
+                              writer.objects_count);
+  size_t object_index = 0;
+  for (Object *object = vm->collector.objects; object != NULL;
+       object = object->next)
+    writer.objects[object_index++] = object;
+  qsort(writer.objects, writer.objects_count, sizeof(Object *),
+        compare_object_addresses);
+  write_snapshot_contents(&writer, vm);
+  FREE_ARRAY(MEMORY_TAG_SNAPSHOT, Object *, writer.objects,
+             writer.objects_count);
+  if (fclose(writer.file) != 0)
+    writer.is_error = true;
+  return !writer.is_error;
+}
+
+static void read_snapshot_bytes(SnapshotReader *reader, void *bytes,
+                                size_t size) {
+  if (reader->is_error || (size_t)(reader->end - reader->current) < size) {
+    reader->is_error = true;
+    memset(bytes, 0, size);
+    return;
+  }
+  memcpy(bytes, reader->current, size);
+  reader->current += size;
+}
+
+static uint8_t read_snapshot_uint8(SnapshotReader *reader) {
+  uint8_t value;
+  read_snapshot_bytes(reader, &value, sizeof(value));
+  return value;
+}
+
+static int32_t read_snapshot_int32(SnapshotReader *reader) {
+  int32_t value;
+  read_snapshot_bytes(reader, &value, sizeof(value));
+  return value;
+}
+
+static uint64_t read_snapshot_uint64(SnapshotReader *reader) {
+  uint64_t value;
+  read_snapshot_bytes(reader, &value, sizeof(value));
+  return value;
+}
+
+static Object *read_snapshot_reference(SnapshotReader *reader,
+                                       ObjectType object_type) {
+  uint32_t reference;
+  read_snapshot_bytes(reader, &reference, sizeof(reference));
+  if (reference == SNAPSHOT_NULL_REFERENCE)
+    return NULL;
+  if (reference > reader->objects_count ||
+      reader->objects[reference - 1]->type != object_type) {
+    reader->is_error = true;
+    return NULL;
+  }
+  return reader->objects[reference - 1];
+}
+
+static Constant read_snapshot_constant(SnapshotReader *reader) {
+  switch (read_snapshot_uint8(reader)) {
+  case CONSTANT_BOOLEAN:
+    return BOOLEAN_CONSTANT(read_snapshot_uint8(reader) != 0);
+  case CONSTANT_INTEGER: {
+    int64_t integer;
+    read_snapshot_bytes(reader, &integer, sizeof(integer));
+    return INTEGER_CONSTANT(integer);
+  }
+  case CONSTANT_NIL:
+    return NIL_CONSTANT;
+  case CONSTANT_NUMBER: {
+    double number;
+    read_snapshot_bytes(reader, &number, sizeof(number));
+    return NUMBER_CONSTANT(number);
+  }
+  case CONSTANT_OBJECT: {
+    uint32_t reference;
+    read_snapshot_bytes(reader, &reference, sizeof(reference));
+    if (reference != SNAPSHOT_NULL_REFERENCE &&
+        reference <= reader->objects_count)
+      return OBJECT_CONSTANT(reader->objects[reference - 1]);
+    break;
+  }
+  default:
+    break;
+  }
+  reader->is_error = true;
+  return NIL_CONSTANT;
+}
+
+static void read_snapshot_table(SnapshotReader *reader, Table *table) {
+  uint64_t entries_count = read_snapshot_uint64(reader);
+  for (uint64_t i = 0; i < entries_count && !reader->is_error; i++) {
+    ObjectString *key =
+        (ObjectString *)read_snapshot_reference(reader, OBJECT_STRING);
+    Constant value = read_snapshot_constant(reader);
+    if (key == NULL)
+      reader->is_error = true;
+    else
+      set_in_table(table, key, value);
+  }
+}
+
+static bool table_values_are_objects(Table *table, ObjectType object_type) {
+  for (size_t i = 0; i < table->capacity; i++) {
+    TableEntry *entry = &table->entries[i];
+    if (entry->key != NULL &&
+        !constant_is_object_type(entry->value, object_type))
+      return false;
+  }
+  return true;
+}
+
+static bool table_values_are_slots(Table *table, int field_count) {
+  for (size_t i = 0; i < table->capacity; i++) {
+    TableEntry *entry = &table->entries[i];
+    if (entry->key != NULL &&
+        (!IS_INTEGER_CONSTANT(entry->value) ||
+         AS_INTEGER_CONSTANT(entry->value) < 0 ||
+         AS_INTEGER_CONSTANT(entry->value) >= field_count))
+      return false;
+  }
+  return true;
+}
+
+static void read_snapshot_function(SnapshotReader *reader,
+                                   ObjectFunction *function) {
+  uint8_t function_type = read_snapshot_uint8(reader);
+  function->type = (FunctionType)function_type;
+  function->arity = read_snapshot_int32(reader);
+  function->name =
+      (ObjectString *)read_snapshot_reference(reader, OBJECT_STRING);
+  function->source =
+      (ObjectString *)read_snapshot_reference(reader, OBJECT_STRING);
+  function->source_offset = read_snapshot_uint64(reader);
+  function->source_line_number = read_snapshot_uint64(reader);
+  if (function_type > FUNCTION_TYPE_SCRIPT || function->arity < 0 ||
+      function->arity > UINT8_MAX ||
+      (function->name == NULL && function_type != FUNCTION_TYPE_SCRIPT) ||
+      (function->source != NULL &&
+       function->source_offset > function->source->length))
+    reader->is_error = true;
+  uint64_t instructions_count = read_snapshot_uint64(reader);
+  const uint8_t *instructions = reader->current;
+  if (instructions_count > (uint64_t)(reader->end - reader->current))
+    reader->is_error = true;
+  else
+    reader->current += instructions_count;
+  for (uint64_t i = 0; i < instructions_count && !reader->is_error; i++)
+    push_instruction_to_chunk(&function->chunk, instructions[i],
+                              read_snapshot_uint64(reader));
+  uint64_t constants_count = read_snapshot_uint64(reader);
+  for (uint64_t i = 0; i < constants_count && !reader->is_error; i++)
+    push_constant_to_chunk(&function->chunk, read_snapshot_constant(reader));
+  uint64_t caches_count = read_snapshot_uint64(reader);
+  if (caches_count > UINT16_MAX + 1)
+    reader->is_error = true;
+  for (uint64_t i = 0; i < caches_count && !reader->is_error; i++)
+    push_inline_cache_to_chunk(&function->chunk);
+  uint64_t handlers_count = read_snapshot_uint64(reader);
+  if (handlers_count > instructions_count)
+    reader->is_error = true;
+  for (uint64_t i = 0; i < handlers_count && !reader->is_error; i++) {
+    ExceptionHandler handler;
+    handler.start_offset = read_snapshot_uint64(reader);
+    handler.end_offset = read_snapshot_uint64(reader);
+    handler.handler_offset = read_snapshot_uint64(reader);
+    handler.stack_depth = read_snapshot_int32(reader);
+    push_exception_handler_to_chunk(&function->chunk, handler);
+  }
+}
+
+static void read_snapshot_instance(SnapshotReader *reader,
+                                   ObjectInstance *instance) {
+  instance->shape =
+      (ObjectShape *)read_snapshot_reference(reader, OBJECT_SHAPE);
+  int32_t fields_count = read_snapshot_int32(reader);
+  if (instance->shape == NULL || fields_count < 0 ||
+      (uint64_t)fields_count > (uint64_t)(reader->end - reader->current)) {
+    reader->is_error = true;
+    return;
+  }
+  reserve_instance_fields(reader->vm, instance, fields_count);
+  for (int32_t i = 0; i < fields_count && !reader->is_error; i++)
+    instance->fields[i] = read_snapshot_constant(reader);
+}
+
+static void read_snapshot_object(SnapshotReader *reader, Object *object) {
+  switch (object->type) {
+  case OBJECT_BOUND_METHOD: {
+    ObjectBoundMethod *bound_method = (ObjectBoundMethod *)object;
+    bound_method->receiver = read_snapshot_constant(reader);
+    bound_method->method =
+        (ObjectFunction *)read_snapshot_reference(reader, OBJECT_FUNCTION);
+    if (bound_method->method == NULL)
+      reader->is_error = true;
+    break;
+  }
+  case OBJECT_CLASS: {
+    ObjectClass *object_class = (ObjectClass *)object;
+    object_class->name =
+        (ObjectString *)read_snapshot_reference(reader, OBJECT_STRING);
+    object_class->initializer =
+        (ObjectFunction *)read_snapshot_reference(reader, OBJECT_FUNCTION);
+    object_class->root_shape =
+        (ObjectShape *)read_snapshot_reference(reader, OBJECT_SHAPE);
+    read_snapshot_table(reader, &object_class->methods);
+    if (object_class->name == NULL || object_class->root_shape == NULL ||
+        !table_values_are_objects(&object_class->methods, OBJECT_FUNCTION))
+      reader->is_error = true;
+    break;
+  }
+  case OBJECT_COROUTINE: {
+    ObjectCoroutine *coroutine = (ObjectCoroutine *)object;
+    uint8_t state = read_snapshot_uint8(reader);
+    coroutine->function =
+        (ObjectFunction *)read_snapshot_reference(reader, OBJECT_FUNCTION);
+    if (state == COROUTINE_STATE_DEAD) {
+      coroutine->state = COROUTINE_STATE_DEAD;
+      free_coroutine_stacks(reader->vm, coroutine);
+    } else if (state != COROUTINE_STATE_SUSPENDED) {
+      reader->is_error = true;
+    }
+    if (coroutine->function == NULL)
+      reader->is_error = true;
+    break;
+  }
+  case OBJECT_FUNCTION:
+    read_snapshot_function(reader, (ObjectFunction *)object);
+    break;
+  case OBJECT_INSTANCE:
+    read_snapshot_instance(reader, (ObjectInstance *)object);
+    break;
+  case OBJECT_NATIVE: {
+    ObjectNative *native = (ObjectNative *)object;
+    native->name =
+        (ObjectString *)read_snapshot_reference(reader, OBJECT_STRING);
+    const NativeDefinition *definition =
+        native->name == NULL
+            ? NULL
+            : find_native_definition(reader->vm, native->name);
+    if (definition == NULL) {
+      reader->is_error = true;
+      break;
+    }
+    native->function = definition->function;
+    native->arity = definition->arity;
+    break;
+  }
+  case OBJECT_SHAPE: {
+    ObjectShape *shape = (ObjectShape *)object;
+    shape->owner_class =
+        (ObjectClass *)read_snapshot_reference(reader, OBJECT_CLASS);
+    shape->field_count = read_snapshot_int32(reader);
+    read_snapshot_table(reader, &shape->slots);
+    read_snapshot_table(reader, &shape->transitions);
+    if (shape->owner_class == NULL || shape->field_count < 0 ||
+        !table_values_are_slots(&shape->slots, shape->field_count) ||
+        !table_values_are_objects(&shape->transitions, OBJECT_SHAPE))
+      reader->is_error = true;
+    break;
+  }
+  case OBJECT_STRING:
+    break;
+  }
+}
+
+static Object *allocate_snapshot_object(SnapshotReader *reader,
+                                        uint8_t object_type) {
+  VirtualMachine *vm = reader->vm;
+  switch (object_type) {
+  case OBJECT_BOUND_METHOD: {
+    ObjectBoundMethod *bound_method = (ObjectBoundMethod *)allocate_object(
+        vm, sizeof(ObjectBoundMethod), OBJECT_BOUND_METHOD);
+    bound_method->receiver = NIL_CONSTANT;
+    bound_method->method = NULL;
+    return (Object *)bound_method;
+  }
+  case OBJECT_CLASS: {
+    ObjectClass *object_class =
+        (ObjectClass *)allocate_object(vm, sizeof(ObjectClass), OBJECT_CLASS);
+    object_class->name = NULL;
+    init_table(&object_class->methods);
+    object_class->initializer = NULL;
+    object_class->root_shape = NULL;
+    return (Object *)object_class;
+  }
+  case OBJECT_COROUTINE:
+    return (Object *)new_coroutine(vm, NULL);
+  case OBJECT_FUNCTION:
+    return (Object *)new_function(vm);
+  case OBJECT_INSTANCE: {
+    ObjectInstance *instance = (ObjectInstance *)allocate_object(
+        vm, sizeof(ObjectInstance), OBJECT_INSTANCE);
+    instance->shape = NULL;
+    instance->fields_capacity = 0;
+    instance->fields = NULL;
+    return (Object *)instance;
+  }
+  case OBJECT_NATIVE:
+    return (Object *)new_native(vm, NULL, NULL, 0);
+  case OBJECT_SHAPE: {
+    ObjectShape *shape =
+        (ObjectShape *)allocate_object(vm, sizeof(ObjectShape), OBJECT_SHAPE);
+    shape->owner_class = NULL;
+    shape->field_count = 0;
+    init_table(&shape->slots);
+    init_table(&shape->transitions);
+    return (Object *)shape;
+  }
+  case OBJECT_STRING: {
+    uint64_t length = read_snapshot_uint64(reader);
+    if (length > (uint64_t)(reader->end - reader->current)) {
+      reader->is_error = true;
+      return NULL;
+    }
+    const char *characters = (const char *)reader->current;
+    reader->current += length;
+    return (Object *)copy_string(vm, characters, (size_t)length);
+  }
+  }
+  reader->is_error = true;
+  return NULL;
+}
+
+static bool transitions_extend_shape(ObjectShape *shape) {
+  Table *transitions = &shape->transitions;
+  for (size_t i = 0; i < transitions->capacity; i++) {
+    TableEntry *entry = &transitions->entries[i];
+    if (entry->key == NULL)
+      continue;
+    ObjectShape *child_shape = (ObjectShape *)AS_OBJECT_CONSTANT(entry->value);
+    if (child_shape->field_count != shape->field_count + 1)
+      return false;
+  }
+  return true;
+}
+
+static bool objects_are_consistent(SnapshotReader *reader) {
+  for (size_t i = 0; i < reader->objects_count; i++) {
+    Object *object = reader->objects[i];
+    switch (object->type) {
+    case OBJECT_CLASS:
+      if (((ObjectClass *)object)->root_shape->field_count != 0)
+        return false;
+      break;
+    case OBJECT_INSTANCE: {
+      ObjectInstance *instance = (ObjectInstance *)object;
+      if (instance->fields_capacity < instance->shape->field_count)
+        return false;
+      break;
+    }
+    case OBJECT_SHAPE:
+      if (!transitions_extend_shape((ObjectShape *)object))
+        return false;
+      break;
+    default:
+      break;
+    }
+  }
+  return true;
+}
+
+static void read_snapshot_contents(SnapshotReader *reader, Table *globals) {
+  SnapshotHeader header;
+  read_snapshot_bytes(reader, &header, sizeof(header));
+  if (reader->is_error ||
+      memcmp(header.magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LENGTH) != 0 ||
+      header.version != SNAPSHOT_VERSION ||
+      header.byte_order_mark != SNAPSHOT_BYTE_ORDER_MARK ||
+      header.objects_count > (uint64_t)(reader->end - reader->current)) {
+    reader->is_error = true;
+    return;
+  }
+  reader->objects_count = (size_t)header.objects_count;
+  reader->objects = GROW_ARRAY(MEMORY_TAG_SNAPSHOT, Object *, NULL, 0,
+                               reader->objects_count);
+  for (size_t i = 0; i < reader->objects_count; i++) {
+    reader->objects[i] =
+        allocate_snapshot_object(reader, read_snapshot_uint8(reader));
+    if (reader->is_error)
+      return;
+  }
+  for (size_t i = 0; i < reader->objects_count && !reader->is_error; i++)
+    read_snapshot_object(reader, reader->objects[i]);
+  uint64_t globals_count = read_snapshot_uint64(reader);
+  for (uint64_t i = 0; i < globals_count && !reader->is_error; i++) {
+    ObjectString *name =
+        (ObjectString *)read_snapshot_reference(reader, OBJECT_STRING);
+    Constant value = read_snapshot_constant(reader);
+    if (name == NULL)
+      reader->is_error = true;
+    else
+      set_in_table(globals, name, value);
+  }
+  if (!reader->is_error && (reader->current != reader->end ||
+                            !objects_are_consistent(reader)))
+    reader->is_error = true;
+}
+
+bool read_snapshot(VirtualMachine *vm, const char *snapshot_path) {
+  int file_descriptor = open(snapshot_path, O_RDONLY);
+  if (file_descriptor == -1)
+    return false;
+  struct stat file_status;
+  if (fstat(file_descriptor, &file_status) == -1 || file_status.st_size == 0) {
+    close(file_descriptor);
+    return false;
+  }
+  size_t snapshot_size = (size_t)file_status.st_size;
+  void *snapshot = mmap(NULL, snapshot_size, PROT_READ, MAP_PRIVATE,
+                        file_descriptor, 0);
+  close(file_descriptor);
+  if (snapshot == MAP_FAILED)
+    return false;
+  SnapshotReader reader;
+  reader.vm = vm;
+  reader.current = (const uint8_t *)snapshot;
+  reader.end = reader.current + snapshot_size;
+  reader.objects_count = 0;
+  reader.objects = NULL;
+  reader.is_error = false;
+  Table globals;
+  init_table(&globals);
+  vm->collector.is_paused = true;
+  read_snapshot_contents(&reader, &globals);
+  if (!reader.is_error) {
+    for (size_t i = 0; i < globals.capacity; i++) {
+      TableEntry *entry = &globals.entries[i];
+      if (entry->key != NULL)
+        set_in_table(&vm->globals, entry->key, entry->value);
+    }
+  }
+  vm->collector.is_paused = false;
+  free_table(&globals);
+  FREE_ARRAY(MEMORY_TAG_SNAPSHOT, Object *, reader.objects,
+             reader.objects_count);
+  munmap(snapshot, snapshot_size);
+  return !reader.is_error;
+}
@@ -0,0 +1,85 @@
+#ifndef interpres_snapshot_h
+#define interpres_snapshot_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "vm.h"
+
+/* Here we define the bytes every snapshot file starts with and the version of
+ * its format, which is bumped every time the layout of the file changes so
+ * that stale snapshots are rejected instead of being misread. */
+#define SNAPSHOT_MAGIC "interpre"
+#define SNAPSHOT_MAGIC_LENGTH 8
+#define SNAPSHOT_VERSION 5
+#define SNAPSHOT_BYTE_ORDER_MARK 0x01020304
+/* Objects refer to each other through their index in the snapshot, starting
+ * from 1, so that a snapshot can be loaded at any address; this index stands
+ * for a NULL reference. */
+#define SNAPSHOT_NULL_REFERENCE 0
+/* A snapshot file starts with this header, which is followed by the type of
+ * every object (along with the characters of strings, which hold no
+ * references), then by the contents of every other object in the same order
+ * and finally by the table of global variables. Every field is stored in the
+ * byte order of the machine that wrote the snapshot, which is checked through
+ * "byte_order_mark" when loading it. */
+typedef struct {
+  char magic[SNAPSHOT_MAGIC_LENGTH];
+  uint32_t version;
+  uint32_t byte_order_mark;
+  uint64_t objects_count;
+} SnapshotHeader;
+/* While taking a snapshot, the writer keeps every object that is about to be
+ * written in the "objects" array, sorted by address, so that the index of the
+ * object a reference points to can be found with a binary search; "is_error"
+ * is set as soon as writing to the file fails or an object turns out not to
+ * be writable, such as a coroutine that is in the middle of its function. */
+typedef struct {
+  FILE *file;
+  size_t objects_count;
+  Object **objects;
+  bool is_error;
+} SnapshotWriter;
+/* While loading a snapshot, the reader walks the mapped file from "current"
+ * up to "end" and keeps the object created for every index in the "objects"
+ * array; "is_error" is set as soon as the file turns out to be truncated or
+ * malformed, after which every read yields zeroes. */
+typedef struct {
+  VirtualMachine *vm;
+  const uint8_t *current;
+  const uint8_t *end;
+  size_t objects_count;
+  Object **objects;
+  bool is_error;
+} SnapshotReader;
+/*
+ * @brief Write a snapshot of the virtual machine's heap to a file.
+ * This function will run a full collection and then write every object that
+ * survived it, including every compiled chunk and every interned string, along
+ * with the table of global variables. Natives are written by name,
+ * coroutines only when they have not started or are dead, and tasks only once
+ * they are dead, since the event loop is not written. The virtual machine
+ * must not be running any code when the snapshot is taken.
+ *
+ * @param vm A pointer to the virtual machine to take the snapshot of
+ * @param snapshot_path The path of the file to write the snapshot to
+ * @return Whether the snapshot was written successfully or not
+ */
+bool write_snapshot(VirtualMachine *vm, const char *snapshot_path);
+/*
+ * @brief Load a snapshot into the virtual machine.
+ * This function will map the snapshot file into memory, recreate every object
+ * it holds on the virtual machine's heap and define every global variable it
+ * holds. Functions are verified again on their first call. If the snapshot is
+ * malformed, the objects loaded so far are left to the garbage collector and
+ * no global variable is defined.
+ *
+ * @param vm A pointer to the virtual machine to load the snapshot into
+ * @param snapshot_path The path of the file to read the snapshot from
+ * @return Whether the snapshot was loaded successfully or not
+ */
+bool read_snapshot(VirtualMachine *vm, const char *snapshot_path);
+
+#endif
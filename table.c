@@ -0,0 +1,116 @@
+#include <string.h>
+
+#include "memory.h"
+#include "object.h"
+#include "table.h"
+
+void init_table(Table *table) {
+  table->used = 0;
+  table->capacity = 0;
+  table->entries = NULL;
+}
+
+void free_table(Table *table) {
+  FREE_ARRAY(MEMORY_TAG_TABLES, TableEntry, table->entries, table->capacity);
+  init_table(table);
+}
+
+static TableEntry *find_table_entry(TableEntry *entries, size_t capacity,
+                                    ObjectString *key) {
+  size_t index = key->hash & (capacity - 1);
+  TableEntry *tombstone = NULL;
+  for (;;) {
+    TableEntry *entry = &entries[index];
+    if (entry->key == NULL) {
+      if (IS_NIL_CONSTANT(entry->value))
+        return tombstone != NULL ? tombstone : entry;
+      if (tombstone == NULL)
+        tombstone = entry;
+    } else if (entry->key == key) {
+      return entry;
+    }
+    index = (index + 1) & (capacity - 1);
+  }
+}
+
+static void grow_table(Table *table) {
+  size_t capacity = COMPUTE_ARRAY_CAPACITY(table->capacity);
+  TableEntry *entries =
+      GROW_ARRAY(MEMORY_TAG_TABLES, TableEntry, NULL, 0, capacity);
+  for (size_t i = 0; i < capacity; i++) {
+    entries[i].key = NULL;
+    entries[i].value = NIL_CONSTANT;
+  }
+  table->used = 0;
+  for (size_t i = 0; i < table->capacity; i++) {
+    TableEntry *entry = &table->entries[i];
+    if (entry->key == NULL)
+      continue;
+    TableEntry *destination = find_table_entry(entries, capacity, entry->key);
+    destination->key = entry->key;
+    destination->value = entry->value;
+    table->used++;
+  }
+  FREE_ARRAY(MEMORY_TAG_TABLES, TableEntry, table->entries, table->capacity);
+  table->entries = entries;
+  table->capacity = capacity;
+}
+
+bool get_from_table(Table *table, ObjectString *key, Constant *value) {
+  if (table->used == 0)
+    return false;
+  TableEntry *entry = find_table_entry(table->entries, table->capacity, key);
+  if (entry->key == NULL)
+    return false;
+  *value = entry->value;
+  return true;
+}
+
+bool set_in_table(Table *table, ObjectString *key, Constant value) {
+  if (table->used + 1 > table->capacity * TABLE_MAX_LOAD)
+    grow_table(table);
+  TableEntry *entry = find_table_entry(table->entries, table->capacity, key);
+  bool is_new_key = entry->key == NULL;
+  if (is_new_key && IS_NIL_CONSTANT(entry->value))
+    table->used++;
+  entry->key = key;
+  entry->value = value;
+  return is_new_key;
+}
+
+bool delete_from_table(Table *table, ObjectString *key) {
+  if (table->used == 0)
+    return false;
+  TableEntry *entry = find_table_entry(table->entries, table->capacity, key);
+  if (entry->key == NULL)
+    return false;
+  entry->key = NULL;
+  entry->value = BOOLEAN_CONSTANT(true);
+  return true;
+}
+
+void copy_table(Table *source, Table *destination) {
+  for (size_t i = 0; i < source->capacity; i++) {
+    TableEntry *entry = &source->entries[i];
+    if (entry->key != NULL)
+      set_in_table(destination, entry->key, entry->value);
+  }
+}
+
+ObjectString *find_string_in_table(Table *table, const char *characters,
+                                   size_t length, uint32_t hash) {
+  if (table->used == 0)
+    return NULL;
+  size_t index = hash & (table->capacity - 1);
+  for (;;) {
+    TableEntry *entry = &table->entries[index];
+    if (entry->key == NULL) {
+      if (IS_NIL_CONSTANT(entry->value))
+        return NULL;
+    } else if (entry->key->length == length && entry->key->hash == hash &&
+               memcmp(entry->key->characters, characters, length) == 0) {
+      return entry->key;
+    }
+    index = (index + 1) & (table->capacity - 1);
+  }
+}
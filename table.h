@@ -0,0 +1,102 @@
+#ifndef interpres_table_h
+#define interpres_table_h
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "constant.h"
+
+/* Here we define the maximum ratio between the number of used entries and the
+ * capacity of a table before we grow it. */
+#define TABLE_MAX_LOAD 0.75
+/* Each entry of a table maps a string key to a constant. Entries whose key is
+ * NULL are either empty, when their value is nil, or tombstones left behind by
+ * a deletion, when their value is true. */
+typedef struct {
+  ObjectString *key;
+  Constant value;
+} TableEntry;
+/* A table is a hash table implemented with open addressing and linear probing
+ * on top of a dynamic array of entries. The "used" counter includes
+ * tombstones, so that the load factor accounts for them too. */
+typedef struct {
+  size_t used;
+  size_t capacity;
+  TableEntry *entries;
+} Table;
+/*
+ * @brief Initialize a new table.
+ * We set a starting value of 0 for "used" and "capacity", while the entries
+ * array starts completely empty; we do not even allocate space for the entries
+ * during initialization.
+ *
+ * @param table A pointer to the table to initialize
+ * @return void
+ */
+void init_table(Table *table);
+/*
+ * @brief Free the table.
+ * This function will free the memory allocated for the table's entries and
+ * re-initialize it to an empty state by calling init_table. Keys and values
+ * are not freed: they are owned by the garbage collector.
+ *
+ * @param table A pointer to the table to free
+ * @return void
+ */
+void free_table(Table *table);
+/*
+ * @brief Look up a key in the table.
+ *
+ * @param table A pointer to the table to look into
+ * @param key The key to look up
+ * @param value A pointer that receives the value mapped to the key, if any
+ * @return Whether the key was found in the table or not
+ */
+bool get_from_table(Table *table, ObjectString *key, Constant *value);
+/*
+ * @brief Map a key to a value.
+ * This function will insert the key in the table, growing it when the load
+ * factor goes past TABLE_MAX_LOAD, or overwrite the value it is mapped to if
+ * the key is already present.
+ *
+ * @param table A pointer to the table to insert into
+ * @param key The key to insert
+ * @param value The value to map the key to
+ * @return Whether the key is new to the table or not
+ */
+bool set_in_table(Table *table, ObjectString *key, Constant value);
+/*
+ * @brief Remove a key from the table.
+ * This function will replace the key's entry with a tombstone, so that probe
+ * sequences that went through it keep working.
+ *
+ * @param table A pointer to the table to remove the key from
+ * @param key The key to remove
+ * @return Whether the key was found in the table or not
+ */
+bool delete_from_table(Table *table, ObjectString *key);
+/*
+ * @brief Copy every entry of a table into another one.
+ * Keys that are already in the destination table are overwritten.
+ *
+ * @param source A pointer to the table to copy the entries from
+ * @param destination A pointer to the table to copy the entries into
+ * @return void
+ */
+void copy_table(Table *source, Table *destination);
+/*
+ * @brief Look up a string key by its characters.
+ * Unlike get_from_table, which compares keys by identity, this function
+ * compares the characters of the keys, which is what makes string interning
+ * possible.
+ *
+ * @param table A pointer to the table to look into
+ * @param characters The characters of the string to look up
+ * @param length The number of characters of the string to look up
+ * @param hash The hash of the string to look up
+ * @return The key with the given characters, or NULL if there is none
+ */
+ObjectString *find_string_in_table(Table *table, const char *characters,
+                                   size_t length, uint32_t hash);
+
+#endif
@@ -0,0 +1,125 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Here we define the largest output a script of the test cases can print,
+ * errors included. */
+#define OUTPUT_CAPACITY 4096
+
+/* A test case runs "source" with the interpreter, once for each of the ways
+ * the virtual machine can execute it, and expects "output" from every run. */
+typedef struct {
+  const char *description;
+  const char *source;
+  const char *output;
+} LanguageTest;
+
+static const char *const execution_flags[] = {
+    "",
+    "--registers",
+    "--optimize",
+    "--tier-up-threshold 1",
+};
+
+static const LanguageTest language_tests[] = {
+    {"a method invoked in tail position reuses the caller's frame",
+     "class L {\n"
+     "  go(n) { if (n == 0) return \"done\"; return this.go(n - 1); }\n"
+     "}\n"
+     "print L().go(100000);\n",
+     "done\n"},
+    {"a bound method held by a field and invoked in tail position reuses the "
+     "caller's frame",
+     "class R {\n"
+     "  init() { this.next = this.step; }\n"
+     "  step(n) { if (n == 0) return \"done\"; return this.next(n - 1); }\n"
+     "}\n"
+     "print R().step(100000);\n",
+     "done\n"},
+    {"integers and doubles are compared exactly around 2^53",
+     "print 9007199254740993 == 9007199254740992.0;\n"
+     "print 9007199254740992 == 9007199254740992.0;\n"
+     "print 9007199254740992.0 != 9007199254740993;\n"
+     "print 9007199254740993 > 9007199254740992.0;\n"
+     "print 9007199254740992.0 < 9007199254740993;\n"
+     "print 9007199254740991 < 9007199254740992.0;\n"
+     "print 9007199254740992 <= 9007199254740992.0;\n"
+     "if (9007199254740993 > 9007199254740992.0) print \"above\";\n",
+     "false\ntrue\ntrue\ntrue\ntrue\ntrue\ntrue\nabove\n"},
+    {"integers and doubles past the range of integers are ordered",
+     "print 9223372036854775807 == 9223372036854775808.0;\n"
+     "print 9223372036854775807 < 9223372036854775808.0;\n"
+     "print -9223372036854775807 - 1 == -9223372036854775808.0;\n"
+     "print 3 < 3.5;\n"
+     "print -3 > -3.5;\n"
+     "var nan = 0.0 / 0.0;\n"
+     "print 1 == nan;\n"
+     "print 1 != nan;\n"
+     "print nan >= 1;\n",
+     "false\ntrue\ntrue\ntrue\ntrue\nfalse\ntrue\nfalse\n"},
+};
+
+static int failures_count = 0;
+
+static bool run_script(const char *interpreter, const char *flags,
+                       const char *script_path, char *output,
+                       size_t output_capacity) {
+  char command[1024];
+  snprintf(command, sizeof(command), "%s %s %s 2>&1", interpreter, flags,
+           script_path);
+  FILE *pipe = popen(command, "r");
+  if (pipe == NULL)
+    return false;
+  size_t output_used = fread(output, 1, output_capacity - 1, pipe);
+  output[output_used] = '\0';
+  return pclose(pipe) != -1;
+}
+
+static void run_test(const char *interpreter, const char *script_path,
+                     const LanguageTest *test) {
+  FILE *script = fopen(script_path, "w");
+  if (script == NULL || fputs(test->source, script) == EOF) {
+    fprintf(stderr, "FAIL: %s: can't write the script\n", test->description);
+    failures_count++;
+    if (script != NULL)
+      fclose(script);
+    return;
+  }
+  fclose(script);
+  size_t flags_count = sizeof(execution_flags) / sizeof(execution_flags[0]);
+  for (size_t i = 0; i < flags_count; i++) {
+    char output[OUTPUT_CAPACITY];
+    if (run_script(interpreter, execution_flags[i], script_path, output,
+                   sizeof(output)) &&
+        strcmp(output, test->output) == 0)
+      continue;
+    fprintf(stderr, "FAIL: %s (%s): expected \"%s\" but got \"%s\"\n",
+            test->description, execution_flags[i], test->output, output);
+    failures_count++;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <interpres binary>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  char directory[] = "/tmp/interpres_language_test_XXXXXX";
+  if (mkdtemp(directory) == NULL)
+    return EXIT_FAILURE;
+  char script_path[64];
+  snprintf(script_path, sizeof(script_path), "%s/script", directory);
+  size_t tests_count = sizeof(language_tests) / sizeof(language_tests[0]);
+  for (size_t i = 0; i < tests_count; i++)
+    run_test(argv[1], script_path, &language_tests[i]);
+  unlink(script_path);
+  rmdir(directory);
+  if (failures_count > 0)
+    return EXIT_FAILURE;
+  printf("language tests passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,251 @@
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../number.h"
+
+/* Here we define the number of random inputs each test goes through unless
+ * another count is given on the command line, and the seed they are drawn
+ * from, fixed so that a failure can be reproduced. */
+#define DEFAULT_ITERATIONS 50000
+#define RANDOM_SEED 0x9e3779b97f4a7c15u
+/* Here we define the size of the buffer a literal is written to: the longest
+ * literal, the halfway point below the smallest subnormal, has 1075 digits
+ * after the decimal point, while the largest has 309 digits before it. */
+#define LITERAL_CAPACITY 2048
+/* Here we define the number of failures printed before the remaining ones are
+ * only counted. */
+#define MAX_REPORTED_FAILURES 20
+
+static int failures_count = 0;
+static uint64_t random_state = RANDOM_SEED;
+
+static uint64_t next_random(void) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 7;
+  random_state ^= random_state << 17;
+  return random_state;
+}
+
+static int random_below(int limit) {
+  return (int)(next_random() % (uint64_t)limit);
+}
+
+static uint64_t double_bits(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+static double random_finite_double(void) {
+  for (;;) {
+    uint64_t bits = next_random();
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    if (isfinite(value))
+      return value;
+  }
+}
+
+static void report_failure(const char *description, const char *input) {
+  if (failures_count++ < MAX_REPORTED_FAILURES)
+    fprintf(stderr, "FAIL: %s: %s\n", description, input);
+}
+
+static double parse_literal(const char *literal) {
+  DecimalNumber number;
+  init_decimal_number(&number);
+  const char *character = literal;
+  while (*character != '\0' && *character != '.')
+    push_decimal_digit(&number, *character++ - '0', false);
+  if (*character == '.')
+    for (character++; *character != '\0'; character++)
+      push_decimal_digit(&number, *character - '0', true);
+  return decimal_number_to_double(&number, literal, strlen(literal));
+}
+
+static void check_literal(const char *literal) {
+  if (double_bits(parse_literal(literal)) !=
+      double_bits(strtod(literal, NULL)))
+    report_failure("a literal parses to the double strtod reads", literal);
+}
+
+static void write_random_digits(char *literal, int count) {
+  for (int i = 0; i < count; i++)
+    literal[i] = (char)('0' + random_below(10));
+  literal[count] = '\0';
+}
+
+/* Literals have neither a sign nor an exponent, so the scientific notation
+ * printed by printf is written out positionally. */
+static void write_positional(const char *scientific, char *literal) {
+  char digits[64];
+  int digits_count = 0;
+  const char *character = scientific;
+  for (; *character != 'e'; character++)
+    if (*character != '.')
+      digits[digits_count++] = *character;
+  int point = atoi(character + 1) + 1;
+  char *end = literal;
+  if (point <= 0) {
+    end += sprintf(end, "0.");
+    for (int i = point; i < 0; i++)
+      *end++ = '0';
+    memcpy(end, digits, (size_t)digits_count);
+    end += digits_count;
+  } else {
+    for (int i = 0; i < point || i < digits_count; i++) {
+      if (i == point)
+        *end++ = '.';
+      *end++ = i < digits_count ? digits[i] : '0';
+    }
+  }
+  *end = '\0';
+}
+
+static void test_random_literals(int iterations) {
+  char literal[LITERAL_CAPACITY];
+  for (int i = 0; i < iterations; i++) {
+    int integer_digits = 1 + random_below(25);
+    write_random_digits(literal, integer_digits);
+    if (random_below(2) == 0) {
+      literal[integer_digits] = '.';
+      write_random_digits(literal + integer_digits + 1, 1 + random_below(25));
+    }
+    check_literal(literal);
+  }
+}
+
+static void test_rounded_doubles(int iterations) {
+  char scientific[64];
+  char literal[LITERAL_CAPACITY];
+  for (int i = 0; i < iterations; i++) {
+    double value = fabs(random_finite_double());
+    snprintf(scientific, sizeof(scientific), "%.*e", random_below(26), value);
+    write_positional(scientific, literal);
+    check_literal(literal);
+  }
+}
+
+static void append_digits(char *literal, const char *digits) {
+  if (strchr(literal, '.') == NULL)
+    strcat(literal, ".");
+  strcat(literal, digits);
+}
+
+static void decrement_last_digit(char *literal) {
+  for (char *digit = literal + strlen(literal) - 1; digit >= literal;
+       digit--) {
+    if (*digit == '.')
+      continue;
+    if (*digit != '0') {
+      (*digit)--;
+      return;
+    }
+    *digit = '9';
+  }
+}
+
+/* The halfway points between two neighbouring doubles are the hardest inputs:
+ * they are exact in a long double, which printf writes out in full, and the
+ * literals right above and right below them must round the other way. */
+static void test_halfway_points(int iterations) {
+#if LDBL_MANT_DIG > DBL_MANT_DIG
+  char literal[LITERAL_CAPACITY];
+  for (int i = 0; i < iterations; i++) {
+    double value = fabs(random_finite_double());
+    if (value == DBL_MAX)
+      continue;
+    long double halfway =
+        ((long double)value + (long double)nextafter(value, INFINITY)) / 2;
+    snprintf(literal, sizeof(literal), "%.1100Lf", halfway);
+    char *end = literal + strlen(literal);
+    while (end[-1] == '0')
+      end--;
+    if (end[-1] == '.')
+      end--;
+    *end = '\0';
+    check_literal(literal);
+    char neighbour[LITERAL_CAPACITY + 8];
+    strcpy(neighbour, literal);
+    append_digits(neighbour, "0001");
+    check_literal(neighbour);
+    strcpy(neighbour, literal);
+    decrement_last_digit(neighbour);
+    append_digits(neighbour, "9999");
+    check_literal(neighbour);
+  }
+#else
+  (void)iterations;
+#endif
+}
+
+static int count_significant_digits(const char *formatted) {
+  const char *first = formatted;
+  while (*first == '-' || *first == '0' || *first == '.')
+    first++;
+  const char *last = first;
+  for (const char *character = first;
+       *character != '\0' && *character != 'e'; character++)
+    if (*character != '0' && *character != '.')
+      last = character + 1;
+  int count = 0;
+  for (const char *character = first; character < last; character++)
+    if (*character != '.')
+      count++;
+  return count;
+}
+
+static int count_shortest_digits(double value) {
+  char scientific[64];
+  for (int digits = 1; digits < NUMBER_FORMAT_MAX_DIGITS; digits++) {
+    snprintf(scientific, sizeof(scientific), "%.*e", digits - 1, value);
+    if (strtod(scientific, NULL) == value)
+      return digits;
+  }
+  return NUMBER_FORMAT_MAX_DIGITS;
+}
+
+static void test_formatted_doubles(int iterations) {
+  char formatted[NUMBER_FORMAT_MAX_LENGTH];
+  for (int i = 0; i < iterations; i++) {
+    double value = random_finite_double();
+    size_t length = format_double(value, formatted);
+    int shortest_digits = value == 0 ? 0 : count_shortest_digits(value);
+    if (length != strlen(formatted) || length >= NUMBER_FORMAT_MAX_LENGTH)
+      report_failure("a double is formatted within the buffer", formatted);
+    else if (double_bits(strtod(formatted, NULL)) != double_bits(value))
+      report_failure("a formatted double reads back to itself", formatted);
+    else if (count_significant_digits(formatted) != shortest_digits)
+      report_failure("a double is formatted with the fewest digits", formatted);
+  }
+  const double special_values[] = {INFINITY, -INFINITY, NAN};
+  const char *special_texts[] = {"inf", "-inf", "nan"};
+  for (size_t i = 0; i < 3; i++) {
+    format_double(special_values[i], formatted);
+    if (strcmp(formatted, special_texts[i]) != 0)
+      report_failure("a double that is not finite is named", formatted);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+  if (argc > 2 || iterations <= 0) {
+    fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  test_random_literals(iterations);
+  test_rounded_doubles(iterations);
+  test_halfway_points(iterations);
+  test_formatted_doubles(iterations);
+  if (failures_count > 0) {
+    fprintf(stderr, "%d failures\n", failures_count);
+    return EXIT_FAILURE;
+  }
+  printf("number tests passed\n");
+  return EXIT_SUCCESS;
+}
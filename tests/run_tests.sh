@@ -0,0 +1,14 @@
+#!/bin/sh
+# Build the interpreter and the test drivers next to each other in a scratch
+# directory, then run every test against them.
+set -e
+cd "$(dirname "$0")/.."
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+cc -std=c11 -Wall -O2 -o "$build/interpres" *.c
+cc -std=c11 -Wall -O2 -o "$build/server_test" tests/server_test.c
+"$build/server_test" "$build/interpres"
+cc -std=c11 -Wall -O2 -o "$build/number_test" tests/number_test.c number.c -lm
+"$build/number_test"
+cc -std=c11 -Wall -O2 -o "$build/language_test" tests/language_test.c
+"$build/language_test" "$build/interpres"
@@ -0,0 +1,290 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Here we define the fuel the server is started with: enough for the loop of
+ * FUEL_REQUEST on its own, but not once the loop of FUEL_PRELUDE has taken its
+ * share, so that a request only succeeds if its fuel was reset. */
+#define SERVER_FUEL "3000"
+#define FUEL_PRELUDE "var i = 0;\nwhile (i < 100) { i = i + 1; }\n"
+#define FUEL_REQUEST "var j = 0; while (j < 150) { j = j + 1; } print j;"
+/* Here we define the number of connections a hash frame is sent on after the
+ * script was compiled on another one; with several workers, some of them are
+ * bound to land on the worker that compiled it. */
+#define HASH_CONNECTIONS 12
+/* Here we define the address space the server is limited to, so that a
+ * request growing a string without bounds makes its worker run out of memory
+ * and exit, and the number of requests sent once it was replaced. */
+#define SERVER_ADDRESS_SPACE (256 * 1024 * 1024)
+#define MEMORY_REQUEST "var s = \"x\"; while (true) s = s + s;"
+#define RESTART_CONNECTIONS 6
+/* Here we define a request that leaves a task on the event loop and one that
+ * runs whatever is left there, which is sent next on the same connection so
+ * that the same worker serves both. */
+#define SPAWNING_REQUEST "fun leak(x) { print \"leaked\"; } spawn(leak);"
+#define RUNNING_REQUEST "run_tasks(); print \"done\";"
+
+enum {
+  RESULT_OK,
+  RESULT_COMPILE_ERROR,
+  RESULT_RUNTIME_ERROR,
+  RESULT_UNKNOWN_HASH,
+};
+
+static int failures_count = 0;
+
+static void check(bool condition, const char *description) {
+  if (condition)
+    return;
+  fprintf(stderr, "FAIL: %s\n", description);
+  failures_count++;
+}
+
+static int connect_server(const char *socket_path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+  for (int attempt = 0; attempt < 200; attempt++) {
+    int client = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (client < 0)
+      return -1;
+    if (connect(client, (struct sockaddr *)&address, sizeof(address)) == 0)
+      return client;
+    close(client);
+    struct timespec delay = {0, 10 * 1000 * 1000};
+    nanosleep(&delay, NULL);
+  }
+  return -1;
+}
+
+static bool write_all(int client, const void *bytes, size_t length) {
+  const char *characters = bytes;
+  while (length > 0) {
+    ssize_t written = write(client, characters, length);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+    characters += written;
+    length -= (size_t)written;
+  }
+  return true;
+}
+
+static bool read_all(int client, void *bytes, size_t length) {
+  char *characters = bytes;
+  while (length > 0) {
+    ssize_t bytes_read = read(client, characters, length);
+    if (bytes_read < 0 && errno == EINTR)
+      continue;
+    if (bytes_read <= 0)
+      return false;
+    characters += bytes_read;
+    length -= (size_t)bytes_read;
+  }
+  return true;
+}
+
+static bool send_frame(int client, char kind, const void *payload,
+                       uint32_t length) {
+  unsigned char header[] = {(unsigned char)kind, (unsigned char)(length >> 24),
+                            (unsigned char)(length >> 16),
+                            (unsigned char)(length >> 8),
+                            (unsigned char)length};
+  return write_all(client, header, sizeof(header)) &&
+         write_all(client, payload, length);
+}
+
+static bool receive_result(int client, int *result, uint32_t *hash,
+                           char *output, size_t output_capacity) {
+  size_t output_used = 0;
+  for (;;) {
+    unsigned char header[5];
+    if (!read_all(client, header, sizeof(header)))
+      return false;
+    uint32_t length = ((uint32_t)header[1] << 24) |
+                      ((uint32_t)header[2] << 16) |
+                      ((uint32_t)header[3] << 8) | (uint32_t)header[4];
+    char payload[4096];
+    if (length > sizeof(payload) || !read_all(client, payload, length))
+      return false;
+    if (header[0] == 'o' && output_used + length < output_capacity) {
+      memcpy(output + output_used, payload, length);
+      output_used += length;
+    }
+    if (header[0] == 'r' && length == 5) {
+      output[output_used] = '\0';
+      const unsigned char *bytes = (const unsigned char *)payload;
+      *result = bytes[0];
+      *hash = ((uint32_t)bytes[1] << 24) | ((uint32_t)bytes[2] << 16) |
+              ((uint32_t)bytes[3] << 8) | (uint32_t)bytes[4];
+      return true;
+    }
+  }
+}
+
+static int evaluate_source(int client, const char *source, uint32_t *hash,
+                           char *output, size_t output_capacity) {
+  int result = -1;
+  if (!send_frame(client, 's', source, (uint32_t)strlen(source)) ||
+      !receive_result(client, &result, hash, output, output_capacity))
+    return -1;
+  return result;
+}
+
+static int evaluate_hash(int client, uint32_t hash) {
+  unsigned char payload[] = {(unsigned char)(hash >> 24),
+                             (unsigned char)(hash >> 16),
+                             (unsigned char)(hash >> 8), (unsigned char)hash};
+  int result = -1;
+  uint32_t answered_hash;
+  char output[256];
+  if (!send_frame(client, 'h', payload, sizeof(payload)) ||
+      !receive_result(client, &result, &answered_hash, output,
+                      sizeof(output)))
+    return -1;
+  return result;
+}
+
+static void test_fuel(const char *socket_path) {
+  for (int i = 0; i < 2; i++) {
+    int client = connect_server(socket_path);
+    uint32_t hash;
+    char output[256];
+    check(client >= 0 && evaluate_source(client, FUEL_REQUEST, &hash, output,
+                                         sizeof(output)) == RESULT_OK,
+          "a request gets the configured fuel, not what the prelude left");
+    check(strcmp(output, "150\n") == 0, "the request prints its result");
+    close(client);
+  }
+}
+
+static void test_hashes(const char *socket_path) {
+  int client = connect_server(socket_path);
+  uint32_t hash = 0;
+  char output[256];
+  check(client >= 0 && evaluate_source(client, "print 1 + 2;", &hash, output,
+                                       sizeof(output)) == RESULT_OK,
+        "a source frame runs");
+  check(evaluate_hash(client, hash) == RESULT_OK,
+        "a hash frame runs the script sent on the same connection");
+  check(evaluate_hash(client, hash ^ 1) == RESULT_UNKNOWN_HASH,
+        "a hash frame for an unknown script is refused");
+  close(client);
+  for (int i = 0; i < HASH_CONNECTIONS; i++) {
+    client = connect_server(socket_path);
+    check(client >= 0 && evaluate_hash(client, hash) == RESULT_UNKNOWN_HASH,
+          "a hash frame is refused on another connection");
+    close(client);
+  }
+}
+
+static void test_tasks(const char *socket_path) {
+  int client = connect_server(socket_path);
+  uint32_t hash;
+  char output[256];
+  check(client >= 0 && evaluate_source(client, SPAWNING_REQUEST, &hash, output,
+                                       sizeof(output)) == RESULT_OK,
+        "a request spawns a task it never runs");
+  check(evaluate_source(client, RUNNING_REQUEST, &hash, output,
+                        sizeof(output)) == RESULT_OK &&
+            strcmp(output, "done\n") == 0,
+        "a request does not run the tasks the request before left");
+  close(client);
+}
+
+static bool file_contains(const char *path, const char *text) {
+  char contents[4096];
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+    return false;
+  size_t length = fread(contents, 1, sizeof(contents) - 1, file);
+  fclose(file);
+  contents[length] = '\0';
+  return strstr(contents, text) != NULL;
+}
+
+static void test_worker_exit(const char *socket_path, const char *log_path) {
+  int client = connect_server(socket_path);
+  uint32_t hash;
+  char output[256];
+  check(client >= 0 && evaluate_source(client, MEMORY_REQUEST, &hash, output,
+                                       sizeof(output)) == -1,
+        "a worker running out of memory drops the connection");
+  close(client);
+  bool is_reported = false;
+  for (int attempt = 0; attempt < 200 && !is_reported; attempt++) {
+    struct timespec delay = {0, 10 * 1000 * 1000};
+    nanosleep(&delay, NULL);
+    is_reported = file_contains(log_path, "exited with status 1");
+  }
+  check(is_reported, "the server reports a worker that exited");
+  for (int i = 0; i < RESTART_CONNECTIONS; i++) {
+    client = connect_server(socket_path);
+    check(client >= 0 && evaluate_source(client, "print 1;", &hash, output,
+                                         sizeof(output)) == RESULT_OK,
+          "the server keeps serving once a worker exited");
+    close(client);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <interpres binary>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  char directory[] = "/tmp/interpres_server_test_XXXXXX";
+  if (mkdtemp(directory) == NULL)
+    return EXIT_FAILURE;
+  char socket_path[64];
+  char prelude_path[64];
+  char log_path[64];
+  snprintf(socket_path, sizeof(socket_path), "%s/socket", directory);
+  snprintf(prelude_path, sizeof(prelude_path), "%s/prelude", directory);
+  snprintf(log_path, sizeof(log_path), "%s/log", directory);
+  FILE *prelude = fopen(prelude_path, "w");
+  if (prelude == NULL)
+    return EXIT_FAILURE;
+  fputs(FUEL_PRELUDE, prelude);
+  fclose(prelude);
+  signal(SIGPIPE, SIG_IGN);
+  pid_t server = fork();
+  if (server < 0)
+    return EXIT_FAILURE;
+  if (server == 0) {
+    struct rlimit address_space = {SERVER_ADDRESS_SPACE, SERVER_ADDRESS_SPACE};
+    FILE *log = fopen(log_path, "w");
+    if (log == NULL || dup2(fileno(log), STDERR_FILENO) < 0 ||
+        setrlimit(RLIMIT_AS, &address_space) != 0)
+      _exit(EXIT_FAILURE);
+    execl(argv[1], argv[1], "--fuel", SERVER_FUEL, "--serve", socket_path,
+          "--workers", "3", prelude_path, (char *)NULL);
+    _exit(EXIT_FAILURE);
+  }
+  test_fuel(socket_path);
+  test_hashes(socket_path);
+  test_tasks(socket_path);
+  test_worker_exit(socket_path, log_path);
+  kill(server, SIGTERM);
+  waitpid(server, NULL, 0);
+  unlink(prelude_path);
+  unlink(log_path);
+  rmdir(directory);
+  if (failures_count > 0)
+    return EXIT_FAILURE;
+  printf("server tests passed\n");
+  return EXIT_SUCCESS;
+}
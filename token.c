@@ -19,6 +19,7 @@ static Token make_token(Scanner *scanner, TokenType token_type) {
   token.lexeme_length =
       (size_t)(scanner->lexeme_current - scanner->lexeme_start);
   token.line_number = scanner->line_number;
+  init_decimal_number(&token.number);
   return token;
 }
 
@@ -28,6 +29,7 @@ static Token make_error_token(Scanner *scanner, const char *error_message) {
   token.lexeme_start = error_message;
   token.lexeme_length = (size_t)strlen(error_message);
   token.line_number = scanner->line_number;
+  init_decimal_number(&token.number);
   return token;
 }
 
@@ -92,7 +94,15 @@ static TokenType make_identifier_token_type(Scanner *scanner) {
   case 'a':
     return match_identifier_token_type(scanner, 1, 2, "nd", TOKEN_AND);
   case 'c':
-    return match_identifier_token_type(scanner, 1, 4, "lass", TOKEN_CLASS);
+    if (scanner->lexeme_current - scanner->lexeme_start > 1) {
+      switch (scanner->lexeme_start[1]) {
+      case 'a':
+        return match_identifier_token_type(scanner, 2, 3, "tch", TOKEN_CATCH);
+      case 'l':
+        return match_identifier_token_type(scanner, 2, 3, "ass", TOKEN_CLASS);
+      }
+    }
+    break;
   case 'e':
     return match_identifier_token_type(scanner, 1, 3, "lse", TOKEN_ELSE);
   case 'f':
@@ -123,8 +133,13 @@ static TokenType make_identifier_token_type(Scanner *scanner) {
     if (scanner->lexeme_current - scanner->lexeme_start > 1) {
       switch (scanner->lexeme_start[1]) {
       case 'h':
+        if (scanner->lexeme_current - scanner->lexeme_start > 2 &&
+            scanner->lexeme_start[2] == 'r')
+          return match_identifier_token_type(scanner, 3, 2, "ow", TOKEN_THROW);
         return match_identifier_token_type(scanner, 2, 2, "is", TOKEN_THIS);
       case 'r':
+        if (scanner->lexeme_current - scanner->lexeme_start == 3)
+          return match_identifier_token_type(scanner, 2, 1, "y", TOKEN_TRY);
         return match_identifier_token_type(scanner, 2, 2, "ue", TOKEN_TRUE);
       }
     }
@@ -145,15 +160,20 @@ static Token make_identifier_token(Scanner *scanner) {
 }
 
 static Token make_numeric_token(Scanner *scanner) {
+  DecimalNumber number;
+  init_decimal_number(&number);
+  push_decimal_digit(&number, scanner->lexeme_start[0] - '0', false);
   while (token_is_digit(peek_scanner(scanner)))
-    advance_scanner(scanner);
+    push_decimal_digit(&number, advance_scanner(scanner) - '0', false);
   if (peek_scanner(scanner) == '.' &&
       token_is_digit(peek_scanner_next(scanner))) {
     advance_scanner(scanner);
     while (token_is_digit(peek_scanner(scanner)))
-      advance_scanner(scanner);
+      push_decimal_digit(&number, advance_scanner(scanner) - '0', true);
   }
-  return make_token(scanner, TOKEN_NUMBER);
+  Token token = make_token(scanner, TOKEN_NUMBER);
+  token.number = number;
+  return token;
 }
 
 static Token make_string_token(Scanner *scanner) {
@@ -169,9 +189,13 @@ static Token make_string_token(Scanner *scanner) {
 }
 
 Token scan_token(Scanner *scanner) {
-  skip_whitespaces(scanner);
-  skip_newlines(scanner);
-  skip_comments(scanner);
+  const char *skipping_start;
+  do {
+    skipping_start = scanner->lexeme_current;
+    skip_whitespaces(scanner);
+    skip_newlines(scanner);
+    skip_comments(scanner);
+  } while (scanner->lexeme_current != skipping_start);
   scanner->lexeme_start = scanner->lexeme_current;
   if (scanner_is_eof(scanner))
     return make_token(scanner, TOKEN_EOF);
@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 
+#include "number.h"
 #include "scanner.h"
 
 /* This list contains all the supported tokens for the language. */
@@ -45,17 +46,22 @@ typedef enum {
   TOKEN_THIS,
   TOKEN_SUPER,
   TOKEN_PRINT,
+  TOKEN_TRY,
+  TOKEN_CATCH,
+  TOKEN_THROW,
   TOKEN_ERROR,
   TOKEN_EOF
 } TokenType;
 /* Each token that our scanner produces have a type, a lexeme (the actual
  * string that was scanned), the length of the lexeme and the line number in
- * which it was found. */
+ * which it was found. Numeric tokens also carry the decimal number the scanner
+ * read off their digits. */
 typedef struct {
   TokenType type;
   const char *lexeme_start;
   size_t lexeme_length;
   size_t line_number;
+  DecimalNumber number;
 } Token;
 /*
  * @brief Scan a new character from input.
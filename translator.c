@@ -0,0 +1,483 @@
+#include "translator.h"
+#include "memory.h"
+
+static const TranslatorOperand no_operand = {false, 0};
+
+static TranslatorOperand register_operand(int slot) {
+  return (TranslatorOperand){false, (uint16_t)slot};
+}
+
+static TranslatorOperand constant_operand(uint16_t index) {
+  return (TranslatorOperand){true, index};
+}
+
+static TranslatorOperand integer_operand(Translator *translator,
+                                         int64_t value) {
+  ConstantsArray *constants = &translator->function->chunk.constants;
+  for (size_t i = 0; i < constants->used; i++)
+    if (IS_INTEGER_CONSTANT(constants->values[i]) &&
+        AS_INTEGER_CONSTANT(constants->values[i]) == value)
+      return constant_operand((uint16_t)i);
+  return constant_operand((uint16_t)push_constant_to_chunk(
+      &translator->function->chunk, INTEGER_CONSTANT(value)));
+}
+
+static bool slot_holds_own_value(Translator *translator, int slot) {
+  TranslatorOperand operand = translator->slots[slot];
+  return !operand.is_constant && operand.index == slot;
+}
+
+static uint8_t read_operand(Translator *translator, size_t operand_offset) {
+  return translator->function->chunk.instructions
+      .values[translator->offset + operand_offset];
+}
+
+static uint16_t read_operand_short(Translator *translator,
+                                   size_t operand_offset) {
+  return (uint16_t)((read_operand(translator, operand_offset) << 8) |
+                    read_operand(translator, operand_offset + 1));
+}
+
+static uint32_t read_property_argument(Translator *translator,
+                                       size_t cache_offset) {
+  return ((uint32_t)read_operand(translator, 1) << REGISTER_ARGUMENT_SHIFT) |
+         read_operand_short(translator, cache_offset);
+}
+
+static size_t write_register_instruction(Translator *translator,
+                                         RegisterOpCode opcode,
+                                         int destination,
+                                         TranslatorOperand first_operand,
+                                         TranslatorOperand second_operand,
+                                         uint32_t argument) {
+  RegisterInstruction instruction = {
+      .opcode = (uint8_t)opcode,
+      .operand_kinds =
+          (uint8_t)((first_operand.is_constant
+                         ? REGISTER_FIRST_OPERAND_IS_CONSTANT
+                         : 0) |
+                    (second_operand.is_constant
+                         ? REGISTER_SECOND_OPERAND_IS_CONSTANT
+                         : 0)),
+      .destination = (uint16_t)destination,
+      .first_operand = first_operand.index,
+      .second_operand = second_operand.index,
+      .argument = argument,
+  };
+  translator->has_retargetable_instruction = false;
+  return write_register_instructions_array(
+      &translator->function->chunk.registers, instruction, translator->offset);
+}
+
+static void push_operand(Translator *translator, TranslatorOperand operand) {
+  translator->slots[translator->depth] = operand;
+  translator->depth++;
+  RegisterInstructionsArray *registers = &translator->function->chunk.registers;
+  if (registers->registers_count < translator->depth)
+    registers->registers_count = translator->depth;
+}
+
+static TranslatorOperand pop_operand(Translator *translator) {
+  translator->depth--;
+  return translator->slots[translator->depth];
+}
+
+static void push_result(Translator *translator, RegisterOpCode opcode,
+                        TranslatorOperand first_operand,
+                        TranslatorOperand second_operand, uint32_t argument) {
+  size_t instruction_index =
+      write_register_instruction(translator, opcode, translator->depth,
+                                 first_operand, second_operand, argument);
+  push_operand(translator, register_operand(translator->depth));
+  translator->has_retargetable_instruction = true;
+  translator->retargetable_instruction_index = instruction_index;
+}
+
+static void materialize_slot(Translator *translator, int slot) {
+  if (slot_holds_own_value(translator, slot))
+    return;
+  write_register_instruction(translator, REGISTER_OP_MOVE, slot,
+                             translator->slots[slot], no_operand, 0);
+  translator->slots[slot] = register_operand(slot);
+}
+
+static void materialize_slots(Translator *translator) {
+  for (int i = 0; i < translator->depth; i++)
+    materialize_slot(translator, i);
+}
+
+static void set_local_variable(Translator *translator, int slot) {
+  TranslatorOperand value = translator->slots[translator->depth - 1];
+  for (int i = slot + 1; i < translator->depth - 1; i++) {
+    TranslatorOperand operand = translator->slots[i];
+    if (!operand.is_constant && operand.index == slot)
+      materialize_slot(translator, i);
+  }
+  RegisterInstructionsArray *registers = &translator->function->chunk.registers;
+  if (translator->has_retargetable_instruction && !value.is_constant &&
+      value.index == translator->depth - 1 &&
+      slot_holds_own_value(translator, translator->depth - 1)) {
+    registers->values[translator->retargetable_instruction_index].destination =
+        (uint16_t)slot;
+    translator->slots[slot] = register_operand(slot);
+    translator->slots[translator->depth - 1] = register_operand(slot);
+    translator->has_retargetable_instruction = false;
+    return;
+  }
+  if (value.is_constant || value.index != slot)
+    write_register_instruction(translator, REGISTER_OP_MOVE, slot, value,
+                               no_operand, 0);
+  translator->slots[slot] = register_operand(slot);
+}
+
+static void write_jump(Translator *translator, RegisterOpCode opcode,
+                       TranslatorOperand first_operand,
+                       TranslatorOperand second_operand, size_t target) {
+  materialize_slots(translator);
+  if (translator->depths[target] == VERIFIER_UNKNOWN_DEPTH)
+    translator->depths[target] = translator->depth;
+  write_register_instruction(translator, opcode, 0, first_operand,
+                             second_operand, (uint32_t)target);
+}
+
+static size_t get_jump_target(Translator *translator) {
+  return translator->offset + 3 + read_operand_short(translator, 1);
+}
+
+static void write_call(Translator *translator, RegisterOpCode opcode,
+                       int arguments_count, uint32_t argument) {
+  materialize_slots(translator);
+  int callee = translator->depth - arguments_count - 1;
+  write_register_instruction(translator, opcode, callee,
+                             register_operand(arguments_count), no_operand,
+                             argument);
+  translator->depth = callee + 1;
+}
+
+static RegisterOpCode get_register_opcode(uint8_t instruction) {
+  switch (instruction) {
+  case OP_NIL:
+    return REGISTER_OP_NIL;
+  case OP_TRUE:
+    return REGISTER_OP_TRUE;
+  case OP_FALSE:
+    return REGISTER_OP_FALSE;
+  case OP_EQUAL:
+    return REGISTER_OP_EQUAL;
+  case OP_NOT_EQUAL:
+    return REGISTER_OP_NOT_EQUAL;
+  case OP_GREATER:
+    return REGISTER_OP_GREATER;
+  case OP_GREATER_EQUAL:
+    return REGISTER_OP_GREATER_EQUAL;
+  case OP_LESS:
+    return REGISTER_OP_LESS;
+  case OP_LESS_EQUAL:
+    return REGISTER_OP_LESS_EQUAL;
+  case OP_ADD:
+    return REGISTER_OP_ADD;
+  case OP_SUBTRACT:
+    return REGISTER_OP_SUBTRACT;
+  case OP_MULTIPLY:
+    return REGISTER_OP_MULTIPLY;
+  case OP_DIVIDE:
+    return REGISTER_OP_DIVIDE;
+  case OP_NOT:
+    return REGISTER_OP_NOT;
+  case OP_NEGATE:
+    return REGISTER_OP_NEGATE;
+  case OP_JUMP_IF_EQUAL:
+    return REGISTER_OP_JUMP_IF_EQUAL;
+  case OP_JUMP_IF_NOT_EQUAL:
+    return REGISTER_OP_JUMP_IF_NOT_EQUAL;
+  case OP_JUMP_IF_NOT_GREATER:
+    return REGISTER_OP_JUMP_IF_NOT_GREATER;
+  case OP_JUMP_IF_NOT_GREATER_EQUAL:
+    return REGISTER_OP_JUMP_IF_NOT_GREATER_EQUAL;
+  case OP_JUMP_IF_NOT_LESS:
+    return REGISTER_OP_JUMP_IF_NOT_LESS;
+  case OP_JUMP_IF_NOT_LESS_EQUAL:
+    return REGISTER_OP_JUMP_IF_NOT_LESS_EQUAL;
+  case OP_CALL:
+    return REGISTER_OP_CALL;
+  case OP_TAIL_CALL:
+    return REGISTER_OP_TAIL_CALL;
+  case OP_INVOKE:
+    return REGISTER_OP_INVOKE;
+  case OP_TAIL_INVOKE:
+    return REGISTER_OP_TAIL_INVOKE;
+  }
+  return REGISTER_OP_MOVE;
+}
+
+static void translate_instruction(Translator *translator, uint8_t instruction) {
+  RegisterOpCode opcode = get_register_opcode(instruction);
+  switch (instruction) {
+  case OP_RETURN:
+    write_register_instruction(translator, REGISTER_OP_RETURN, 0,
+                               pop_operand(translator), no_operand, 0);
+    break;
+  case OP_CONSTANT:
+    push_operand(translator, constant_operand(read_operand(translator, 1)));
+    break;
+  case OP_ZERO:
+    push_operand(translator, integer_operand(translator, 0));
+    break;
+  case OP_ONE:
+    push_operand(translator, integer_operand(translator, 1));
+    break;
+  case OP_SMALL_INTEGER: {
+    int8_t integer = (int8_t)read_operand(translator, 1);
+    push_operand(translator, integer_operand(translator, integer));
+    break;
+  }
+  case OP_SHORT_INTEGER: {
+    int16_t integer = (int16_t)read_operand_short(translator, 1);
+    push_operand(translator, integer_operand(translator, integer));
+    break;
+  }
+  case OP_NIL:
+  case OP_TRUE:
+  case OP_FALSE:
+    push_result(translator, opcode, no_operand, no_operand, 0);
+    break;
+  case OP_POP:
+    pop_operand(translator);
+    break;
+  case OP_DEFINE_GLOBAL:
+    write_register_instruction(translator, REGISTER_OP_DEFINE_GLOBAL, 0,
+                               pop_operand(translator), no_operand,
+                               read_operand(translator, 1));
+    break;
+  case OP_GET_GLOBAL:
+    push_result(translator, REGISTER_OP_GET_GLOBAL, no_operand, no_operand,
+                read_operand(translator, 1));
+    break;
+  case OP_SET_GLOBAL:
+    write_register_instruction(translator, REGISTER_OP_SET_GLOBAL, 0,
+                               translator->slots[translator->depth - 1],
+                               no_operand, read_operand(translator, 1));
+    break;
+  case OP_GET_LOCAL: {
+    uint8_t slot = read_operand(translator, 1);
+    push_operand(translator, slot_holds_own_value(translator, slot)
+                                 ? register_operand(slot)
+                                 : translator->slots[slot]);
+    break;
+  }
+  case OP_SET_LOCAL:
+    set_local_variable(translator, read_operand(translator, 1));
+    break;
+  case OP_EQUAL:
+  case OP_NOT_EQUAL:
+  case OP_GREATER:
+  case OP_GREATER_EQUAL:
+  case OP_LESS:
+  case OP_LESS_EQUAL:
+  case OP_ADD:
+  case OP_SUBTRACT:
+  case OP_MULTIPLY:
+  case OP_DIVIDE: {
+    TranslatorOperand second_operand = pop_operand(translator);
+    TranslatorOperand first_operand = pop_operand(translator);
+    push_result(translator, opcode, first_operand, second_operand, 0);
+    break;
+  }
+  case OP_NOT:
+  case OP_NEGATE:
+    push_result(translator, opcode, pop_operand(translator), no_operand, 0);
+    break;
+  case OP_PRINT:
+    write_register_instruction(translator, REGISTER_OP_PRINT, 0,
+                               pop_operand(translator), no_operand, 0);
+    break;
+  case OP_JUMP:
+    write_jump(translator, REGISTER_OP_JUMP, no_operand, no_operand,
+               get_jump_target(translator));
+    break;
+  case OP_JUMP_IF_FALSE:
+    write_jump(translator, REGISTER_OP_JUMP_IF_FALSE,
+               register_operand(translator->depth - 1), no_operand,
+               get_jump_target(translator));
+    break;
+  case OP_POP_JUMP_IF_FALSE: {
+    TranslatorOperand condition = pop_operand(translator);
+    write_jump(translator, REGISTER_OP_JUMP_IF_FALSE, condition, no_operand,
+               get_jump_target(translator));
+    break;
+  }
+  case OP_JUMP_IF_EQUAL:
+  case OP_JUMP_IF_NOT_EQUAL:
+  case OP_JUMP_IF_NOT_GREATER:
+  case OP_JUMP_IF_NOT_GREATER_EQUAL:
+  case OP_JUMP_IF_NOT_LESS:
+  case OP_JUMP_IF_NOT_LESS_EQUAL: {
+    TranslatorOperand second_operand = pop_operand(translator);
+    TranslatorOperand first_operand = pop_operand(translator);
+    write_jump(translator, opcode, first_operand, second_operand,
+               get_jump_target(translator));
+    break;
+  }
+  case OP_LOOP: {
+    uint16_t loop_offset = read_operand_short(translator, 1);
+    write_jump(translator, REGISTER_OP_LOOP, register_operand(loop_offset),
+               no_operand, translator->offset + 3 - loop_offset);
+    break;
+  }
+  case OP_CALL:
+  case OP_TAIL_CALL:
+    write_call(translator, opcode, read_operand(translator, 1), 0);
+    break;
+  case OP_GET_PROPERTY:
+    push_result(translator, REGISTER_OP_GET_PROPERTY, pop_operand(translator),
+                no_operand, read_property_argument(translator, 2));
+    break;
+  case OP_SET_PROPERTY: {
+    TranslatorOperand value = pop_operand(translator);
+    TranslatorOperand instance = pop_operand(translator);
+    push_result(translator, REGISTER_OP_SET_PROPERTY, instance, value,
+                read_property_argument(translator, 2));
+    break;
+  }
+  case OP_INVOKE:
+  case OP_TAIL_INVOKE:
+    write_call(translator, opcode, read_operand(translator, 2),
+               read_property_argument(translator, 3));
+    break;
+  case OP_CLASS:
+    push_result(translator, REGISTER_OP_CLASS, no_operand, no_operand,
+                read_operand(translator, 1));
+    break;
+  case OP_INHERIT: {
+    TranslatorOperand subclass = pop_operand(translator);
+    TranslatorOperand superclass = pop_operand(translator);
+    write_register_instruction(translator, REGISTER_OP_INHERIT, 0, superclass,
+                               subclass, 0);
+    break;
+  }
+  case OP_METHOD: {
+    TranslatorOperand method = pop_operand(translator);
+    write_register_instruction(translator, REGISTER_OP_METHOD, 0,
+                               translator->slots[translator->depth - 1],
+                               method, read_operand(translator, 1));
+    break;
+  }
+  case OP_THROW: {
+    TranslatorOperand exception = pop_operand(translator);
+    materialize_slots(translator);
+    write_register_instruction(translator, REGISTER_OP_THROW, 0, exception,
+                               no_operand, 0);
+    break;
+  }
+  }
+}
+
+static bool instruction_ends_block(uint8_t instruction) {
+  return instruction == OP_RETURN || instruction == OP_JUMP ||
+         instruction == OP_LOOP || instruction == OP_THROW;
+}
+
+static void mark_jump_targets(Translator *translator) {
+  Chunk *chunk = &translator->function->chunk;
+  for (size_t i = 0; i < chunk->handlers.used; i++) {
+    ExceptionHandler *handler = &chunk->handlers.values[i];
+    translator->is_jump_target[handler->handler_offset] = true;
+    translator->depths[handler->handler_offset] = handler->stack_depth + 1;
+    if (chunk->registers.registers_count < handler->stack_depth + 1)
+      chunk->registers.registers_count = handler->stack_depth + 1;
+  }
+  for (translator->offset = 0;
+       translator->offset < chunk->instructions.used;
+       translator->offset += (size_t)get_instruction_length(
+           chunk->instructions.values[translator->offset])) {
+    uint8_t instruction = get_generic_instruction(
+        chunk->instructions.values[translator->offset]);
+    if (instruction == OP_LOOP)
+      translator->is_jump_target[translator->offset + 3 -
+                                 read_operand_short(translator, 1)] = true;
+    else if (instruction >= OP_JUMP &&
+             instruction <= OP_JUMP_IF_NOT_LESS_EQUAL)
+      translator->is_jump_target[get_jump_target(translator)] = true;
+  }
+  translator->offset = 0;
+}
+
+static void enter_jump_target(Translator *translator, size_t offset) {
+  if (translator->is_reachable) {
+    translator->offset = translator->previous_offset;
+    materialize_slots(translator);
+    translator->offset = offset;
+  }
+  translator->has_retargetable_instruction = false;
+  translator->depth = translator->depths[offset];
+  for (int i = 0; i < translator->depth; i++)
+    translator->slots[i] = register_operand(i);
+}
+
+static void translate_instructions(Translator *translator) {
+  InstructionsArray *instructions = &translator->function->chunk.instructions;
+  while (translator->offset < instructions->used) {
+    size_t offset = translator->offset;
+    uint8_t instruction = get_generic_instruction(instructions->values[offset]);
+    if (translator->is_jump_target[offset]) {
+      if (translator->is_reachable &&
+          translator->depths[offset] == VERIFIER_UNKNOWN_DEPTH)
+        translator->depths[offset] = translator->depth;
+      if (translator->depths[offset] != VERIFIER_UNKNOWN_DEPTH) {
+        enter_jump_target(translator, offset);
+        translator->is_reachable = true;
+      }
+    } else if (translator->is_reachable) {
+      translator->depths[offset] = translator->depth;
+    }
+    if (translator->is_reachable) {
+      translate_instruction(translator, instruction);
+      if (instruction_ends_block(instruction))
+        translator->is_reachable = false;
+    }
+    translator->previous_offset = offset;
+    translator->offset += (size_t)get_instruction_length(instruction);
+  }
+}
+
+static bool register_instruction_jumps(uint8_t opcode) {
+  return opcode >= REGISTER_OP_JUMP && opcode <= REGISTER_OP_LOOP;
+}
+
+static void patch_jump_targets(RegisterInstructionsArray *registers) {
+  for (size_t i = 0; i < registers->used; i++) {
+    RegisterInstruction *instruction = &registers->values[i];
+    if (register_instruction_jumps(instruction->opcode))
+      instruction->argument = (uint32_t)find_register_instruction(
+          registers, instruction->argument);
+  }
+}
+
+void translate_function(ObjectFunction *function) {
+  size_t instructions_count = function->chunk.instructions.used;
+  Translator translator;
+  translator.function = function;
+  translator.offset = 0;
+  translator.previous_offset = 0;
+  translator.depth = 0;
+  translator.is_reachable = true;
+  translator.has_retargetable_instruction = false;
+  translator.retargetable_instruction_index = 0;
+  translator.depths =
+      GROW_ARRAY(MEMORY_TAG_TRANSLATOR, int, NULL, 0, instructions_count);
+  translator.is_jump_target =
+      GROW_ARRAY(MEMORY_TAG_TRANSLATOR, bool, NULL, 0, instructions_count);
+  for (size_t i = 0; i < instructions_count; i++) {
+    translator.depths[i] = VERIFIER_UNKNOWN_DEPTH;
+    translator.is_jump_target[i] = false;
+  }
+  mark_jump_targets(&translator);
+  for (int i = 0; i <= function->arity; i++)
+    push_operand(&translator, register_operand(i));
+  translate_instructions(&translator);
+  patch_jump_targets(&function->chunk.registers);
+  FREE_ARRAY(MEMORY_TAG_TRANSLATOR, int, translator.depths,
+             instructions_count);
+  FREE_ARRAY(MEMORY_TAG_TRANSLATOR, bool, translator.is_jump_target,
+             instructions_count);
+}
@@ -0,0 +1,61 @@
+#ifndef interpres_translator_h
+#define interpres_translator_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "object.h"
+#include "verifier.h"
+
+/* While translating, the translator keeps track of what every slot of the
+ * stack holds: either the value of its own register or, as long as the value
+ * has not been written to its register yet, a copy of another register or a
+ * constant. Pushing a local variable or a constant therefore writes nothing:
+ * the instruction that pops the slot reads the variable or the constant in
+ * place. Slots only ever refer to registers below them that hold their own
+ * value. */
+typedef struct {
+  bool is_constant;
+  uint16_t index;
+} TranslatorOperand;
+/* The translator walks a verified chunk's instructions once, in order, while
+ * keeping track of the offset of the instruction being translated and of the
+ * one before it, of the depth of the stack right before it and of whether it
+ * can be reached at all, just like the verifier does. The "depths" array
+ * records the depth every offset starts with, the "is_jump_target" array marks
+ * the offsets that jumps and exception handlers lead to, where every slot has
+ * to hold its own value, and the "slots" array holds the operand every slot of
+ * the stack stands for. The last register instruction written can have its
+ * destination changed to a local variable as long as it is marked as
+ * retargetable, which turns "a = b + c" into a single instruction. */
+typedef struct {
+  ObjectFunction *function;
+  size_t offset;
+  size_t previous_offset;
+  int depth;
+  bool is_reachable;
+  int *depths;
+  bool *is_jump_target;
+  TranslatorOperand slots[VERIFIER_MAX_STACK_DEPTH];
+  bool has_retargetable_instruction;
+  size_t retargetable_instruction_index;
+} Translator;
+/*
+ * @brief Translate the bytecode of a verified function into register
+ * instructions.
+ * Every slot of the call frame becomes a register: the register instructions
+ * read their operands from the registers and constants the bytecode would have
+ * pushed and write their result to the register the bytecode would have
+ * pushed it to, so that the function can be run on registers without changing
+ * the layout of its call frame. The instructions are stored in the function's
+ * chunk, along with the number of registers they use. Quickened instructions
+ * are translated from their generic forms, so that a function can be
+ * translated after it has already run on the stack.
+ *
+ * @param function A pointer to the verified function to translate
+ * @return void
+ */
+void translate_function(ObjectFunction *function);
+
+#endif
@@ -0,0 +1,312 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "memory.h"
+#include "verifier.h"
+
+static bool verification_error(Verifier *verifier, const char *error_format,
+                               ...) {
+  ObjectFunction *function = verifier->function;
+  size_t line_number = 0;
+  if (verifier->offset < function->chunk.instructions.used)
+    line_number = function->chunk.instructions.line_numbers[verifier->offset];
+  fprintf(stderr, "[line:%d] verification error in %s: ", (int)line_number,
+          function->name == NULL ? "script" : function->name->characters);
+  va_list error_arguments;
+  va_start(error_arguments, error_format);
+  vfprintf(stderr, error_format, error_arguments);
+  va_end(error_arguments);
+  fputs("\n", stderr);
+  return false;
+}
+
+static uint16_t read_operand_short(Verifier *verifier, size_t operand_offset) {
+  uint8_t *instructions = verifier->function->chunk.instructions.values;
+  return (uint16_t)((instructions[verifier->offset + operand_offset] << 8) |
+                    instructions[verifier->offset + operand_offset + 1]);
+}
+
+static bool verify_constant(Verifier *verifier, size_t operand_offset,
+                            bool is_name) {
+  Chunk *chunk = &verifier->function->chunk;
+  uint8_t index = chunk->instructions.values[verifier->offset + operand_offset];
+  if (index >= chunk->constants.used)
+    return verification_error(verifier, "constant %d out of bounds.", index);
+  if (is_name && !IS_STRING_CONSTANT(chunk->constants.values[index]))
+    return verification_error(verifier, "constant %d is not a name.", index);
+  return true;
+}
+
+static bool verify_inline_cache(Verifier *verifier, size_t operand_offset) {
+  uint16_t index = read_operand_short(verifier, operand_offset);
+  if (index >= verifier->function->chunk.caches.used)
+    return verification_error(verifier, "inline cache %d out of bounds.",
+                              index);
+  return true;
+}
+
+static bool verify_local_slot(Verifier *verifier) {
+  uint8_t slot =
+      verifier->function->chunk.instructions.values[verifier->offset + 1];
+  if (verifier->is_reachable && slot >= verifier->depth)
+    return verification_error(verifier, "local slot %d out of bounds.", slot);
+  return true;
+}
+
+static bool verify_stack_effect(Verifier *verifier, int pops, int pushes) {
+  if (!verifier->is_reachable)
+    return true;
+  if (verifier->depth < pops)
+    return verification_error(verifier, "stack underflow.");
+  verifier->depth += pushes - pops;
+  if (verifier->depth > VERIFIER_MAX_STACK_DEPTH)
+    return verification_error(verifier, "stack overflow.");
+  return true;
+}
+
+static bool verify_jump(Verifier *verifier, bool is_backward) {
+  uint16_t jump_offset = read_operand_short(verifier, 1);
+  size_t instruction_end = verifier->offset + 3;
+  if (is_backward && jump_offset > instruction_end)
+    return verification_error(verifier, "jump before the start of the chunk.");
+  size_t target = is_backward ? instruction_end - jump_offset
+                              : instruction_end + jump_offset;
+  if (target >= verifier->function->chunk.instructions.used)
+    return verification_error(verifier, "jump past the end of the chunk.");
+  if (!verifier->is_reachable)
+    return true;
+  if (target <= verifier->offset && !verifier->is_instruction_start[target])
+    return verification_error(verifier,
+                              "jump into the middle of an instruction.");
+  if (verifier->depths[target] == VERIFIER_UNKNOWN_DEPTH) {
+    if (target <= verifier->offset)
+      return verification_error(verifier, "jump to unreachable code.");
+    verifier->depths[target] = verifier->depth;
+  } else if (verifier->depths[target] != verifier->depth) {
+    return verification_error(verifier, "inconsistent stack depth at jump.");
+  }
+  return true;
+}
+
+static bool verify_instruction(Verifier *verifier, uint8_t instruction) {
+  uint8_t *instructions = verifier->function->chunk.instructions.values;
+  switch (instruction) {
+  case OP_RETURN:
+    return verify_stack_effect(verifier, 1, 0);
+  case OP_CONSTANT:
+    return verify_constant(verifier, 1, false) &&
+           verify_stack_effect(verifier, 0, 1);
+  case OP_ZERO:
+  case OP_ONE:
+  case OP_SMALL_INTEGER:
+  case OP_SHORT_INTEGER:
+  case OP_NIL:
+  case OP_TRUE:
+  case OP_FALSE:
+    return verify_stack_effect(verifier, 0, 1);
+  case OP_POP:
+  case OP_PRINT:
+  case OP_THROW:
+    return verify_stack_effect(verifier, 1, 0);
+  case OP_DEFINE_GLOBAL:
+    return verify_constant(verifier, 1, true) &&
+           verify_stack_effect(verifier, 1, 0);
+  case OP_GET_GLOBAL:
+    return verify_constant(verifier, 1, true) &&
+           verify_stack_effect(verifier, 0, 1);
+  case OP_SET_GLOBAL:
+    return verify_constant(verifier, 1, true) &&
+           verify_stack_effect(verifier, 1, 1);
+  case OP_GET_LOCAL:
+    return verify_local_slot(verifier) && verify_stack_effect(verifier, 0, 1);
+  case OP_SET_LOCAL:
+    return verify_local_slot(verifier) && verify_stack_effect(verifier, 1, 1);
+  case OP_EQUAL:
+  case OP_NOT_EQUAL:
+  case OP_GREATER:
+  case OP_GREATER_EQUAL:
+  case OP_LESS:
+  case OP_LESS_EQUAL:
+  case OP_ADD:
+  case OP_SUBTRACT:
+  case OP_MULTIPLY:
+  case OP_DIVIDE:
+    return verify_stack_effect(verifier, 2, 1);
+  case OP_NOT:
+  case OP_NEGATE:
+    return verify_stack_effect(verifier, 1, 1);
+  case OP_JUMP:
+    return verify_jump(verifier, false);
+  case OP_JUMP_IF_FALSE:
+    return verify_stack_effect(verifier, 1, 1) && verify_jump(verifier, false);
+  case OP_POP_JUMP_IF_FALSE:
+    return verify_stack_effect(verifier, 1, 0) && verify_jump(verifier, false);
+  case OP_JUMP_IF_EQUAL:
+  case OP_JUMP_IF_NOT_EQUAL:
+  case OP_JUMP_IF_NOT_GREATER:
+  case OP_JUMP_IF_NOT_GREATER_EQUAL:
+  case OP_JUMP_IF_NOT_LESS:
+  case OP_JUMP_IF_NOT_LESS_EQUAL:
+    return verify_stack_effect(verifier, 2, 0) && verify_jump(verifier, false);
+  case OP_LOOP:
+    return verify_jump(verifier, true);
+  case OP_CALL:
+  case OP_TAIL_CALL:
+    return verify_stack_effect(
+        verifier, instructions[verifier->offset + 1] + 1, 1);
+  case OP_GET_PROPERTY:
+    return verify_constant(verifier, 1, true) &&
+           verify_inline_cache(verifier, 2) &&
+           verify_stack_effect(verifier, 1, 1);
+  case OP_SET_PROPERTY:
+    return verify_constant(verifier, 1, true) &&
+           verify_inline_cache(verifier, 2) &&
+           verify_stack_effect(verifier, 2, 1);
+  case OP_INVOKE:
+  case OP_TAIL_INVOKE:
+    return verify_constant(verifier, 1, true) &&
+           verify_inline_cache(verifier, 3) &&
+           verify_stack_effect(
+               verifier, instructions[verifier->offset + 2] + 1, 1);
+  case OP_CLASS:
+    return verify_constant(verifier, 1, true) &&
+           verify_stack_effect(verifier, 0, 1);
+  case OP_INHERIT:
+    return verify_stack_effect(verifier, 2, 0);
+  case OP_METHOD:
+    return verify_constant(verifier, 1, true) &&
+           verify_stack_effect(verifier, 2, 1);
+  }
+  return verification_error(verifier, "unknown opcode %d.", instruction);
+}
+
+static bool instruction_ends_block(uint8_t instruction) {
+  return instruction == OP_RETURN || instruction == OP_JUMP ||
+         instruction == OP_LOOP || instruction == OP_THROW;
+}
+
+static bool seed_exception_handlers(Verifier *verifier) {
+  Chunk *chunk = &verifier->function->chunk;
+  for (size_t i = 0; i < chunk->handlers.used; i++) {
+    ExceptionHandler *handler = &chunk->handlers.values[i];
+    if (handler->start_offset > handler->end_offset ||
+        handler->end_offset > handler->handler_offset ||
+        handler->handler_offset >= chunk->instructions.used)
+      return verification_error(verifier, "exception handler %d out of bounds.",
+                                (int)i);
+    if (handler->stack_depth < verifier->function->arity + 1 ||
+        handler->stack_depth >= VERIFIER_MAX_STACK_DEPTH)
+      return verification_error(
+          verifier, "invalid stack depth for exception handler %d.", (int)i);
+    int *handler_depth = &verifier->depths[handler->handler_offset];
+    if (*handler_depth != VERIFIER_UNKNOWN_DEPTH &&
+        *handler_depth != handler->stack_depth + 1)
+      return verification_error(
+          verifier, "inconsistent stack depth at exception handler %d.",
+          (int)i);
+    *handler_depth = handler->stack_depth + 1;
+  }
+  return true;
+}
+
+static bool verify_exception_handler_ranges(Verifier *verifier) {
+  Chunk *chunk = &verifier->function->chunk;
+  for (size_t i = 0; i < chunk->handlers.used; i++) {
+    ExceptionHandler *handler = &chunk->handlers.values[i];
+    if (!verifier->is_instruction_start[handler->start_offset] ||
+        !verifier->is_instruction_start[handler->end_offset])
+      return verification_error(
+          verifier, "exception handler %d splits an instruction.", (int)i);
+    for (size_t j = handler->start_offset; j < handler->end_offset; j++) {
+      if (verifier->is_instruction_start[j] &&
+          verifier->depths[j] != VERIFIER_UNKNOWN_DEPTH &&
+          verifier->depths[j] < handler->stack_depth) {
+        verifier->offset = j;
+        return verification_error(
+            verifier, "stack below the depth of exception handler %d.",
+            (int)i);
+      }
+    }
+  }
+  return true;
+}
+
+static bool verify_instructions(Verifier *verifier) {
+  InstructionsArray *instructions = &verifier->function->chunk.instructions;
+  if (instructions->used == 0)
+    return verification_error(verifier, "empty chunk.");
+  if (!seed_exception_handlers(verifier))
+    return false;
+  uint8_t instruction = OP_RETURN;
+  while (verifier->offset < instructions->used) {
+    size_t offset = verifier->offset;
+    verifier->is_instruction_start[offset] = true;
+    if (verifier->depths[offset] != VERIFIER_UNKNOWN_DEPTH) {
+      if (verifier->is_reachable && verifier->depths[offset] != verifier->depth)
+        return verification_error(verifier,
+                                  "inconsistent stack depth at jump target.");
+      verifier->depth = verifier->depths[offset];
+      verifier->is_reachable = true;
+    } else if (verifier->is_reachable) {
+      verifier->depths[offset] = verifier->depth;
+    }
+    if (verifier->is_reachable &&
+        verifier->depth > verifier->function->max_stack_depth)
+      verifier->function->max_stack_depth = verifier->depth;
+    instruction = instructions->values[offset];
+    int instruction_length = get_instruction_length(instruction);
+    if (instruction_length == 0)
+      return verification_error(verifier, "unknown opcode %d.", instruction);
+    if (offset + (size_t)instruction_length > instructions->used)
+      return verification_error(verifier, "truncated instruction.");
+    if (!verify_instruction(verifier, instruction))
+      return false;
+    if (instruction_ends_block(instruction))
+      verifier->is_reachable = false;
+    verifier->offset += (size_t)instruction_length;
+  }
+  verifier->offset = instructions->used - 1;
+  if (instruction != OP_RETURN)
+    return verification_error(verifier, "chunk does not end with a return.");
+  for (size_t i = 0; i < instructions->used; i++) {
+    if (verifier->depths[i] != VERIFIER_UNKNOWN_DEPTH &&
+        !verifier->is_instruction_start[i]) {
+      verifier->offset = i;
+      return verification_error(verifier,
+                                "jump into the middle of an instruction.");
+    }
+  }
+  return verify_exception_handler_ranges(verifier);
+}
+
+bool verify_function(ObjectFunction *function) {
+  if (function->is_verified || function->source != NULL)
+    return true;
+  function->is_verified = true;
+  size_t instructions_count = function->chunk.instructions.used;
+  Verifier verifier;
+  verifier.function = function;
+  verifier.offset = 0;
+  verifier.depth = function->arity + 1;
+  function->max_stack_depth = verifier.depth;
+  verifier.is_reachable = true;
+  verifier.depths =
+      GROW_ARRAY(MEMORY_TAG_VERIFIER, int, NULL, 0, instructions_count);
+  verifier.is_instruction_start =
+      GROW_ARRAY(MEMORY_TAG_VERIFIER, bool, NULL, 0, instructions_count);
+  for (size_t i = 0; i < instructions_count; i++) {
+    verifier.depths[i] = VERIFIER_UNKNOWN_DEPTH;
+    verifier.is_instruction_start[i] = false;
+  }
+  bool is_valid = verify_instructions(&verifier);
+  FREE_ARRAY(MEMORY_TAG_VERIFIER, int, verifier.depths, instructions_count);
+  FREE_ARRAY(MEMORY_TAG_VERIFIER, bool, verifier.is_instruction_start,
+             instructions_count);
+  ConstantsArray *constants = &function->chunk.constants;
+  for (size_t i = 0; is_valid && i < constants->used; i++) {
+    if (IS_FUNCTION_CONSTANT(constants->values[i]))
+      is_valid = verify_function(AS_FUNCTION_CONSTANT(constants->values[i]));
+  }
+  function->is_verified = is_valid;
+  return is_valid;
+}
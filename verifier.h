@@ -0,0 +1,54 @@
+#ifndef interpres_verifier_h
+#define interpres_verifier_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "object.h"
+
+/* Here we define the largest number of stack slots a single call may use,
+ * counting the function itself, its arguments, its local variables and every
+ * temporary value: that is enough for all the 256 local slots a function can
+ * address plus as many temporaries. Functions that could grow the stack any
+ * further are rejected, which is what allows the virtual machine to size its
+ * stack once and for all without checking it on every push. */
+#define VERIFIER_MAX_STACK_DEPTH (2 * (UINT8_MAX + 1))
+/* Here we define the stack depth recorded for offsets that no reachable
+ * instruction has reached or jumped to yet. */
+#define VERIFIER_UNKNOWN_DEPTH -1
+/* The verifier walks a chunk's instructions once, in order. While doing so it
+ * keeps track of the offset of the instruction being verified and of the
+ * depth of the stack right before it, measured from the first slot of the
+ * call frame; "is_reachable" tells whether the instruction can be reached at
+ * all, since the code that follows a return or an unconditional jump is only
+ * reached through jumps. The "depths" array records the depth every offset is
+ * expected to start with, as set by the instructions that reach it, and the
+ * "is_instruction_start" array marks the offsets at which an instruction
+ * starts, so that jumps into the middle of an instruction can be caught. */
+typedef struct {
+  ObjectFunction *function;
+  size_t offset;
+  int depth;
+  bool is_reachable;
+  int *depths;
+  bool *is_instruction_start;
+} Verifier;
+/*
+ * @brief Verify the bytecode of a function and of every function it holds.
+ * This function will check that every opcode is known, that every operand
+ * refers to a constant, an inline cache, a local slot or a jump target that
+ * exists and has the expected type, that the stack never underflows the call
+ * frame nor grows past VERIFIER_MAX_STACK_DEPTH, that every instruction is
+ * always reached with the same stack depth, that every exception handler covers
+ * whole instructions which never leave fewer values on the stack than the
+ * handler expects and that the chunk ends with OP_RETURN. Functions that pass
+ * verification are marked as verified and are not verified again. Errors are
+ * reported to stderr.
+ *
+ * @param function A pointer to the function to verify
+ * @return Whether the function could be verified or not
+ */
+bool verify_function(ObjectFunction *function);
+
+#endif
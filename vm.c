@@ -1,73 +1,1746 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "compiler.h"
+#include "object.h"
+#include "translator.h"
 
-static void init_stack(VirtualMachine *vm) { vm->stack_pointer = vm->stack; }
+static void init_stack(VirtualMachine *vm) {
+  vm->stack = vm->main_stack;
+  vm->stack_pointer = vm->stack;
+  vm->stack_limit = vm->stack + STACK_MAX_SIZE;
+}
+
+static Constant peek_stack(VirtualMachine *vm, int distance) {
+  return vm->stack_pointer[-1 - distance];
+}
+
+static void init_frames(VirtualMachine *vm) {
+  vm->frame_count = 0;
+  vm->frames = vm->main_frames;
+  vm->frames_capacity = FRAMES_MAX_SIZE;
+  vm->coroutine = NULL;
+}
+
+static size_t get_frame_instruction_offset(CallFrame *frame) {
+  Chunk *chunk = &frame->function->chunk;
+  if (frame->runs_on_registers)
+    return chunk->registers
+        .offsets[frame->register_pointer - chunk->registers.values - 1];
+  return (size_t)(frame->instruction_pointer - chunk->instructions.values - 1);
+}
+
+static int get_frame_line_number(CallFrame *frame) {
+  Chunk *chunk = &frame->function->chunk;
+  return (int)chunk->instructions
+      .line_numbers[get_frame_instruction_offset(frame)];
+}
+
+static void print_stack_trace(CallFrame *frames, int frame_count) {
+  for (int i = frame_count - 1; i >= 0; i--) {
+    CallFrame *frame = &frames[i];
+    fprintf(stderr, "[line:%d] in ", get_frame_line_number(frame));
+    if (frame->function->name == NULL)
+      fprintf(stderr, "script\n");
+    else
+      fprintf(stderr, "%s()\n", frame->function->name->characters);
+  }
+}
+
+static void runtime_error(VirtualMachine *vm, const char *error_format, ...) {
+  flush_output_buffer(&vm->output);
+  if (vm->frame_count > 0)
+    fprintf(stderr, "[line:%d] ",
+            get_frame_line_number(&vm->frames[vm->frame_count - 1]));
+  fprintf(stderr, "runtime error: ");
+  va_list error_arguments;
+  va_start(error_arguments, error_format);
+  vfprintf(stderr, error_format, error_arguments);
+  va_end(error_arguments);
+  fputs("\n", stderr);
+  print_stack_trace(vm->frames, vm->frame_count);
+  vm->event_loop.is_running = false;
+  vm->event_loop.runner = NULL;
+  ObjectCoroutine *coroutine = vm->coroutine;
+  if (coroutine != NULL) {
+    for (ObjectCoroutine *resumer = coroutine->resumer; resumer != NULL;
+         resumer = resumer->resumer)
+      print_stack_trace(resumer->frames, resumer->frame_count);
+    print_stack_trace(vm->main_frames, vm->main_frame_count);
+  }
+  init_frames(vm);
+  init_stack(vm);
+  while (coroutine != NULL) {
+    ObjectCoroutine *resumer = coroutine->resumer;
+    coroutine->state = COROUTINE_STATE_DEAD;
+    coroutine->resumer = NULL;
+    free_coroutine_stacks(vm, coroutine);
+    coroutine = resumer;
+  }
+}
+
+static void switch_coroutine(VirtualMachine *vm, ObjectCoroutine *coroutine) {
+  ObjectCoroutine *current_coroutine = vm->coroutine;
+  int frame_count = vm->frame_count;
+  vm->frame_count = 0;
+  atomic_signal_fence(memory_order_release);
+  if (current_coroutine == NULL) {
+    vm->main_frame_count = frame_count;
+    vm->main_stack_pointer = vm->stack_pointer;
+  } else {
+    current_coroutine->frame_count = frame_count;
+    current_coroutine->stack_pointer = vm->stack_pointer;
+    collector_stack_barrier(vm, (Object *)current_coroutine);
+  }
+  if (coroutine == NULL) {
+    vm->frames = vm->main_frames;
+    vm->frames_capacity = FRAMES_MAX_SIZE;
+    vm->stack = vm->main_stack;
+    vm->stack_pointer = vm->main_stack_pointer;
+    vm->stack_limit = vm->main_stack + STACK_MAX_SIZE;
+    frame_count = vm->main_frame_count;
+  } else {
+    vm->frames = coroutine->frames;
+    vm->frames_capacity = coroutine->frames_capacity;
+    vm->stack = coroutine->stack;
+    vm->stack_pointer = coroutine->stack_pointer;
+    vm->stack_limit = coroutine->stack + coroutine->stack_capacity;
+    frame_count = coroutine->frame_count;
+  }
+  vm->coroutine = coroutine;
+  atomic_signal_fence(memory_order_release);
+  vm->frame_count = frame_count;
+}
+
+static void leave_coroutine(VirtualMachine *vm, CoroutineState state) {
+  ObjectCoroutine *coroutine = vm->coroutine;
+  ObjectCoroutine *resumer = coroutine->resumer;
+  switch_coroutine(vm, resumer);
+  if (resumer != NULL)
+    resumer->state = COROUTINE_STATE_RUNNING;
+  coroutine->state = state;
+  coroutine->resumer = NULL;
+  if (state == COROUTINE_STATE_DEAD)
+    free_coroutine_stacks(vm, coroutine);
+  if (coroutine->is_task) {
+    vm->event_loop.is_running = false;
+    vm->event_loop.runner = NULL;
+  }
+}
+
+static bool grow_stacks(VirtualMachine *vm, Constant *stack_end) {
+  ObjectCoroutine *coroutine = vm->coroutine;
+  size_t stack_size = (size_t)(stack_end - vm->stack);
+  if (coroutine == NULL || stack_size > STACK_MAX_SIZE ||
+      vm->frame_count == FRAMES_MAX_SIZE) {
+    runtime_error(vm, "stack overflow.");
+    return false;
+  }
+  int frames_capacity = vm->frames_capacity;
+  if (vm->frame_count == frames_capacity)
+    frames_capacity = frames_capacity * 2 < FRAMES_MAX_SIZE
+                          ? frames_capacity * 2
+                          : FRAMES_MAX_SIZE;
+  size_t stack_capacity = coroutine->stack_capacity;
+  while (stack_capacity < stack_size)
+    stack_capacity *= 2;
+  if (stack_capacity > STACK_MAX_SIZE)
+    stack_capacity = STACK_MAX_SIZE;
+  CallFrame *frames = vm->frames;
+  if (frames_capacity != vm->frames_capacity)
+    frames = ALLOCATE_OBJECT_MEMORY(vm, CallFrame, frames_capacity);
+  Constant *stack = vm->stack;
+  if (stack_capacity != coroutine->stack_capacity)
+    stack = ALLOCATE_OBJECT_MEMORY(vm, Constant, stack_capacity);
+  int frame_count = vm->frame_count;
+  vm->frame_count = 0;
+  atomic_signal_fence(memory_order_release);
+  if (stack != vm->stack) {
+    memcpy(stack, vm->stack,
+           sizeof(Constant) * (size_t)(vm->stack_pointer - vm->stack));
+    for (int i = 0; i < frame_count; i++)
+      vm->frames[i].slots = stack + (vm->frames[i].slots - vm->stack);
+    vm->stack_pointer = stack + (vm->stack_pointer - vm->stack);
+    FREE_OBJECT_MEMORY(vm, Constant, vm->stack, coroutine->stack_capacity);
+    vm->stack = coroutine->stack = stack;
+    vm->stack_limit = stack + stack_capacity;
+    coroutine->stack_capacity = stack_capacity;
+  }
+  if (frames != vm->frames) {
+    memcpy(frames, vm->frames, sizeof(CallFrame) * (size_t)frame_count);
+    FREE_OBJECT_MEMORY(vm, CallFrame, vm->frames, vm->frames_capacity);
+    vm->frames = coroutine->frames = frames;
+    vm->frames_capacity = coroutine->frames_capacity = frames_capacity;
+  }
+  atomic_signal_fence(memory_order_release);
+  vm->frame_count = frame_count;
+  return true;
+}
+
+static ObjectString *concatenate_strings(VirtualMachine *vm,
+                                         ObjectString *first_string,
+                                         ObjectString *second_string) {
+  size_t length = first_string->length + second_string->length;
+  char *characters = ALLOCATE_OBJECT_MEMORY(vm, char, length + 1);
+  memcpy(characters, first_string->characters, first_string->length);
+  memcpy(characters + first_string->length, second_string->characters,
+         second_string->length);
+  characters[length] = '\0';
+  return take_string(vm, characters, length);
+}
+
+static bool compile_function(VirtualMachine *vm, ObjectFunction *function) {
+  if (function->source != NULL) {
+    flush_output_buffer(&vm->output);
+    if (!compile_function_body(vm, function)) {
+      runtime_error(vm, "can't compile function '%s'.",
+                    function->name->characters);
+      return false;
+    }
+  }
+  if (!verify_function(function)) {
+    runtime_error(vm, "can't verify function '%s'.",
+                  function->name->characters);
+    return false;
+  }
+  debug_function(vm, function);
+  return true;
+}
+
+static bool consume_fuel(VirtualMachine *vm, size_t fuel) {
+  if (vm->fuel >= fuel) {
+    vm->fuel -= fuel;
+    return true;
+  }
+  if (vm->collector.is_over_heap_limit) {
+    vm->collector.is_over_heap_limit = false;
+    vm->fuel = vm->interrupted_fuel;
+    runtime_error(vm, "heap limit exceeded.");
+    return false;
+  }
+  vm->fuel = 0;
+  runtime_error(vm, "out of fuel.");
+  return false;
+}
+
+static bool throw_exception(VirtualMachine *vm, Constant exception) {
+  for (;;) {
+    for (int i = vm->frame_count - 1; i >= 0; i--) {
+      CallFrame *frame = &vm->frames[i];
+      Chunk *chunk = &frame->function->chunk;
+      ExceptionHandler *handler = find_exception_handler(
+          &chunk->handlers, get_frame_instruction_offset(frame));
+      if (handler == NULL)
+        continue;
+      vm->frame_count = i + 1;
+      vm->stack_pointer = frame->slots + handler->stack_depth;
+      push_onto_stack(vm, exception);
+      frame->instruction_pointer =
+          chunk->instructions.values + handler->handler_offset;
+      frame->register_pointer =
+          chunk->registers.values +
+          find_register_instruction(&chunk->registers, handler->handler_offset);
+      return true;
+    }
+    if (vm->coroutine == NULL)
+      break;
+    leave_coroutine(vm, COROUTINE_STATE_DEAD);
+  }
+  if (IS_STRING_CONSTANT(exception))
+    runtime_error(vm, "uncaught exception: %s",
+                  AS_STRING_CONSTANT(exception)->characters);
+  else
+    runtime_error(vm, "uncaught exception.");
+  return false;
+}
+
+static bool call_function(VirtualMachine *vm, ObjectFunction *function,
+                          int arguments_count) {
+  if (function->arity != arguments_count) {
+    runtime_error(vm, "expected %d arguments but got %d.", function->arity,
+                  arguments_count);
+    return false;
+  }
+  if (!function->is_verified && !compile_function(vm, function))
+    return false;
+  if (!consume_fuel(vm, function->chunk.instructions.used))
+    return false;
+  if ((vm->frame_count == vm->frames_capacity ||
+       vm->stack_pointer - arguments_count - 1 + function->max_stack_depth >
+           vm->stack_limit) &&
+      !grow_stacks(vm, vm->stack_pointer - arguments_count - 1 +
+                           function->max_stack_depth))
+    return false;
+  if (vm->runs_on_registers && function->chunk.registers.used == 0)
+    translate_function(function);
+  CallFrame *frame = &vm->frames[vm->frame_count];
+  frame->function = function;
+  frame->instruction_pointer = function->chunk.instructions.values;
+  frame->register_pointer = function->chunk.registers.values;
+  frame->slots = vm->stack_pointer - arguments_count - 1;
+  frame->runs_on_registers = function->chunk.registers.used > 0;
+  atomic_signal_fence(memory_order_release);
+  vm->frame_count++;
+  return true;
+}
+
+static bool call_constant(VirtualMachine *vm, Constant callee,
+                          int arguments_count) {
+  if (IS_OBJECT_CONSTANT(callee)) {
+    switch (OBJECT_TYPE(callee)) {
+    case OBJECT_BOUND_METHOD: {
+      ObjectBoundMethod *bound_method = AS_BOUND_METHOD_CONSTANT(callee);
+      vm->stack_pointer[-arguments_count - 1] = bound_method->receiver;
+      return call_function(vm, bound_method->method, arguments_count);
+    }
+    case OBJECT_CLASS: {
+      ObjectClass *object_class = AS_CLASS_CONSTANT(callee);
+      vm->stack_pointer[-arguments_count - 1] =
+          OBJECT_CONSTANT(new_instance(vm, object_class));
+      if (object_class->initializer != NULL)
+        return call_function(vm, object_class->initializer, arguments_count);
+      if (arguments_count != 0) {
+        runtime_error(vm, "expected 0 arguments but got %d.", arguments_count);
+        return false;
+      }
+      return true;
+    }
+    case OBJECT_FUNCTION:
+      return call_function(vm, AS_FUNCTION_CONSTANT(callee), arguments_count);
+    case OBJECT_NATIVE: {
+      ObjectNative *native = AS_NATIVE_CONSTANT(callee);
+      if (native->arity != arguments_count) {
+        runtime_error(vm, "expected %d arguments but got %d.", native->arity,
+                      arguments_count);
+        return false;
+      }
+      return native->function(vm, vm->stack_pointer - arguments_count);
+    }
+    default:
+      break;
+    }
+  }
+  runtime_error(vm, "can only call functions and classes.");
+  return false;
+}
+
+static bool tail_call_function(VirtualMachine *vm, ObjectFunction *function,
+                               int arguments_count) {
+  if (function->arity != arguments_count) {
+    runtime_error(vm, "expected %d arguments but got %d.", function->arity,
+                  arguments_count);
+    return false;
+  }
+  if (!function->is_verified && !compile_function(vm, function))
+    return false;
+  if (!consume_fuel(vm, function->chunk.instructions.used))
+    return false;
+  Constant *slots = vm->frames[vm->frame_count - 1].slots;
+  if (slots + function->max_stack_depth > vm->stack_limit &&
+      !grow_stacks(vm, slots + function->max_stack_depth))
+    return false;
+  if (vm->runs_on_registers && function->chunk.registers.used == 0)
+    translate_function(function);
+  CallFrame *frame = &vm->frames[vm->frame_count - 1];
+  memmove(frame->slots, vm->stack_pointer - arguments_count - 1,
+          sizeof(Constant) * (size_t)(arguments_count + 1));
+  vm->stack_pointer = frame->slots + arguments_count + 1;
+  frame->function = function;
+  frame->instruction_pointer = function->chunk.instructions.values;
+  frame->register_pointer = function->chunk.registers.values;
+  frame->runs_on_registers = function->chunk.registers.used > 0;
+  return true;
+}
+
+static bool tail_call_constant(VirtualMachine *vm, Constant callee,
+                               int arguments_count) {
+  if (IS_FUNCTION_CONSTANT(callee))
+    return tail_call_function(vm, AS_FUNCTION_CONSTANT(callee),
+                              arguments_count);
+  if (IS_BOUND_METHOD_CONSTANT(callee)) {
+    ObjectBoundMethod *bound_method = AS_BOUND_METHOD_CONSTANT(callee);
+    vm->stack_pointer[-arguments_count - 1] = bound_method->receiver;
+    return tail_call_function(vm, bound_method->method, arguments_count);
+  }
+  return call_constant(vm, callee, arguments_count);
+}
+
+static bool invoke_property(VirtualMachine *vm, ObjectInstance *instance,
+                            InlineCacheEntry *entry, int arguments_count,
+                            bool is_tail_call) {
+  if (entry->method != NULL)
+    return is_tail_call
+               ? tail_call_function(vm, entry->method, arguments_count)
+               : call_function(vm, entry->method, arguments_count);
+  Constant field = instance->fields[entry->slot];
+  vm->stack_pointer[-arguments_count - 1] = field;
+  return is_tail_call ? tail_call_constant(vm, field, arguments_count)
+                      : call_constant(vm, field, arguments_count);
+}
+
+static void release_finished_task(VirtualMachine *vm,
+                                  ObjectCoroutine *coroutine) {
+  if (coroutine == NULL || coroutine->state != COROUTINE_STATE_DEAD)
+    return;
+  coroutine->resumer = NULL;
+  free_coroutine_stacks(vm, coroutine);
+}
+
+static bool stop_tasks(VirtualMachine *vm) {
+  EventLoop *loop = &vm->event_loop;
+  ObjectCoroutine *coroutine = vm->coroutine;
+  ObjectCoroutine *runner = loop->runner;
+  loop->is_running = false;
+  loop->runner = NULL;
+  switch_coroutine(vm, runner);
+  if (runner != NULL)
+    runner->state = COROUTINE_STATE_RUNNING;
+  release_finished_task(vm, coroutine);
+  push_onto_stack(vm, NIL_CONSTANT);
+  return true;
+}
+
+bool run_next_task(VirtualMachine *vm) {
+  EventLoop *loop = &vm->event_loop;
+  ObjectCoroutine *coroutine = vm->coroutine;
+  ReadyTask ready_task;
+  for (;;) {
+    if (pop_ready_task(loop, &ready_task)) {
+      if (ready_task.task->state != COROUTINE_STATE_DEAD)
+        break;
+    } else if (loop->operations_count == 0) {
+      return stop_tasks(vm);
+    } else if (!wait_for_event_operations(vm)) {
+      runtime_error(vm, "can't wait for I/O: %s.", strerror(errno));
+      return false;
+    }
+  }
+  ObjectCoroutine *task = ready_task.task;
+  if (loop->runner != NULL)
+    collector_write_barrier(vm, (Object *)task, OBJECT_CONSTANT(loop->runner));
+  task->resumer = loop->runner;
+  switch_coroutine(vm, task);
+  task->state = COROUTINE_STATE_RUNNING;
+  release_finished_task(vm, coroutine);
+  if (task->frame_count == 0) {
+    ObjectFunction *function = task->function;
+    push_onto_stack(vm, OBJECT_CONSTANT(function));
+    if (function->arity == 1)
+      push_onto_stack(vm, NIL_CONSTANT);
+    return call_function(vm, function, function->arity);
+  }
+  if (ready_task.is_error)
+    return throw_exception(vm, ready_task.value);
+  push_onto_stack(vm, ready_task.value);
+  return true;
+}
+
+static bool finish_coroutine(VirtualMachine *vm, Constant result) {
+  ObjectCoroutine *coroutine = vm->coroutine;
+  if (coroutine->is_task) {
+    coroutine->state = COROUTINE_STATE_DEAD;
+    return run_next_task(vm);
+  }
+  leave_coroutine(vm, COROUTINE_STATE_DEAD);
+  push_onto_stack(vm, result);
+  return true;
+}
+
+static bool coroutine_native(VirtualMachine *vm, Constant *arguments) {
+  if (!IS_FUNCTION_CONSTANT(arguments[0]) ||
+      AS_FUNCTION_CONSTANT(arguments[0])->arity > 1)
+    return throw_from_native(
+        vm, "coroutines run functions of at most one parameter.");
+  ObjectCoroutine *coroutine =
+      new_coroutine(vm, AS_FUNCTION_CONSTANT(arguments[0]));
+  return return_from_native(vm, arguments, OBJECT_CONSTANT(coroutine));
+}
+
+static bool resume_native(VirtualMachine *vm, Constant *arguments) {
+  if (!IS_COROUTINE_CONSTANT(arguments[0]))
+    return throw_from_native(vm, "can only resume coroutines.");
+  ObjectCoroutine *coroutine = AS_COROUTINE_CONSTANT(arguments[0]);
+  if (coroutine->is_task)
+    return throw_from_native(vm, "can't resume a task.");
+  if (coroutine->state == COROUTINE_STATE_DEAD)
+    return throw_from_native(vm, "can't resume a dead coroutine.");
+  if (coroutine->state != COROUTINE_STATE_SUSPENDED)
+    return throw_from_native(vm, "can't resume a running coroutine.");
+  Constant value = arguments[1];
+  vm->stack_pointer = arguments - 1;
+  if (vm->coroutine != NULL) {
+    vm->coroutine->state = COROUTINE_STATE_NORMAL;
+    collector_write_barrier(vm, (Object *)coroutine,
+                            OBJECT_CONSTANT(vm->coroutine));
+  }
+  coroutine->resumer = vm->coroutine;
+  switch_coroutine(vm, coroutine);
+  coroutine->state = COROUTINE_STATE_RUNNING;
+  if (coroutine->frame_count > 0) {
+    push_onto_stack(vm, value);
+    return true;
+  }
+  ObjectFunction *function = coroutine->function;
+  push_onto_stack(vm, OBJECT_CONSTANT(function));
+  if (function->arity == 1)
+    push_onto_stack(vm, value);
+  return call_function(vm, function, function->arity);
+}
+
+static bool yield_native(VirtualMachine *vm, Constant *arguments) {
+  if (vm->coroutine == NULL)
+    return throw_from_native(vm, "can't yield outside of a coroutine.");
+  Constant value = arguments[0];
+  vm->stack_pointer = arguments - 1;
+  if (vm->coroutine->is_task) {
+    vm->coroutine->state = COROUTINE_STATE_SUSPENDED;
+    schedule_task(&vm->event_loop, vm->coroutine, NIL_CONSTANT, false);
+    return run_next_task(vm);
+  }
+  leave_coroutine(vm, COROUTINE_STATE_SUSPENDED);
+  push_onto_stack(vm, value);
+  return true;
+}
+
+static bool is_done_native(VirtualMachine *vm, Constant *arguments) {
+  if (!IS_COROUTINE_CONSTANT(arguments[0]))
+    return throw_from_native(vm, "can only check whether coroutines are done.");
+  return return_from_native(
+      vm, arguments,
+      BOOLEAN_CONSTANT(AS_COROUTINE_CONSTANT(arguments[0])->state ==
+                       COROUTINE_STATE_DEAD));
+}
+
+static const NativeDefinition natives[] = {
+    {"coroutine", coroutine_native, 1},
+    {"resume", resume_native, 2},
+    {"yield", yield_native, 1},
+    {"is_done", is_done_native, 1},
+    {"spawn", spawn_native, 1},
+    {"run_tasks", run_tasks_native, 0},
+};
+
+static const NativeDefinition io_natives[] = {
+    {"open", open_native, 2},
+    {"read", read_native, 2},
+    {"write", write_native, 2},
+    {"close", close_native, 1},
+};
+
+static const NativeDefinition *
+find_native_in(const NativeDefinition *definitions, size_t count,
+               ObjectString *name) {
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(definitions[i].name, name->characters) == 0)
+      return &definitions[i];
+  }
+  return NULL;
+}
+
+const NativeDefinition *find_native_definition(VirtualMachine *vm,
+                                               ObjectString *name) {
+  const NativeDefinition *definition =
+      find_native_in(natives, sizeof(natives) / sizeof(natives[0]), name);
+  if (definition == NULL && vm->allows_io)
+    definition = find_native_in(
+        io_natives, sizeof(io_natives) / sizeof(io_natives[0]), name);
+  return definition;
+}
+
+static void define_natives(VirtualMachine *vm,
+                           const NativeDefinition *definitions, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    ObjectString *name =
+        copy_string(vm, definitions[i].name, strlen(definitions[i].name));
+    push_onto_stack(vm, OBJECT_CONSTANT(name));
+    ObjectNative *native =
+        new_native(vm, definitions[i].function, name, definitions[i].arity);
+    set_in_table(&vm->globals, name, OBJECT_CONSTANT(native));
+    pop_from_stack(vm);
+  }
+}
+
+static void record_property(VirtualMachine *vm, ObjectFunction *function,
+                            InlineCache *cache, InlineCacheEntry entry) {
+  if (!record_inline_cache_entry(cache, entry))
+    return;
+  collector_write_barrier(vm, (Object *)function,
+                          OBJECT_CONSTANT(entry.shape));
+  collector_write_barrier(vm, (Object *)function,
+                          OBJECT_CONSTANT(entry.transition));
+  collector_write_barrier(vm, (Object *)function,
+                          OBJECT_CONSTANT(entry.method));
+}
+
+static InlineCacheEntry *lookup_property(VirtualMachine *vm,
+                                         ObjectFunction *function,
+                                         InlineCache *cache, ObjectShape *shape,
+                                         ObjectString *name,
+                                         InlineCacheEntry *resolved_entry) {
+  InlineCacheEntry *entry = find_inline_cache_entry(cache, shape);
+  if (entry != NULL)
+    return entry;
+  *resolved_entry =
+      (InlineCacheEntry){shape, NULL, NULL, find_shape_slot(shape, name)};
+  if (resolved_entry->slot == -1) {
+    Constant method;
+    if (!get_from_table(&shape->owner_class->methods, name, &method)) {
+      runtime_error(vm, "undefined property '%s'.", name->characters);
+      return NULL;
+    }
+    resolved_entry->method = AS_FUNCTION_CONSTANT(method);
+  }
+  record_property(vm, function, cache, *resolved_entry);
+  return resolved_entry;
+}
+
+static InlineCacheEntry *lookup_field(VirtualMachine *vm,
+                                      ObjectFunction *function,
+                                      InlineCache *cache, ObjectShape *shape,
+                                      ObjectString *name,
+                                      InlineCacheEntry *resolved_entry) {
+  InlineCacheEntry *entry = find_inline_cache_entry(cache, shape);
+  if (entry != NULL)
+    return entry;
+  *resolved_entry =
+      (InlineCacheEntry){shape, NULL, NULL, find_shape_slot(shape, name)};
+  if (resolved_entry->slot == -1) {
+    resolved_entry->transition = get_shape_transition(vm, shape, name);
+    resolved_entry->slot = shape->field_count;
+  }
+  record_property(vm, function, cache, *resolved_entry);
+  return resolved_entry;
+}
+
+static bool name_is_initializer(ObjectString *name) {
+  return name->length == 4 && memcmp(name->characters, "init", 4) == 0;
+}
+
+static bool multiply_integers_overflow(int64_t first_operand,
+                                       int64_t second_operand,
+                                       int64_t *result) {
+  if (__builtin_mul_overflow(first_operand, second_operand, result))
+    return true;
+  return *result == 0 && (first_operand < 0 || second_operand < 0);
+}
+
+static bool tier_up_frame(VirtualMachine *vm, CallFrame *frame) {
+  ObjectFunction *function = frame->function;
+  Chunk *chunk = &function->chunk;
+  if (function->type == FUNCTION_TYPE_SCRIPT) {
+    chunk->loop_iterations_count = 0;
+    return false;
+  }
+  if (chunk->registers.used == 0)
+    translate_function(function);
+  size_t offset =
+      (size_t)(frame->instruction_pointer - chunk->instructions.values);
+  frame->register_pointer =
+      chunk->registers.values +
+      find_register_instruction(&chunk->registers, offset);
+  atomic_signal_fence(memory_order_release);
+  frame->runs_on_registers = true;
+  if (vm->traces_tiering) {
+    flush_output_buffer(&vm->output);
+    fprintf(stderr, "[line:%d] tier-up of %s() after %zu loop iterations.\n",
+            (int)chunk->instructions.line_numbers[offset],
+            function->name->characters, chunk->loop_iterations_count);
+  }
+  return true;
+}
+
+static uint8_t get_quickened_instruction(uint8_t instruction,
+                                         Constant first_operand,
+                                         Constant second_operand) {
+  bool are_integers =
+      IS_INTEGER_CONSTANT(first_operand) && IS_INTEGER_CONSTANT(second_operand);
+  bool are_numbers =
+      IS_NUMBER_CONSTANT(first_operand) && IS_NUMBER_CONSTANT(second_operand);
+  switch (instruction) {
+  case OP_ADD:
+    if (IS_STRING_CONSTANT(first_operand) && IS_STRING_CONSTANT(second_operand))
+      return OP_ADD_STRING;
+    return are_integers  ? OP_ADD_INTEGER
+           : are_numbers ? OP_ADD_NUMBER
+                         : instruction;
+  case OP_SUBTRACT:
+    return are_integers  ? OP_SUBTRACT_INTEGER
+           : are_numbers ? OP_SUBTRACT_NUMBER
+                         : instruction;
+  case OP_MULTIPLY:
+    return are_integers  ? OP_MULTIPLY_INTEGER
+           : are_numbers ? OP_MULTIPLY_NUMBER
+                         : instruction;
+  case OP_JUMP_IF_NOT_GREATER:
+    return are_integers ? OP_JUMP_IF_NOT_GREATER_INTEGER : instruction;
+  case OP_JUMP_IF_NOT_GREATER_EQUAL:
+    return are_integers ? OP_JUMP_IF_NOT_GREATER_EQUAL_INTEGER : instruction;
+  case OP_JUMP_IF_NOT_LESS:
+    return are_integers ? OP_JUMP_IF_NOT_LESS_INTEGER : instruction;
+  case OP_JUMP_IF_NOT_LESS_EQUAL:
+    return are_integers ? OP_JUMP_IF_NOT_LESS_EQUAL_INTEGER : instruction;
+  }
+  return instruction;
+}
+
+static void quicken_instruction(CallFrame *frame, Constant first_operand,
+                                Constant second_operand) {
+  Chunk *chunk = &frame->function->chunk;
+  uint8_t *instruction_pointer = frame->instruction_pointer - 1;
+  QuickeningCounter *counter = get_quickening_counter(
+      chunk, (size_t)(instruction_pointer - chunk->instructions.values));
+  if (counter->deoptimizations >= QUICKENING_MAX_DEOPTIMIZATIONS)
+    return;
+  uint8_t quickened_instruction = get_quickened_instruction(
+      *instruction_pointer, first_operand, second_operand);
+  if (quickened_instruction == *instruction_pointer) {
+    counter->executions = 0;
+    return;
+  }
+  if (++counter->executions < QUICKENING_THRESHOLD)
+    return;
+  counter->executions = 0;
+  *instruction_pointer = quickened_instruction;
+}
+
+static void deoptimize_instruction(CallFrame *frame) {
+  Chunk *chunk = &frame->function->chunk;
+  frame->instruction_pointer--;
+  QuickeningCounter *counter = get_quickening_counter(
+      chunk, (size_t)(frame->instruction_pointer - chunk->instructions.values));
+  *frame->instruction_pointer =
+      get_generic_instruction(*frame->instruction_pointer);
+  if (counter->deoptimizations < UINT8_MAX)
+    counter->deoptimizations++;
+}
 
 static InterpretationResult run_input_compiled(VirtualMachine *vm) {
-#define READ_INSTRUCTION(vm) (*vm->instruction_pointer++)
-#define READ_INSTRUCTION_CONSTANT(vm)                                          \
-  (vm->chunk->constants.values[READ_INSTRUCTION(vm)])
-#define BINARY_OPERATION(vm, operator)                                         \
+  CallFrame *frame = &vm->frames[vm->frame_count - 1];
+#define LOAD_FRAME()                                                           \
   do {                                                                         \
+    frame = &vm->frames[vm->frame_count - 1];                                  \
+    if (frame->runs_on_registers)                                              \
+      return INTERPRETATION_OK;                                                \
+  } while (false)
+#define READ_INSTRUCTION(frame) (*frame->instruction_pointer++)
+#define READ_INSTRUCTION_SHORT(frame)                                          \
+  (frame->instruction_pointer += 2,                                            \
+   (uint16_t)((frame->instruction_pointer[-2] << 8) |                         \
+              frame->instruction_pointer[-1]))
+#define READ_INSTRUCTION_CONSTANT(frame)                                       \
+  (frame->function->chunk.constants.values[READ_INSTRUCTION(frame)])
+#define READ_INSTRUCTION_STRING(frame)                                         \
+  AS_STRING_CONSTANT(READ_INSTRUCTION_CONSTANT(frame))
+#define READ_INSTRUCTION_CACHE(frame)                                          \
+  (&frame->function->chunk.caches.values[READ_INSTRUCTION_SHORT(frame)])
+#define CHECK_NUMERIC_OPERANDS(vm)                                             \
+  do {                                                                         \
+    if (!IS_NUMERIC_CONSTANT(peek_stack(vm, 0)) ||                             \
+        !IS_NUMERIC_CONSTANT(peek_stack(vm, 1))) {                             \
+      runtime_error(vm, "operands must be numbers.");                          \
+      return INTERPRETATION_RUNTIME_ERROR;                                     \
+    }                                                                          \
+  } while (false)
+#define BINARY_OPERATION(vm, constant_type, operator)                          \
+  do {                                                                         \
+    CHECK_NUMERIC_OPERANDS(vm);                                                \
+    double second_operand = numeric_constant_to_double(pop_from_stack(vm));    \
+    double first_operand = numeric_constant_to_double(pop_from_stack(vm));     \
+    push_onto_stack(vm, constant_type(first_operand operator second_operand)); \
+  } while (false)
+#define INTEGER_OPERATION(vm, overflow_check, operator)                        \
+  do {                                                                         \
+    Constant second_operand = peek_stack(vm, 0);                               \
+    Constant first_operand = peek_stack(vm, 1);                                \
+    int64_t integer_result;                                                    \
+    if (IS_INTEGER_CONSTANT(first_operand) &&                                  \
+        IS_INTEGER_CONSTANT(second_operand) &&                                 \
+        !overflow_check(AS_INTEGER_CONSTANT(first_operand),                    \
+                        AS_INTEGER_CONSTANT(second_operand),                   \
+                        &integer_result)) {                                    \
+      vm->stack_pointer--;                                                     \
+      vm->stack_pointer[-1] = INTEGER_CONSTANT(integer_result);                \
+    } else {                                                                   \
+      BINARY_OPERATION(vm, NUMBER_CONSTANT, operator);                         \
+    }                                                                          \
+  } while (false)
+#define COMPARE_OPERANDS(first_operand, second_operand, operator)              \
+  (IS_INTEGER_CONSTANT(first_operand) && IS_INTEGER_CONSTANT(second_operand)   \
+       ? AS_INTEGER_CONSTANT(first_operand) operator AS_INTEGER_CONSTANT(      \
+             second_operand)                                                   \
+   : IS_INTEGER_CONSTANT(first_operand)                                        \
+       ? compare_integer_to_number(AS_INTEGER_CONSTANT(first_operand),         \
+                                   AS_NUMBER_CONSTANT(second_operand))         \
+             operator 0                                                        \
+   : IS_INTEGER_CONSTANT(second_operand)                                       \
+       ? 0 operator compare_integer_to_number(                                 \
+             AS_INTEGER_CONSTANT(second_operand),                              \
+             AS_NUMBER_CONSTANT(first_operand))                                \
+       : AS_NUMBER_CONSTANT(first_operand) operator AS_NUMBER_CONSTANT(        \
+             second_operand))
+#define COMPARISON_OPERATION(vm, operator)                                     \
+  do {                                                                         \
+    CHECK_NUMERIC_OPERANDS(vm);                                                \
     Constant second_operand = pop_from_stack(vm);                              \
     Constant first_operand = pop_from_stack(vm);                               \
-    push_onto_stack(vm, first_operand operator second_operand);                \
+    push_onto_stack(vm, BOOLEAN_CONSTANT(COMPARE_OPERANDS(                     \
+                            first_operand, second_operand, operator)));        \
+  } while (false)
+#define COMPARISON_JUMP(vm, frame, operator)                                   \
+  do {                                                                         \
+    CHECK_NUMERIC_OPERANDS(vm);                                                \
+    Constant second_operand = pop_from_stack(vm);                              \
+    Constant first_operand = pop_from_stack(vm);                               \
+    uint16_t jump_offset = READ_INSTRUCTION_SHORT(frame);                      \
+    if (!COMPARE_OPERANDS(first_operand, second_operand, operator))            \
+      frame->instruction_pointer += jump_offset;                               \
+  } while (false)
+#define QUICKENED_INTEGER_OPERATION(vm, frame, overflow_check, operator)      \
+  do {                                                                         \
+    Constant second_operand = peek_stack(vm, 0);                               \
+    Constant first_operand = peek_stack(vm, 1);                                \
+    if (!IS_INTEGER_CONSTANT(first_operand) ||                                 \
+        !IS_INTEGER_CONSTANT(second_operand)) {                                \
+      deoptimize_instruction(frame);                                           \
+      break;                                                                   \
+    }                                                                          \
+    int64_t integer_result;                                                    \
+    vm->stack_pointer--;                                                       \
+    if (overflow_check(AS_INTEGER_CONSTANT(first_operand),                     \
+                       AS_INTEGER_CONSTANT(second_operand), &integer_result))  \
+      vm->stack_pointer[-1] = NUMBER_CONSTANT(                                 \
+          (double)AS_INTEGER_CONSTANT(first_operand) operator(double)          \
+              AS_INTEGER_CONSTANT(second_operand));                            \
+    else                                                                       \
+      vm->stack_pointer[-1] = INTEGER_CONSTANT(integer_result);                \
+  } while (false)
+#define QUICKENED_NUMBER_OPERATION(vm, frame, operator)                        \
+  do {                                                                         \
+    Constant second_operand = peek_stack(vm, 0);                               \
+    Constant first_operand = peek_stack(vm, 1);                                \
+    if (!IS_NUMBER_CONSTANT(first_operand) ||                                  \
+        !IS_NUMBER_CONSTANT(second_operand)) {                                 \
+      deoptimize_instruction(frame);                                           \
+      break;                                                                   \
+    }                                                                          \
+    vm->stack_pointer--;                                                       \
+    vm->stack_pointer[-1] =                                                    \
+        NUMBER_CONSTANT(AS_NUMBER_CONSTANT(first_operand)                      \
+                            operator AS_NUMBER_CONSTANT(second_operand));      \
+  } while (false)
+#define QUICKENED_COMPARISON_JUMP(vm, frame, operator)                         \
+  do {                                                                         \
+    Constant second_operand = peek_stack(vm, 0);                               \
+    Constant first_operand = peek_stack(vm, 1);                                \
+    if (!IS_INTEGER_CONSTANT(first_operand) ||                                 \
+        !IS_INTEGER_CONSTANT(second_operand)) {                                \
+      deoptimize_instruction(frame);                                           \
+      break;                                                                   \
+    }                                                                          \
+    vm->stack_pointer -= 2;                                                    \
+    uint16_t jump_offset = READ_INSTRUCTION_SHORT(frame);                      \
+    if (!(AS_INTEGER_CONSTANT(first_operand)                                   \
+              operator AS_INTEGER_CONSTANT(second_operand)))                   \
+      frame->instruction_pointer += jump_offset;                               \
   } while (false)
   for (;;) {
     uint8_t instruction;
-    switch (instruction = READ_INSTRUCTION(vm)) {
+    switch (instruction = READ_INSTRUCTION(frame)) {
     case OP_CONSTANT: {
-      Constant instruction_constant = READ_INSTRUCTION_CONSTANT(vm);
+      Constant instruction_constant = READ_INSTRUCTION_CONSTANT(frame);
       push_onto_stack(vm, instruction_constant);
       break;
     }
+    case OP_ZERO:
+      push_onto_stack(vm, INTEGER_CONSTANT(0));
+      break;
+    case OP_ONE:
+      push_onto_stack(vm, INTEGER_CONSTANT(1));
+      break;
+    case OP_SMALL_INTEGER:
+      push_onto_stack(vm,
+                      INTEGER_CONSTANT((int8_t)READ_INSTRUCTION(frame)));
+      break;
+    case OP_SHORT_INTEGER:
+      push_onto_stack(
+          vm, INTEGER_CONSTANT((int16_t)READ_INSTRUCTION_SHORT(frame)));
+      break;
+    case OP_NIL:
+      push_onto_stack(vm, NIL_CONSTANT);
+      break;
+    case OP_TRUE:
+      push_onto_stack(vm, BOOLEAN_CONSTANT(true));
+      break;
+    case OP_FALSE:
+      push_onto_stack(vm, BOOLEAN_CONSTANT(false));
+      break;
+    case OP_POP:
+      pop_from_stack(vm);
+      break;
+    case OP_DEFINE_GLOBAL: {
+      ObjectString *name = READ_INSTRUCTION_STRING(frame);
+      set_in_table(&vm->globals, name, peek_stack(vm, 0));
+      pop_from_stack(vm);
+      break;
+    }
+    case OP_GET_GLOBAL: {
+      ObjectString *name = READ_INSTRUCTION_STRING(frame);
+      Constant value;
+      if (!get_from_table(&vm->globals, name, &value)) {
+        runtime_error(vm, "undefined variable '%s'.", name->characters);
+        return INTERPRETATION_RUNTIME_ERROR;
+      }
+      push_onto_stack(vm, value);
+      break;
+    }
+    case OP_SET_GLOBAL: {
+      ObjectString *name = READ_INSTRUCTION_STRING(frame);
+      if (set_in_table(&vm->globals, name, peek_stack(vm, 0))) {
+        delete_from_table(&vm->globals, name);
+        runtime_error(vm, "undefined variable '%s'.", name->characters);
+        return INTERPRETATION_RUNTIME_ERROR;
+      }
+      break;
+    }
+    case OP_GET_LOCAL: {
+      uint8_t slot = READ_INSTRUCTION(frame);
+      push_onto_stack(vm, frame->slots[slot]);
+      break;
+    }
+    case OP_SET_LOCAL: {
+      uint8_t slot = READ_INSTRUCTION(frame);
+      frame->slots[slot] = peek_stack(vm, 0);
+      break;
+    }
+    case OP_EQUAL: {
+      Constant second_operand = pop_from_stack(vm);
+      Constant first_operand = pop_from_stack(vm);
+      push_onto_stack(vm, BOOLEAN_CONSTANT(constants_are_equal(
+                              first_operand, second_operand)));
+      break;
+    }
+    case OP_NOT_EQUAL: {
+      Constant second_operand = pop_from_stack(vm);
+      Constant first_operand = pop_from_stack(vm);
+      push_onto_stack(vm, BOOLEAN_CONSTANT(!constants_are_equal(
+                              first_operand, second_operand)));
+      break;
+    }
+    case OP_GREATER:
+      COMPARISON_OPERATION(vm, >);
+      break;
+    case OP_GREATER_EQUAL:
+      COMPARISON_OPERATION(vm, >=);
+      break;
+    case OP_LESS:
+      COMPARISON_OPERATION(vm, <);
+      break;
+    case OP_LESS_EQUAL:
+      COMPARISON_OPERATION(vm, <=);
+      break;
     case OP_ADD:
-      BINARY_OPERATION(vm, +);
+      quicken_instruction(frame, peek_stack(vm, 1), peek_stack(vm, 0));
+      if (IS_STRING_CONSTANT(peek_stack(vm, 0)) &&
+          IS_STRING_CONSTANT(peek_stack(vm, 1))) {
+        ObjectString *result =
+            concatenate_strings(vm, AS_STRING_CONSTANT(peek_stack(vm, 1)),
+                                AS_STRING_CONSTANT(peek_stack(vm, 0)));
+        pop_from_stack(vm);
+        pop_from_stack(vm);
+        push_onto_stack(vm, OBJECT_CONSTANT(result));
+      } else if (IS_NUMERIC_CONSTANT(peek_stack(vm, 0)) &&
+                 IS_NUMERIC_CONSTANT(peek_stack(vm, 1))) {
+        INTEGER_OPERATION(vm, __builtin_add_overflow, +);
+      } else {
+        runtime_error(vm, "operands must be two numbers or two strings.");
+        return INTERPRETATION_RUNTIME_ERROR;
+      }
+      break;
+    case OP_ADD_INTEGER:
+      QUICKENED_INTEGER_OPERATION(vm, frame, __builtin_add_overflow, +);
+      break;
+    case OP_ADD_NUMBER:
+      QUICKENED_NUMBER_OPERATION(vm, frame, +);
+      break;
+    case OP_ADD_STRING: {
+      if (!IS_STRING_CONSTANT(peek_stack(vm, 0)) ||
+          !IS_STRING_CONSTANT(peek_stack(vm, 1))) {
+        deoptimize_instruction(frame);
+        break;
+      }
+      ObjectString *result =
+          concatenate_strings(vm, AS_STRING_CONSTANT(peek_stack(vm, 1)),
+                              AS_STRING_CONSTANT(peek_stack(vm, 0)));
+      pop_from_stack(vm);
+      pop_from_stack(vm);
+      push_onto_stack(vm, OBJECT_CONSTANT(result));
       break;
+    }
     case OP_SUBTRACT:
-      BINARY_OPERATION(vm, -);
+      quicken_instruction(frame, peek_stack(vm, 1), peek_stack(vm, 0));
+      INTEGER_OPERATION(vm, __builtin_sub_overflow, -);
+      break;
+    case OP_SUBTRACT_INTEGER:
+      QUICKENED_INTEGER_OPERATION(vm, frame, __builtin_sub_overflow, -);
+      break;
+    case OP_SUBTRACT_NUMBER:
+      QUICKENED_NUMBER_OPERATION(vm, frame, -);
       break;
     case OP_MULTIPLY:
-      BINARY_OPERATION(vm, *);
+      quicken_instruction(frame, peek_stack(vm, 1), peek_stack(vm, 0));
+      INTEGER_OPERATION(vm, multiply_integers_overflow, *);
+      break;
+    case OP_MULTIPLY_INTEGER:
+      QUICKENED_INTEGER_OPERATION(vm, frame, multiply_integers_overflow, *);
+      break;
+    case OP_MULTIPLY_NUMBER:
+      QUICKENED_NUMBER_OPERATION(vm, frame, *);
       break;
     case OP_DIVIDE:
-      BINARY_OPERATION(vm, /);
+      BINARY_OPERATION(vm, NUMBER_CONSTANT, /);
+      break;
+    case OP_NOT:
+      push_onto_stack(vm,
+                      BOOLEAN_CONSTANT(constant_is_falsey(pop_from_stack(vm))));
       break;
     case OP_NEGATE:
-      push_onto_stack(vm, -pop_from_stack(vm));
+      if (!IS_NUMERIC_CONSTANT(peek_stack(vm, 0))) {
+        runtime_error(vm, "operand must be a number.");
+        return INTERPRETATION_RUNTIME_ERROR;
+      }
+      if (IS_INTEGER_CONSTANT(peek_stack(vm, 0)) &&
+          AS_INTEGER_CONSTANT(peek_stack(vm, 0)) != 0 &&
+          AS_INTEGER_CONSTANT(peek_stack(vm, 0)) != INT64_MIN) {
+        vm->stack_pointer[-1] =
+            INTEGER_CONSTANT(-AS_INTEGER_CONSTANT(peek_stack(vm, 0)));
+        break;
+      }
+      push_onto_stack(vm, NUMBER_CONSTANT(-numeric_constant_to_double(
+                              pop_from_stack(vm))));
+      break;
+    case OP_PRINT:
+      print_constant(&vm->output, pop_from_stack(vm));
+      write_output_characters(&vm->output, "\n", 1);
+      break;
+    case OP_JUMP: {
+      uint16_t jump_offset = READ_INSTRUCTION_SHORT(frame);
+      frame->instruction_pointer += jump_offset;
+      break;
+    }
+    case OP_JUMP_IF_FALSE: {
+      uint16_t jump_offset = READ_INSTRUCTION_SHORT(frame);
+      if (constant_is_falsey(peek_stack(vm, 0)))
+        frame->instruction_pointer += jump_offset;
+      break;
+    }
+    case OP_POP_JUMP_IF_FALSE: {
+      uint16_t jump_offset = READ_INSTRUCTION_SHORT(frame);
+      if (constant_is_falsey(pop_from_stack(vm)))
+        frame->instruction_pointer += jump_offset;
+      break;
+    }
+    case OP_JUMP_IF_EQUAL: {
+      Constant second_operand = pop_from_stack(vm);
+      Constant first_operand = pop_from_stack(vm);
+      uint16_t jump_offset = READ_INSTRUCTION_SHORT(frame);
+      if (constants_are_equal(first_operand, second_operand))
+        frame->instruction_pointer += jump_offset;
+      break;
+    }
+    case OP_JUMP_IF_NOT_EQUAL: {
+      Constant second_operand = pop_from_stack(vm);
+      Constant first_operand = pop_from_stack(vm);
+      uint16_t jump_offset = READ_INSTRUCTION_SHORT(frame);
+      if (!constants_are_equal(first_operand, second_operand))
+        frame->instruction_pointer += jump_offset;
+      break;
+    }
+    case OP_JUMP_IF_NOT_GREATER:
+      quicken_instruction(frame, peek_stack(vm, 1), peek_stack(vm, 0));
+      COMPARISON_JUMP(vm, frame, >);
+      break;
+    case OP_JUMP_IF_NOT_GREATER_INTEGER:
+      QUICKENED_COMPARISON_JUMP(vm, frame, >);
+      break;
+    case OP_JUMP_IF_NOT_GREATER_EQUAL:
+      quicken_instruction(frame, peek_stack(vm, 1), peek_stack(vm, 0));
+      COMPARISON_JUMP(vm, frame, >=);
+      break;
+    case OP_JUMP_IF_NOT_GREATER_EQUAL_INTEGER:
+      QUICKENED_COMPARISON_JUMP(vm, frame, >=);
+      break;
+    case OP_JUMP_IF_NOT_LESS:
+      quicken_instruction(frame, peek_stack(vm, 1), peek_stack(vm, 0));
+      COMPARISON_JUMP(vm, frame, <);
+      break;
+    case OP_JUMP_IF_NOT_LESS_INTEGER:
+      QUICKENED_COMPARISON_JUMP(vm, frame, <);
+      break;
+    case OP_JUMP_IF_NOT_LESS_EQUAL:
+      quicken_instruction(frame, peek_stack(vm, 1), peek_stack(vm, 0));
+      COMPARISON_JUMP(vm, frame, <=);
+      break;
+    case OP_JUMP_IF_NOT_LESS_EQUAL_INTEGER:
+      QUICKENED_COMPARISON_JUMP(vm, frame, <=);
+      break;
+    case OP_LOOP: {
+      uint16_t loop_offset = READ_INSTRUCTION_SHORT(frame);
+      if (!consume_fuel(vm, loop_offset))
+        return INTERPRETATION_RUNTIME_ERROR;
+      frame->instruction_pointer -= loop_offset;
+      if (++frame->function->chunk.loop_iterations_count >=
+              vm->tier_up_threshold &&
+          tier_up_frame(vm, frame))
+        return INTERPRETATION_OK;
+      break;
+    }
+    case OP_CALL: {
+      int arguments_count = READ_INSTRUCTION(frame);
+      if (!call_constant(vm, peek_stack(vm, arguments_count), arguments_count))
+        return INTERPRETATION_RUNTIME_ERROR;
+      LOAD_FRAME();
+      break;
+    }
+    case OP_TAIL_CALL: {
+      int arguments_count = READ_INSTRUCTION(frame);
+      if (!tail_call_constant(vm, peek_stack(vm, arguments_count),
+                              arguments_count))
+        return INTERPRETATION_RUNTIME_ERROR;
+      LOAD_FRAME();
+      break;
+    }
+    case OP_GET_PROPERTY: {
+      ObjectString *name = READ_INSTRUCTION_STRING(frame);
+      InlineCache *cache = READ_INSTRUCTION_CACHE(frame);
+      if (!IS_INSTANCE_CONSTANT(peek_stack(vm, 0))) {
+        runtime_error(vm, "only instances have properties.");
+        return INTERPRETATION_RUNTIME_ERROR;
+      }
+      ObjectInstance *instance = AS_INSTANCE_CONSTANT(peek_stack(vm, 0));
+      InlineCacheEntry resolved_entry;
+      InlineCacheEntry *entry =
+          lookup_property(vm, frame->function, cache, instance->shape, name,
+                          &resolved_entry);
+      if (entry == NULL)
+        return INTERPRETATION_RUNTIME_ERROR;
+      if (entry->method == NULL) {
+        vm->stack_pointer[-1] = instance->fields[entry->slot];
+      } else {
+        ObjectBoundMethod *bound_method =
+            new_bound_method(vm, peek_stack(vm, 0), entry->method);
+        vm->stack_pointer[-1] = OBJECT_CONSTANT(bound_method);
+      }
+      break;
+    }
+    case OP_SET_PROPERTY: {
+      ObjectString *name = READ_INSTRUCTION_STRING(frame);
+      InlineCache *cache = READ_INSTRUCTION_CACHE(frame);
+      if (!IS_INSTANCE_CONSTANT(peek_stack(vm, 1))) {
+        runtime_error(vm, "only instances have fields.");
+        return INTERPRETATION_RUNTIME_ERROR;
+      }
+      ObjectInstance *instance = AS_INSTANCE_CONSTANT(peek_stack(vm, 1));
+      InlineCacheEntry resolved_entry;
+      InlineCacheEntry *entry = lookup_field(
+          vm, frame->function, cache, instance->shape, name, &resolved_entry);
+      if (entry->transition != NULL) {
+        reserve_instance_fields(vm, instance, entry->transition->field_count);
+        instance->shape = entry->transition;
+        collector_write_barrier(vm, (Object *)instance,
+                                OBJECT_CONSTANT(entry->transition));
+      }
+      Constant value = pop_from_stack(vm);
+      instance->fields[entry->slot] = value;
+      collector_write_barrier(vm, (Object *)instance, value);
+      vm->stack_pointer[-1] = value;
+      break;
+    }
+    case OP_INVOKE:
+    case OP_TAIL_INVOKE: {
+      ObjectString *name = READ_INSTRUCTION_STRING(frame);
+      int arguments_count = READ_INSTRUCTION(frame);
+      InlineCache *cache = READ_INSTRUCTION_CACHE(frame);
+      if (!IS_INSTANCE_CONSTANT(peek_stack(vm, arguments_count))) {
+        runtime_error(vm, "only instances have methods.");
+        return INTERPRETATION_RUNTIME_ERROR;
+      }
+      ObjectInstance *instance =
+          AS_INSTANCE_CONSTANT(peek_stack(vm, arguments_count));
+      InlineCacheEntry resolved_entry;
+      InlineCacheEntry *entry =
+          lookup_property(vm, frame->function, cache, instance->shape, name,
+                          &resolved_entry);
+      if (entry == NULL ||
+          !invoke_property(vm, instance, entry, arguments_count,
+                           instruction == OP_TAIL_INVOKE))
+        return INTERPRETATION_RUNTIME_ERROR;
+      LOAD_FRAME();
+      break;
+    }
+    case OP_CLASS:
+      push_onto_stack(
+          vm, OBJECT_CONSTANT(new_class(vm, READ_INSTRUCTION_STRING(frame))));
+      break;
+    case OP_INHERIT: {
+      Constant superclass = peek_stack(vm, 1);
+      if (!IS_CLASS_CONSTANT(superclass)) {
+        runtime_error(vm, "superclass must be a class.");
+        return INTERPRETATION_RUNTIME_ERROR;
+      }
+      ObjectClass *subclass = AS_CLASS_CONSTANT(peek_stack(vm, 0));
+      copy_table(&AS_CLASS_CONSTANT(superclass)->methods, &subclass->methods);
+      subclass->initializer = AS_CLASS_CONSTANT(superclass)->initializer;
+      collector_write_barrier(vm, (Object *)subclass, superclass);
+      pop_from_stack(vm);
+      pop_from_stack(vm);
+      break;
+    }
+    case OP_METHOD: {
+      ObjectString *name = READ_INSTRUCTION_STRING(frame);
+      Constant method = peek_stack(vm, 0);
+      ObjectClass *object_class = AS_CLASS_CONSTANT(peek_stack(vm, 1));
+      set_in_table(&object_class->methods, name, method);
+      if (name_is_initializer(name))
+        object_class->initializer = AS_FUNCTION_CONSTANT(method);
+      collector_write_barrier(vm, (Object *)object_class,
+                              OBJECT_CONSTANT(name));
+      collector_write_barrier(vm, (Object *)object_class, method);
+      pop_from_stack(vm);
+      break;
+    }
+    case OP_THROW:
+      if (!throw_exception(vm, pop_from_stack(vm)))
+        return INTERPRETATION_RUNTIME_ERROR;
+      LOAD_FRAME();
       break;
     case OP_RETURN: {
-      printf("%g\n", pop_from_stack(vm));
-      return INTERPRETATION_OK;
+      Constant result = pop_from_stack(vm);
+      vm->frame_count--;
+      vm->stack_pointer = frame->slots;
+      if (vm->frame_count > 0)
+        push_onto_stack(vm, result);
+      else if (vm->coroutine == NULL)
+        return INTERPRETATION_OK;
+      else if (!finish_coroutine(vm, result))
+        return INTERPRETATION_RUNTIME_ERROR;
+      LOAD_FRAME();
+      break;
     }
+    case OP_BREAKPOINT:
+      frame->instruction_pointer--;
+      hit_breakpoint(vm, frame->function,
+                     (size_t)(frame->instruction_pointer -
+                              frame->function->chunk.instructions.values));
+      break;
     }
   }
 
+#undef LOAD_FRAME
 #undef READ_INSTRUCTION
+#undef READ_INSTRUCTION_SHORT
 #undef READ_INSTRUCTION_CONSTANT
+#undef READ_INSTRUCTION_STRING
+#undef READ_INSTRUCTION_CACHE
+#undef CHECK_NUMERIC_OPERANDS
+#undef BINARY_OPERATION
+#undef INTEGER_OPERATION
+#undef COMPARISON_OPERATION
+#undef COMPARISON_JUMP
+#undef QUICKENED_INTEGER_OPERATION
+#undef QUICKENED_NUMBER_OPERATION
+#undef QUICKENED_COMPARISON_JUMP
+}
+
+static void reset_registers(VirtualMachine *vm, CallFrame *frame) {
+  Constant *registers_end =
+      frame->slots + frame->function->chunk.registers.registers_count;
+  while (vm->stack_pointer < registers_end)
+    push_onto_stack(vm, NIL_CONSTANT);
+}
+
+static InterpretationResult run_registers_compiled(VirtualMachine *vm) {
+  CallFrame *frame = &vm->frames[vm->frame_count - 1];
+  Constant *constants = frame->function->chunk.constants.values;
+  reset_registers(vm, frame);
+#define LOAD_FRAME()                                                           \
+  do {                                                                         \
+    frame = &vm->frames[vm->frame_count - 1];                                  \
+    if (!frame->runs_on_registers)                                             \
+      return INTERPRETATION_OK;                                                \
+    constants = frame->function->chunk.constants.values;                       \
+  } while (false)
+#define FIRST_OPERAND(instruction)                                             \
+  ((instruction)->operand_kinds & REGISTER_FIRST_OPERAND_IS_CONSTANT           \
+       ? constants[(instruction)->first_operand]                               \
+       : frame->slots[(instruction)->first_operand])
+#define SECOND_OPERAND(instruction)                                            \
+  ((instruction)->operand_kinds & REGISTER_SECOND_OPERAND_IS_CONSTANT          \
+       ? constants[(instruction)->second_operand]                              \
+       : frame->slots[(instruction)->second_operand])
+#define DESTINATION(instruction) (frame->slots[(instruction)->destination])
+#define READ_NAME(instruction)                                                 \
+  AS_STRING_CONSTANT(constants[(instruction)->argument])
+#define READ_PROPERTY_NAME(instruction)                                        \
+  AS_STRING_CONSTANT(                                                          \
+      constants[(instruction)->argument >> REGISTER_ARGUMENT_SHIFT])
+#define READ_PROPERTY_CACHE(instruction)                                       \
+  (&frame->function->chunk.caches                                              \
+        .values[(instruction)->argument & REGISTER_ARGUMENT_MASK])
+#define JUMP(instruction)                                                      \
+  (frame->register_pointer =                                                   \
+       frame->function->chunk.registers.values + (instruction)->argument)
+#define CHECK_NUMERIC_OPERANDS(first_operand, second_operand)                  \
+  do {                                                                         \
+    if (!IS_NUMERIC_CONSTANT(first_operand) ||                                 \
+        !IS_NUMERIC_CONSTANT(second_operand)) {                                \
+      runtime_error(vm, "operands must be numbers.");                          \
+      return INTERPRETATION_RUNTIME_ERROR;                                     \
+    }                                                                          \
+  } while (false)
+#define BINARY_OPERATION(instruction, operator)                                \
+  do {                                                                         \
+    Constant first_operand = FIRST_OPERAND(instruction);                       \
+    Constant second_operand = SECOND_OPERAND(instruction);                     \
+    CHECK_NUMERIC_OPERANDS(first_operand, second_operand);                     \
+    DESTINATION(instruction) =                                                 \
+        NUMBER_CONSTANT(numeric_constant_to_double(first_operand)              \
+                            operator numeric_constant_to_double(               \
+                                second_operand));                              \
+  } while (false)
+#define INTEGER_OPERATION(instruction, overflow_check, operator)               \
+  do {                                                                         \
+    Constant first_operand = FIRST_OPERAND(instruction);                       \
+    Constant second_operand = SECOND_OPERAND(instruction);                     \
+    int64_t integer_result;                                                    \
+    if (IS_INTEGER_CONSTANT(first_operand) &&                                  \
+        IS_INTEGER_CONSTANT(second_operand) &&                                 \
+        !overflow_check(AS_INTEGER_CONSTANT(first_operand),                    \
+                        AS_INTEGER_CONSTANT(second_operand),                   \
+                        &integer_result)) {                                    \
+      DESTINATION(instruction) = INTEGER_CONSTANT(integer_result);             \
+    } else {                                                                   \
+      CHECK_NUMERIC_OPERANDS(first_operand, second_operand);                   \
+      DESTINATION(instruction) =                                               \
+          NUMBER_CONSTANT(numeric_constant_to_double(first_operand)            \
+                              operator numeric_constant_to_double(             \
+                                  second_operand));                            \
+    }                                                                          \
+  } while (false)
+#define COMPARISON_OPERATION(instruction, operator)                            \
+  do {                                                                         \
+    Constant first_operand = FIRST_OPERAND(instruction);                       \
+    Constant second_operand = SECOND_OPERAND(instruction);                     \
+    CHECK_NUMERIC_OPERANDS(first_operand, second_operand);                     \
+    DESTINATION(instruction) = BOOLEAN_CONSTANT(                               \
+        COMPARE_OPERANDS(first_operand, second_operand, operator));            \
+  } while (false)
+#define COMPARISON_JUMP(instruction, operator)                                 \
+  do {                                                                         \
+    Constant first_operand = FIRST_OPERAND(instruction);                       \
+    Constant second_operand = SECOND_OPERAND(instruction);                     \
+    CHECK_NUMERIC_OPERANDS(first_operand, second_operand);                     \
+    if (!COMPARE_OPERANDS(first_operand, second_operand, operator))            \
+      JUMP(instruction);                                                       \
+  } while (false)
+  for (;;) {
+    RegisterInstruction *instruction = frame->register_pointer++;
+    switch (instruction->opcode) {
+    case REGISTER_OP_MOVE:
+      DESTINATION(instruction) = FIRST_OPERAND(instruction);
+      break;
+    case REGISTER_OP_NIL:
+      DESTINATION(instruction) = NIL_CONSTANT;
+      break;
+    case REGISTER_OP_TRUE:
+      DESTINATION(instruction) = BOOLEAN_CONSTANT(true);
+      break;
+    case REGISTER_OP_FALSE:
+      DESTINATION(instruction) = BOOLEAN_CONSTANT(false);
+      break;
+    case REGISTER_OP_DEFINE_GLOBAL:
+      set_in_table(&vm->globals, READ_NAME(instruction),
+                   FIRST_OPERAND(instruction));
+      break;
+    case REGISTER_OP_GET_GLOBAL: {
+      ObjectString *name = READ_NAME(instruction);
+      Constant value;
+      if (!get_from_table(&vm->globals, name, &value)) {
+        runtime_error(vm, "undefined variable '%s'.", name->characters);
+        return INTERPRETATION_RUNTIME_ERROR;
+      }
+      DESTINATION(instruction) = value;
+      break;
+    }
+    case REGISTER_OP_SET_GLOBAL: {
+      ObjectString *name = READ_NAME(instruction);
+      if (set_in_table(&vm->globals, name, FIRST_OPERAND(instruction))) {
+        delete_from_table(&vm->globals, name);
+        runtime_error(vm, "undefined variable '%s'.", name->characters);
+        return INTERPRETATION_RUNTIME_ERROR;
+      }
+      break;
+    }
+    case REGISTER_OP_EQUAL:
+      DESTINATION(instruction) = BOOLEAN_CONSTANT(constants_are_equal(
+          FIRST_OPERAND(instruction), SECOND_OPERAND(instruction)));
+      break;
+    case REGISTER_OP_NOT_EQUAL:
+      DESTINATION(instruction) = BOOLEAN_CONSTANT(!constants_are_equal(
+          FIRST_OPERAND(instruction), SECOND_OPERAND(instruction)));
+      break;
+    case REGISTER_OP_GREATER:
+      COMPARISON_OPERATION(instruction, >);
+      break;
+    case REGISTER_OP_GREATER_EQUAL:
+      COMPARISON_OPERATION(instruction, >=);
+      break;
+    case REGISTER_OP_LESS:
+      COMPARISON_OPERATION(instruction, <);
+      break;
+    case REGISTER_OP_LESS_EQUAL:
+      COMPARISON_OPERATION(instruction, <=);
+      break;
+    case REGISTER_OP_ADD: {
+      Constant first_operand = FIRST_OPERAND(instruction);
+      Constant second_operand = SECOND_OPERAND(instruction);
+      if (IS_STRING_CONSTANT(first_operand) &&
+          IS_STRING_CONSTANT(second_operand)) {
+        ObjectString *result =
+            concatenate_strings(vm, AS_STRING_CONSTANT(first_operand),
+                                AS_STRING_CONSTANT(second_operand));
+        DESTINATION(instruction) = OBJECT_CONSTANT(result);
+      } else if (IS_NUMERIC_CONSTANT(first_operand) &&
+                 IS_NUMERIC_CONSTANT(second_operand)) {
+        INTEGER_OPERATION(instruction, __builtin_add_overflow, +);
+      } else {
+        runtime_error(vm, "operands must be two numbers or two strings.");
+        return INTERPRETATION_RUNTIME_ERROR;
+      }
+      break;
+    }
+    case REGISTER_OP_SUBTRACT:
+      INTEGER_OPERATION(instruction, __builtin_sub_overflow, -);
+      break;
+    case REGISTER_OP_MULTIPLY:
+      INTEGER_OPERATION(instruction, multiply_integers_overflow, *);
+      break;
+    case REGISTER_OP_DIVIDE:
+      BINARY_OPERATION(instruction, /);
+      break;
+    case REGISTER_OP_NOT:
+      DESTINATION(instruction) =
+          BOOLEAN_CONSTANT(constant_is_falsey(FIRST_OPERAND(instruction)));
+      break;
+    case REGISTER_OP_NEGATE: {
+      Constant operand = FIRST_OPERAND(instruction);
+      if (!IS_NUMERIC_CONSTANT(operand)) {
+        runtime_error(vm, "operand must be a number.");
+        return INTERPRETATION_RUNTIME_ERROR;
+      }
+      if (IS_INTEGER_CONSTANT(operand) && AS_INTEGER_CONSTANT(operand) != 0 &&
+          AS_INTEGER_CONSTANT(operand) != INT64_MIN)
+        DESTINATION(instruction) =
+            INTEGER_CONSTANT(-AS_INTEGER_CONSTANT(operand));
+      else
+        DESTINATION(instruction) =
+            NUMBER_CONSTANT(-numeric_constant_to_double(operand));
+      break;
+    }
+    case REGISTER_OP_PRINT:
+      print_constant(&vm->output, FIRST_OPERAND(instruction));
+      write_output_characters(&vm->output, "\n", 1);
+      break;
+    case REGISTER_OP_JUMP:
+      JUMP(instruction);
+      break;
+    case REGISTER_OP_JUMP_IF_FALSE:
+      if (constant_is_falsey(FIRST_OPERAND(instruction)))
+        JUMP(instruction);
+      break;
+    case REGISTER_OP_JUMP_IF_EQUAL:
+      if (constants_are_equal(FIRST_OPERAND(instruction),
+                              SECOND_OPERAND(instruction)))
+        JUMP(instruction);
+      break;
+    case REGISTER_OP_JUMP_IF_NOT_EQUAL:
+      if (!constants_are_equal(FIRST_OPERAND(instruction),
+                               SECOND_OPERAND(instruction)))
+        JUMP(instruction);
+      break;
+    case REGISTER_OP_JUMP_IF_NOT_GREATER:
+      COMPARISON_JUMP(instruction, >);
+      break;
+    case REGISTER_OP_JUMP_IF_NOT_GREATER_EQUAL:
+      COMPARISON_JUMP(instruction, >=);
+      break;
+    case REGISTER_OP_JUMP_IF_NOT_LESS:
+      COMPARISON_JUMP(instruction, <);
+      break;
+    case REGISTER_OP_JUMP_IF_NOT_LESS_EQUAL:
+      COMPARISON_JUMP(instruction, <=);
+      break;
+    case REGISTER_OP_LOOP:
+      if (!consume_fuel(vm, instruction->first_operand))
+        return INTERPRETATION_RUNTIME_ERROR;
+      JUMP(instruction);
+      break;
+    case REGISTER_OP_CALL: {
+      int arguments_count = instruction->first_operand;
+      vm->stack_pointer =
+          frame->slots + instruction->destination + arguments_count + 1;
+      if (!call_constant(vm, DESTINATION(instruction), arguments_count))
+        return INTERPRETATION_RUNTIME_ERROR;
+      if (&vm->frames[vm->frame_count - 1] != frame)
+        LOAD_FRAME();
+      reset_registers(vm, frame);
+      break;
+    }
+    case REGISTER_OP_TAIL_CALL: {
+      int arguments_count = instruction->first_operand;
+      Constant callee = DESTINATION(instruction);
+      bool replaces_frame =
+          IS_FUNCTION_CONSTANT(callee) || IS_BOUND_METHOD_CONSTANT(callee);
+      vm->stack_pointer =
+          frame->slots + instruction->destination + arguments_count + 1;
+      if (!tail_call_constant(vm, callee, arguments_count))
+        return INTERPRETATION_RUNTIME_ERROR;
+      if (replaces_frame || &vm->frames[vm->frame_count - 1] != frame)
+        LOAD_FRAME();
+      reset_registers(vm, frame);
+      break;
+    }
+    case REGISTER_OP_GET_PROPERTY: {
+      Constant receiver = FIRST_OPERAND(instruction);
+      if (!IS_INSTANCE_CONSTANT(receiver)) {
+        runtime_error(vm, "only instances have properties.");
+        return INTERPRETATION_RUNTIME_ERROR;
+      }
+      ObjectInstance *instance = AS_INSTANCE_CONSTANT(receiver);
+      InlineCacheEntry resolved_entry;
+      InlineCacheEntry *entry = lookup_property(
+          vm, frame->function, READ_PROPERTY_CACHE(instruction),
+          instance->shape, READ_PROPERTY_NAME(instruction), &resolved_entry);
+      if (entry == NULL)
+        return INTERPRETATION_RUNTIME_ERROR;
+      if (entry->method == NULL)
+        DESTINATION(instruction) = instance->fields[entry->slot];
+      else
+        DESTINATION(instruction) =
+            OBJECT_CONSTANT(new_bound_method(vm, receiver, entry->method));
+      break;
+    }
+    case REGISTER_OP_SET_PROPERTY: {
+      Constant receiver = FIRST_OPERAND(instruction);
+      if (!IS_INSTANCE_CONSTANT(receiver)) {
+        runtime_error(vm, "only instances have fields.");
+        return INTERPRETATION_RUNTIME_ERROR;
+      }
+      ObjectInstance *instance = AS_INSTANCE_CONSTANT(receiver);
+      InlineCacheEntry resolved_entry;
+      InlineCacheEntry *entry = lookup_field(
+          vm, frame->function, READ_PROPERTY_CACHE(instruction),
+          instance->shape, READ_PROPERTY_NAME(instruction), &resolved_entry);
+      if (entry->transition != NULL) {
+        reserve_instance_fields(vm, instance, entry->transition->field_count);
+        instance->shape = entry->transition;
+        collector_write_barrier(vm, (Object *)instance,
+                                OBJECT_CONSTANT(entry->transition));
+      }
+      Constant value = SECOND_OPERAND(instruction);
+      instance->fields[entry->slot] = value;
+      collector_write_barrier(vm, (Object *)instance, value);
+      DESTINATION(instruction) = value;
+      break;
+    }
+    case REGISTER_OP_INVOKE:
+    case REGISTER_OP_TAIL_INVOKE: {
+      int arguments_count = instruction->first_operand;
+      if (!IS_INSTANCE_CONSTANT(DESTINATION(instruction))) {
+        runtime_error(vm, "only instances have methods.");
+        return INTERPRETATION_RUNTIME_ERROR;
+      }
+      ObjectInstance *instance = AS_INSTANCE_CONSTANT(DESTINATION(instruction));
+      InlineCacheEntry resolved_entry;
+      InlineCacheEntry *entry = lookup_property(
+          vm, frame->function, READ_PROPERTY_CACHE(instruction),
+          instance->shape, READ_PROPERTY_NAME(instruction), &resolved_entry);
+      if (entry == NULL)
+        return INTERPRETATION_RUNTIME_ERROR;
+      vm->stack_pointer =
+          frame->slots + instruction->destination + arguments_count + 1;
+      bool is_tail_call = instruction->opcode == REGISTER_OP_TAIL_INVOKE;
+      Constant callee = entry->method != NULL
+                            ? OBJECT_CONSTANT(entry->method)
+                            : instance->fields[entry->slot];
+      bool replaces_frame = is_tail_call && (IS_FUNCTION_CONSTANT(callee) ||
+                                             IS_BOUND_METHOD_CONSTANT(callee));
+      if (!invoke_property(vm, instance, entry, arguments_count, is_tail_call))
+        return INTERPRETATION_RUNTIME_ERROR;
+      if (replaces_frame || &vm->frames[vm->frame_count - 1] != frame)
+        LOAD_FRAME();
+      reset_registers(vm, frame);
+      break;
+    }
+    case REGISTER_OP_CLASS:
+      DESTINATION(instruction) =
+          OBJECT_CONSTANT(new_class(vm, READ_NAME(instruction)));
+      break;
+    case REGISTER_OP_INHERIT: {
+      Constant superclass = FIRST_OPERAND(instruction);
+      if (!IS_CLASS_CONSTANT(superclass)) {
+        runtime_error(vm, "superclass must be a class.");
+        return INTERPRETATION_RUNTIME_ERROR;
+      }
+      ObjectClass *subclass = AS_CLASS_CONSTANT(SECOND_OPERAND(instruction));
+      copy_table(&AS_CLASS_CONSTANT(superclass)->methods, &subclass->methods);
+      subclass->initializer = AS_CLASS_CONSTANT(superclass)->initializer;
+      collector_write_barrier(vm, (Object *)subclass, superclass);
+      break;
+    }
+    case REGISTER_OP_METHOD: {
+      ObjectString *name = READ_NAME(instruction);
+      Constant method = SECOND_OPERAND(instruction);
+      ObjectClass *object_class =
+          AS_CLASS_CONSTANT(FIRST_OPERAND(instruction));
+      set_in_table(&object_class->methods, name, method);
+      if (name_is_initializer(name))
+        object_class->initializer = AS_FUNCTION_CONSTANT(method);
+      collector_write_barrier(vm, (Object *)object_class,
+                              OBJECT_CONSTANT(name));
+      collector_write_barrier(vm, (Object *)object_class, method);
+      break;
+    }
+    case REGISTER_OP_THROW:
+      if (!throw_exception(vm, FIRST_OPERAND(instruction)))
+        return INTERPRETATION_RUNTIME_ERROR;
+      LOAD_FRAME();
+      reset_registers(vm, frame);
+      break;
+    case REGISTER_OP_RETURN: {
+      Constant result = FIRST_OPERAND(instruction);
+      vm->frame_count--;
+      vm->stack_pointer = frame->slots;
+      if (vm->frame_count > 0)
+        push_onto_stack(vm, result);
+      else if (vm->coroutine == NULL)
+        return INTERPRETATION_OK;
+      else if (!finish_coroutine(vm, result))
+        return INTERPRETATION_RUNTIME_ERROR;
+      LOAD_FRAME();
+      reset_registers(vm, frame);
+      break;
+    }
+    }
+  }
+
+#undef LOAD_FRAME
+#undef FIRST_OPERAND
+#undef SECOND_OPERAND
+#undef DESTINATION
+#undef READ_NAME
+#undef READ_PROPERTY_NAME
+#undef READ_PROPERTY_CACHE
+#undef JUMP
+#undef CHECK_NUMERIC_OPERANDS
 #undef BINARY_OPERATION
+#undef INTEGER_OPERATION
+#undef COMPARE_OPERANDS
+#undef COMPARISON_OPERATION
+#undef COMPARISON_JUMP
 }
 
-void init_vm(VirtualMachine *vm) { init_stack(vm); }
+static InterpretationResult run_frames(VirtualMachine *vm) {
+  InterpretationResult interpretation_result = INTERPRETATION_OK;
+  while (interpretation_result == INTERPRETATION_OK && vm->frame_count > 0)
+    interpretation_result =
+        vm->frames[vm->frame_count - 1].runs_on_registers
+            ? run_registers_compiled(vm)
+            : run_input_compiled(vm);
+  return interpretation_result;
+}
+
+void init_vm(VirtualMachine *vm) {
+  init_stack(vm);
+  init_frames(vm);
+  vm->main_frame_count = 0;
+  vm->main_stack_pointer = vm->main_stack;
+  vm->compiler = NULL;
+  vm->compiles_lazily = false;
+  vm->optimizes_expressions = false;
+  vm->runs_on_registers = false;
+  vm->tier_up_threshold = TIER_UP_THRESHOLD;
+  vm->traces_tiering = false;
+  vm->fuel = SIZE_MAX;
+  vm->interrupted_fuel = 0;
+  init_garbage_collector(&vm->collector);
+  init_slab_allocator(&vm->allocator);
+  init_table(&vm->strings);
+  init_table(&vm->globals);
+  init_output_buffer(&vm->output, OUTPUT_STANDARD_OUTPUT);
+  init_profiler(&vm->profiler);
+  init_debugger(&vm->debugger);
+  init_table(&vm->compiled_inputs);
+  init_table(&vm->initial_globals);
+  init_event_loop(&vm->event_loop);
+  vm->allows_io = false;
+  define_natives(vm, natives, sizeof(natives) / sizeof(natives[0]));
+}
 
-void free_vm(VirtualMachine *vm) {}
+void free_vm(VirtualMachine *vm) {
+  flush_output_buffer(&vm->output);
+  stop_profiler(vm);
+  free_profiler(&vm->profiler);
+  detach_debugger(vm);
+  free_table(&vm->strings);
+  free_table(&vm->globals);
+  free_table(&vm->compiled_inputs);
+  free_table(&vm->initial_globals);
+  free_event_loop(vm);
+  free_garbage_collector(vm);
+  free_slab_allocator(&vm->allocator);
+}
 
 InterpretationResult interpret_input(VirtualMachine *vm, const char *input) {
-  Chunk compilation_chunk;
-  init_chunk(&compilation_chunk);
-  if (!compile_input(input, &compilation_chunk)) {
-    free_chunk(&compilation_chunk);
+  ObjectFunction *function = compile_input(vm, input);
+  if (function == NULL || !verify_function(function))
     return INTERPRETATION_COMPILE_ERROR;
-  }
-  vm->chunk = &compilation_chunk;
-  vm->instruction_pointer = vm->chunk->instructions.values;
-  InterpretationResult interpretation_result = run_input_compiled(vm);
-  free_chunk(&compilation_chunk);
+  debug_function(vm, function);
+  InterpretationResult interpretation_result = interpret_function(vm, function);
+  flush_output_buffer(&vm->output);
   return interpretation_result;
 }
 
+InterpretationResult interpret_function(VirtualMachine *vm,
+                                        ObjectFunction *function) {
+  push_onto_stack(vm, OBJECT_CONSTANT(function));
+  if (!call_function(vm, function, 0))
+    return INTERPRETATION_RUNTIME_ERROR;
+  return run_frames(vm);
+}
+
+void allow_io(VirtualMachine *vm) {
+  if (vm->allows_io)
+    return;
+  vm->allows_io = true;
+  define_natives(vm, io_natives, sizeof(io_natives) / sizeof(io_natives[0]));
+}
+
+bool return_from_native(VirtualMachine *vm, Constant *arguments,
+                        Constant result) {
+  arguments[-1] = result;
+  vm->stack_pointer = arguments;
+  return true;
+}
+
+bool throw_from_native(VirtualMachine *vm, const char *message) {
+  ObjectString *exception = copy_string(vm, message, strlen(message));
+  return throw_exception(vm, OBJECT_CONSTANT(exception));
+}
+
 void push_onto_stack(VirtualMachine *vm, Constant constant) {
   *vm->stack_pointer = constant;
   vm->stack_pointer++;
@@ -1,19 +1,145 @@
 #ifndef interpres_vm_h
 #define interpres_vm_h
 
+#include "allocator.h"
 #include "chunk.h"
+#include "collector.h"
+#include "debugger.h"
+#include "event_loop.h"
+#include "output.h"
+#include "profiler.h"
+#include "table.h"
+#include "verifier.h"
 
-#define STACK_MAX_SIZE 256
-/* This is our language's definition of a virtual machine. It holds a couple of
- * things: a chunk, a pointer to the chunk's next instruction to execute, the
- * stack of constants that we need for the instructions we're evaluating and a
- * pointer that points just past the last element of the stack itself. */
-typedef struct {
-  Chunk *chunk;
+/* Here we define the maximum number of nested calls that can be active at the
+ * same time, and the size of the stack of constants, which must be large
+ * enough for every active call to use as many slots as the bytecode verifier
+ * allows. */
+#define FRAMES_MAX_SIZE 64
+#define STACK_MAX_SIZE (FRAMES_MAX_SIZE * VERIFIER_MAX_STACK_DEPTH)
+/* Here we define the number of times in a row an instruction has to see the
+ * same operand types before it is quickened, and the number of times it can
+ * fall back to its generic form before it is no longer quickened at all. */
+#define QUICKENING_THRESHOLD 8
+#define QUICKENING_MAX_DEOPTIMIZATIONS 4
+/* Here we define the default number of backward jumps a function can take on
+ * the stack before it is tiered up to run on registers. */
+#define TIER_UP_THRESHOLD 1000
+/* The compiler's state is defined in compiler.h; the virtual machine only
+ * needs to know about it to keep the functions being compiled alive. */
+typedef struct Compiler Compiler;
+/* A call frame represents a single ongoing function call: it holds the
+ * function being called, a pointer to the next instruction of the function's
+ * chunk to execute and a pointer to the first slot of the stack that the
+ * function can use, which holds the function itself and is followed by its
+ * arguments and local variables. When the frame runs on registers,
+ * "register_pointer" points to the next register instruction to execute
+ * instead, and the slots of the frame are its registers. Frames running on
+ * the stack and on registers can call and return to each other freely. */
+struct CallFrame {
+  ObjectFunction *function;
   uint8_t *instruction_pointer;
-  Constant stack[STACK_MAX_SIZE];
+  RegisterInstruction *register_pointer;
+  Constant *slots;
+  bool runs_on_registers;
+};
+/* This is our language's definition of a virtual machine. It holds a couple of
+ * things: the stack of call frames of the functions being executed, the stack
+ * of constants that we need for the instructions we're evaluating, a pointer
+ * that points just past the last element of the stack itself, the coroutine
+ * these stacks belong to, if any, the innermost
+ * compiler that is running, if any, whether function bodies are compiled
+ * lazily on their first call, whether the bytecode of expressions is optimized
+ * as it is compiled, whether functions are run on registers rather than on the
+ * stack from their first call, the number of backward jumps after which a
+ * function running on the stack is tiered up to registers (SIZE_MAX never
+ * tiers up), whether tier-up events are traced to stderr, the fuel left to the
+ * program, the garbage collector that owns every object allocated while
+ * compiling and running the code, the slab allocator those objects are carved
+ * from, the table of interned strings, the table of global variables, the
+ * buffer the program's output is written to, the profiler that samples the
+ * call frames, the debugger attached to the virtual machine, if any, and, for
+ * a virtual machine that serves requests, the table of scripts it compiled,
+ * keyed by their source, along with the global variables every request starts
+ * from. A
+ * function is tiered up in the middle of the loop that made it hot: the frame
+ * that ran it moves on to the register instruction its backward jump leads to,
+ * and later calls to the function run on registers from the start. The
+ * top-level script is never tiered up, since its variables are globals, which
+ * registers do not speed up.
+ * Fuel is measured in bytes of bytecode and is only charged at calls, for the
+ * size of the callee's chunk, and at backward jumps, for the size of the loop
+ * body; since code that neither calls nor loops can only run through its chunk
+ * once, this bounds the work done by the program without metering every
+ * instruction. The program is stopped with a runtime error once it runs out of
+ * fuel. Going past the collector's heap limit takes away the program's fuel,
+ * which is stashed in "interrupted_fuel" until the error is reported, so that
+ * the same check also stops programs that use too much memory.
+ * The top-level script runs on "main_frames" and "main_stack", while every
+ * coroutine has stacks of its own: "frames", which can hold "frames_capacity"
+ * call frames, and "stack", which ends at "stack_limit", point to the stacks
+ * of the running coroutine, and the frame count and stack pointer of the
+ * top-level script are kept in "main_frame_count" and "main_stack_pointer"
+ * while "coroutine" runs. Calls check the room left on both stacks, and only
+ * the stacks of a coroutine ever grow. The "event_loop" runs the tasks the
+ * program spawns, switching between them as they wait for I/O, which the
+ * program can only do once "allows_io" is set. */
+struct VirtualMachine {
+  CallFrame *frames;
+  int frame_count;
+  int frames_capacity;
+  Constant *stack;
   Constant *stack_pointer;
-} VirtualMachine;
+  Constant *stack_limit;
+  ObjectCoroutine *coroutine;
+  int main_frame_count;
+  Constant *main_stack_pointer;
+  CallFrame main_frames[FRAMES_MAX_SIZE];
+  Constant main_stack[STACK_MAX_SIZE];
+  Compiler *compiler;
+  bool compiles_lazily;
+  bool optimizes_expressions;
+  bool runs_on_registers;
+  size_t tier_up_threshold;
+  bool traces_tiering;
+  size_t fuel;
+  size_t interrupted_fuel;
+  GarbageCollector collector;
+  SlabAllocator allocator;
+  Table strings;
+  Table globals;
+  OutputBuffer output;
+  Profiler profiler;
+  Debugger debugger;
+  Table compiled_inputs;
+  Table initial_globals;
+  EventLoop event_loop;
+  bool allows_io;
+};
+/* Every virtual machine defines these native functions as global variables:
+ * "coroutine" wraps a function of at most one parameter into a new coroutine,
+ * "resume" runs a coroutine until it yields or returns, handing it a value
+ * that is either the argument of its function, on the first resume, or the
+ * result of the "yield" call it was suspended at, "yield" suspends the running
+ * coroutine and makes its argument the result of the "resume" call that ran
+ * it, and "is_done" checks whether a coroutine is dead. When a coroutine
+ * returns, "resume" returns its result, and an exception a coroutine does not
+ * catch kills it and is thrown again by "resume".
+ * Tasks are coroutines the event loop runs instead: "spawn" creates one and
+ * makes it ready, and "run_tasks" runs ready tasks one at a time until all of
+ * them are done, an exception a task does not catch being thrown again by
+ * "run_tasks". A task that calls "read" or "write" is parked until the
+ * operation completes, and one that calls "yield" lets the other ready tasks
+ * run first, while the other tasks take turns in the meantime; everywhere
+ * else, "read" and "write" block. "open" and "close" work on the descriptors
+ * "read" and "write" take, and never park. These four I/O natives reach the
+ * whole file system, so they are only defined once allow_io is called, and
+ * "close" refuses the descriptors the virtual machine itself uses. */
+typedef struct {
+  const char *name;
+  NativeFunction function;
+  int arity;
+} NativeDefinition;
 /* This enum defines the possible results of a chunk's interpretation. It is
  * used to indicate whether the interpretation was successful or if there was an
  * error during compilation or execution. */
@@ -25,12 +151,21 @@ typedef enum {
 /*
  * @brief Initialize the virtual machine.
  * This function will set the stack pointer to the beginning of the stack so
- * that it can be used to store constants.
+ * that it can be used to store constants, initialize the garbage collector
+ * and the slab allocator with an empty heap and define the native functions.
  *
  * @param vm A pointer to the virtual machine to initialize
  * @return void
  */
 void init_vm(VirtualMachine *vm);
+/*
+ * @brief Free the virtual machine.
+ * This function will free every object that was allocated by the virtual
+ * machine, whether it is still reachable or not.
+ *
+ * @param vm A pointer to the virtual machine to free
+ * @return void
+ */
 void free_vm(VirtualMachine *vm);
 /*
  * @brief Scan and compile input.
@@ -42,6 +177,73 @@ void free_vm(VirtualMachine *vm);
  * @return The result of the interpretation
  */
 InterpretationResult interpret_input(VirtualMachine *vm, const char *input);
+/*
+ * @brief Run a compiled top-level script.
+ * The script must have been verified already. Unlike interpret_input, this
+ * function does not flush the output buffer once the script is done, so that
+ * the caller can append more to it before handing it over to the operating
+ * system.
+ *
+ * @param vm A pointer to the virtual machine
+ * @param function A pointer to the script to run
+ * @return The result of the interpretation
+ */
+InterpretationResult interpret_function(VirtualMachine *vm,
+                                        ObjectFunction *function);
+/*
+ * @brief Find the definition of a native function by its name.
+ * The I/O natives are only found once the virtual machine allows I/O.
+ *
+ * @param vm A pointer to the virtual machine looking the native up
+ * @param name A pointer to the string object holding the native's name
+ * @return A pointer to the definition of the native or NULL if there is no
+ * native with that name
+ */
+const NativeDefinition *find_native_definition(VirtualMachine *vm,
+                                               ObjectString *name);
+/*
+ * @brief Define the I/O natives "open", "read", "write" and "close".
+ * Scripts the virtual machine does not trust, such as the requests of a
+ * server, must not run on a virtual machine that allows I/O.
+ *
+ * @param vm A pointer to the virtual machine to allow I/O on
+ * @return void
+ */
+void allow_io(VirtualMachine *vm);
+/*
+ * @brief Switch to the next ready task.
+ * This function will wait for I/O while no task is ready but operations are
+ * in flight, and switch back to the code that called "run_tasks", handing it
+ * nil, once neither is left. The running task, if any, must already be parked,
+ * scheduled again or dead, with the native that switches away off its stack.
+ *
+ * @param vm A pointer to the virtual machine running the tasks
+ * @return Whether no runtime error was reported
+ */
+bool run_next_task(VirtualMachine *vm);
+/*
+ * @brief Return from a native function.
+ * This function will replace the native and its arguments on the stack with
+ * the native's result.
+ *
+ * @param vm A pointer to the virtual machine running the native
+ * @param arguments A pointer to the first argument of the native
+ * @param result The constant the native returns
+ * @return Always true, so that natives can return it as is
+ */
+bool return_from_native(VirtualMachine *vm, Constant *arguments,
+                        Constant result);
+/*
+ * @brief Throw an exception from a native function.
+ * The exception is a string holding the given message, and it is thrown as if
+ * by the code that called the native.
+ *
+ * @param vm A pointer to the virtual machine running the native
+ * @param message The message of the exception
+ * @return Whether the exception was caught or not, in which case a runtime
+ * error was reported
+ */
+bool throw_from_native(VirtualMachine *vm, const char *message);
 /*
  * @brief Push a constant onto the stack.
  * This function will push a constant onto the stack of the virtual machine.